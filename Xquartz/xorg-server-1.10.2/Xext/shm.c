@@ -38,6 +38,17 @@ in this Software without prior written authorization from The Open Group.
 #include <sys/shm.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#if SHM_FD_PASSING
+#include <sys/mman.h>
+#include <stdlib.h>
+#endif
+#if SHM_FD_PASSING || defined(SHM_ASYNC)
+#include <fcntl.h>
+#endif
+#ifdef SHM_ASYNC
+#include <errno.h>
+#include <pthread.h>
+#endif
 #include <X11/X.h>
 #include <X11/Xproto.h>
 #include "misc.h"
@@ -55,6 +66,11 @@ in this Software without prior written authorization from The Open Group.
 #include <X11/extensions/shmproto.h>
 #include <X11/Xfuncproto.h>
 #include "protocol-versions.h"
+#include "busfault.h"
+#ifdef SHM_ASYNC
+#include "xacestr.h"
+#endif
+#include "damage.h"
 
 /* Needed for Solaris cross-zone shared memory extension */
 #ifdef HAVE_SHMCTL64
@@ -97,6 +113,9 @@ typedef struct _ShmDesc {
     char *addr;
     Bool writable;
     unsigned long size;
+    Bool is_fd;			/* mapped from a passed fd, not shmat */
+    BusFaultPtr busfault;	/* if the client can truncate it */
+    XID resource;
 } ShmDescRec, *ShmDescPtr;
 
 typedef struct _ShmScrPrivateRec {
@@ -119,6 +138,14 @@ static void SShmCompletionEvent(
     );
 
 static Bool ShmDestroyPixmap (PixmapPtr pPixmap);
+static void ShmDamageDestroy(
+    PixmapPtr		/* pPixmap */
+    );
+#ifdef SHM_ASYNC
+static void ShmCopyComplete(
+    Bool		/* wait */
+    );
+#endif
 
 
 static unsigned char ShmReqCode;
@@ -245,6 +272,9 @@ static void
 ShmResetProc(ExtensionEntry *extEntry)
 {
     int i;
+#ifdef SHM_ASYNC
+    ShmCopyComplete(TRUE);
+#endif
     for (i = 0; i < screenInfo.numScreens; i++)
 	ShmRegisterFuncs(screenInfo.screens[i], NULL);
 }
@@ -269,7 +299,10 @@ ShmDestroyPixmap (PixmapPtr pPixmap)
 	shmdesc = (ShmDescPtr)dixLookupPrivate(&pPixmap->devPrivates,
 					       shmPixmapPrivateKey);
 	if (shmdesc)
+	{
+	    ShmDamageDestroy(pPixmap);
 	    ShmDetachSegment ((pointer) shmdesc, pPixmap->drawable.id);
+	}
     }
     
     pScreen->DestroyPixmap = screen_priv->destroyPixmap;
@@ -395,7 +428,7 @@ ProcShmAttach(ClientPtr client)
         return BadValue;
     }
     for (shmdesc = Shmsegs;
-	 shmdesc && (shmdesc->shmid != stuff->shmid);
+	 shmdesc && (shmdesc->is_fd || shmdesc->shmid != stuff->shmid);
 	 shmdesc = shmdesc->next)
 	;
     if (shmdesc)
@@ -432,6 +465,9 @@ ProcShmAttach(ClientPtr client)
 	shmdesc->refcnt = 1;
 	shmdesc->writable = !stuff->readOnly;
 	shmdesc->size = SHM_SEGSZ(buf);
+	shmdesc->is_fd = FALSE;
+	shmdesc->busfault = NULL;
+	shmdesc->resource = stuff->shmseg;
 	shmdesc->next = Shmsegs;
 	Shmsegs = shmdesc;
     }
@@ -450,7 +486,16 @@ ShmDetachSegment(pointer value, /* must conform to DeleteType */
 
     if (--shmdesc->refcnt)
 	return TRUE;
-    shmdt(shmdesc->addr);
+#if SHM_FD_PASSING
+    if (shmdesc->is_fd)
+    {
+	if (shmdesc->busfault)
+	    BusFaultUnregister(shmdesc->busfault);
+	munmap(shmdesc->addr, shmdesc->size);
+    }
+    else
+#endif
+	shmdt(shmdesc->addr);
     for (prev = &Shmsegs; *prev != shmdesc; prev = &(*prev)->next)
 	;
     *prev = shmdesc->next;
@@ -470,6 +515,211 @@ ProcShmDetach(ClientPtr client)
     return Success;
 }
 
+#if SHM_FD_PASSING
+/*
+ * The client truncated a segment we have mapped; the pages are zeroes
+ * now.  Drop its ID so the client learns about it from BadShmSeg.
+ */
+static void
+ShmBusFaultNotify(void *data)
+{
+    ShmDescPtr shmdesc = data;
+    pointer value;
+
+    ErrorF("MIT-SHM: segment 0x%lx truncated by client\n",
+	   (unsigned long) shmdesc->resource);
+    BusFaultUnregister(shmdesc->busfault);
+    shmdesc->busfault = NULL;
+    if (dixLookupResourceByType(&value, shmdesc->resource, ShmSegType,
+				NullClient, DixUnknownAccess) == Success &&
+	value == shmdesc)
+	FreeResource(shmdesc->resource, RT_NONE);
+}
+
+/*
+ * Segments sealed against shrinking cannot lose pages under us.
+ */
+static Bool
+ShmFdSealed(int fd)
+{
+#ifdef F_GET_SEALS
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    return seals != -1 && (seals & F_SEAL_SHRINK);
+#else
+    return FALSE;
+#endif
+}
+
+/*
+ * Map size bytes of fd as segment shmseg.  The caller keeps fd.
+ */
+static int
+ShmAttachFdSegment(ClientPtr client, XID shmseg, int fd,
+		   unsigned long size, Bool readOnly)
+{
+    ShmDescPtr shmdesc;
+
+    shmdesc = malloc(sizeof(ShmDescRec));
+    if (!shmdesc)
+	return BadAlloc;
+    shmdesc->addr = mmap(NULL, size,
+			 readOnly ? PROT_READ : PROT_READ|PROT_WRITE,
+			 MAP_SHARED, fd, 0);
+    if (shmdesc->addr == MAP_FAILED)
+    {
+	free(shmdesc);
+	return BadAccess;
+    }
+    shmdesc->busfault = NULL;
+    if (!ShmFdSealed(fd))
+    {
+	shmdesc->busfault = BusFaultRegister(shmdesc->addr, size,
+					     ShmBusFaultNotify, shmdesc);
+	if (!shmdesc->busfault)
+	{
+	    munmap(shmdesc->addr, size);
+	    free(shmdesc);
+	    return BadAlloc;
+	}
+    }
+    shmdesc->shmid = -1;
+    shmdesc->refcnt = 1;
+    shmdesc->writable = !readOnly;
+    shmdesc->size = size;
+    shmdesc->is_fd = TRUE;
+    shmdesc->resource = shmseg;
+    shmdesc->next = Shmsegs;
+    Shmsegs = shmdesc;
+    if (!AddResource(shmseg, ShmSegType, (pointer)shmdesc))
+	return BadAlloc;
+    return Success;
+}
+
+static int
+ProcShmAttachFd(ClientPtr client)
+{
+    int fd, rc;
+    struct stat statb;
+    REQUEST(xShmAttachFdReq);
+
+    SetReqFds(client, 1);
+    REQUEST_SIZE_MATCH(xShmAttachFdReq);
+    LEGAL_NEW_RESOURCE(stuff->shmseg, client);
+    if ((stuff->readOnly != xTrue) && (stuff->readOnly != xFalse))
+    {
+	client->errorValue = stuff->readOnly;
+        return BadValue;
+    }
+    fd = ReadFdFromClient(client);
+    if (fd < 0)
+	return BadMatch;
+    if (fstat(fd, &statb) < 0 || statb.st_size <= 0)
+    {
+	close(fd);
+	return BadMatch;
+    }
+    rc = ShmAttachFdSegment(client, stuff->shmseg, fd, statb.st_size,
+			    stuff->readOnly);
+    close(fd);
+    return rc;
+}
+
+/*
+ * A file of size bytes nobody else can open.  memfds are sealed at that
+ * size, so clients cannot truncate them under us and the server never
+ * needs to catch faults on them.
+ */
+static int
+ShmCreateFd(unsigned long size)
+{
+    static const char *dirs[] = { "/dev/shm", "/tmp" };
+    char template[PATH_MAX];
+    int fd, i;
+
+#ifdef HAVE_MEMFD_CREATE
+    fd = memfd_create("xorg-shm", MFD_CLOEXEC|MFD_ALLOW_SEALING);
+    if (fd != -1)
+    {
+	if (ftruncate(fd, size) == -1)
+	{
+	    close(fd);
+	    return -1;
+	}
+#ifdef F_ADD_SEALS
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL);
+#endif
+	return fd;
+    }
+#endif
+    for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+    {
+	snprintf(template, sizeof(template), "%s/shmfd-XXXXXX", dirs[i]);
+	fd = mkstemp(template);
+	if (fd == -1)
+	    continue;
+	unlink(template);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (ftruncate(fd, size) == -1)
+	{
+	    close(fd);
+	    continue;
+	}
+	return fd;
+    }
+    return -1;
+}
+
+static int
+ProcShmCreateSegment(ClientPtr client)
+{
+    int fd, rc, n;
+    xShmCreateSegmentReply rep;
+    REQUEST(xShmCreateSegmentReq);
+
+    REQUEST_SIZE_MATCH(xShmCreateSegmentReq);
+    LEGAL_NEW_RESOURCE(stuff->shmseg, client);
+    if ((stuff->readOnly != xTrue) && (stuff->readOnly != xFalse))
+    {
+	client->errorValue = stuff->readOnly;
+        return BadValue;
+    }
+    if (stuff->size == 0)
+    {
+	client->errorValue = 0;
+	return BadValue;
+    }
+    fd = ShmCreateFd(stuff->size);
+    if (fd < 0)
+	return BadAlloc;
+    rc = ShmAttachFdSegment(client, stuff->shmseg, fd, stuff->size,
+			    stuff->readOnly);
+    if (rc != Success)
+    {
+	close(fd);
+	return rc;
+    }
+    if (WriteFdToClient(client, fd, TRUE) < 0)
+    {
+	FreeResource(stuff->shmseg, RT_NONE);
+	close(fd);
+	return BadAlloc;
+    }
+
+    memset(&rep, 0, sizeof(xShmCreateSegmentReply));
+    rep.type = X_Reply;
+    rep.nfd = 1;
+    rep.sequenceNumber = client->sequence;
+    rep.length = 0;
+    if (client->swapped) {
+	swaps(&rep.sequenceNumber, n);
+	swapl(&rep.length, n);
+    }
+    WriteToClient(client, sizeof(xShmCreateSegmentReply), (char *)&rep);
+    return Success;
+}
+#endif /* SHM_FD_PASSING */
+
 /*
  * If the given request doesn't exactly match PutImage's constraints,
  * wrap the image in a scratch pixmap header and let CopyArea sort it out.
@@ -517,6 +767,310 @@ doShmPutImage(DrawablePtr dst, GCPtr pGC,
     }
 }
 
+#ifdef SHM_ASYNC
+/*
+ * Large ZPixmap images put into fb pixmaps are copied by a worker thread
+ * when the client asked for a completion event, which is sent once the
+ * copy has finished.  Copies are finished in the order they were queued.
+ * Until then any lookup of a pixmap being copied to, by any client, waits
+ * for the copies; the pixmap is only copied to while nothing else holds a
+ * reference to it, so its ID is the only way to reach it.
+ */
+typedef struct _ShmCopy {
+    struct _ShmCopy	*next;
+    Bool		done;
+    ClientPtr		client;
+    PixmapPtr		pPixmap;	/* referenced until finished */
+    ShmDescPtr		shmdesc;	/* likewise */
+    char		*src;
+    int			srcStride;
+    int			dx, dy;		/* from pixmap to image coordinates */
+    RegionRec		region;		/* in the pixmap */
+    xShmCompletionEvent	ev;
+} ShmCopyRec, *ShmCopyPtr;
+
+static pthread_mutex_t	shmCopyMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	shmCopyWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	shmCopyDone = PTHREAD_COND_INITIALIZER;
+static ShmCopyPtr	shmCopies;	/* queued and not finished, in order */
+static ShmCopyPtr	*shmCopiesTail = &shmCopies;
+static ShmCopyPtr	shmCopyNext;	/* first one not copied yet */
+static Bool		shmCopyThread;
+static int		shmCopyWakeup[2] = { -1, -1 };
+
+static void
+ShmCopyBoxes(ShmCopyPtr copy)
+{
+    PixmapPtr	pPixmap = copy->pPixmap;
+    int		Bpp = pPixmap->drawable.bitsPerPixel >> 3;
+    BoxPtr	pBox = RegionRects(&copy->region);
+    int		nBox = RegionNumRects(&copy->region);
+    char	*src, *dst;
+    int		y, w;
+
+    for (; nBox--; pBox++)
+    {
+	w = (pBox->x2 - pBox->x1) * Bpp;
+	src = copy->src + (pBox->y1 + copy->dy) * copy->srcStride +
+	      (pBox->x1 + copy->dx) * Bpp;
+	dst = (char *) pPixmap->devPrivate.ptr + pBox->y1 * pPixmap->devKind +
+	      pBox->x1 * Bpp;
+	for (y = pBox->y1; y < pBox->y2; y++)
+	{
+	    memcpy(dst, src, w);
+	    src += copy->srcStride;
+	    dst += pPixmap->devKind;
+	}
+    }
+}
+
+static void *
+ShmCopyThread(void *arg)
+{
+    ShmCopyPtr	copy;
+    char	byte = 0;
+
+    pthread_mutex_lock(&shmCopyMutex);
+    for (;;)
+    {
+	while (!shmCopyNext)
+	    pthread_cond_wait(&shmCopyWork, &shmCopyMutex);
+	copy = shmCopyNext;
+	pthread_mutex_unlock(&shmCopyMutex);
+	ShmCopyBoxes(copy);
+	pthread_mutex_lock(&shmCopyMutex);
+	copy->done = TRUE;
+	shmCopyNext = copy->next;
+	pthread_cond_broadcast(&shmCopyDone);
+	if (write(shmCopyWakeup[1], &byte, 1) < 0 && errno != EAGAIN)
+	    ErrorF("MIT-SHM: failed to wake the server thread: %s\n",
+		   strerror(errno));
+    }
+    return NULL;
+}
+
+static Bool
+ShmStartCopyThread(void)
+{
+    pthread_t	thread;
+    int		i;
+
+    if (shmCopyThread)
+	return TRUE;
+    if (pipe(shmCopyWakeup) < 0)
+	return FALSE;
+    for (i = 0; i < 2; i++)
+    {
+	fcntl(shmCopyWakeup[i], F_SETFL, O_NONBLOCK);
+	fcntl(shmCopyWakeup[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    if (OsCreateThread(&thread, ShmCopyThread, NULL) != 0)
+    {
+	close(shmCopyWakeup[0]);
+	close(shmCopyWakeup[1]);
+	shmCopyWakeup[0] = shmCopyWakeup[1] = -1;
+	return FALSE;
+    }
+    AddGeneralSocket(shmCopyWakeup[0]);
+    shmCopyThread = TRUE;
+    return TRUE;
+}
+
+/*
+ * Report the damage, send the completion event and drop the references.
+ */
+static void
+ShmCopyFinish(ShmCopyPtr copy)
+{
+    PixmapPtr	pPixmap = copy->pPixmap;
+
+    DamageDamageRegion(&pPixmap->drawable, &copy->region);
+    if (!copy->client->clientGone)
+	WriteEventsToClient(copy->client, 1, (xEvent *) &copy->ev);
+    RegionUninit(&copy->region);
+    (*pPixmap->drawable.pScreen->DestroyPixmap)(pPixmap);
+    ShmDetachSegment((pointer) copy->shmdesc, 0);
+    free(copy);
+}
+
+/*
+ * Finish the copies the worker is done with, or all of them if wait.
+ */
+static void
+ShmCopyComplete(Bool wait)
+{
+    ShmCopyPtr	copy;
+
+    if (!shmCopies)
+	return;
+    pthread_mutex_lock(&shmCopyMutex);
+    for (;;)
+    {
+	while ((copy = shmCopies) && copy->done)
+	{
+	    shmCopies = copy->next;
+	    if (!shmCopies)
+		shmCopiesTail = &shmCopies;
+	    pthread_mutex_unlock(&shmCopyMutex);
+	    ShmCopyFinish(copy);
+	    pthread_mutex_lock(&shmCopyMutex);
+	}
+	if (!wait || !shmCopies)
+	    break;
+	pthread_cond_wait(&shmCopyDone, &shmCopyMutex);
+    }
+    pthread_mutex_unlock(&shmCopyMutex);
+}
+
+static void
+ShmCopyBlockHandler(pointer data, OSTimePtr timeout, pointer readmask)
+{
+}
+
+static void
+ShmCopyWakeupHandler(pointer data, int result, pointer readmask)
+{
+    char buf[64];
+
+    /* drain even with nothing queued: a copy that was already collected
+     * by ShmCopyComplete(TRUE) still leaves its byte in the pipe */
+    if (shmCopyWakeup[0] >= 0)
+	while (read(shmCopyWakeup[0], buf, sizeof(buf)) > 0)
+	    ;
+    if (!shmCopies)
+	return;
+    ShmCopyComplete(FALSE);
+}
+
+static void
+ShmCopyResourceAccess(CallbackListPtr *pcbl, pointer unused, pointer calldata)
+{
+    XaceResourceAccessRec *rec = calldata;
+    ShmCopyPtr copy;
+
+    if (rec->rtype != RT_PIXMAP)
+	return;
+    for (copy = shmCopies; copy; copy = copy->next)
+	if (copy->pPixmap == rec->res)
+	{
+	    ShmCopyComplete(TRUE);
+	    return;
+	}
+}
+
+static void
+ShmCopyClientState(CallbackListPtr *pcbl, pointer unused, pointer calldata)
+{
+    NewClientInfoRec *pci = calldata;
+    ShmCopyPtr copy;
+
+    if (pci->client->clientState != ClientStateGone)
+	return;
+    for (copy = shmCopies; copy; copy = copy->next)
+	if (copy->client == pci->client)
+	{
+	    ShmCopyComplete(TRUE);
+	    return;
+	}
+}
+
+/*
+ * Queue a validated ShmPutImage to the worker if it is large enough and
+ * is a plain copy into memory only the worker will touch.  Returns FALSE
+ * to have it done here instead.
+ */
+static Bool
+ShmPutImageAsync(ClientPtr client, xShmPutImageReq *stuff,
+		 DrawablePtr pDraw, GCPtr pGC, ShmDescPtr shmdesc, long length)
+{
+    PixmapPtr		pPixmap = (PixmapPtr) pDraw;
+    ShmScrPrivateRec	*screen_priv;
+    ShmDescPtr		pixdesc;
+    ShmCopyPtr		copy;
+    unsigned long	planes;
+    BoxRec		box;
+    int			x1, y1, x2, y2;
+
+    if (shmAsyncThreshold <= 0 || stuff->format != ZPixmap ||
+	pDraw->type != DRAWABLE_PIXMAP ||
+	length * stuff->srcHeight < shmAsyncThreshold)
+	return FALSE;
+
+    screen_priv = ShmGetScreenPriv(pDraw->pScreen);
+    if (screen_priv->shmFuncs != &fbFuncs || pPixmap->refcnt != 1 ||
+	!pPixmap->devPrivate.ptr || pDraw->x != 0 || pDraw->y != 0 ||
+	pDraw->bitsPerPixel < 8 || (pDraw->bitsPerPixel & 7) ||
+	pDraw->bitsPerPixel != BitsPerPixel(pDraw->depth))
+	return FALSE;
+
+    planes = pDraw->depth < 32 ? (1UL << pDraw->depth) - 1 : 0xffffffff;
+    if (pGC->alu != GXcopy || (pGC->planemask & planes) != planes)
+	return FALSE;
+
+    /* the worker must not fault on segments clients can truncate */
+    pixdesc = dixLookupPrivate(&pPixmap->devPrivates, shmPixmapPrivateKey);
+    if (shmdesc->busfault || (pixdesc && pixdesc->busfault))
+	return FALSE;
+
+    x1 = max(stuff->dstX, 0);
+    y1 = max(stuff->dstY, 0);
+    x2 = min(stuff->dstX + stuff->srcWidth, pDraw->width);
+    y2 = min(stuff->dstY + stuff->srcHeight, pDraw->height);
+    if (x1 >= x2 || y1 >= y2)
+	return FALSE;
+
+    if (!ShmStartCopyThread())
+    {
+	ErrorF("MIT-SHM: cannot start the copy thread\n");
+	shmAsyncThreshold = 0;
+	return FALSE;
+    }
+    copy = malloc(sizeof(ShmCopyRec));
+    if (!copy)
+	return FALSE;
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+    RegionInit(&copy->region, &box, 1);
+    RegionIntersect(&copy->region, &copy->region, pGC->pCompositeClip);
+    if (!RegionNotEmpty(&copy->region))
+    {
+	RegionUninit(&copy->region);
+	free(copy);
+	return FALSE;
+    }
+
+    copy->next = NULL;
+    copy->done = FALSE;
+    copy->client = client;
+    copy->pPixmap = pPixmap;
+    pPixmap->refcnt++;
+    copy->shmdesc = shmdesc;
+    shmdesc->refcnt++;
+    copy->src = shmdesc->addr + stuff->offset;
+    copy->srcStride = length;
+    copy->dx = stuff->srcX - stuff->dstX;
+    copy->dy = stuff->srcY - stuff->dstY;
+    copy->ev.type = ShmCompletionCode;
+    copy->ev.drawable = stuff->drawable;
+    copy->ev.minorEvent = X_ShmPutImage;
+    copy->ev.majorEvent = ShmReqCode;
+    copy->ev.shmseg = stuff->shmseg;
+    copy->ev.offset = stuff->offset;
+
+    pthread_mutex_lock(&shmCopyMutex);
+    *shmCopiesTail = copy;
+    shmCopiesTail = &copy->next;
+    if (!shmCopyNext)
+	shmCopyNext = copy;
+    pthread_cond_signal(&shmCopyWork);
+    pthread_mutex_unlock(&shmCopyMutex);
+    return TRUE;
+}
+#endif /* SHM_ASYNC */
+
 static int
 ProcShmPutImage(ClientPtr client)
 {
@@ -588,6 +1142,12 @@ ProcShmPutImage(ClientPtr client)
 	return BadValue;
     }
 
+#ifdef SHM_ASYNC
+    if (stuff->sendEvent &&
+	ShmPutImageAsync(client, stuff, pDraw, pGC, shmdesc, length))
+	return Success;
+#endif
+
     if ((((stuff->format == ZPixmap) && (stuff->srcX == 0)) ||
 	 ((stuff->format != ZPixmap) &&
 	  (stuff->srcX < screenInfo.bitmapScanlinePad) &&
@@ -1034,6 +1594,173 @@ fbShmCreatePixmap (ScreenPtr pScreen,
     return pPixmap;
 }
 
+/*
+ * Shared pixmaps with a ShmDamageTrailer after their bits.  Damage to
+ * them is collected while clients are served and written to the
+ * trailers before the server sleeps.
+ */
+typedef struct _ShmDamage {
+    struct _ShmDamage	*next;
+    PixmapPtr		pPixmap;
+    DamagePtr		pDamage;
+    RegionRec		pending;	/* written and not acknowledged */
+    ShmDamageTrailer	*trailer;
+    CARD32		maxRects;	/* the client can change the trailer's */
+    CARD32		serial;		/* last one written */
+} ShmDamageRec, *ShmDamagePtr;
+
+static ShmDamagePtr shmDamages;
+static Bool shmDamageHandlers;
+
+#define ShmDamageBarrier()	__sync_synchronize()
+
+static void
+ShmDamageWrite(ShmDamagePtr sd)
+{
+    ShmDamageTrailer *trailer = sd->trailer;
+    RegionPtr pDamage;
+    BoxPtr pBox;
+    int i, nBox;
+
+    if (!sd->pDamage)
+	return;
+    pDamage = DamageRegion(sd->pDamage);
+    /* the trailer already has everything else */
+    if (!RegionNotEmpty(pDamage))
+	return;
+    if (trailer->ack == sd->serial)
+	RegionEmpty(&sd->pending);
+    RegionUnion(&sd->pending, &sd->pending, pDamage);
+    DamageEmpty(sd->pDamage);
+
+    nBox = RegionNumRects(&sd->pending);
+    if (nBox > sd->maxRects)
+    {
+	pBox = RegionExtents(&sd->pending);
+	nBox = 1;
+    }
+    else
+	pBox = RegionRects(&sd->pending);
+
+    trailer->serial = ++sd->serial;
+    ShmDamageBarrier();
+    for (i = 0; i < nBox; i++, pBox++)
+    {
+	trailer->rects[i].x = pBox->x1;
+	trailer->rects[i].y = pBox->y1;
+	trailer->rects[i].width = pBox->x2 - pBox->x1;
+	trailer->rects[i].height = pBox->y2 - pBox->y1;
+    }
+    trailer->numRects = nBox;
+    ShmDamageBarrier();
+    trailer->serial = ++sd->serial;
+}
+
+static void
+ShmDamageBlockHandler(pointer data, OSTimePtr timeout, pointer readmask)
+{
+    ShmDamagePtr sd;
+
+    for (sd = shmDamages; sd; sd = sd->next)
+	ShmDamageWrite(sd);
+}
+
+static void
+ShmDamageWakeupHandler(pointer data, int result, pointer readmask)
+{
+}
+
+/* The damage layer can tear the damage down before the pixmap goes */
+static void
+ShmDamageGone(DamagePtr pDamage, void *closure)
+{
+    ShmDamagePtr sd = closure;
+
+    sd->pDamage = NULL;
+}
+
+/*
+ * Start tracking damage for pPixmap if the client left a trailer for it
+ * at offset in the segment.
+ */
+static void
+ShmDamageCreate(PixmapPtr pPixmap, ShmDescPtr shmdesc, unsigned long offset)
+{
+    ShmDamageTrailer *trailer;
+    ShmDamagePtr sd;
+    CARD32 maxRects;
+
+    if (offset > shmdesc->size ||
+	shmdesc->size - offset < sz_ShmDamageTrailer)
+	return;
+    trailer = (ShmDamageTrailer *) (shmdesc->addr + offset);
+    /* read it once, the client can change it under us */
+    maxRects = *(volatile CARD32 *) &trailer->maxRects;
+    if (trailer->magic != SHM_DAMAGE_MAGIC || maxRects == 0 ||
+	maxRects > (shmdesc->size - offset - sz_ShmDamageTrailer) /
+		   sizeof(xRectangle))
+	return;
+
+    sd = malloc(sizeof(ShmDamageRec));
+    if (!sd)
+	return;
+    sd->pDamage = DamageCreate(NULL, ShmDamageGone, DamageReportNone, FALSE,
+			       pPixmap->drawable.pScreen, sd);
+    if (!sd->pDamage)
+    {
+	free(sd);
+	return;
+    }
+    if (!shmDamageHandlers)
+    {
+	if (!RegisterBlockAndWakeupHandlers(ShmDamageBlockHandler,
+					    ShmDamageWakeupHandler, NULL))
+	{
+	    DamageDestroy(sd->pDamage);
+	    free(sd);
+	    return;
+	}
+	shmDamageHandlers = TRUE;
+    }
+    DamageRegister(&pPixmap->drawable, sd->pDamage);
+    sd->pPixmap = pPixmap;
+    RegionNull(&sd->pending);
+    sd->trailer = trailer;
+    sd->maxRects = maxRects;
+    sd->serial = 0;
+    trailer->serial = 0;
+    trailer->numRects = 0;
+    sd->next = shmDamages;
+    shmDamages = sd;
+}
+
+static void
+ShmDamageDestroy(PixmapPtr pPixmap)
+{
+    ShmDamagePtr *prev, sd;
+
+    for (prev = &shmDamages; (sd = *prev); prev = &sd->next)
+	if (sd->pPixmap == pPixmap)
+	    break;
+    if (!sd)
+	return;
+    *prev = sd->next;
+    if (sd->pDamage)
+    {
+	DamageUnregister(&pPixmap->drawable, sd->pDamage);
+	DamageDestroy(sd->pDamage);
+    }
+    RegionUninit(&sd->pending);
+    free(sd);
+
+    if (!shmDamages && shmDamageHandlers)
+    {
+	RemoveBlockAndWakeupHandlers(ShmDamageBlockHandler,
+				     ShmDamageWakeupHandler, NULL);
+	shmDamageHandlers = FALSE;
+    }
+}
+
 static int
 ProcShmCreatePixmap(ClientPtr client)
 {
@@ -1110,6 +1837,8 @@ CreatePmap:
 	pMap->drawable.id = stuff->pid;
 	if (AddResource(stuff->pid, RT_PIXMAP, (pointer)pMap))
 	{
+	    if (shmdesc->writable)
+		ShmDamageCreate(pMap, shmdesc, stuff->offset + size);
 	    return Success;
 	}
 	pDraw->pScreen->DestroyPixmap(pMap);
@@ -1147,6 +1876,12 @@ ProcShmDispatch (ClientPtr client)
 	   return ProcPanoramiXShmCreatePixmap(client);
 #endif
 	   return ProcShmCreatePixmap(client);
+#if SHM_FD_PASSING
+    case X_ShmAttachFd:
+	return ProcShmAttachFd(client);
+    case X_ShmCreateSegment:
+	return ProcShmCreateSegment(client);
+#endif
     default:
 	return BadRequest;
     }
@@ -1253,6 +1988,32 @@ SProcShmCreatePixmap(ClientPtr client)
     return ProcShmCreatePixmap(client);
 }
 
+#if SHM_FD_PASSING
+static int
+SProcShmAttachFd(ClientPtr client)
+{
+    int n;
+    REQUEST(xShmAttachFdReq);
+    SetReqFds(client, 1);
+    swaps(&stuff->length, n);
+    REQUEST_SIZE_MATCH(xShmAttachFdReq);
+    swapl(&stuff->shmseg, n);
+    return ProcShmAttachFd(client);
+}
+
+static int
+SProcShmCreateSegment(ClientPtr client)
+{
+    int n;
+    REQUEST(xShmCreateSegmentReq);
+    swaps(&stuff->length, n);
+    REQUEST_SIZE_MATCH(xShmCreateSegmentReq);
+    swapl(&stuff->shmseg, n);
+    swapl(&stuff->size, n);
+    return ProcShmCreateSegment(client);
+}
+#endif
+
 static int
 SProcShmDispatch (ClientPtr client)
 {
@@ -1271,6 +2032,12 @@ SProcShmDispatch (ClientPtr client)
 	return SProcShmGetImage(client);
     case X_ShmCreatePixmap:
 	return SProcShmCreatePixmap(client);
+#if SHM_FD_PASSING
+    case X_ShmAttachFd:
+	return SProcShmAttachFd(client);
+    case X_ShmCreateSegment:
+	return SProcShmCreateSegment(client);
+#endif
     default:
 	return BadRequest;
     }
@@ -1323,5 +2090,17 @@ ShmExtensionInit(INITARGS)
 	BadShmSegCode = extEntry->errorBase;
 	SetResourceTypeErrorValue(ShmSegType, BadShmSegCode);
 	EventSwapVector[ShmCompletionCode] = (EventSwapPtr) SShmCompletionEvent;
+#ifdef SHM_ASYNC
+	if (shmAsyncThreshold > 0 &&
+	    (!RegisterBlockAndWakeupHandlers(ShmCopyBlockHandler,
+					     ShmCopyWakeupHandler, NULL) ||
+	     !XaceRegisterCallback(XACE_RESOURCE_ACCESS,
+				   ShmCopyResourceAccess, NULL) ||
+	     !AddCallback(&ClientStateCallback, ShmCopyClientState, NULL)))
+	{
+	    ErrorF("MIT-SHM: copying PutImages on the server thread\n");
+	    shmAsyncThreshold = 0;
+	}
+#endif
     }
 }
@@ -62,6 +62,35 @@ ShmRegisterFuncs(ScreenPtr pScreen, ShmFuncsPtr funcs);
 extern _X_EXPORT void
 ShmRegisterFbFuncs(ScreenPtr pScreen);
 
+/*
+ * A client can have the server tell it which parts of a shared pixmap
+ * changed.  Before ShmCreatePixmap, it writes a ShmDamageTrailer with
+ * SHM_DAMAGE_MAGIC and room for maxRects rectangles right after the
+ * pixmap's bits in the segment, that is at offset + height * the padded
+ * ZPixmap stride.  The server then keeps the damage it has not had
+ * acknowledged in the trailer, as numRects rectangles, or as their
+ * extents if there are more than maxRects.
+ *
+ * serial is odd while the server is writing.  A client copies the
+ * rectangles when serial is even and unchanged across the copy, reads
+ * the pixels under them, and stores the serial in ack.  The server
+ * starts over from an empty region only once ack matches the last
+ * serial it wrote, so damage is never lost, only sometimes repeated.
+ */
+#define SHM_DAMAGE_MAGIC	0x53484d44	/* "SHMD" */
+
+typedef struct _ShmDamageTrailer {
+    CARD32	magic;		/* written by the client */
+    CARD32	maxRects;	/* written by the client */
+    CARD32	serial;		/* written by the server */
+    CARD32	ack;		/* written by the client */
+    CARD32	numRects;	/* written by the server */
+    CARD32	pad;
+    xRectangle	rects[1];	/* maxRects of them */
+} ShmDamageTrailer;
+
+#define sz_ShmDamageTrailer	(sizeof(ShmDamageTrailer) - sizeof(xRectangle))
+
 extern _X_EXPORT RESTYPE ShmSegType;
 extern _X_EXPORT int ShmCompletionCode;
 extern _X_EXPORT int BadShmSegCode;
@@ -75,6 +75,12 @@ extern _X_EXPORT int XaceHookSelectionAccess(ClientPtr ptr,
 				   Selection **ppSel, Mask access_mode);
 extern _X_EXPORT void XaceHookAuditEnd(ClientPtr ptr, int result);
 
+/* TRUE if XaceHookDispatch or XaceHookAuditEnd would call anything.
+ */
+#define XaceDispatchHooked() \
+    (XaceHooks[XACE_AUDIT_BEGIN] || XaceHooks[XACE_CORE_DISPATCH] || \
+     XaceHooks[XACE_EXT_DISPATCH] || XaceHooks[XACE_AUDIT_END])
+
 /* Register a callback for a given hook.
  */
 #define XaceRegisterCallback(hook,callback,data) \
@@ -110,6 +116,8 @@ extern _X_EXPORT void XaceCensorImage(
 
 /* Define calls away when XACE is not being built. */
 
+#define XaceDispatchHooked() FALSE
+
 #ifdef __GNUC__
 #define XaceHook(args...) Success
 #define XaceHookDispatch(args...) Success
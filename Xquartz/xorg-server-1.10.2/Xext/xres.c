@@ -20,6 +20,10 @@
 #include "pixmapstr.h"
 #include "windowstr.h"
 #include "gcstruct.h"
+#include "glyphstr.h"
+#ifdef COMPOSITE
+#include "compositeext.h"
+#endif
 #include "modinit.h"
 #include "protocol-versions.h"
 
@@ -115,6 +119,118 @@ ResFindAllRes (pointer value, XID id, RESTYPE type, pointer cdata)
     counts[(type & TypeMask) - 1]++;
 }
 
+/*
+ * The scheduler's view of a client, and how many of its events were merged
+ * while it wasn't reading (-coalesce), are reported along with its
+ * resources, as pseudo resource types whose count is the statistic.  Zero
+ * values are left out, like resource types the client has none of.  The
+ * server's own client also reports how its pixmap cache, GC pool, render
+ * glyphs and client I/O buffer pool fare.
+ */
+enum {
+    RES_STAT_SCHEDULER_CPU_MS,
+    RES_STAT_SCHEDULER_WAIT_MS,
+    RES_STAT_SCHEDULER_RUNS,
+    RES_STAT_SCHEDULER_PREEMPTIONS,
+    RES_STAT_SCHEDULER_SLICE_MS,
+    RES_STAT_EVENTS_COALESCED_MOTION,
+    RES_STAT_EVENTS_COALESCED_EXPOSE,
+    RES_STAT_EVENTS_COALESCED_CONFIGURE,
+    RES_STAT_EVENTS_COALESCED_OTHER,
+    RES_STAT_PIXMAP_CACHE_HITS,
+    RES_STAT_PIXMAP_CACHE_MISSES,
+    RES_STAT_PIXMAP_CACHE_EVICTIONS,
+    RES_STAT_PIXMAP_CACHE_KB,
+    RES_STAT_GC_POOL_HITS,
+    RES_STAT_GC_POOL_MISSES,
+    RES_STAT_GC_POOL_SIZE,
+    RES_STAT_GLYPH_KB,
+    RES_STAT_GLYPH_UNUSED_KB,
+    RES_STAT_GLYPH_REUSED,
+    RES_STAT_GLYPH_EVICTIONS,
+    RES_STAT_COMPOSITE_PIXMAP_KB,
+    RES_STAT_COMPOSITE_RELEASED,
+    RES_STAT_COMPOSITE_SHARED_RESIZES,
+    RES_STAT_IO_BUFFER_POOL_HITS,
+    RES_STAT_IO_BUFFER_POOL_MISSES,
+    RES_STAT_IO_BUFFER_POOL_KB,
+    RES_CLIENT_STATS
+};
+
+static const char *ResClientStatNames[RES_CLIENT_STATS] = {
+    "SCHEDULER_CPU_MS",		/* time spent running its requests */
+    "SCHEDULER_WAIT_MS",	/* time spent ready while others ran */
+    "SCHEDULER_RUNS",		/* times the scheduler picked it */
+    "SCHEDULER_PREEMPTIONS",	/* times its time slice ran out */
+    "SCHEDULER_SLICE_MS",	/* slice it has earned as a bulk client */
+    "EVENTS_COALESCED_MOTION",	/* events merged while it was blocked */
+    "EVENTS_COALESCED_EXPOSE",
+    "EVENTS_COALESCED_CONFIGURE",
+    "EVENTS_COALESCED_OTHER",
+    "PIXMAP_CACHE_HITS",	/* pixmaps made from recycled storage */
+    "PIXMAP_CACHE_MISSES",
+    "PIXMAP_CACHE_EVICTIONS",	/* storage dropped to stay under the cap */
+    "PIXMAP_CACHE_KB",		/* storage the cache holds */
+    "GC_POOL_HITS",		/* GCs taken from the free pool */
+    "GC_POOL_MISSES",
+    "GC_POOL_SIZE",		/* GCs waiting in the pool */
+    "GLYPH_KB",			/* render glyphs and their pixmaps */
+    "GLYPH_UNUSED_KB",		/* glyphs kept for reuse */
+    "GLYPH_REUSED",		/* unused glyphs uploaded again */
+    "GLYPH_EVICTIONS",		/* unused glyphs dropped for room */
+    "COMPOSITE_PIXMAP_KB",	/* pixmaps of redirected windows */
+    "COMPOSITE_RELEASED",	/* windows without one while obscured */
+    "COMPOSITE_SHARED_RESIZES",	/* resizes done in the old pixmap */
+    "IO_BUFFER_POOL_HITS",	/* client I/O buffers reused */
+    "IO_BUFFER_POOL_MISSES",
+    "IO_BUFFER_POOL_KB",	/* free I/O buffers the pool holds */
+};
+
+static void
+ResGetClientStats (ClientPtr pClient, CARD32 *stats)
+{
+    BufferPoolStatsRec pool[8];
+    unsigned long retained = 0;
+    int i, npool;
+
+    memset(stats, 0, RES_CLIENT_STATS * sizeof(CARD32));
+    stats[RES_STAT_SCHEDULER_CPU_MS] = pClient->smart_cpu / 1000;
+    stats[RES_STAT_SCHEDULER_WAIT_MS] = pClient->smart_wait / 1000;
+    stats[RES_STAT_SCHEDULER_RUNS] = pClient->smart_runs;
+    stats[RES_STAT_SCHEDULER_PREEMPTIONS] = pClient->smart_preempts;
+    if (!SmartScheduleDisable)
+        stats[RES_STAT_SCHEDULER_SLICE_MS] = pClient->smart_slice;
+    stats[RES_STAT_EVENTS_COALESCED_MOTION] = pClient->coalesced_motion;
+    stats[RES_STAT_EVENTS_COALESCED_EXPOSE] = pClient->coalesced_expose;
+    stats[RES_STAT_EVENTS_COALESCED_CONFIGURE] = pClient->coalesced_configure;
+    stats[RES_STAT_EVENTS_COALESCED_OTHER] = pClient->coalesced_other;
+    if (pClient == serverClient) {
+        stats[RES_STAT_PIXMAP_CACHE_HITS] = PixmapCacheStats.hits;
+        stats[RES_STAT_PIXMAP_CACHE_MISSES] = PixmapCacheStats.misses;
+        stats[RES_STAT_PIXMAP_CACHE_EVICTIONS] = PixmapCacheStats.evictions;
+        stats[RES_STAT_PIXMAP_CACHE_KB] = PixmapCacheStats.bytes / 1024;
+        stats[RES_STAT_GC_POOL_HITS] = GCPoolStats.hits;
+        stats[RES_STAT_GC_POOL_MISSES] = GCPoolStats.misses;
+        stats[RES_STAT_GC_POOL_SIZE] = GCPoolStats.pooled;
+        stats[RES_STAT_GLYPH_KB] = GlyphStats.bytes / 1024;
+        stats[RES_STAT_GLYPH_UNUSED_KB] = GlyphStats.unused / 1024;
+        stats[RES_STAT_GLYPH_REUSED] = GlyphStats.reused;
+        stats[RES_STAT_GLYPH_EVICTIONS] = GlyphStats.evictions;
+#ifdef COMPOSITE
+        stats[RES_STAT_COMPOSITE_PIXMAP_KB] = CompositeStats.bytes / 1024;
+        stats[RES_STAT_COMPOSITE_RELEASED] = CompositeStats.released;
+        stats[RES_STAT_COMPOSITE_SHARED_RESIZES] = CompositeStats.sharedResizes;
+#endif
+        npool = GetBufferPoolStats(pool, sizeof(pool) / sizeof(pool[0]));
+        for (i = 0; i < npool; i++) {
+            stats[RES_STAT_IO_BUFFER_POOL_HITS] += pool[i].hits;
+            stats[RES_STAT_IO_BUFFER_POOL_MISSES] += pool[i].misses;
+            retained += pool[i].retained;
+        }
+        stats[RES_STAT_IO_BUFFER_POOL_KB] = retained / 1024;
+    }
+}
+
 static int
 ProcXResQueryClientResources (ClientPtr client)
 {
@@ -122,6 +238,7 @@ ProcXResQueryClientResources (ClientPtr client)
     xXResQueryClientResourcesReply rep;
     int i, clientID, num_types;
     int *counts;
+    CARD32 stats[RES_CLIENT_STATS];
 
     REQUEST_SIZE_MATCH(xXResQueryClientResourcesReq);
 
@@ -142,6 +259,11 @@ ProcXResQueryClientResources (ClientPtr client)
        if(counts[i]) num_types++;
     }
 
+    ResGetClientStats(clients[clientID], stats);
+    for(i = 0; i < RES_CLIENT_STATS; i++) {
+       if(stats[i]) num_types++;
+    }
+
     rep.type = X_Reply;
     rep.sequenceNumber = client->sequence;
     rep.num_types = num_types;
@@ -180,6 +302,22 @@ ProcXResQueryClientResources (ClientPtr client)
             }
             WriteToClient (client, sz_xXResType, (char *) &scratch);
         }
+
+        for(i = 0; i < RES_CLIENT_STATS; i++) {
+            if(!stats[i]) continue;
+
+            scratch.resource_type = MakeAtom(ResClientStatNames[i],
+                                             strlen(ResClientStatNames[i]),
+                                             TRUE);
+            scratch.count = stats[i];
+
+            if(client->swapped) {
+                int n;
+                swapl (&scratch.resource_type, n);
+                swapl (&scratch.count, n);
+            }
+            WriteToClient (client, sz_xXResType, (char *) &scratch);
+        }
     }
 
     free(counts);
@@ -222,6 +360,13 @@ ResFindWindowPixmaps (pointer value, XID id, pointer cdata)
 
    if (pWin->border.pixmap != NULL && !pWin->borderIsPixel)
      *bytes += ResGetApproxPixmapBytes(pWin->border.pixmap);
+
+#ifdef COMPOSITE
+   /* the pixmap a redirected window draws to, empty while it's obscured */
+   if (pWin->redirectDraw != RedirectDrawNone)
+     *bytes += ResGetApproxPixmapBytes(
+	 (*pWin->drawable.pScreen->GetWindowPixmap)(pWin));
+#endif
 }
 
 static void
@@ -273,10 +418,6 @@ ProcXResQueryClientPixmapBytes (ClientPtr client)
 			      ResFindGCPixmaps, 
                               (pointer)(&bytes));
 
-#ifdef COMPOSITE
-    /* FIXME: include composite pixmaps too */
-#endif
-
     rep.type = X_Reply;
     rep.sequenceNumber = client->sequence;
     rep.length = 0;
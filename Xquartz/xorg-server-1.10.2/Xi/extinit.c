@@ -1168,11 +1168,16 @@ AssignTypeAndName(DeviceIntPtr dev, Atom type, char *name)
 static void
 MakeDeviceTypeAtoms(void)
 {
+    const char *names[NUMTYPES];
+    Atom atoms[NUMTYPES];
     int i;
 
     for (i = 0; i < NUMTYPES; i++)
-	dev_type[i].type =
-	    MakeAtom(dev_type[i].name, strlen(dev_type[i].name), 1);
+	names[i] = dev_type[i].name;
+    if (InternAtoms(names, NUMTYPES, TRUE, atoms) != Success)
+	return;
+    for (i = 0; i < NUMTYPES; i++)
+	dev_type[i].type = atoms[i];
 }
 
 /*****************************************************************************
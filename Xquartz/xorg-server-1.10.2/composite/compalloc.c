@@ -46,6 +46,13 @@
 #endif
 
 #include "compint.h"
+#include "compositeext.h"
+
+CompositeStatsRec CompositeStats;
+
+#define compPixmapBytes(p) \
+    ((unsigned long) PixmapBytePad((p)->drawable.width, (p)->drawable.depth) * \
+     (p)->drawable.height)
 
 static void
 compScreenUpdate (ScreenPtr pScreen)
@@ -163,6 +170,8 @@ compRedirectWindow (ClientPtr pClient, WindowPtr pWin, int update)
 	    free(cw);
 	    return BadAlloc;
 	}
+	/* the damage is only painted through cw->borderClip */
+	DamageSetTiled (cw->damage, TRUE);
 	if (wasMapped)
 	{
 	    DisableMapUnmapEvents (pWin);
@@ -180,6 +189,8 @@ compRedirectWindow (ClientPtr pClient, WindowPtr pWin, int update)
 	cw->damageRegistered = FALSE;
 	cw->damaged = FALSE;
 	cw->pOldPixmap = NullPixmap;
+	cw->released = FALSE;
+	cw->allocBytes = 0;
 	dixSetPrivate(&pWin->devPrivates, CompWindowPrivateKey, cw);
     }
     ccw->next = cw->clients;
@@ -531,6 +542,7 @@ compNewPixmap (WindowPtr pWin, int x, int y, int w, int h, Bool map)
 
     if (!pPixmap)
 	return 0;
+    CompositeStats.bytes += compPixmapBytes (pPixmap);
     
     pPixmap->screen_x = x;
     pPixmap->screen_y = y;
@@ -612,19 +624,181 @@ compNewPixmap (WindowPtr pWin, int x, int y, int w, int h, Bool map)
     return pPixmap;
 }
 
+void
+compDestroyPixmap (PixmapPtr pPixmap)
+{
+    CompositeStats.bytes -= compPixmapBytes (pPixmap);
+    (*pPixmap->drawable.pScreen->DestroyPixmap) (pPixmap);
+}
+
+/*
+ * An empty pixmap standing in for the one of a window that has nothing
+ * visible, so that drawing to the window and its inferiors finds a
+ * pixmap but no clip to draw through
+ */
+static PixmapPtr
+compNewPlaceholder (WindowPtr pWin, int x, int y)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    PixmapPtr	    pPixmap;
+
+    pPixmap = (*pScreen->CreatePixmap) (pScreen, 0, 0, pWin->drawable.depth,
+					CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+    if (!pPixmap)
+	return 0;
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+    return pPixmap;
+}
+
+/*
+ * Only automatically redirected windows can do without their pixmap,
+ * as nobody else looks at it.  Their contents come back through Expose,
+ * which leaves windows with background None out, and windows asking for
+ * backing store, which is this very pixmap.
+ */
+static Bool
+compCanReleasePixmap (WindowPtr pWin)
+{
+    CompWindowPtr   cw = GetCompWindow (pWin);
+
+    return (cw->update == CompositeRedirectAutomatic &&
+	    pWin->backingStore == NotUseful &&
+	    TraverseTree (pWin, bgNoneVisitWindow, NULL) == WT_NOMATCH);
+}
+
+/*
+ * Charge only what a pixmap shrunk in place still draws into once it
+ * stops being the window's pixmap.
+ */
+static void
+compSettlePixmap (CompWindowPtr cw, PixmapPtr pPixmap)
+{
+    if (cw->allocBytes)
+    {
+	CompositeStats.bytes -= cw->allocBytes - compPixmapBytes (pPixmap);
+	cw->allocBytes = 0;
+    }
+}
+
+/*
+ * Replace the pixmap of a window nothing of which is visible by a
+ * placeholder.  The caller clips the window as fully obscured.
+ */
 Bool
-compAllocPixmap (WindowPtr pWin)
+compReleasePixmap (WindowPtr pWin)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    PixmapPtr	    pPixmap = (*pScreen->GetWindowPixmap) (pWin);
+    PixmapPtr	    pPlaceholder;
+    CompWindowPtr   cw = GetCompWindow (pWin);
+
+    if (cw->released)
+	return TRUE;
+    /* named pixmaps and pixmaps with bits still to copy stay */
+    if (pPixmap->refcnt != 1 || cw->pOldPixmap || !compCanReleasePixmap (pWin))
+	return FALSE;
+    pPlaceholder = compNewPlaceholder (pWin, pPixmap->screen_x,
+				       pPixmap->screen_y);
+    if (!pPlaceholder)
+	return FALSE;
+    if (cw->damageRegistered)
+	DamageEmpty (cw->damage);
+    compSetPixmap (pWin, pPlaceholder);
+    compSettlePixmap (cw, pPixmap);
+    compDestroyPixmap (pPixmap);
+    cw->released = TRUE;
+    CompositeStats.released++;
+    return TRUE;
+}
+
+/*
+ * Give a released window a pixmap again.  Its contents are whatever the
+ * exposures that follow paint.
+ */
+Bool
+compRestorePixmap (WindowPtr pWin)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    PixmapPtr	    pPlaceholder = (*pScreen->GetWindowPixmap) (pWin);
+    PixmapPtr	    pPixmap;
+    CompWindowPtr   cw = GetCompWindow (pWin);
+    int		    bw = (int) pWin->borderWidth;
+
+    if (!cw->released)
+	return TRUE;
+    pPixmap = compNewPixmap (pWin,
+			     pWin->drawable.x - bw, pWin->drawable.y - bw,
+			     pWin->drawable.width + (bw << 1),
+			     pWin->drawable.height + (bw << 1), FALSE);
+    if (!pPixmap)
+	return FALSE;
+    compSetPixmap (pWin, pPixmap);
+    compDestroyPixmap (pPlaceholder);
+    cw->released = FALSE;
+    CompositeStats.released--;
+    return TRUE;
+}
+
+/*
+ * Restore a released window outside of tree validation, for a client
+ * about to name its pixmap.  The window is revalidated with the pixmap
+ * held, so that it keeps it even when still obscured, and exposed so
+ * that the pixmap gets drawn.
+ */
+Bool
+compReclaimPixmap (WindowPtr pWin)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    CompWindowPtr   cw = GetCompWindow (pWin);
+    WindowPtr	    pLayerWin;
+    PixmapPtr	    pPixmap;
+
+    if (!cw->released)
+	return TRUE;
+    if (!compRestorePixmap (pWin))
+	return FALSE;
+    pPixmap = (*pScreen->GetWindowPixmap) (pWin);
+    ++pPixmap->refcnt;
+    (*pScreen->MarkOverlappedWindows) (pWin, pWin, &pLayerWin);
+    (*pScreen->ValidateTree) (pLayerWin->parent, NullWindow, VTOther);
+    (*pScreen->HandleExposures) (pLayerWin->parent);
+    if (pScreen->PostValidateTree)
+	(*pScreen->PostValidateTree) (pLayerWin->parent, NullWindow, VTOther);
+    (*pScreen->DestroyPixmap) (pPixmap);
+    return TRUE;
+}
+
+Bool
+compAllocPixmap (WindowPtr pWin, Bool realizing)
 {
     int		    bw = (int) pWin->borderWidth;
     int		    x = pWin->drawable.x - bw;
     int		    y = pWin->drawable.y - bw;
     int		    w = pWin->drawable.width + (bw << 1);
     int		    h = pWin->drawable.height + (bw << 1);
-    PixmapPtr	    pPixmap = compNewPixmap (pWin, x, y, w, h, TRUE);
+    PixmapPtr	    pPixmap;
     CompWindowPtr   cw = GetCompWindow (pWin);
 
+    /*
+     * Start released when the contents can be rebuilt and the window is
+     * being realized; validating it allocates the pixmap if any of it
+     * shows.  A window redirected while mapped keeps its clip until the
+     * next validation and needs its pixmap now.
+     */
+    cw->released = realizing && compCanReleasePixmap (pWin);
+    cw->allocBytes = 0;
+    if (cw->released)
+	pPixmap = compNewPlaceholder (pWin, x, y);
+    else
+	pPixmap = compNewPixmap (pWin, x, y, w, h, TRUE);
     if (!pPixmap)
+    {
+	cw->released = FALSE;
 	return FALSE;
+    }
+    if (cw->released)
+	CompositeStats.released++;
     if (cw->update == CompositeRedirectAutomatic)
 	pWin->redirectDraw = RedirectDrawAutomatic;
     else
@@ -666,13 +840,23 @@ compFreePixmap (WindowPtr pWin)
     pParentPixmap = (*pScreen->GetWindowPixmap) (pWin->parent);
     pWin->redirectDraw = RedirectDrawNone;
     compSetPixmap (pWin, pParentPixmap);
-    (*pScreen->DestroyPixmap) (pRedirectPixmap);
+    compSettlePixmap (cw, pRedirectPixmap);
+    compDestroyPixmap (pRedirectPixmap);
+    if (cw->released)
+    {
+	cw->released = FALSE;
+	CompositeStats.released--;
+    }
 }
 
 /*
  * Make sure the pixmap is the right size and offset.  Allocate a new
  * pixmap to change size, adjust origin to change offset, leaving the
- * old pixmap in cw->pOldPixmap so bits can be recovered
+ * old pixmap in cw->pOldPixmap so bits can be recovered.  A pixmap in
+ * memory that only shrinks keeps its storage and stride, and the bits
+ * are moved within it like for a change of offset, as long as it still
+ * uses half of that storage.  The whole storage stays charged to
+ * CompositeStats until the pixmap is replaced.
  */
 Bool
 compReallocPixmap (WindowPtr pWin, int draw_x, int draw_y,
@@ -692,11 +876,36 @@ compReallocPixmap (WindowPtr pWin, int draw_x, int draw_y,
     pix_y = draw_y - bw;
     pix_w = w + (bw << 1);
     pix_h = h + (bw << 1);
-    if (pix_w != pOld->drawable.width || pix_h != pOld->drawable.height)
+    if (cw->released)
+    {
+	/* the pixmap comes back at the new size when the window shows */
+	pNew = pOld;
+	cw->pOldPixmap = 0;
+    }
+    else if (pix_w <= pOld->drawable.width && pix_h <= pOld->drawable.height &&
+	     (pix_w != pOld->drawable.width || pix_h != pOld->drawable.height) &&
+	     pOld->refcnt == 1 && pOld->devPrivate.ptr &&
+	     (unsigned long) PixmapBytePad (pix_w, pOld->drawable.depth) *
+	     pix_h * 2 >= (cw->allocBytes ? cw->allocBytes :
+			   compPixmapBytes (pOld)))
+    {
+	unsigned long	bytes = compPixmapBytes (pOld);
+
+	if (!(*pScreen->ModifyPixmapHeader) (pOld, pix_w, pix_h, 0, 0,
+					     pOld->devKind, NULL))
+	    return FALSE;
+	if (!cw->allocBytes)
+	    cw->allocBytes = bytes;
+	CompositeStats.sharedResizes++;
+	pNew = pOld;
+	cw->pOldPixmap = 0;
+    }
+    else if (pix_w != pOld->drawable.width || pix_h != pOld->drawable.height)
     {
 	pNew = compNewPixmap (pWin, pix_x, pix_y, pix_w, pix_h, FALSE);
 	if (!pNew)
 	    return FALSE;
+	compSettlePixmap (cw, pOld);
 	cw->pOldPixmap = pOld;
 	compSetPixmap (pWin, pNew);
     }
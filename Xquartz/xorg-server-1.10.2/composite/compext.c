@@ -247,6 +247,10 @@ ProcCompositeNameWindowPixmap (ClientPtr client)
     if (!cw)
 	return BadMatch;
 
+    /* the pixmap may have been given up while the window was obscured */
+    if (!compReclaimPixmap (pWin))
+	return BadAlloc;
+
     pPixmap = (*pWin->drawable.pScreen->GetWindowPixmap) (pWin);
     if (!pPixmap)
 	return BadMatch;
@@ -731,6 +735,12 @@ PanoramiXCompositeNameWindowPixmap (ClientPtr client)
 	    return BadMatch;
 	}
 
+	if (!compReclaimPixmap (pWin))
+	{
+	    free (newPix);
+	    return BadAlloc;
+	}
+
 	pPixmap = (*pWin->drawable.pScreen->GetWindowPixmap) (pWin);
 	if (!pPixmap)
 	{
@@ -132,6 +132,21 @@ compChangeWindowAttributes(WindowPtr pWin, unsigned long mask)
     return ret;
 }
 
+/*
+ * Whether the window draws to the placeholder of a window that gave up
+ * its pixmap, which has no bits to read back
+ */
+static Bool
+compWindowReleased (WindowPtr pWin)
+{
+    CompWindowPtr   cw;
+
+    while (pWin->redirectDraw == RedirectDrawNone && pWin->parent)
+	pWin = pWin->parent;
+    cw = GetCompWindow (pWin);
+    return pWin->redirectDraw != RedirectDrawNone && cw && cw->released;
+}
+
 static void
 compGetImage (DrawablePtr pDrawable,
 	      int sx, int sy,
@@ -146,7 +161,18 @@ compGetImage (DrawablePtr pDrawable,
     pScreen->GetImage = cs->GetImage;
     if (pDrawable->type == DRAWABLE_WINDOW)
 	compPaintChildrenToWindow ((WindowPtr) pDrawable);
-    (*pScreen->GetImage) (pDrawable, sx, sy, w, h, format, planemask, pdstLine);
+    if (pDrawable->type == DRAWABLE_WINDOW &&
+	compWindowReleased ((WindowPtr) pDrawable))
+    {
+	/* the contents of obscured windows are undefined */
+	if (format == ZPixmap)
+	    memset (pdstLine, 0, PixmapBytePad (w, pDrawable->depth) * h);
+	else
+	    memset (pdstLine, 0, BitmapBytePad (w) * h);
+    }
+    else
+	(*pScreen->GetImage) (pDrawable, sx, sy, w, h, format, planemask,
+			      pdstLine);
     cs->GetImage = pScreen->GetImage;
     pScreen->GetImage = compGetImage;
 }
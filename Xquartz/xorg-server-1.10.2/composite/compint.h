@@ -96,6 +96,8 @@ typedef struct _CompWindow {
     int			    oldy;
     PixmapPtr		    pOldPixmap;
     int			    borderClipX, borderClipY;
+    Bool		    released;	/* pixmap dropped while obscured */
+    unsigned long	    allocBytes;	/* storage of a pixmap shrunk in place */
 } CompWindowRec, *CompWindowPtr;
 
 #define COMP_ORIGIN_INVALID	    0x80000000
@@ -212,11 +214,23 @@ int
 compUnredirectOneSubwindow (WindowPtr pParent, WindowPtr pWin);
 
 Bool
-compAllocPixmap (WindowPtr pWin);
+compAllocPixmap (WindowPtr pWin, Bool realizing);
 
 void
 compFreePixmap (WindowPtr pWin);
 
+void
+compDestroyPixmap (PixmapPtr pPixmap);
+
+Bool
+compReleasePixmap (WindowPtr pWin);
+
+Bool
+compRestorePixmap (WindowPtr pWin);
+
+Bool
+compReclaimPixmap (WindowPtr pWin);
+
 Bool
 compReallocPixmap (WindowPtr pWin, int x, int y,
 		   unsigned int w, unsigned int h, int bw);
@@ -254,6 +268,18 @@ compCreateOverlayWindow (ScreenPtr pScreen);
 void
 compDestroyOverlayWindow (ScreenPtr pScreen);
 
+/*
+ * compthread.c
+ */
+
+Bool
+compPaintQueue (PixmapPtr pSrcPixmap, CARD32 srcFormat,
+		PixmapPtr pDstPixmap, CARD32 dstFormat,
+		RegionPtr pRegion, DrawablePtr pDamaged);
+
+void
+compPaintFlush (void);
+
 /*
  * compwindow.c
  */
@@ -305,7 +331,7 @@ compCreateWindow (WindowPtr pWin);
 Bool
 compDestroyWindow (WindowPtr pWin);
 
-void
+Bool
 compSetRedirectBorderClip (WindowPtr pWin, RegionPtr pRegion);
 
 RegionPtr
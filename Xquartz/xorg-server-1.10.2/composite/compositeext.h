@@ -35,4 +35,12 @@ extern _X_EXPORT Bool CompositeRegisterAlternateVisuals(ScreenPtr pScreen,
                                                         VisualID *vids,
                                                         int nVisuals);
 
+typedef struct _CompositeStats {
+    unsigned long	bytes;		/* pixmaps of redirected windows */
+    unsigned long	released;	/* windows without one while obscured */
+    unsigned long	sharedResizes;	/* resizes done in the old pixmap */
+} CompositeStatsRec;
+
+extern _X_EXPORT CompositeStatsRec CompositeStats;
+
 #endif /* _COMPOSITEEXT_H_ */
@@ -0,0 +1,354 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "compint.h"
+
+/*
+ * Painting automatically redirected windows into their parents on
+ * several threads.
+ *
+ * The paints of one screen update are queued instead of being drawn as
+ * they are found.  Queued paints form a wave of paints which don't
+ * depend on each other: no paint reads a pixmap another one writes, and
+ * paints into the same pixmap don't overlap.  A paint which would break
+ * that flushes the wave first, so the stacking order is kept where
+ * windows overlap and a parent is painted only after its children were
+ * painted into it.
+ *
+ * Flushing a wave splits the boxes of its paints into strips which the
+ * server thread and compositeThreads - 1 workers copy with pixman.  This
+ * only works on pixmaps whose bits are in memory, the way fb keeps
+ * them; everything else goes through CompositePicture as before.
+ */
+
+#ifdef COMPOSITE_THREADS
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define COMP_PAINT_ROWS		32	/* rows per strip */
+#define COMP_PAINT_MAX_THREADS	64
+
+typedef struct _CompPaint {
+    PixmapPtr		pSrcPixmap;
+    PixmapPtr		pDstPixmap;
+    pixman_image_t	*src;
+    pixman_image_t	*dst;
+    BoxRec		extents;	/* screen coordinates */
+    DrawablePtr		pDamaged;
+} CompPaintRec, *CompPaintPtr;
+
+typedef struct _CompPaintStrip {
+    int			paint;
+    BoxRec		box;		/* screen coordinates */
+} CompPaintStripRec, *CompPaintStripPtr;
+
+static CompPaintPtr	    compPaints;
+static int		    compNumPaints, compSizePaints;
+static CompPaintStripPtr    compStrips;
+static int		    compNumStrips, compSizeStrips;
+
+/*
+ * Workers only look at the strips while a wave is being flushed, and
+ * then only at the ones handed out under compPaintMutex.
+ */
+static pthread_mutex_t	compPaintMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	compPaintWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	compPaintDone = PTHREAD_COND_INITIALIZER;
+static int		compPaintNext, compPaintAvail, compPaintRemaining;
+static int		compPaintActive;	/* workers taking part */
+static int		compPaintWorkers;	/* workers started */
+
+static void
+compPaintStrip (CompPaintStripPtr pStrip)
+{
+    CompPaintPtr    pPaint = &compPaints[pStrip->paint];
+    BoxPtr	    pBox = &pStrip->box;
+
+    pixman_image_composite (PIXMAN_OP_SRC,
+			    pPaint->src, NULL, pPaint->dst,
+			    pBox->x1 - pPaint->pSrcPixmap->screen_x,
+			    pBox->y1 - pPaint->pSrcPixmap->screen_y,
+			    0, 0,
+			    pBox->x1 - pPaint->pDstPixmap->screen_x,
+			    pBox->y1 - pPaint->pDstPixmap->screen_y,
+			    pBox->x2 - pBox->x1,
+			    pBox->y2 - pBox->y1);
+}
+
+/*
+ * Paint strips until there are none left to hand out.  Called and
+ * returns with compPaintMutex held.
+ */
+static void
+compPaintStrips (void)
+{
+    int	    i;
+
+    while (compPaintNext < compPaintAvail)
+    {
+	i = compPaintNext++;
+	pthread_mutex_unlock (&compPaintMutex);
+	compPaintStrip (&compStrips[i]);
+	pthread_mutex_lock (&compPaintMutex);
+	if (--compPaintRemaining == 0)
+	    pthread_cond_signal (&compPaintDone);
+    }
+}
+
+static void *
+compPaintThread (void *arg)
+{
+    int	    index = (int) (intptr_t) arg;
+
+    pthread_mutex_lock (&compPaintMutex);
+    for (;;)
+    {
+	while (index >= compPaintActive || compPaintNext >= compPaintAvail)
+	    pthread_cond_wait (&compPaintWork, &compPaintMutex);
+	compPaintStrips ();
+    }
+    return NULL;
+}
+
+/*
+ * Start workers until there are enough for compositeThreads.  Workers
+ * never exit; the ones above the current count just sleep.
+ */
+static void
+compPaintStartThreads (int wanted)
+{
+    pthread_t	thread;
+
+    if (wanted > COMP_PAINT_MAX_THREADS - 1)
+	wanted = COMP_PAINT_MAX_THREADS - 1;
+    if (compPaintWorkers >= wanted)
+	return;
+
+    while (compPaintWorkers < wanted)
+    {
+	if (OsCreateThread (&thread, compPaintThread,
+			    (void *) (intptr_t) compPaintWorkers) != 0)
+	{
+	    ErrorF ("composite: can only paint on %d threads\n",
+		    compPaintWorkers + 1);
+	    /* don't try again */
+	    compositeThreads = compPaintWorkers + 1;
+	    break;
+	}
+	compPaintWorkers++;
+    }
+}
+
+/*
+ * Indexed formats need the colormap's pixman palette, which only the
+ * Picture code sets up; those windows are painted by CompositePicture.
+ */
+static Bool
+compPaintFormatOk (CARD32 format)
+{
+    return PICT_FORMAT_TYPE (format) != PICT_TYPE_COLOR &&
+	   PICT_FORMAT_TYPE (format) != PICT_TYPE_GRAY;
+}
+
+static pixman_image_t *
+compPaintImage (PixmapPtr pPixmap, CARD32 format)
+{
+    return pixman_image_create_bits ((pixman_format_code_t) format,
+				     pPixmap->drawable.width,
+				     pPixmap->drawable.height,
+				     (uint32_t *) pPixmap->devPrivate.ptr,
+				     pPixmap->devKind);
+}
+
+static Bool
+compPaintConflicts (PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, BoxPtr pExtents)
+{
+    CompPaintPtr    pPaint;
+    int		    i;
+
+    for (i = 0; i < compNumPaints; i++)
+    {
+	pPaint = &compPaints[i];
+	if (pPaint->pDstPixmap == pSrcPixmap ||
+	    pPaint->pSrcPixmap == pDstPixmap)
+	    return TRUE;
+	if (pPaint->pDstPixmap == pDstPixmap &&
+	    pPaint->extents.x1 < pExtents->x2 &&
+	    pExtents->x1 < pPaint->extents.x2 &&
+	    pPaint->extents.y1 < pExtents->y2 &&
+	    pExtents->y1 < pPaint->extents.y2)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Queue a copy of pRegion, in screen coordinates, from pSrcPixmap to
+ * pDstPixmap.  The region must lie within both pixmaps.  The caller
+ * reports the damage of the copy to pDamaged, if any, before the copy
+ * is painted; the damage pending on it is processed afterwards.
+ * Returns FALSE when the copy has to be done with CompositePicture
+ * instead; nothing is queued then.
+ */
+Bool
+compPaintQueue (PixmapPtr pSrcPixmap, CARD32 srcFormat,
+		PixmapPtr pDstPixmap, CARD32 dstFormat,
+		RegionPtr pRegion, DrawablePtr pDamaged)
+{
+    CompPaintPtr	pPaint;
+    CompPaintStripPtr	pStrip;
+    BoxPtr		pBox;
+    int			nbox, nstrip, y;
+
+    if (compositeThreads < 2)
+	return FALSE;
+    if (!pSrcPixmap->devPrivate.ptr || !pDstPixmap->devPrivate.ptr)
+	return FALSE;
+    if (PIXMAN_FORMAT_BPP (srcFormat) != pSrcPixmap->drawable.bitsPerPixel ||
+	PIXMAN_FORMAT_BPP (dstFormat) != pDstPixmap->drawable.bitsPerPixel)
+	return FALSE;
+    if (!compPaintFormatOk (srcFormat) || !compPaintFormatOk (dstFormat))
+	return FALSE;
+    if (!RegionNotEmpty (pRegion))
+	return TRUE;
+
+    if (compPaintConflicts (pSrcPixmap, pDstPixmap, RegionExtents (pRegion)))
+	compPaintFlush ();
+
+    nstrip = 0;
+    pBox = RegionRects (pRegion);
+    for (nbox = RegionNumRects (pRegion); nbox--; pBox++)
+	nstrip += (pBox->y2 - pBox->y1 + COMP_PAINT_ROWS - 1) / COMP_PAINT_ROWS;
+
+    if (compNumPaints == compSizePaints)
+    {
+	int	    size = compSizePaints ? compSizePaints * 2 : 32;
+	pPaint = realloc (compPaints, size * sizeof (CompPaintRec));
+	if (!pPaint)
+	    return FALSE;
+	compPaints = pPaint;
+	compSizePaints = size;
+    }
+    if (compNumStrips + nstrip > compSizeStrips)
+    {
+	int	    size = compSizeStrips ? compSizeStrips : 256;
+	while (size < compNumStrips + nstrip)
+	    size *= 2;
+	pStrip = realloc (compStrips, size * sizeof (CompPaintStripRec));
+	if (!pStrip)
+	    return FALSE;
+	compStrips = pStrip;
+	compSizeStrips = size;
+    }
+
+    pPaint = &compPaints[compNumPaints];
+    pPaint->pSrcPixmap = pSrcPixmap;
+    pPaint->pDstPixmap = pDstPixmap;
+    pPaint->src = compPaintImage (pSrcPixmap, srcFormat);
+    pPaint->dst = compPaintImage (pDstPixmap, dstFormat);
+    if (!pPaint->src || !pPaint->dst)
+    {
+	if (pPaint->src)
+	    pixman_image_unref (pPaint->src);
+	if (pPaint->dst)
+	    pixman_image_unref (pPaint->dst);
+	return FALSE;
+    }
+    pPaint->extents = *RegionExtents (pRegion);
+    pPaint->pDamaged = pDamaged;
+
+    pStrip = &compStrips[compNumStrips];
+    pBox = RegionRects (pRegion);
+    for (nbox = RegionNumRects (pRegion); nbox--; pBox++)
+    {
+	for (y = pBox->y1; y < pBox->y2; y += COMP_PAINT_ROWS)
+	{
+	    pStrip->paint = compNumPaints;
+	    pStrip->box.x1 = pBox->x1;
+	    pStrip->box.x2 = pBox->x2;
+	    pStrip->box.y1 = y;
+	    pStrip->box.y2 = min (y + COMP_PAINT_ROWS, pBox->y2);
+	    pStrip++;
+	}
+    }
+    compNumStrips += nstrip;
+    compNumPaints++;
+    return TRUE;
+}
+
+/*
+ * Paint everything queued and wait for it to be done.
+ */
+void
+compPaintFlush (void)
+{
+    int	    i;
+
+    if (!compNumPaints)
+	return;
+
+    compPaintStartThreads (compositeThreads - 1);
+
+    pthread_mutex_lock (&compPaintMutex);
+    compPaintActive = min (compositeThreads - 1, compPaintWorkers);
+    compPaintNext = 0;
+    compPaintAvail = compNumStrips;
+    compPaintRemaining = compNumStrips;
+    if (compPaintActive > 0 && compNumStrips > 1)
+	pthread_cond_broadcast (&compPaintWork);
+    compPaintStrips ();
+    while (compPaintRemaining)
+	pthread_cond_wait (&compPaintDone, &compPaintMutex);
+    compPaintNext = compPaintAvail = 0;
+    pthread_mutex_unlock (&compPaintMutex);
+
+    for (i = 0; i < compNumPaints; i++)
+    {
+	pixman_image_unref (compPaints[i].src);
+	pixman_image_unref (compPaints[i].dst);
+	if (compPaints[i].pDamaged)
+	    DamageRegionProcessPending (compPaints[i].pDamaged);
+    }
+    compNumPaints = 0;
+    compNumStrips = 0;
+}
+
+#else /* COMPOSITE_THREADS */
+
+Bool
+compPaintQueue (PixmapPtr pSrcPixmap, CARD32 srcFormat,
+		PixmapPtr pDstPixmap, CARD32 dstFormat,
+		RegionPtr pRegion, DrawablePtr pDamaged)
+{
+    return FALSE;
+}
+
+void
+compPaintFlush (void)
+{
+}
+
+#endif /* COMPOSITE_THREADS */
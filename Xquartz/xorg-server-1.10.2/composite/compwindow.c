@@ -143,8 +143,8 @@ compSetPixmap (WindowPtr pWindow, PixmapPtr pPixmap)
     compCheckTree (pWindow->drawable.pScreen);
 }
 
-Bool
-compCheckRedirect (WindowPtr pWin)
+static Bool
+compUpdateRedirect (WindowPtr pWin, Bool realizing)
 {
     CompWindowPtr   cw = GetCompWindow (pWin);
     CompScreenPtr   cs = GetCompScreen(pWin->drawable.pScreen);
@@ -163,13 +163,19 @@ compCheckRedirect (WindowPtr pWin)
     if (should != (pWin->redirectDraw != RedirectDrawNone))
     {
 	if (should)
-	    return compAllocPixmap (pWin);
+	    return compAllocPixmap (pWin, realizing);
 	else
 	    compFreePixmap (pWin);
     }
     return TRUE;
 }
 
+Bool
+compCheckRedirect (WindowPtr pWin)
+{
+    return compUpdateRedirect (pWin, FALSE);
+}
+
 static int
 updateOverlayWindow(ScreenPtr pScreen)
 {
@@ -254,7 +260,8 @@ compRealizeWindow (WindowPtr pWin)
     Bool	    ret = TRUE;
 
     pScreen->RealizeWindow = cs->RealizeWindow;
-    compCheckRedirect (pWin);
+    /* the window is validated next, which gives it its pixmap if shown */
+    compUpdateRedirect (pWin, TRUE);
     if (!(*pScreen->RealizeWindow) (pWin))
 	ret = FALSE;
     cs->RealizeWindow = pScreen->RealizeWindow;
@@ -350,13 +357,12 @@ compImplicitRedirect (WindowPtr pWin, WindowPtr pParent)
 
 static void compFreeOldPixmap(WindowPtr pWin)
 {
-    ScreenPtr		pScreen = pWin->drawable.pScreen;
     if (pWin->redirectDraw != RedirectDrawNone)
     {
 	CompWindowPtr	cw = GetCompWindow (pWin);
 	if (cw->pOldPixmap)
 	{
-	    (*pScreen->DestroyPixmap) (cw->pOldPixmap);
+	    compDestroyPixmap (cw->pOldPixmap);
 	    cw->pOldPixmap = NullPixmap;
 	}
     }
@@ -592,12 +598,29 @@ compDestroyWindow (WindowPtr pWin)
     return ret;
 }
 
-void
+/*
+ * Windows showing nothing give up their pixmap, if they can, until they
+ * show again.  Returns FALSE while the window has none.
+ */
+Bool
 compSetRedirectBorderClip (WindowPtr pWin, RegionPtr pRegion)
 {
     CompWindowPtr   cw = GetCompWindow (pWin);
     RegionRec	    damage;
 
+    if (RegionNotEmpty(pRegion))
+	compRestorePixmap (pWin);
+    else
+	compReleasePixmap (pWin);
+    if (cw->released)
+    {
+	/* nothing is visible to repaint when the pixmap comes back */
+	RegionEmpty(&cw->borderClip);
+	cw->borderClipX = pWin->drawable.x;
+	cw->borderClipY = pWin->drawable.y;
+	return FALSE;
+    }
+
     RegionNull(&damage);
     /*
      * Align old border clip with new border clip
@@ -620,6 +643,7 @@ compSetRedirectBorderClip (WindowPtr pWin, RegionPtr pRegion)
     RegionCopy(&cw->borderClip, pRegion);
     cw->borderClipX = pWin->drawable.x;
     cw->borderClipY = pWin->drawable.y;
+    return TRUE;
 }
 
 RegionPtr
@@ -652,6 +676,61 @@ compWindowFormat (WindowPtr pWin)
 			       compGetWindowVisual (pWin));
 }
 
+/*
+ * Queue the paint of pRegion, the damage of pWin in screen coordinates,
+ * for the paint threads.  The parent is damaged here, before any
+ * painting, so nothing reacting to the damage draws under a paint in
+ * flight; the damage reported after rendering is processed when the
+ * wave has been painted.
+ */
+static Bool
+compPaintWindowThreaded (WindowPtr pWin, PixmapPtr pSrcPixmap,
+			 PictFormatPtr pSrcFormat, PictFormatPtr pDstFormat,
+			 RegionPtr pRegion)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    WindowPtr	    pParent = pWin->parent;
+    PixmapPtr	    pDstPixmap;
+    RegionRec	    region, pixmapClip;
+    BoxRec	    box;
+
+    if (compositeThreads < 2 || !pSrcFormat || !pDstFormat)
+	return FALSE;
+    pDstPixmap = (*pScreen->GetWindowPixmap) (pParent);
+
+    /*
+     * Clip to what an IncludeInferiors picture of the parent would
+     * show and to both pixmaps.
+     */
+    RegionNull (&region);
+    RegionIntersect (&region, pRegion, &pParent->borderClip);
+    RegionIntersect (&region, &region, &pParent->winSize);
+    box.x1 = pSrcPixmap->screen_x;
+    box.y1 = pSrcPixmap->screen_y;
+    box.x2 = box.x1 + pSrcPixmap->drawable.width;
+    box.y2 = box.y1 + pSrcPixmap->drawable.height;
+    RegionInit (&pixmapClip, &box, 1);
+    RegionIntersect (&region, &region, &pixmapClip);
+    box.x1 = pDstPixmap->screen_x;
+    box.y1 = pDstPixmap->screen_y;
+    box.x2 = box.x1 + pDstPixmap->drawable.width;
+    box.y2 = box.y1 + pDstPixmap->drawable.height;
+    RegionReset (&pixmapClip, &box);
+    RegionIntersect (&region, &region, &pixmapClip);
+    RegionUninit (&pixmapClip);
+
+    if (!compPaintQueue (pSrcPixmap, pSrcFormat->format,
+			 pDstPixmap, pDstFormat->format, &region,
+			 &pParent->drawable))
+    {
+	RegionUninit (&region);
+	return FALSE;
+    }
+    DamageRegionAppend (&pParent->drawable, &region);
+    RegionUninit (&region);
+    return TRUE;
+}
+
 static void
 compWindowUpdateAutomatic (WindowPtr pWin)
 {
@@ -663,18 +742,9 @@ compWindowUpdateAutomatic (WindowPtr pWin)
     PictFormatPtr   pDstFormat = compWindowFormat (pWin->parent);
     int		    error;
     RegionPtr	    pRegion = DamageRegion (cw->damage);
-    PicturePtr	    pSrcPicture = CreatePicture (0, &pSrcPixmap->drawable,
-						 pSrcFormat,
-						 0, 0,
-						 serverClient,
-						 &error);
+    PicturePtr	    pSrcPicture;
     XID		    subwindowMode = IncludeInferiors;
-    PicturePtr	    pDstPicture = CreatePicture (0, &pParent->drawable,
-						 pDstFormat,
-						 CPSubwindowMode,
-						 &subwindowMode,
-						 serverClient,
-						 &error);
+    PicturePtr	    pDstPicture;
 
     /*
      * First move the region from window to screen coordinates
@@ -687,6 +757,26 @@ compWindowUpdateAutomatic (WindowPtr pWin)
      */
     RegionIntersect(pRegion, pRegion, &cw->borderClip);
 
+    if (compPaintWindowThreaded (pWin, pSrcPixmap, pSrcFormat, pDstFormat,
+				 pRegion))
+    {
+	DamageEmpty (cw->damage);
+	return;
+    }
+    compPaintFlush ();
+
+    pSrcPicture = CreatePicture (0, &pSrcPixmap->drawable,
+				 pSrcFormat,
+				 0, 0,
+				 serverClient,
+				 &error);
+    pDstPicture = CreatePicture (0, &pParent->drawable,
+				 pDstFormat,
+				 CPSubwindowMode,
+				 &subwindowMode,
+				 serverClient,
+				 &error);
+
     /*
      * Now translate from screen to dest coordinates
      */
@@ -720,10 +810,13 @@ compWindowUpdateAutomatic (WindowPtr pWin)
     DamageEmpty (cw->damage);
 }
 
+static void
+compPaintChildren (WindowPtr pWin);
+
 static void
 compPaintWindowToParent (WindowPtr pWin)
 {
-    compPaintChildrenToWindow (pWin);
+    compPaintChildren (pWin);
 
     if (pWin->redirectDraw != RedirectDrawNone)
     {
@@ -737,8 +830,8 @@ compPaintWindowToParent (WindowPtr pWin)
     }
 }
 
-void
-compPaintChildrenToWindow (WindowPtr pWin)
+static void
+compPaintChildren (WindowPtr pWin)
 {
     WindowPtr pChild;
 
@@ -751,6 +844,16 @@ compPaintChildrenToWindow (WindowPtr pWin)
     pWin->damagedDescendants = FALSE;
 }
 
+void
+compPaintChildrenToWindow (WindowPtr pWin)
+{
+    if (!pWin->damagedDescendants)
+	return;
+
+    compPaintChildren (pWin);
+    compPaintFlush ();
+}
+
 WindowPtr
 CompositeRealChildHead (WindowPtr pWin)
 {
@@ -484,6 +484,38 @@ SDamageNotifyEvent (xDamageNotifyEvent *from,
     cpswaps (from->geometry.height, to->geometry.height);
 }
 
+/*
+ * While the client isn't reading, a notify for the same damage takes in the
+ * area of the next one.  The merged event reports a box covering both,
+ * which only ever asks the client to look at more than was damaged.
+ */
+static Bool
+DamageCoalesceNotify (xDamageNotifyEvent *queued,
+		      xDamageNotifyEvent *ev)
+{
+    int	x1, y1, x2, y2;
+
+    if (queued->damage != ev->damage || queued->drawable != ev->drawable)
+	return FALSE;
+    x1 = min (queued->area.x, ev->area.x);
+    y1 = min (queued->area.y, ev->area.y);
+    x2 = max (queued->area.x + queued->area.width,
+	      ev->area.x + ev->area.width);
+    y2 = max (queued->area.y + queued->area.height,
+	      ev->area.y + ev->area.height);
+    if (x2 - x1 > 0xffff || y2 - y1 > 0xffff)
+	return FALSE;
+    queued->level = ev->level;
+    queued->sequenceNumber = ev->sequenceNumber;
+    queued->timestamp = ev->timestamp;
+    queued->area.x = x1;
+    queued->area.y = y1;
+    queued->area.width = x2 - x1;
+    queued->area.height = y2 - y1;
+    queued->geometry = ev->geometry;
+    return TRUE;
+}
+
 void
 DamageExtensionInit(void)
 {
@@ -516,6 +548,8 @@ DamageExtensionInit(void)
 	DamageEventBase = extEntry->eventBase;
 	EventSwapVector[DamageEventBase + XDamageNotify] =
 			(EventSwapPtr) SDamageNotifyEvent;
+	EventCoalesceVector[DamageEventBase + XDamageNotify] =
+			(EventCoalescePtr) DamageCoalesceNotify;
 	SetResourceTypeErrorValue(DamageExtType, extEntry->errorBase + BadDamage);
     }
 }
@@ -381,7 +381,7 @@ ProcDbeAllocateBackBufferName(ClientPtr client)
 
 out_free:
     dixSetPrivate(&pWin->devPrivates, dbeWindowPrivKey, NULL);
-    free(pDbeWindowPriv);
+    dixFreeObjectWithPrivates(pDbeWindowPriv, PRIVATE_DBE_WINDOW);
     return status;
 
 } /* ProcDbeAllocateBackBufferName() */
@@ -59,98 +59,194 @@ SOFTWARE.
 #include "dix.h"
 
 #define InitialTableSize 100
+#define InitialHashBits 8
+
+/*
+ * Atoms are found by name through an open addressing hash table of FNV-1a
+ * hashes and by number through nodeTable, which is indexed by the atom
+ * itself.  Atoms are never freed until the server resets, so the hash
+ * table doesn't need tombstones and nodeTable only ever grows.
+ *
+ * NameForAtom and ValidAtom don't take any lock.  nodeTable is grown by
+ * copying it and publishing the new table after the copy; the old table
+ * is kept until FreeAllAtoms in case a reader still has it.  A new node is
+ * stored in the table before lastAtom is bumped.
+ */
 
 typedef struct _Node {
-    struct _Node   *left,   *right;
     Atom a;
-    unsigned int fingerPrint;
+    unsigned int hash;
+    unsigned len;
     const char   *string;
 } NodeRec, *NodePtr;
 
-static Atom lastAtom = None;
-static NodePtr atomRoot = NULL;
+typedef struct _NodeTable {
+    struct _NodeTable *prev;
+    NodePtr nodes[1];
+} NodeTableRec, *NodeTablePtr;
+
+static volatile Atom lastAtom = None;
 static unsigned long tableLength;
-static NodePtr *nodeTable;
+static NodePtr * volatile nodeTable;
+static NodeTablePtr nodeTables;
+static NodePtr *hashTable;
+static int hashBits;
 
-void FreeAtom(NodePtr patom);
+#define AtomBarrier()	__sync_synchronize()
+#define HashSize()	(1UL << hashBits)
 
-Atom
-MakeAtom(const char *string, unsigned len, Bool makeit)
+static unsigned int
+HashAtom(const char *string, unsigned len)
 {
-    NodePtr * np;
-    unsigned i;
-    int comp;
-    unsigned int fp = 0;
+    unsigned int hash = 2166136261U;
 
-    np = &atomRoot;
-    for (i = 0; i < (len+1)/2; i++)
+    while (len--)
     {
-	fp = fp * 27 + string[i];
-	fp = fp * 27 + string[len - 1 - i];
+	hash ^= (unsigned char) *string++;
+	hash *= 16777619U;
     }
-    while (*np != NULL)
+    return hash;
+}
+
+static NodePtr *
+FindNode(const char *string, unsigned len, unsigned int hash)
+{
+    unsigned long mask = HashSize() - 1;
+    unsigned long i = hash & mask;
+    NodePtr nd;
+
+    while ((nd = hashTable[i]) != NULL)
     {
-	if (fp < (*np)->fingerPrint)
-	    np = &((*np)->left);
-	else if (fp > (*np)->fingerPrint)
-	    np = &((*np)->right);
-	else
-	{			       /* now start testing the strings */
-	    comp = strncmp(string, (*np)->string, (int)len);
-	    if ((comp < 0) || ((comp == 0) && (len < strlen((*np)->string))))
-		np = &((*np)->left);
-	    else if (comp > 0)
-		np = &((*np)->right);
-	    else
-		return(*np)->a;
-	    }
+	if (nd->hash == hash && nd->len == len &&
+	    memcmp(nd->string, string, len) == 0)
+	    break;
+	i = (i + 1) & mask;
     }
-    if (makeit)
+    return &hashTable[i];
+}
+
+/*
+ * Make room for count more atoms in both tables, so that interning them
+ * doesn't have to allocate anything but the nodes.
+ */
+static Bool
+ReserveAtoms(unsigned long count)
+{
+    unsigned long need = lastAtom + count + 1;
+
+    if (need >= tableLength)
     {
-	NodePtr nd;
+	unsigned long length = tableLength;
+	NodeTablePtr table;
 
-	nd = malloc(sizeof(NodeRec));
-	if (!nd)
-	    return BAD_RESOURCE;
-	if (lastAtom < XA_LAST_PREDEFINED)
-	{
-	    nd->string = string;
-	}
-	else
+	while (need >= length)
+	    length <<= 1;
+	table = malloc(sizeof(NodeTableRec) + (length - 1) * sizeof(NodePtr));
+	if (!table)
+	    return FALSE;
+	memcpy(table->nodes, nodeTable, (lastAtom + 1) * sizeof(NodePtr));
+	table->prev = nodeTables;
+	nodeTables = table;
+	AtomBarrier();
+	nodeTable = table->nodes;
+	tableLength = length;
+    }
+
+    /* keep the hash table at most half full */
+    if (need * 2 > HashSize())
+    {
+	NodePtr *old = hashTable;
+	unsigned long oldSize = HashSize();
+	int bits = hashBits;
+	unsigned long i;
+
+	while (need * 2 > (1UL << bits))
+	    bits++;
+	hashTable = calloc(1UL << bits, sizeof(NodePtr));
+	if (!hashTable)
 	{
-	    char *newstring = malloc(len + 1);
-	    if (!newstring) {
-		free(nd);
-		return BAD_RESOURCE;
-	    }
-	    strncpy(newstring, string, (int)len);
-	    newstring[len] = 0;
-	    nd->string = newstring;
-	}
-	if ((lastAtom + 1) >= tableLength) {
-	    NodePtr *table;
-
-	    table = realloc(nodeTable, tableLength * (2 * sizeof(NodePtr)));
-	    if (!table) {
-		if (nd->string != string) {
-                    /* nd->string has been strdup'ed */
-		    free((char *)nd->string);
-                }
-		free(nd);
-		return BAD_RESOURCE;
-	    }
-	    tableLength <<= 1;
-	    nodeTable = table;
+	    hashTable = old;
+	    return FALSE;
 	}
-	*np = nd;
-	nd->left = nd->right = NULL;
-	nd->fingerPrint = fp;
-	nd->a = ++lastAtom;
-	nodeTable[lastAtom] = nd;
-	return nd->a;
+	hashBits = bits;
+	for (i = 0; i < oldSize; i++)
+	    if (old[i])
+		*FindNode(old[i]->string, old[i]->len, old[i]->hash) = old[i];
+	free(old);
     }
-    else
+    return TRUE;
+}
+
+static Atom
+InternAtom(const char *string, unsigned len, Bool makeit)
+{
+    NodePtr *np;
+    NodePtr nd;
+    unsigned int hash = HashAtom(string, len);
+
+    np = FindNode(string, len, hash);
+    if (*np)
+	return (*np)->a;
+    if (!makeit)
 	return None;
+    if (!ReserveAtoms(1))
+	return BAD_RESOURCE;
+    /* growing the hash table moves everything */
+    np = FindNode(string, len, hash);
+
+    nd = malloc(sizeof(NodeRec));
+    if (!nd)
+	return BAD_RESOURCE;
+    if (lastAtom < XA_LAST_PREDEFINED)
+    {
+	nd->string = string;
+    }
+    else
+    {
+	char *newstring = malloc(len + 1);
+	if (!newstring) {
+	    free(nd);
+	    return BAD_RESOURCE;
+	}
+	memcpy(newstring, string, len);
+	newstring[len] = 0;
+	nd->string = newstring;
+    }
+    nd->hash = hash;
+    nd->len = len;
+    nd->a = lastAtom + 1;
+    *np = nd;
+    nodeTable[nd->a] = nd;
+    AtomBarrier();
+    lastAtom = nd->a;
+    return nd->a;
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    return InternAtom(string, len, makeit);
+}
+
+/*
+ * Intern count nul-terminated names at once, storing the atoms in the
+ * same order.  Both tables are sized for all of them up front.  Names
+ * that don't exist get None if makeit is FALSE.
+ */
+int
+InternAtoms(const char * const *names, int count, Bool makeit, Atom *atoms)
+{
+    int i;
+
+    if (makeit && !ReserveAtoms(count))
+	return BadAlloc;
+    for (i = 0; i < count; i++)
+    {
+	atoms[i] = InternAtom(names[i], strlen(names[i]), makeit);
+	if (atoms[i] == BAD_RESOURCE)
+	    return BadAlloc;
+    }
+    return Success;
 }
 
 Bool
@@ -164,6 +260,7 @@ NameForAtom(Atom atom)
 {
     NodePtr node;
     if (atom > lastAtom) return 0;
+    AtomBarrier();
     if ((node = nodeTable[atom]) == NULL) return 0;
     return node->string;
 }
@@ -174,32 +271,33 @@ AtomError(void)
     FatalError("initializing atoms");
 }
 
-void
-FreeAtom(NodePtr patom)
-{
-    if(patom->left)
-	FreeAtom(patom->left);
-    if(patom->right)
-	FreeAtom(patom->right);
-    if (patom->a > XA_LAST_PREDEFINED) {
-        /*
-         * All strings above XA_LAST_PREDEFINED are strdup'ed, so it's safe to
-         * cast here
-         */
-	free((char *)patom->string);
-    }
-    free(patom);
-}
-
 void
 FreeAllAtoms(void)
 {
-    if (atomRoot == NULL)
+    NodeTablePtr table;
+    Atom a;
+
+    if (nodeTable == NULL)
 	return;
-    FreeAtom(atomRoot);
-    atomRoot = NULL;
-    free(nodeTable);
+    for (a = None + 1; a <= lastAtom; a++)
+    {
+	if (a > XA_LAST_PREDEFINED) {
+	    /*
+	     * All strings above XA_LAST_PREDEFINED are strdup'ed, so it's safe to
+	     * cast here
+	     */
+	    free((char *)nodeTable[a]->string);
+	}
+	free(nodeTable[a]);
+    }
+    while ((table = nodeTables) != NULL)
+    {
+	nodeTables = table->prev;
+	free(table);
+    }
     nodeTable = NULL;
+    free(hashTable);
+    hashTable = NULL;
     lastAtom = None;
 }
 
@@ -208,9 +306,14 @@ InitAtoms(void)
 {
     FreeAllAtoms();
     tableLength = InitialTableSize;
-    nodeTable = malloc(InitialTableSize * sizeof(NodePtr));
-    if (!nodeTable)
+    nodeTables = malloc(sizeof(NodeTableRec) +
+			(InitialTableSize - 1) * sizeof(NodePtr));
+    hashBits = InitialHashBits;
+    hashTable = calloc(HashSize(), sizeof(NodePtr));
+    if (!nodeTables || !hashTable)
 	AtomError();
+    nodeTables->prev = NULL;
+    nodeTable = nodeTables->nodes;
     nodeTable[None] = NULL;
     MakePredeclaredAtoms();
     if (lastAtom != XA_LAST_PREDEFINED)
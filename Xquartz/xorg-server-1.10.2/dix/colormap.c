@@ -245,6 +245,20 @@ typedef struct _colorResource
  */
 
 
+/*
+ * The default colormap of a screen has its privates allocated separately,
+ * since it is created before all keys are registered.
+ */
+static void
+FreeColormapRec(ColormapPtr pmap)
+{
+    if (pmap->flags & IsDefault) {
+	dixFreePrivates(pmap->devPrivates, PRIVATE_COLORMAP);
+	free(pmap);
+    } else
+	dixFreeObjectWithPrivates(pmap, PRIVATE_COLORMAP);
+}
+
 /** 
  * Create and initialize the color map 
  * 
@@ -323,7 +337,7 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
 	ppix = malloc(size * sizeof(Pixel));
 	if (!ppix)
 	{
-	    free(pmap);
+	    FreeColormapRec(pmap);
 	    return BadAlloc;
 	}
 	pmap->clientPixelsRed[client] = ppix;
@@ -370,7 +384,7 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
 	    if (!ppix)
 	    {
 		free(pmap->clientPixelsRed[client]);
-		free(pmap);
+		FreeColormapRec(pmap);
 		return BadAlloc;
 	    }
 	    pmap->clientPixelsGreen[client] = ppix;
@@ -387,7 +401,7 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
 	    {
 		free(pmap->clientPixelsGreen[client]);
 		free(pmap->clientPixelsRed[client]);
-		free(pmap);
+		FreeColormapRec(pmap);
 		return BadAlloc;
 	    }
 	    pmap->clientPixelsBlue[client] = ppix;
@@ -477,11 +491,7 @@ FreeColormap (pointer value, XID mid)
         }
     }
 
-    if (pmap->flags & IsDefault) {
-	dixFreePrivates(pmap->devPrivates, PRIVATE_COLORMAP);
-	free(pmap);
-    } else
-	dixFreeObjectWithPrivates(pmap, PRIVATE_COLORMAP);
+    FreeColormapRec(pmap);
     return Success;
 }
 
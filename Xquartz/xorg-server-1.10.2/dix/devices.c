@@ -282,7 +282,7 @@ AddInputDevice(ClientPtr client, DeviceProc deviceProc, Bool autoStart)
     /*  security creation/labeling check
      */
     if (XaceHook(XACE_DEVICE_ACCESS, client, dev, DixCreateAccess)) {
-	free(dev);
+	dixFreeObjectWithPrivates(dev, PRIVATE_DEVICE);
 	return NULL;
     }
 
@@ -224,6 +224,24 @@ UpdateCurrentTimeIf(void)
 #define SMART_SCHEDULE_DEFAULT_INTERVAL	20	    /* ms */
 #define SMART_SCHEDULE_MAX_SLICE	200	    /* ms */
 
+/*
+ * Clients are run in order of virtual run time: the time they spent
+ * running requests, scaled down for clients with a high smart_priority
+ * and up for those with a low one.  The ready clients are kept in a heap
+ * on smart_vruntime, so picking the next one is O(1) and requeueing is
+ * O(log n).
+ *
+ * A client that becomes ready again after sleeping starts no further
+ * behind than SchedMinVruntime, so it can't bank run time while idle.
+ * Interactive clients (positive smart_priority, i.e. ones receiving
+ * input or marked critical by Composite) are placed SMART_WAKEUP_BONUS
+ * ahead of that and always get the short slice, which bounds their
+ * latency.  Bulk clients that keep using up their slice earn a longer one,
+ * up to SmartScheduleMaxSlice, as long as no interactive client is ready.
+ */
+#define SMART_WAKEUP_BONUS	(SmartScheduleInterval * 1000L)	    /* us */
+#define SMART_WEIGHT(prio)	(1024 + (prio) * 48)
+
 Bool SmartScheduleDisable = FALSE;
 long SmartScheduleSlice = SMART_SCHEDULE_DEFAULT_INTERVAL;
 long SmartScheduleInterval = SMART_SCHEDULE_DEFAULT_INTERVAL;
@@ -231,7 +249,10 @@ long SmartScheduleMaxSlice = SMART_SCHEDULE_MAX_SLICE;
 long SmartScheduleTime;
 int SmartScheduleLatencyLimited = 0;
 static ClientPtr   SmartLastClient;
-static int	   SmartLastIndex[SMART_MAX_PRIORITY-SMART_MIN_PRIORITY+1];
+static ClientPtr   *SchedHeap;
+static int	   SchedHeapSize;
+static unsigned long SchedRound;
+static CARD64	   SchedMinVruntime;
 
 #ifdef SMART_DEBUG
 long	    SmartLastPrint;
@@ -239,24 +260,106 @@ long	    SmartLastPrint;
 
 void        Dispatch(void);
 
+static void
+SchedHeapSet(int i, ClientPtr pClient)
+{
+    SchedHeap[i] = pClient;
+    pClient->smart_heap_index = i;
+}
+
+static void
+SchedHeapUp(int i)
+{
+    ClientPtr	pClient = SchedHeap[i];
+    int		parent;
+
+    while (i > 0)
+    {
+	parent = (i - 1) / 2;
+	if (SchedHeap[parent]->smart_vruntime <= pClient->smart_vruntime)
+	    break;
+	SchedHeapSet(i, SchedHeap[parent]);
+	i = parent;
+    }
+    SchedHeapSet(i, pClient);
+}
+
+static void
+SchedHeapDown(int i)
+{
+    ClientPtr	pClient = SchedHeap[i];
+    int		child;
+
+    while ((child = 2 * i + 1) < SchedHeapSize)
+    {
+	if (child + 1 < SchedHeapSize &&
+	    SchedHeap[child + 1]->smart_vruntime < SchedHeap[child]->smart_vruntime)
+	    child++;
+	if (pClient->smart_vruntime <= SchedHeap[child]->smart_vruntime)
+	    break;
+	SchedHeapSet(i, SchedHeap[child]);
+	i = child;
+    }
+    SchedHeapSet(i, pClient);
+}
+
+static void
+SchedHeapRemove(ClientPtr pClient)
+{
+    int		i = pClient->smart_heap_index;
+    ClientPtr	last;
+
+    if (i < 0)
+	return;
+    pClient->smart_heap_index = -1;
+    last = SchedHeap[--SchedHeapSize];
+    if (last == pClient)
+	return;
+    SchedHeapSet(i, last);
+    SchedHeapUp(i);
+    SchedHeapDown(last->smart_heap_index);
+}
+
+/*
+ * Put a client that was not ready in the previous round back in line.
+ */
+static void
+SchedWakeup(ClientPtr pClient, CARD64 now)
+{
+    CARD64	floor = SchedMinVruntime;
+
+    if (pClient->smart_priority > 0)
+	floor = floor > SMART_WAKEUP_BONUS ? floor - SMART_WAKEUP_BONUS : 0;
+    if (pClient->smart_vruntime < floor)
+	pClient->smart_vruntime = floor;
+    pClient->smart_ready_time = now;
+    if (pClient->smart_heap_index < 0)
+    {
+	SchedHeap[SchedHeapSize] = pClient;
+	SchedHeapUp(SchedHeapSize++);
+    }
+    else
+    {
+	SchedHeapUp(pClient->smart_heap_index);
+	SchedHeapDown(pClient->smart_heap_index);
+    }
+}
+
 static int
 SmartScheduleClient (int *clientReady, int nready)
 {
     ClientPtr	pClient;
     int		i;
-    int		client;
-    int		bestPrio, best = 0;
-    int		bestRobin, robin;
+    Bool	interactive = FALSE;
     long	now = SmartScheduleTime;
     long	idle;
+    CARD64	now_us = GetTimeInMicros();
 
-    bestPrio = -0x7fffffff;
-    bestRobin = 0;
+    SchedRound++;
     idle = 2 * SmartScheduleSlice;
     for (i = 0; i < nready; i++)
     {
-	client = clientReady[i];
-	pClient = clients[client];
+	pClient = clients[clientReady[i]];
 	/* Praise clients which are idle */
 	if ((now - pClient->smart_check_tick) >= idle)
 	{
@@ -264,30 +367,31 @@ SmartScheduleClient (int *clientReady, int nready)
 		pClient->smart_priority++;
 	}
 	pClient->smart_check_tick = now;
-	
-	/* check priority to select best client */
-	robin = (pClient->index - SmartLastIndex[pClient->smart_priority-SMART_MIN_PRIORITY]) & 0xff;
-	if (pClient->smart_priority > bestPrio ||
-	    (pClient->smart_priority == bestPrio && robin > bestRobin))
-	{
-	    bestPrio = pClient->smart_priority;
-	    bestRobin = robin;
-	    best = client;
-	}
-#ifdef SMART_DEBUG
-	if ((now - SmartLastPrint) >= 5000)
-	    fprintf (stderr, " %2d: %3d", client, pClient->smart_priority);
-#endif
-    }
+
+	if (pClient->smart_heap_index < 0 ||
+	    pClient->smart_round != SchedRound - 1)
+	    SchedWakeup(pClient, now_us);
+	pClient->smart_round = SchedRound;
+	if (pClient->smart_priority > 0)
+	    interactive = TRUE;
+    }
+    /* Clients without input are dropped once they reach the top */
+    while (SchedHeap[0]->smart_round != SchedRound)
+	SchedHeapRemove(SchedHeap[0]);
+    pClient = SchedHeap[0];
 #ifdef SMART_DEBUG
     if ((now - SmartLastPrint) >= 5000)
     {
-	fprintf (stderr, " use %2d\n", best);
+	for (i = 0; i < SchedHeapSize; i++)
+	    fprintf (stderr, " %2d: %3d %8lu", SchedHeap[i]->index,
+		     SchedHeap[i]->smart_priority,
+		     (unsigned long) SchedHeap[i]->smart_vruntime);
+	fprintf (stderr, " use %2d\n", pClient->index);
 	SmartLastPrint = now;
     }
 #endif
-    pClient = clients[best];
-    SmartLastIndex[bestPrio-SMART_MIN_PRIORITY] = pClient->index;
+    pClient->smart_wait += now_us - pClient->smart_ready_time;
+    pClient->smart_runs++;
     /*
      * Set current client pointer
      */
@@ -299,24 +403,40 @@ SmartScheduleClient (int *clientReady, int nready)
     /*
      * Adjust slice
      */
-    if (nready == 1 && SmartScheduleLatencyLimited == 0)
-    {
-	/*
-	 * If it's been a long time since another client
-	 * has run, bump the slice up to get maximal
-	 * performance from a single client
-	 */
-	if ((now - pClient->smart_start_tick) > 1000 &&
-	    SmartScheduleSlice < SmartScheduleMaxSlice)
-	{
-	    SmartScheduleSlice += SmartScheduleInterval;
-	}
-    }
+    if (interactive || SmartScheduleLatencyLimited)
+	SmartScheduleSlice = SmartScheduleInterval;
     else
+	SmartScheduleSlice = max(pClient->smart_slice, SmartScheduleInterval);
+    return pClient->index;
+}
+
+/*
+ * Charge a client for the time it just ran and requeue it.
+ */
+static void
+SmartScheduleCharge(ClientPtr pClient, CARD64 start, Bool preempted)
+{
+    CARD64	now = GetTimeInMicros();
+    CARD64	ran = now - start;
+
+    pClient->smart_cpu += ran;
+    if (SmartScheduleDisable)
+	return;
+    pClient->smart_vruntime += ran * SMART_WEIGHT(0) /
+			       SMART_WEIGHT(pClient->smart_priority);
+    pClient->smart_ready_time = now;
+    if (preempted)
     {
-	SmartScheduleSlice = SmartScheduleInterval;
+	pClient->smart_preempts++;
+	if (pClient->smart_slice < SmartScheduleMaxSlice)
+	    pClient->smart_slice += SmartScheduleInterval;
     }
-    return best;
+    else
+	pClient->smart_slice = SmartScheduleInterval;
+    if (pClient->smart_heap_index >= 0)
+	SchedHeapDown(pClient->smart_heap_index);
+    if (SchedHeapSize && SchedHeap[0]->smart_vruntime > SchedMinVruntime)
+	SchedMinVruntime = SchedHeap[0]->smart_vruntime;
 }
 
 void
@@ -338,6 +458,13 @@ DisableLimitedSchedulingLatency(void)
 
 #define MAJOROP ((xReq *)client->requestBuffer)->reqType
 
+/*
+ * Requests already complete in a client's input buffer are run back to
+ * back, up to DISPATCH_BATCH of them, before input, critical output and
+ * the time slice are looked at again.
+ */
+#define DISPATCH_BATCH 64
+
 void
 Dispatch(void)
 {
@@ -347,6 +474,10 @@ Dispatch(void)
     int	nready;
     HWEventQueuePtr* icheck = checkForInput;
     long			start_tick;
+    int		batch;
+    Bool	hooked = FALSE;
+    Bool	preempted;
+    CARD64	start_time;
 
     nextFreeClientID = 1;
     nClients = 0;
@@ -354,6 +485,13 @@ Dispatch(void)
     clientReady = malloc(sizeof(int) * MaxClients);
     if (!clientReady)
 	return;
+    SchedHeap = malloc(sizeof(ClientPtr) * MaxClients);
+    if (!SchedHeap)
+    {
+	free(clientReady);
+	return;
+    }
+    SchedHeapSize = 0;
 
     SmartScheduleSlice = SmartScheduleInterval;
     while (!dispatchException)
@@ -393,19 +531,29 @@ Dispatch(void)
 	    isItTimeToYield = FALSE;
  
 	    start_tick = SmartScheduleTime;
+	    start_time = GetTimeInMicros();
+	    preempted = FALSE;
+	    batch = 0;
 	    while (!isItTimeToYield)
 	    {
-	        if (*icheck[0] != *icheck[1])
-		    ProcessInputEvents();
-		
-		FlushIfCriticalOutputPending();
-		if (!SmartScheduleDisable && 
-		    (SmartScheduleTime - start_tick) >= SmartScheduleSlice)
+		if (!batch)
 		{
-		    /* Penalize clients which consume ticks */
-		    if (client->smart_priority > SMART_MIN_PRIORITY)
-			client->smart_priority--;
-		    break;
+		    if (*icheck[0] != *icheck[1])
+			ProcessInputEvents();
+
+		    FlushIfCriticalOutputPending();
+		    if (!SmartScheduleDisable && 
+			(SmartScheduleTime - start_tick) >= SmartScheduleSlice)
+		    {
+			/* Penalize clients which consume ticks */
+			if (client->smart_priority > SMART_MIN_PRIORITY)
+			    client->smart_priority--;
+			preempted = TRUE;
+			break;
+		    }
+		    /* security hooks get the checks between every request */
+		    hooked = XaceDispatchHooked();
+		    batch = hooked ? 1 : DISPATCH_BATCH;
 		}
 		/* now, finally, deal with client requests */
 
@@ -425,12 +573,14 @@ Dispatch(void)
 #endif
 		if (result > (maxBigRequestSize << 2))
 		    result = BadLength;
-		else {
+		else if (hooked) {
 		    result = XaceHookDispatch(client, MAJOROP);
 		    if (result == Success)
 			result = (* client->requestVector[MAJOROP])(client);
 		    XaceHookAuditEnd(client, result);
 		}
+		else
+		    result = (* client->requestVector[MAJOROP])(client);
 #ifdef XSERVER_DTRACE
 		XSERVER_REQUEST_DONE(LookupMajorName(MAJOROP), MAJOROP,
 			      client->sequence, client->index, result);
@@ -448,11 +598,17 @@ Dispatch(void)
 				      client->errorValue, result);
 		    break;
 		}
+		/* end the batch once the buffered requests run out */
+		if (--batch && !ClientHasQueuedRequest(client))
+		    batch = 0;
 	    }
 	    FlushAllOutput();
 	    client = clients[clientReady[nready]];
 	    if (client)
+	    {
 		client->smart_stop_tick = SmartScheduleTime;
+		SmartScheduleCharge(client, start_time, preempted);
+	    }
 	}
 	dispatchException &= ~DE_PRIORITYCHANGE;
     }
@@ -461,6 +617,10 @@ Dispatch(void)
 #endif
     KillAllClients();
     free(clientReady);
+    free(SchedHeap);
+    SchedHeap = NULL;
+    SchedHeapSize = 0;
+    SmartLastClient = NULL;
     dispatchException &= ~DE_RESET;
     SmartScheduleLatencyLimited = 0;
 }
@@ -1990,6 +2150,33 @@ ProcPutImage(ClientPtr client)
      return Success;
 }
 
+static void
+FreeImageStrip(pointer data, pointer closure)
+{
+    free(data);
+}
+
+/*
+ * Hand a finished GetImage strip over to the client without copying it,
+ * and return a buffer of size bytes for the next strip, or NULL if
+ * nothing remains.  If no new buffer can be had the strip is copied out
+ * and its buffer reused.
+ */
+static char *
+WriteImageStrip(ClientPtr client, char *pBuf, int count,
+		long size, long remaining)
+{
+    char *pNext = NULL;
+
+    if (remaining > 0 && !(pNext = calloc(1, size)))
+    {
+	(void)WriteToClient(client, count, pBuf);
+	return pBuf;
+    }
+    (void)WriteToClientNoCopy(client, count, pBuf, FreeImageStrip, NULL);
+    return pNext;
+}
+
 static int
 DoGetImage(ClientPtr client, int format, Drawable drawable, 
            int x, int y, int width, int height, 
@@ -2000,7 +2187,7 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     int			linesDone;
     /* coordinates relative to the bounding drawable */
     int			relx, rely;
-    long		widthBytesLine, length;
+    long		widthBytesLine, length, remaining = 0;
     Mask		plane = 0;
     char		*pBuf;
     xGetImageReply	xgi;
@@ -2103,6 +2290,7 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 	pBuf += sz_xGetImageReply;
     } else {
 	xgi.length = bytes_to_int32(xgi.length);
+	remaining = length;
 	if (widthBytesLine == 0 || height == 0)
 	    linesPerBuf = 0;
 	else if (widthBytesLine >= IMAGE_BUFSIZE)
@@ -2174,10 +2362,10 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 			       BitsPerPixel (pDraw->depth),
 			       ClientOrder(client));
 
-/* Don't split me, gcc pukes when you do */
-		(void)WriteToClient(client,
-				    (int)(nlines * widthBytesLine),
-				    pBuf);
+		remaining -= nlines * widthBytesLine;
+		pBuf = WriteImageStrip(client, pBuf,
+				       (int)(nlines * widthBytesLine),
+				       length, remaining);
 	    }
 	    linesDone += nlines;
         }
@@ -2216,10 +2404,10 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 				       1,
 				       ClientOrder (client));
 
-/* Don't split me, gcc pukes when you do */
-			(void)WriteToClient(client,
-					(int)(nlines * widthBytesLine),
-					pBuf);
+			remaining -= nlines * widthBytesLine;
+			pBuf = WriteImageStrip(client, pBuf,
+					       (int)(nlines * widthBytesLine),
+					       length, remaining);
 		    }
 		    linesDone += nlines;
 		}
@@ -3430,6 +3618,9 @@ CloseDownClient(ClientPtr client)
 	    ClientSignal (client);
 	ProcessWorkQueueZombies();
 	CloseDownConnection(client);
+	SchedHeapRemove(client);
+	if (SmartLastClient == client)
+	    SmartLastClient = NULL;
 
 	/* If the client made it to the Running stage, nClients has
 	 * been incremented on its behalf, so we need to decrement it
@@ -3496,6 +3687,9 @@ void InitClient(ClientPtr client, int i, pointer ospriv)
     client->smart_start_tick = SmartScheduleTime;
     client->smart_stop_tick = SmartScheduleTime;
     client->smart_check_tick = SmartScheduleTime;
+    client->smart_slice = SmartScheduleInterval;
+    client->smart_heap_index = -1;
+    client->smart_vruntime = SchedMinVruntime;
 }
 
 /************************
@@ -257,6 +257,15 @@ EventSyncInfoRec syncEvents;
 static xEvent* swapEvent = NULL;
 static int swapEventLen = 0;
 
+/**
+ * Set by -coalesce: events for a client that is not reading its output are
+ * merged into the last one queued where the protocol allows it, see
+ * WriteEventsToClient.
+ */
+Bool CoalesceBlockedEvents = FALSE;
+
+EventCoalescePtr EventCoalesceVector[128];
+
 void
 NotImplemented(xEvent *from, xEvent *to)
 {
@@ -1931,6 +1940,199 @@ TryClientEvents (ClientPtr client, DeviceIntPtr dev, xEvent *pEvents,
     return 1;
 }
 
+/**
+ * Windows with at least this many other clients get an index of their
+ * selections: for each event mask bit, a bitmap of the clients (in list
+ * order) that selected it.  Delivery then only visits the clients that
+ * want the event instead of walking the whole list.  The index is built on
+ * first delivery and thrown away whenever the list or a mask changes.
+ */
+#define EVENT_INDEX_MIN_CLIENTS	8
+#define EVENT_INDEX_BITS	25	/* bits in AllEventMasks */
+
+typedef struct _EventIndex {
+    int			numClients;
+    int			numWords;
+    OtherClientsPtr	*clients;
+    CARD32		*selected;	/* EVENT_INDEX_BITS bitmaps */
+} EventIndexRec, *EventIndexPtr;
+
+static void
+FreeEventIndex(WindowPtr pWin)
+{
+    if (pWin->optional && pWin->optional->eventIndex)
+    {
+	free(pWin->optional->eventIndex);
+	pWin->optional->eventIndex = NULL;
+    }
+}
+
+static EventIndexPtr
+GetEventIndex(WindowPtr pWin)
+{
+    EventIndexPtr pIndex;
+    OtherClientsPtr other;
+    Mask mask;
+    int n, words, i;
+
+    if (!pWin->optional)
+	return NULL;
+    if (pWin->optional->eventIndex)
+	return pWin->optional->eventIndex;
+
+    n = 0;
+    for (other = wOtherClients(pWin); other; other = other->next)
+	n++;
+    if (n < EVENT_INDEX_MIN_CLIENTS)
+	return NULL;
+
+    words = (n + 31) / 32;
+    pIndex = calloc(1, sizeof(EventIndexRec) + n * sizeof(OtherClientsPtr) +
+		       EVENT_INDEX_BITS * words * sizeof(CARD32));
+    if (!pIndex)
+	return NULL;
+    pIndex->numClients = n;
+    pIndex->numWords = words;
+    pIndex->clients = (OtherClientsPtr *)(pIndex + 1);
+    pIndex->selected = (CARD32 *)(pIndex->clients + n);
+
+    for (i = 0, other = wOtherClients(pWin); other; i++, other = other->next)
+    {
+	pIndex->clients[i] = other;
+	for (mask = other->mask & AllEventMasks; mask; mask &= mask - 1)
+	    pIndex->selected[(ffs(mask) - 1) * words + i / 32] |=
+		(CARD32)1 << (i % 32);
+    }
+    pWin->optional->eventIndex = pIndex;
+    return pIndex;
+}
+
+/**
+ * Return the first client at or after position *pos in the index that
+ * selected any of the events in filter and move *pos past it, or NULL if
+ * there is none.
+ */
+static OtherClientsPtr
+NextSelectingClient(EventIndexPtr pIndex, Mask filter, int *pos)
+{
+    int word = *pos / 32;
+    CARD32 set, skip = ~(CARD32)0 << (*pos % 32);
+    Mask bits;
+
+    for (; word < pIndex->numWords; word++, skip = ~(CARD32)0)
+    {
+	set = 0;
+	for (bits = filter & AllEventMasks; bits; bits &= bits - 1)
+	    set |= pIndex->selected[(ffs(bits) - 1) * pIndex->numWords + word];
+	set &= skip;
+	if (set)
+	{
+	    *pos = word * 32 + ffs(set) - 1;
+	    return pIndex->clients[(*pos)++];
+	}
+    }
+    *pos = pIndex->numClients;
+    return NULL;
+}
+
+/*
+ * Merging events for write-blocked clients.  Only the last event queued
+ * can be merged into, so anything the client got in between keeps both
+ * events, and events sent with SendEvent (type with the high bit set) are
+ * never merged.
+ */
+
+/* Later motion in the same window and state replaces the earlier one. */
+static Bool
+CoalesceMotion(xEvent *queued, xEvent *event)
+{
+    if (queued->u.u.detail != event->u.u.detail ||
+        queued->u.keyButtonPointer.root != event->u.keyButtonPointer.root ||
+        queued->u.keyButtonPointer.event != event->u.keyButtonPointer.event ||
+        queued->u.keyButtonPointer.child != event->u.keyButtonPointer.child ||
+        queued->u.keyButtonPointer.state != event->u.keyButtonPointer.state ||
+        queued->u.keyButtonPointer.sameScreen !=
+            event->u.keyButtonPointer.sameScreen)
+        return FALSE;
+    *queued = *event;
+    return TRUE;
+}
+
+/*
+ * An Expose ending its series takes in the first rectangle of the next
+ * series for the window.  Events already queued before it said at least
+ * so many more follow, which stays true; merging within a series would
+ * not.
+ */
+static Bool
+CoalesceExpose(xEvent *queued, xEvent *event)
+{
+    int x1, y1, x2, y2;
+
+    if (queued->u.expose.window != event->u.expose.window ||
+        queued->u.expose.count != 0)
+        return FALSE;
+    x1 = min(queued->u.expose.x, event->u.expose.x);
+    y1 = min(queued->u.expose.y, event->u.expose.y);
+    x2 = max(queued->u.expose.x + queued->u.expose.width,
+             event->u.expose.x + event->u.expose.width);
+    y2 = max(queued->u.expose.y + queued->u.expose.height,
+             event->u.expose.y + event->u.expose.height);
+    if (x2 - x1 > 0xffff || y2 - y1 > 0xffff)
+        return FALSE;
+    queued->u.u.sequenceNumber = event->u.u.sequenceNumber;
+    queued->u.expose.x = x1;
+    queued->u.expose.y = y1;
+    queued->u.expose.width = x2 - x1;
+    queued->u.expose.height = y2 - y1;
+    queued->u.expose.count = event->u.expose.count;
+    return TRUE;
+}
+
+/* The latest configuration of a window is the one that counts. */
+static Bool
+CoalesceConfigure(xEvent *queued, xEvent *event)
+{
+    if (queued->u.configureNotify.event != event->u.configureNotify.event ||
+        queued->u.configureNotify.window != event->u.configureNotify.window)
+        return FALSE;
+    *queued = *event;
+    return TRUE;
+}
+
+/**
+ * Try to merge an event into the last one queued for a client that isn't
+ * reading its output, and count it if that worked.
+ *
+ * @return TRUE if the event was merged and must not be written.
+ */
+static Bool
+CoalesceQueuedEvent(ClientPtr pClient, xEvent *event)
+{
+    xEvent *queued = LastQueuedEvent(pClient);
+    int type = event->u.u.type;
+
+    if (!queued || queued->u.u.type != type ||
+        !(*EventCoalesceVector[type]) (queued, event))
+        return FALSE;
+
+    switch (type) {
+    case MotionNotify:
+        pClient->coalesced_motion++;
+        break;
+    case Expose:
+        pClient->coalesced_expose++;
+        break;
+    case ConfigureNotify:
+        pClient->coalesced_configure++;
+        break;
+    default:
+        pClient->coalesced_other++;
+        break;
+    }
+    return TRUE;
+}
+
 /**
  * Deliver events to a window. At this point, we do not yet know if the event
  * actually needs to be delivered. May activate a grab if the event is a
@@ -1957,7 +2159,9 @@ DeliverEventsToWindow(DeviceIntPtr pDev, WindowPtr pWin, xEvent
 {
     int deliveries = 0, nondeliveries = 0;
     int attempt;
-    InputClients *other;
+    InputClients *other, *next;
+    EventIndexPtr pIndex = NULL;
+    int pos = 0;
     ClientPtr client = NullClient;
     Mask deliveryMask = 0; /* If a grab occurs due to a button press, then
 		              this mask is the mask of the grab. */
@@ -1995,7 +2199,12 @@ DeliverEventsToWindow(DeviceIntPtr pDev, WindowPtr pWin, xEvent
     if (filter != CantBeFiltered)
     {
         if (CORE_EVENT(pEvents))
+        {
             other = (InputClients *)wOtherClients(pWin);
+            if (other && (pIndex = GetEventIndex(pWin)))
+                other = (InputClients *)NextSelectingClient(pIndex, filter,
+                                                            &pos);
+        }
         else if (XI2_EVENT(pEvents))
         {
             OtherInputMasks *inputMasks = wOtherInputMasks(pWin);
@@ -2013,9 +2222,16 @@ DeliverEventsToWindow(DeviceIntPtr pDev, WindowPtr pWin, xEvent
             other = inputMasks->inputClients;
         }
 
-        for (; other; other = other->next)
+        for (; other; other = next)
         {
             Mask mask;
+
+            if (pIndex)
+                next = (InputClients *)NextSelectingClient(pIndex, filter,
+                                                           &pos);
+            else
+                next = other->next;
+
             if (IsInterferingGrab(rClient(other), pDev, pEvents))
                 continue;
 
@@ -2544,52 +2760,55 @@ PointInBorderSize(WindowPtr pWin, int x, int y)
  *
  * @returns the window at the given coordinates.
  */
-WindowPtr
-XYToWindow(SpritePtr pSprite, int x, int y)
+static Bool
+PointInWindow(WindowPtr pWin, int x, int y)
 {
-    WindowPtr  pWin;
     BoxRec		box;
 
-    pSprite->spriteTraceGood = 1;	/* root window still there */
-    pWin = RootWindow(pSprite)->firstChild;
-    while (pWin)
-    {
-	if ((pWin->mapped) &&
-	    (x >= pWin->drawable.x - wBorderWidth (pWin)) &&
-	    (x < pWin->drawable.x + (int)pWin->drawable.width +
-	     wBorderWidth(pWin)) &&
-	    (y >= pWin->drawable.y - wBorderWidth (pWin)) &&
-	    (y < pWin->drawable.y + (int)pWin->drawable.height +
-	     wBorderWidth (pWin))
-	    /* When a window is shaped, a further check
-	     * is made to see if the point is inside
-	     * borderSize
-	     */
-	    && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
-	    && (!wInputShape(pWin) ||
-		RegionContainsPoint(wInputShape(pWin),
-				    x - pWin->drawable.x,
-				    y - pWin->drawable.y, &box))
+    return (x >= pWin->drawable.x - wBorderWidth (pWin)) &&
+	   (x < pWin->drawable.x + (int)pWin->drawable.width +
+	    wBorderWidth(pWin)) &&
+	   (y >= pWin->drawable.y - wBorderWidth (pWin)) &&
+	   (y < pWin->drawable.y + (int)pWin->drawable.height +
+	    wBorderWidth (pWin))
+	   /* When a window is shaped, a further check
+	    * is made to see if the point is inside
+	    * borderSize
+	    */
+	   && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
+	   && (!wInputShape(pWin) ||
+	       RegionContainsPoint(wInputShape(pWin),
+				   x - pWin->drawable.x,
+				   y - pWin->drawable.y, &box))
 #ifdef ROOTLESS
     /* In rootless mode windows may be offscreen, even when
      * they're in X's stack. (E.g. if the native window system
      * implements some form of virtual desktop system).
      */
-		&& !pWin->rootlessUnhittable
+	   && !pWin->rootlessUnhittable
 #endif
-	    )
+	   ;
+}
+
+WindowPtr
+XYToWindow(SpritePtr pSprite, int x, int y)
+{
+    WindowPtr  pWin, *trace;
+
+    pSprite->spriteTraceGood = 1;	/* root window still there */
+    pWin = RootWindow(pSprite);
+    while ((pWin = ChildAtPoint(pWin, x, y, PointInWindow)))
+    {
+	if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize)
 	{
-	    if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize)
-	    {
-		pSprite->spriteTraceSize += 10;
-		pSprite->spriteTrace = realloc(pSprite->spriteTrace,
-		                    pSprite->spriteTraceSize*sizeof(WindowPtr));
-	    }
-	    pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
-	    pWin = pWin->firstChild;
+	    trace = realloc(pSprite->spriteTrace,
+			    2 * pSprite->spriteTraceSize * sizeof(WindowPtr));
+	    if (!trace)
+		break;
+	    pSprite->spriteTrace = trace;
+	    pSprite->spriteTraceSize *= 2;
 	}
-	else
-	    pWin = pWin->nextSib;
+	pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
     }
     return pSprite->spriteTrace[pSprite->spriteTraceGood-1];
 }
@@ -3943,6 +4162,7 @@ RecalculateDeliverableEvents(WindowPtr pWin)
     OtherClients *others;
     WindowPtr pChild;
 
+    FreeEventIndex(pWin);
     pChild = pWin;
     while (1)
     {
@@ -3988,6 +4208,7 @@ OtherClientGone(pointer value, XID id)
     {
 	if (other->resource == id)
 	{
+	    FreeEventIndex(pWin);
 	    if (prev)
 		prev->next = other->next;
 	    else
@@ -4967,6 +5188,13 @@ InitEvents(void)
 	DontPropagateRefCnts[i] = 0;
     }
 
+    /* extensions set theirs again, possibly at other event bases */
+    for (i = 0; i < 128; i++)
+	EventCoalesceVector[i] = NULL;
+    EventCoalesceVector[MotionNotify] = CoalesceMotion;
+    EventCoalesceVector[Expose] = CoalesceExpose;
+    EventCoalesceVector[ConfigureNotify] = CoalesceConfigure;
+
     InputEventListLen = GetMaximumEventsNum();
     InputEventList = InitEventList(InputEventListLen);
     if (!InputEventList)
@@ -5638,6 +5866,11 @@ WriteEventsToClient(ClientPtr pClient, int count, xEvent *events)
         eventlength += ((xGenericEvent*)events)->length * 4;
     }
 
+    if (CoalesceBlockedEvents && count == 1 && !pClient->swapped &&
+        !(events->u.u.type & 0x80) && EventCoalesceVector[events->u.u.type] &&
+        CoalesceQueuedEvent(pClient, events))
+        return;
+
     if(pClient->swapped)
     {
         if (eventlength > swapEventLen)
@@ -5670,6 +5903,9 @@ WriteEventsToClient(ClientPtr pClient, int count, xEvent *events)
          * eventlength is arbitrary or eventlength is 32 and count doesn't
          * matter. And we're all set. Woohoo. */
 	WriteToClient(pClient, count * eventlength, (char *) events);
+	if (CoalesceBlockedEvents && count == 1 &&
+	    eventlength == sizeof(xEvent))
+	    MarkQueuedEvent(pClient);
     }
 }
 
@@ -73,6 +73,60 @@ static Bool CreateDefaultTile(GCPtr pGC);
 
 static unsigned char DefaultDash[2] = {4, 4};
 
+/*
+ * Freed GCs are kept for the next CreateGC, up to GC_POOL_SIZE of them.
+ * Their privates are finished when they go into the pool, so they don't
+ * count as existing objects, and the pool is dropped whenever the size of
+ * the GC privates changes.
+ */
+#define GC_POOL_SIZE	64
+#define GC_PRIVATES_OFFSET \
+    ((sizeof(GC) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static GCPtr gcPool[GC_POOL_SIZE];
+static unsigned gcPoolPrivatesSize;
+
+GCPoolStatsRec GCPoolStats;
+
+static void
+DrainGCPool(void)
+{
+    while (GCPoolStats.pooled)
+	dixSlabFree(gcPool[--GCPoolStats.pooled]);
+}
+
+static GCPtr
+AllocateGC(void)
+{
+    GCPtr pGC;
+
+    if (GCPoolStats.pooled && gcPoolPrivatesSize != dixPrivatesSize(PRIVATE_GC))
+	DrainGCPool();
+    if (!GCPoolStats.pooled)
+    {
+	GCPoolStats.misses++;
+	return dixAllocateObjectWithPrivates(GC, PRIVATE_GC);
+    }
+    GCPoolStats.hits++;
+    pGC = gcPool[--GCPoolStats.pooled];
+    memset(pGC, 0, sizeof(GC));
+    dixInitPrivates(pGC, (char *)pGC + GC_PRIVATES_OFFSET, PRIVATE_GC);
+    return pGC;
+}
+
+static void
+ReleaseGC(GCPtr pGC)
+{
+    if (GCPoolStats.pooled == GC_POOL_SIZE)
+    {
+	dixFreeObjectWithPrivates(pGC, PRIVATE_GC);
+	return;
+    }
+    dixFiniPrivates(pGC, PRIVATE_GC);
+    gcPoolPrivatesSize = dixPrivatesSize(PRIVATE_GC);
+    gcPool[GCPoolStats.pooled++] = pGC;
+}
+
 void
 ValidateGC(DrawablePtr pDraw, GC *pGC)
 {
@@ -479,7 +533,7 @@ CreateGC(DrawablePtr pDrawable, BITS32 mask, XID *pval, int *pStatus,
 {
     GCPtr pGC;
 
-    pGC = dixAllocateObjectWithPrivates(GC, PRIVATE_GC);
+    pGC = AllocateGC();
     if (!pGC)
     {
 	*pStatus = BadAlloc;
@@ -782,7 +836,7 @@ FreeGC(pointer value, XID gid)
     (*pGC->funcs->DestroyGC) (pGC);
     if (pGC->dash != DefaultDash)
 	free(pGC->dash);
-    dixFreeObjectWithPrivates(pGC, PRIVATE_GC);
+    ReleaseGC(pGC);
     return Success;
 }
 
@@ -804,7 +858,7 @@ CreateScratchGC(ScreenPtr pScreen, unsigned depth)
 {
     GCPtr pGC;
 
-    pGC = dixAllocateObjectWithPrivates(GC, PRIVATE_GC);
+    pGC = AllocateGC();
     if (!pGC)
 	return (GCPtr)NULL;
 
@@ -299,6 +299,7 @@ int main(int argc, char *argv[], char *envp[])
 	if (screenIsSaved == SCREEN_SAVER_ON)
 	    dixSaveScreens(serverClient, SCREEN_SAVER_OFF, ScreenSaverReset);
 	FreeScreenSaverTimer();
+	ResetOsBuffers();
 	CloseDownExtensions();
 
 #ifdef PANORAMIX
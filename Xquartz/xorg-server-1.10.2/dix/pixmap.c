@@ -109,6 +109,8 @@ FreeScratchPixmapsForScreen(int scrnum)
 }
 
 
+PixmapCacheStatsRec PixmapCacheStats;
+
 /* callable by ddx */
 PixmapPtr
 AllocatePixmap(ScreenPtr pScreen, int pixDataSize)
@@ -120,7 +122,8 @@ AllocatePixmap(ScreenPtr pScreen, int pixDataSize)
     if (pScreen->totalPixmapSize > ((size_t)-1) - pixDataSize)
 	return NullPixmap;
     
-    pPixmap = malloc(pScreen->totalPixmapSize + pixDataSize);
+    pPixmap = dixSlabAlloc(PRIVATE_PIXMAP,
+			   pScreen->totalPixmapSize + pixDataSize);
     if (!pPixmap)
 	return NullPixmap;
 
@@ -133,5 +136,5 @@ void
 FreePixmap(PixmapPtr pPixmap)
 {
     dixFiniPrivates(pPixmap, PRIVATE_PIXMAP);
-    free(pPixmap);
+    dixSlabFree(pPixmap);
 }
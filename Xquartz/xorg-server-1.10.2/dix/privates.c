@@ -86,6 +86,159 @@ static const Bool xselinux_private[PRIVATE_LAST] = {
     [PRIVATE_GLYPHSET] = TRUE,
 };
 
+/*
+ * Objects with privates are carved out of slabs, one set of slabs per
+ * DevPrivateType and size class, so creating and destroying them doesn't
+ * go to malloc.  Each object is preceded by a pointer to its slab; free
+ * objects are kept on their slab's free list.  A slab that becomes empty
+ * is released unless it is the last one of its class with room.  Objects
+ * larger than the largest class are malloc'd with a NULL slab pointer.
+ */
+#define SLAB_CLASS_SHIFT	5	/* classes are multiples of 32 bytes */
+#define SLAB_NUM_CLASSES	64	/* up to 2048 bytes */
+#define SLAB_BYTES		16384
+#define SLAB_MIN_OBJECTS	8
+#define SLAB_HEADER		(2 * sizeof (void *))	/* keeps malloc alignment */
+
+typedef struct _PrivateSlab *PrivateSlabPtr;
+
+typedef struct _PrivateSlabClass {
+    PrivateSlabPtr	partial;	/* slabs with free objects */
+    int			slabs;
+    int			objects;	/* in all slabs */
+    int			used;
+} PrivateSlabClassRec, *PrivateSlabClassPtr;
+
+typedef struct _PrivateSlab {
+    PrivateSlabPtr	next, prev;	/* on the class's partial list */
+    PrivateSlabClassPtr	class;
+    void		*free;		/* free objects, linked through their
+					   first word */
+    int			used;
+    int			count;
+    char		*base;		/* first object slot */
+} PrivateSlabRec;
+
+static PrivateSlabClassRec slabClasses[PRIVATE_LAST][SLAB_NUM_CLASSES];
+
+static void
+SlabUnlinkPartial(PrivateSlabPtr slab)
+{
+    if (slab->prev)
+	slab->prev->next = slab->next;
+    else
+	slab->class->partial = slab->next;
+    if (slab->next)
+	slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+static void
+SlabLinkPartial(PrivateSlabPtr slab)
+{
+    slab->prev = NULL;
+    slab->next = slab->class->partial;
+    if (slab->next)
+	slab->next->prev = slab;
+    slab->class->partial = slab;
+}
+
+static PrivateSlabPtr
+SlabCreate(PrivateSlabClassPtr class, unsigned slotSize)
+{
+    PrivateSlabPtr	slab;
+    unsigned		headSize, i, count;
+    char		*slot;
+
+    headSize = (sizeof (PrivateSlabRec) + SLAB_HEADER - 1) & ~(SLAB_HEADER - 1);
+    count = (SLAB_BYTES - headSize) / slotSize;
+    if (count < SLAB_MIN_OBJECTS)
+	count = SLAB_MIN_OBJECTS;
+    slab = malloc(headSize + count * slotSize);
+    if (!slab)
+	return NULL;
+    slab->class = class;
+    slab->used = 0;
+    slab->count = count;
+    slab->base = (char *) slab + headSize;
+    slab->free = NULL;
+    for (i = count; i-- > 0; ) {
+	slot = slab->base + i * slotSize;
+	*(PrivateSlabPtr *) slot = slab;
+	*(void **) (slot + SLAB_HEADER) = slab->free;
+	slab->free = slot + SLAB_HEADER;
+    }
+    class->slabs++;
+    class->objects += count;
+    SlabLinkPartial(slab);
+    return slab;
+}
+
+/*
+ * Allocate size bytes for an object of the given type.  The memory is not
+ * cleared and must be released with dixSlabFree.
+ */
+void *
+dixSlabAlloc(DevPrivateType type, unsigned size)
+{
+    PrivateSlabClassPtr	class;
+    PrivateSlabPtr	slab;
+    unsigned		c;
+    void		*object;
+    char		*slot;
+
+    if (size > (SLAB_NUM_CLASSES << SLAB_CLASS_SHIFT) - SLAB_HEADER) {
+	if (size > ((unsigned) -1) - SLAB_HEADER)
+	    return NULL;
+	slot = malloc(SLAB_HEADER + size);
+	if (!slot)
+	    return NULL;
+	*(PrivateSlabPtr *) slot = NULL;
+	return slot + SLAB_HEADER;
+    }
+
+    c = (size + SLAB_HEADER + (1 << SLAB_CLASS_SHIFT) - 1) >> SLAB_CLASS_SHIFT;
+    class = &slabClasses[type][c - 1];
+    slab = class->partial;
+    if (!slab && !(slab = SlabCreate(class, c << SLAB_CLASS_SHIFT)))
+	return NULL;
+    object = slab->free;
+    slab->free = *(void **) object;
+    if (!slab->free)
+	SlabUnlinkPartial(slab);
+    slab->used++;
+    class->used++;
+    return object;
+}
+
+void
+dixSlabFree(void *object)
+{
+    PrivateSlabClassPtr	class;
+    PrivateSlabPtr	slab;
+
+    if (!object)
+	return;
+    slab = *(PrivateSlabPtr *) ((char *) object - SLAB_HEADER);
+    if (!slab) {
+	free((char *) object - SLAB_HEADER);
+	return;
+    }
+    class = slab->class;
+    if (!slab->free)
+	SlabLinkPartial(slab);
+    *(void **) object = slab->free;
+    slab->free = object;
+    slab->used--;
+    class->used--;
+    if (slab->used == 0 && (slab->prev || slab->next)) {
+	SlabUnlinkPartial(slab);
+	class->slabs--;
+	class->objects -= slab->count;
+	free(slab);
+    }
+}
+
 typedef Bool (*FixupFunc)(PrivatePtr *privates, int offset, unsigned bytes);
 
 static Bool
@@ -313,7 +466,7 @@ _dixAllocateObjectWithPrivates(unsigned baseSize, unsigned clear, unsigned offse
     /* round up so that void * is aligned */
     baseSize = (baseSize + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
     totalSize = baseSize + keys[type].offset;
-    object = malloc(totalSize);
+    object = dixSlabAlloc(type, totalSize);
     if (!object)
 	return NULL;
 
@@ -362,7 +515,7 @@ void
 _dixFreeObjectWithPrivates(void *object, PrivatePtr privates, DevPrivateType type)
 {
     _dixFiniPrivates(privates, type);
-    free(object);
+    dixSlabFree(object);
 }
 
 /*
@@ -456,7 +609,10 @@ dixPrivateUsage(void)
     int objects = 0;
     int	bytes = 0;
     int alloc = 0;
+    int slabs, slabObjects, slabUsed;
+    int totalSlabs = 0, totalObjects = 0, totalUsed = 0;
     DevPrivateType t;
+    int c;
 
     for (t = PRIVATE_XSELINUX + 1; t < PRIVATE_LAST; t++) {
 	if (keys[t].offset) {
@@ -467,9 +623,27 @@ dixPrivateUsage(void)
 	    objects += keys[t].created;
 	    alloc += keys[t].allocated;
 	}
+	slabs = slabObjects = slabUsed = 0;
+	for (c = 0; c < SLAB_NUM_CLASSES; c++) {
+	    slabs += slabClasses[t][c].slabs;
+	    slabObjects += slabClasses[t][c].objects;
+	    slabUsed += slabClasses[t][c].used;
+	}
+	if (slabs) {
+	    ErrorF("%s: %d slabs, %d of %d slab objects in use (%d%%)\n",
+		   key_names[t], slabs, slabUsed, slabObjects,
+		   slabUsed * 100 / slabObjects);
+	    totalSlabs += slabs;
+	    totalObjects += slabObjects;
+	    totalUsed += slabUsed;
+	}
     }
     ErrorF("TOTAL: %d objects, %d bytes, %d allocs\n",
 	   objects, bytes, alloc);
+    if (totalSlabs)
+	ErrorF("SLABS: %d slabs, %d of %d slab objects in use (%d%%)\n",
+	       totalSlabs, totalUsed, totalObjects,
+	       totalUsed * 100 / totalObjects);
 }
 
 void
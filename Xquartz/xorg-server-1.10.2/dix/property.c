@@ -66,8 +66,223 @@ SOFTWARE.
  *   Properties belong to windows.  The list of properties should not be
  *   traversed directly.  Instead, use the three functions listed above.
  *
+ *   Windows with PROPERTY_INDEX_MIN or more properties also get an index
+ *   from property name to the first property of that name on the list,
+ *   so lookups don't walk the list.  A name can appear more than once
+ *   when a security module polyinstantiates it; the module gets the
+ *   first one and walks on from there, so the index keeps the list order.
+ *
+ *   Property values are reference counted and never changed in place:
+ *   changing a property allocates a new value.  GetProperty hands a
+ *   reference to the output code instead of copying the value.
+ *
  *****************************************************************/
 
+#define PROPERTY_INDEX_MIN 16	/* properties before a window is indexed */
+
+typedef struct _PropertySlot {
+    Atom		name;		/* None if the slot is empty */
+    int			count;		/* properties of this name */
+    PropertyPtr		first;		/* the first of them on the list */
+} PropertySlotRec, *PropertySlotPtr;
+
+typedef struct _PropertyIndex {
+    int			numProps;	/* properties on the window */
+    int			used;		/* slots in use */
+    int			mask;		/* slots - 1, slots a power of two */
+    PropertySlotRec	slots[1];
+} PropertyIndexRec, *PropertyIndexPtr;
+
+typedef struct _PropertyData {
+    int			refcnt;
+    int			pad;		/* keep the value 8 byte aligned */
+} PropertyDataRec, *PropertyDataPtr;
+
+#define PropertyHash(name, mask) (((name) * 0x9e3779b1U) & (mask))
+
+static PropertySlotPtr
+FindPropertySlot(PropertyIndexPtr pIndex, Atom name)
+{
+    unsigned int i = PropertyHash(name, pIndex->mask);
+
+    while (pIndex->slots[i].name != None && pIndex->slots[i].name != name)
+	i = (i + 1) & pIndex->mask;
+    return &pIndex->slots[i];
+}
+
+/*
+ * Linear probing without tombstones: move later entries of the probe run
+ * back into the hole so that lookups still find them.
+ */
+static void
+ClearPropertySlot(PropertyIndexPtr pIndex, PropertySlotPtr slot)
+{
+    unsigned int i = slot - pIndex->slots;
+    unsigned int j = i, k;
+
+    for (;;)
+    {
+	j = (j + 1) & pIndex->mask;
+	if (pIndex->slots[j].name == None)
+	    break;
+	k = PropertyHash(pIndex->slots[j].name, pIndex->mask);
+	if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	pIndex->slots[i] = pIndex->slots[j];
+	i = j;
+    }
+    pIndex->slots[i].name = None;
+    pIndex->slots[i].count = 0;
+    pIndex->slots[i].first = NULL;
+    pIndex->used--;
+}
+
+/*
+ * (Re)build the index of pWin with four slots for every property, so it
+ * stays at most half full for a while.  If that fails the window just
+ * isn't indexed.
+ */
+static void
+IndexProperties(WindowPtr pWin, int numProps)
+{
+    PropertyIndexPtr pIndex;
+    PropertySlotPtr slot;
+    PropertyPtr pProp;
+    int size = 2 * PROPERTY_INDEX_MIN;
+
+    while (size < 4 * numProps)
+	size <<= 1;
+    free(pWin->optional->propIndex);
+    pIndex = calloc(1, sizeof(PropertyIndexRec) +
+		       (size - 1) * sizeof(PropertySlotRec));
+    pWin->optional->propIndex = pIndex;
+    if (!pIndex)
+	return;
+    pIndex->numProps = numProps;
+    pIndex->mask = size - 1;
+    for (pProp = pWin->optional->userProps; pProp; pProp = pProp->next)
+    {
+	slot = FindPropertySlot(pIndex, pProp->propertyName);
+	if (slot->name == None)
+	{
+	    slot->name = pProp->propertyName;
+	    slot->first = pProp;
+	    pIndex->used++;
+	}
+	slot->count++;
+    }
+}
+
+/* Add pProp to the front of the property list of pWin. */
+static void
+LinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr pIndex = pWin->optional->propIndex;
+    PropertySlotPtr slot;
+    int numProps;
+
+    pProp->prev = NULL;
+    pProp->next = pWin->optional->userProps;
+    if (pProp->next)
+	pProp->next->prev = pProp;
+    pWin->optional->userProps = pProp;
+
+    if (!pIndex)
+    {
+	numProps = 0;
+	for (pProp = pWin->optional->userProps; pProp; pProp = pProp->next)
+	    numProps++;
+	if (numProps >= PROPERTY_INDEX_MIN)
+	    IndexProperties(pWin, numProps);
+	return;
+    }
+    pIndex->numProps++;
+    slot = FindPropertySlot(pIndex, pProp->propertyName);
+    if (slot->name == None)
+    {
+	if (2 * (pIndex->used + 1) > pIndex->mask + 1)
+	{
+	    IndexProperties(pWin, pIndex->numProps);
+	    return;
+	}
+	slot->name = pProp->propertyName;
+	pIndex->used++;
+    }
+    slot->first = pProp;
+    slot->count++;
+}
+
+/* Take pProp off the property list of pWin. */
+static void
+UnlinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr pIndex = pWin->optional->propIndex;
+    PropertySlotPtr slot;
+    PropertyPtr pNext;
+
+    if (pIndex)
+    {
+	slot = FindPropertySlot(pIndex, pProp->propertyName);
+	if (--slot->count == 0)
+	    ClearPropertySlot(pIndex, slot);
+	else if (slot->first == pProp)
+	{
+	    for (pNext = pProp->next; pNext; pNext = pNext->next)
+		if (pNext->propertyName == pProp->propertyName)
+		    break;
+	    slot->first = pNext;
+	}
+	if (--pIndex->numProps < PROPERTY_INDEX_MIN / 2)
+	{
+	    free(pIndex);
+	    pWin->optional->propIndex = NULL;
+	}
+    }
+
+    if (pProp->next)
+	pProp->next->prev = pProp->prev;
+    if (pProp->prev)
+	pProp->prev->next = pProp->next;
+    else if (!(pWin->optional->userProps = pProp->next))
+	CheckWindowOptionalNeed (pWin);
+}
+
+static pointer
+AllocPropertyData(unsigned long size)
+{
+    PropertyDataPtr header = malloc(sizeof(PropertyDataRec) + size);
+
+    if (!header)
+	return NULL;
+    header->refcnt = 1;
+    return header + 1;
+}
+
+static void
+UnrefPropertyData(pointer data)
+{
+    PropertyDataPtr header;
+
+    if (!data)
+	return;
+    header = (PropertyDataPtr)data - 1;
+    if (--header->refcnt == 0)
+	free(header);
+}
+
+static void
+PropertyDataWritten(pointer buf, pointer closure)
+{
+    UnrefPropertyData(closure);
+}
+
+static void
+FreeProperty(PropertyPtr pProp)
+{
+    UnrefPropertyData(pProp->data);
+    dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+}
+
 #ifdef notdef
 static void
 PrintPropertys(WindowPtr pWin)
@@ -96,9 +311,13 @@ dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
     int rc = BadMatch;
     client->errorValue = propertyName;
 
-    for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
-	if (pProp->propertyName == propertyName)
-	    break;
+    if (pWin->optional && pWin->optional->propIndex)
+	pProp = FindPropertySlot(pWin->optional->propIndex,
+				 propertyName)->first;
+    else
+	for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
+	    if (pProp->propertyName == propertyName)
+		break;
 
     if (pProp)
 	rc = XaceHookPropertyAccess(client, pWin, &pProp, access_mode);
@@ -120,6 +339,21 @@ deliverPropertyNotifyEvent(WindowPtr pWin, int state, Atom atom)
     DeliverEvents(pWin, &event, 1, (WindowPtr)NULL);
 }
 
+typedef struct _RotateAtom {
+    Atom	atom;
+    int		pos;
+} RotateAtomRec, *RotateAtomPtr;
+
+static int
+CompareRotateAtoms(const void *a, const void *b)
+{
+    const RotateAtomRec *ra = a, *rb = b;
+
+    if (ra->atom != rb->atom)
+	return (ra->atom < rb->atom) ? -1 : 1;
+    return ra->pos - rb->pos;
+}
+
 int
 ProcRotateProperties(ClientPtr client)
 {
@@ -129,6 +363,8 @@ ProcRotateProperties(ClientPtr client)
     Atom * atoms;
     PropertyPtr * props;               /* array of pointer */
     PropertyPtr pProp, saved;
+    RotateAtomPtr sorted;
+    char *dup;                         /* atom repeated later in the list */
 
     REQUEST_FIXED_SIZE(xRotatePropertiesReq, stuff->nAtoms << 2);
     UpdateCurrentTime();
@@ -139,11 +375,24 @@ ProcRotateProperties(ClientPtr client)
     atoms = (Atom *) & stuff[1];
     props = malloc(stuff->nAtoms * sizeof(PropertyPtr));
     saved = malloc(stuff->nAtoms * sizeof(PropertyRec));
-    if (!props || !saved) {
+    sorted = malloc(stuff->nAtoms * sizeof(RotateAtomRec));
+    dup = calloc(stuff->nAtoms, 1);
+    if (!props || !saved || !sorted || !dup) {
 	rc = BadAlloc;
 	goto out;
     }
 
+    /* find repeated atoms by sorting rather than comparing every pair */
+    for (i = 0; i < stuff->nAtoms; i++)
+    {
+	sorted[i].atom = atoms[i];
+	sorted[i].pos = i;
+    }
+    qsort(sorted, stuff->nAtoms, sizeof(RotateAtomRec), CompareRotateAtoms);
+    for (i = 0; i < stuff->nAtoms - 1; i++)
+	if (sorted[i].atom == sorted[i + 1].atom)
+	    dup[sorted[i].pos] = TRUE;
+
     for (i = 0; i < stuff->nAtoms; i++)
     {
         if (!ValidAtom(atoms[i])) {
@@ -151,12 +400,11 @@ ProcRotateProperties(ClientPtr client)
 	    client->errorValue = atoms[i];
 	    goto out;
         }
-        for (j = i + 1; j < stuff->nAtoms; j++)
-            if (atoms[j] == atoms[i])
-            {
-		rc = BadMatch;
-		goto out;
-            }
+        if (dup[i])
+        {
+	    rc = BadMatch;
+	    goto out;
+        }
 
 	rc = dixLookupProperty(&pProp, pWin, atoms[i], client,
 			       DixReadAccess|DixWriteAccess);
@@ -188,6 +436,8 @@ ProcRotateProperties(ClientPtr client)
 	}
     }
 out:
+    free(dup);
+    free(sorted);
     free(saved);
     free(props);
     return rc;
@@ -272,8 +522,8 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 	pProp = dixAllocateObjectWithPrivates(PropertyRec, PRIVATE_PROPERTY);
 	if (!pProp)
 	    return BadAlloc;
-        data = malloc(totalSize);
-	if (!data && len)
+        data = AllocPropertyData(totalSize);
+	if (!data)
 	{
 	    dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
 	    return BadAlloc;
@@ -287,13 +537,11 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 	rc = XaceHookPropertyAccess(pClient, pWin, &pProp,
 				    DixCreateAccess|DixWriteAccess);
 	if (rc != Success) {
-	    free(data);
-	    dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+	    FreeProperty(pProp);
 	    pClient->errorValue = property;
 	    return rc;
 	}
-        pProp->next = pWin->optional->userProps;
-        pWin->optional->userProps = pProp;
+	LinkProperty(pWin, pProp);
     }
     else if (rc == Success)
     {
@@ -312,8 +560,8 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 
         if (mode == PropModeReplace)
         {
-	    data = malloc(totalSize);
-	    if (!data && len)
+	    data = AllocPropertyData(totalSize);
+	    if (!data)
 		return BadAlloc;
 	    memcpy(data, value, totalSize);
 	    pProp->data = data;
@@ -327,7 +575,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 	}
         else if (mode == PropModeAppend)
         {
-	    data = malloc((pProp->size + len) * sizeInBytes);
+	    data = AllocPropertyData((pProp->size + len) * sizeInBytes);
 	    if (!data)
 		return BadAlloc;
 	    memcpy(data, pProp->data, pProp->size * sizeInBytes);
@@ -337,7 +585,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 	}
         else if (mode == PropModePrepend)
         {
-            data = malloc(sizeInBytes * (len + pProp->size));
+            data = AllocPropertyData(sizeInBytes * (len + pProp->size));
 	    if (!data)
 		return BadAlloc;
             memcpy(data + totalSize, pProp->data, pProp->size * sizeInBytes);
@@ -352,12 +600,12 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 	if (rc == Success)
 	{
 	    if (savedProp.data != pProp->data)
-		free(savedProp.data);
+		UnrefPropertyData(savedProp.data);
 	}
 	else
 	{
 	    if (savedProp.data != pProp->data)
-		free(pProp->data);
+		UnrefPropertyData(pProp->data);
 	    *pProp = savedProp;
 	    return rc;
 	}
@@ -383,7 +631,7 @@ ChangeWindowProperty(WindowPtr pWin, Atom property, Atom type, int format,
 int
 DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     int rc;
 
     rc = dixLookupProperty(&pProp, pWin, propName, client, DixDestroyAccess);
@@ -391,21 +639,9 @@ DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 	return Success; /* Succeed if property does not exist */
 
     if (rc == Success) {
-	if (pWin->optional->userProps == pProp) {
-	    /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-		CheckWindowOptionalNeed (pWin);
-	} else {
-	    /* Need to traverse to find the previous element */
-	    prevProp = pWin->optional->userProps;
-	    while (prevProp->next != pProp)
-		prevProp = prevProp->next;
-	    prevProp->next = pProp->next;
-	}
-
+	UnlinkProperty(pWin, pProp);
 	deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp->propertyName);
-	free(pProp->data);
-	dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+	FreeProperty(pProp);
     }
     return rc;
 }
@@ -420,13 +656,16 @@ DeleteAllWindowProperties(WindowPtr pWin)
     {
 	deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp->propertyName);
 	pNextProp = pProp->next;
-        free(pProp->data);
-	dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+	FreeProperty(pProp);
 	pProp = pNextProp;
     }
 
     if (pWin->optional)
+    {
         pWin->optional->userProps = NULL;
+	free(pWin->optional->propIndex);
+	pWin->optional->propIndex = NULL;
+    }
 }
 
 static int
@@ -458,7 +697,7 @@ NullPropertyReply(
 int
 ProcGetProperty(ClientPtr client)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     unsigned long n, len, ind;
     int rc;
     WindowPtr pWin;
@@ -545,7 +784,14 @@ ProcGetProperty(ClientPtr client)
 	deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp->propertyName);
 
     WriteReplyToClient(client, sizeof(xGenericReply), &reply);
-    if (len)
+    if (len && !client->swapped)
+    {
+	/* the value can't change under the reply, it can only be replaced */
+	((PropertyDataPtr)pProp->data - 1)->refcnt++;
+	(void)WriteToClientNoCopy(client, len, (char *)pProp->data + ind,
+				  PropertyDataWritten, pProp->data);
+    }
+    else if (len)
     {
 	switch (reply.format) {
 	case 32: client->pSwapReplyFunc = (ReplySwapPtr)CopySwap32Write; break;
@@ -558,20 +804,8 @@ ProcGetProperty(ClientPtr client)
 
     if (stuff->delete && (reply.bytesAfter == 0)) {
 	/* Delete the Property */
-	if (pWin->optional->userProps == pProp) {
-	    /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-		CheckWindowOptionalNeed (pWin);
-	} else {
-	    /* Need to traverse to find the previous element */
-	    prevProp = pWin->optional->userProps;
-	    while (prevProp->next != pProp)
-		prevProp = prevProp->next;
-	    prevProp->next = pProp->next;
-	}
-
-	free(pProp->data);
-	dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+	UnlinkProperty(pWin, pProp);
+	FreeProperty(pProp);
     }
     return Success;
 }
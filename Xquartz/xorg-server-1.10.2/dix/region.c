@@ -84,6 +84,9 @@ Equipment Corporation.
 #include <X11/Xfuncproto.h>
 #include "gc.h"
 #include <pixman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #undef assert
 #ifdef REGION_DEBUG
@@ -256,6 +259,122 @@ RegionDestroy(RegionPtr pReg)
 	free(pReg);
 }
 
+/*****************************************************************
+ *   Temporary regions
+ *     Handed out in order from chunks that are never freed, and all
+ *     taken back at once by RegionResetTemporaries.  Rectangle storage
+ *     up to TEMPORARY_KEEP_RECTS is kept with the region, so a region
+ *     used the same way in the next cycle doesn't allocate at all.
+ *     Chunks the last cycle didn't use, and any beyond
+ *     TEMPORARY_KEEP_CHUNKS, are freed.  None of this is locked: only
+ *     the main thread may use temporary regions.
+ *****************************************************************/
+
+#define TEMPORARY_CHUNK		64
+#define TEMPORARY_KEEP_RECTS	256
+#define TEMPORARY_KEEP_CHUNKS	16
+
+typedef struct _RegionChunk {
+    struct _RegionChunk	*next;
+    RegionRec		regions[TEMPORARY_CHUNK];
+} RegionChunkRec, *RegionChunkPtr;
+
+static RegionChunkPtr temporaryChunks;	/* first chunk */
+static RegionChunkPtr temporaryChunk;	/* chunk being handed out */
+static int temporaryUsed;		/* regions used in temporaryChunk */
+
+RegionPtr
+RegionCreateTemporary(BoxPtr rect, int size)
+{
+    RegionChunkPtr chunk = temporaryChunk;
+    RegionPtr pReg;
+    int i;
+
+    if (!chunk || temporaryUsed == TEMPORARY_CHUNK)
+    {
+	chunk = chunk ? chunk->next : temporaryChunks;
+	if (!chunk)
+	{
+	    chunk = malloc(sizeof(RegionChunkRec));
+	    if (!chunk)
+		return &RegionBrokenRegion;
+	    chunk->next = NULL;
+	    for (i = 0; i < TEMPORARY_CHUNK; i++)
+		RegionNull(&chunk->regions[i]);
+	    if (temporaryChunk)
+		temporaryChunk->next = chunk;
+	    else
+		temporaryChunks = chunk;
+	}
+	temporaryChunk = chunk;
+	temporaryUsed = 0;
+    }
+    pReg = &chunk->regions[temporaryUsed++];
+
+    /* reset regions are empty, perhaps with storage to reuse */
+    if (rect || size > RegionSize(pReg))
+    {
+	xfreeData(pReg);
+	RegionInit(pReg, rect, size);
+    }
+    return pReg;
+}
+
+void
+RegionResetTemporaries(void)
+{
+    RegionChunkPtr chunk, *prev;
+    RegionPtr pReg;
+    int i, used, n, keep;
+
+    if (!temporaryChunks)
+	return;
+
+    /* keep the chunks this cycle used, but no more than
+     * TEMPORARY_KEEP_CHUNKS, so one burst doesn't pin memory forever */
+    keep = 0;
+    if (temporaryChunk)
+	for (chunk = temporaryChunks; ; chunk = chunk->next)
+	{
+	    keep++;
+	    if (chunk == temporaryChunk)
+		break;
+	}
+    if (keep > TEMPORARY_KEEP_CHUNKS)
+	keep = TEMPORARY_KEEP_CHUNKS;
+
+    n = 0;
+    prev = &temporaryChunks;
+    while ((chunk = *prev))
+    {
+	if (n++ >= keep)
+	{
+	    *prev = chunk->next;
+	    for (i = 0; i < TEMPORARY_CHUNK; i++)
+		xfreeData(&chunk->regions[i]);
+	    free(chunk);
+	    continue;
+	}
+	used = chunk == temporaryChunk ? temporaryUsed : TEMPORARY_CHUNK;
+	for (i = 0; i < used; i++)
+	{
+	    pReg = &chunk->regions[i];
+	    pReg->extents = RegionEmptyBox;
+	    if (pReg->data && pReg->data->size &&
+		pReg->data->size <= TEMPORARY_KEEP_RECTS)
+		pReg->data->numRects = 0;
+	    else
+	    {
+		xfreeData(pReg);
+		pReg->data = &RegionEmptyData;
+	    }
+	}
+	prev = &chunk->next;
+    }
+    temporaryChunk = NULL;
+    temporaryUsed = 0;
+}
+
 void
 RegionPrint(RegionPtr rgn)
 {
@@ -374,6 +493,85 @@ RegionRectAlloc(RegionPtr pRgn, int n)
  *	    Generic Region Operator
  *====================================================================*/
 
+/*
+ * Band kernels.  A BoxRec is four shorts, so with SSE2 two boxes fit in
+ * a vector, x1 y1 x2 y2 from the low lane up; the scalar loops handle
+ * what's left over, or everything on other machines.
+ */
+
+#ifdef __SSE2__
+#define BOX_LANES(x1,y1,x2,y2)	_mm_set_epi16(y2, x2, y1, x1, y2, x2, y1, x1)
+#endif
+
+/* Whether two bands of n boxes have boxes at the same x positions */
+_X_INLINE static Bool
+RegionBandsMatch (BoxPtr pBox1, BoxPtr pBox2, int n)
+{
+#ifdef __SSE2__
+    const __m128i ymask = BOX_LANES(0, -1, 0, -1);
+
+    for (; n >= 2; n -= 2, pBox1 += 2, pBox2 += 2)
+    {
+	__m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((__m128i *) pBox1),
+				     _mm_loadu_si128((__m128i *) pBox2));
+
+	if (_mm_movemask_epi8(_mm_or_si128(eq, ymask)) != 0xffff)
+	    return FALSE;
+    }
+#endif
+    for (; n; n--, pBox1++, pBox2++)
+	if (pBox1->x1 != pBox2->x1 || pBox1->x2 != pBox2->x2)
+	    return FALSE;
+    return TRUE;
+}
+
+/* Set the bottom of n boxes to y2 */
+_X_INLINE static void
+RegionBandSetBottom (BoxPtr pBox, int n, int y2)
+{
+#ifdef __SSE2__
+    const __m128i keep = BOX_LANES(-1, -1, -1, 0);
+    const __m128i bottom = BOX_LANES(0, 0, 0, y2);
+
+    for (; n >= 2; n -= 2, pBox += 2)
+    {
+	__m128i v = _mm_loadu_si128((__m128i *) pBox);
+
+	_mm_storeu_si128((__m128i *) pBox,
+			 _mm_or_si128(_mm_and_si128(v, keep), bottom));
+    }
+#endif
+    for (; n; n--, pBox++)
+	pBox->y2 = y2;
+}
+
+/* Copy the x positions of n boxes into a band from y1 to y2 */
+_X_INLINE static void
+RegionBandCopy (BoxPtr pDst, BoxPtr pSrc, int n, int y1, int y2)
+{
+#ifdef __SSE2__
+    const __m128i xmask = BOX_LANES(-1, 0, -1, 0);
+    const __m128i y = BOX_LANES(0, y1, 0, y2);
+
+    for (; n >= 2; n -= 2, pDst += 2, pSrc += 2)
+    {
+	__m128i v = _mm_loadu_si128((__m128i *) pSrc);
+
+	assert(pSrc[0].x1 < pSrc[0].x2 && pSrc[1].x1 < pSrc[1].x2);
+	_mm_storeu_si128((__m128i *) pDst,
+			 _mm_or_si128(_mm_and_si128(v, xmask), y));
+    }
+#endif
+    for (; n; n--, pDst++, pSrc++)
+    {
+	assert(pSrc->x1 < pSrc->x2);
+	pDst->x1 = pSrc->x1;
+	pDst->y1 = y1;
+	pDst->x2 = pSrc->x2;
+	pDst->y2 = y2;
+    }
+}
+
 /*-
  *-----------------------------------------------------------------------
  * RegionCoalesce --
@@ -426,26 +624,15 @@ RegionCoalesce (
      */
     y2 = pCurBox->y2;
 
-    do {
-	if ((pPrevBox->x1 != pCurBox->x1) || (pPrevBox->x2 != pCurBox->x2)) {
-	    return curStart;
-	}
-	pPrevBox++;
-	pCurBox++;
-	numRects--;
-    } while (numRects);
+    if (!RegionBandsMatch(pPrevBox, pCurBox, numRects))
+	return curStart;
 
     /*
      * The bands may be merged, so set the bottom y of each box
      * in the previous band to the bottom y of the current band.
      */
-    numRects = curStart - prevStart;
     pReg->data->numRects -= numRects;
-    do {
-	pPrevBox--;
-	pPrevBox->y2 = y2;
-	numRects--;
-    } while (numRects);
+    RegionBandSetBottom(pPrevBox, numRects, y2);
     return prevStart;
 }
 
@@ -496,11 +683,7 @@ RegionAppendNonO (
     RECTALLOC(pReg, newRects);
     pNextRect = RegionTop(pReg);
     pReg->data->numRects += newRects;
-    do {
-	assert(r->x1 < r->x2);
-	ADDRECT(pNextRect, r->x1, y1, r->x2, y2);
-	r++;
-    } while (r != rEnd);
+    RegionBandCopy(pNextRect, r, newRects, y1, y2);
 
     return TRUE;
 }
@@ -828,6 +1011,30 @@ RegionSetExtents (RegionPtr pReg)
     pReg->extents.y2 = pBoxEnd->y2;
 
     assert(pReg->extents.y1 < pReg->extents.y2);
+#ifdef __SSE2__
+    if (pBoxEnd - pBox >= 3)
+    {
+	__m128i lo = _mm_loadu_si128((__m128i *) pBox);
+	__m128i hi = lo;
+	int x1, x2;
+
+	for (pBox += 2; pBox < pBoxEnd; pBox += 2)
+	{
+	    __m128i v = _mm_loadu_si128((__m128i *) pBox);
+
+	    lo = _mm_min_epi16(lo, v);
+	    hi = _mm_max_epi16(hi, v);
+	}
+	x1 = min((short) _mm_extract_epi16(lo, 0),
+		 (short) _mm_extract_epi16(lo, 4));
+	x2 = max((short) _mm_extract_epi16(hi, 2),
+		 (short) _mm_extract_epi16(hi, 6));
+	if (x1 < pReg->extents.x1)
+	    pReg->extents.x1 = x1;
+	if (x2 > pReg->extents.x2)
+	    pReg->extents.x2 = x2;
+    }
+#endif
     while (pBox <= pBoxEnd) {
 	if (pBox->x1 < pReg->extents.x1)
 	    pReg->extents.x1 = pBox->x1;
@@ -106,8 +106,8 @@ Equipment Corporation.
  *      A resource ID is a 32 bit quantity, the upper 2 bits of which are
  *	off-limits for client-visible resources.  The next 8 bits are
  *      used as client ID, and the low 22 bits come from the client.
- *	A resource ID is "hashed" by extracting and xoring subfields
- *      (varying with the size of the hash table).
+ *	A resource ID is hashed by multiplying its low 22 bits with a
+ *      constant and keeping the top bits of the product.
  *
  *      It is sometimes necessary for the server to create an ID that looks
  *      like it belongs to a client.  This ID, however,  must not be one
@@ -142,6 +142,7 @@ Equipment Corporation.
 #include "xace.h"
 #include <assert.h>
 #include "registry.h"
+#include "list.h"
 
 #ifdef XSERVER_DTRACE
 #include <sys/types.h>
@@ -151,28 +152,47 @@ typedef const char *string;
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(
-    int /*client*/
-);
-
 #define SERVER_MINID 32
 
-#define INITBUCKETS 64
-#define INITHASHSIZE 6
-#define MAXHASHSIZE 11
+#define INITHASHSIZE 6		/* log(2) of a new client's table size */
+#define REHASH_STEP 16		/* old slots moved by each table update */
 
 typedef struct _Resource {
-    struct _Resource	*next;
+    struct _Resource	*next;		/* older resource with the same id */
     XID			id;
     RESTYPE		type;
     pointer		value;
+    struct list		all;		/* client's resources, newest first */
+    struct list		byType;		/* client's resources of this type */
 } ResourceRec, *ResourcePtr;
 
+/*
+ * Ids are looked up in an open addressing table with linear probing.
+ * A slot holds the newest resource with its id, older resources with
+ * the same id are chained behind it.  When the table fills up, a bigger
+ * one is allocated and the old slots are moved over a few at a time by
+ * later updates; until then ids are looked for in both.
+ */
+static ResourceRec deletedSlot;
+
+#define SLOT_EMPTY	((ResourcePtr)NULL)
+#define SLOT_DELETED	(&deletedSlot)
+
+typedef struct _ResourceTable {
+    ResourcePtr *slots;
+    int		hashsize;	/* log(2)(size) */
+    int		used;		/* slots holding resources */
+    int		deleted;	/* SLOT_DELETED slots */
+} ResourceTableRec, *ResourceTablePtr;
+
 typedef struct _ClientResource {
-    ResourcePtr *resources;
+    ResourceTableRec table;	/* new ids go here */
+    ResourceTableRec old;	/* being moved to table, if slots */
+    int		rehash;		/* next slot of old to move */
     int		elements;
-    int		buckets;
-    int		hashsize;	/* log(2)(buckets) */
+    struct list	all;
+    struct list	*byType;	/* indexed by type & TypeMask */
+    int		numTypes;
     XID		fakeID;
     XID		endFakeID;
 } ClientResourceRec;
@@ -284,6 +304,262 @@ CreateNewResourceClass(void)
 
 static ClientResourceRec clientTable[MAXCLIENTS];
 
+#define TableSize(t) (1 << (t)->hashsize)
+
+static _X_INLINE unsigned int
+Hash(ResourceTablePtr table, XID id)
+{
+    /* multiplicative hashing, the top bits are the well mixed ones */
+    return ((CARD32)(id & RESOURCE_ID_MASK) * 0x9e3779b1U) >>
+	   (32 - table->hashsize);
+}
+
+static Bool
+InitResourceTable(ResourceTablePtr table, int hashsize)
+{
+    table->slots = calloc(1 << hashsize, sizeof(ResourcePtr));
+    if (!table->slots)
+	return FALSE;
+    table->hashsize = hashsize;
+    table->used = 0;
+    table->deleted = 0;
+    return TRUE;
+}
+
+static ResourcePtr *
+TableFind(ResourceTablePtr table, XID id)
+{
+    unsigned int mask = TableSize(table) - 1;
+    unsigned int i;
+    ResourcePtr res;
+
+    for (i = Hash(table, id); (res = table->slots[i]); i = (i + 1) & mask)
+	if (res != SLOT_DELETED && res->id == id)
+	    return &table->slots[i];
+    return NULL;
+}
+
+/* res->id must not be in the table yet */
+static void
+TableInsert(ResourceTablePtr table, ResourcePtr res)
+{
+    unsigned int mask = TableSize(table) - 1;
+    unsigned int i;
+
+    for (i = Hash(table, res->id);
+	 table->slots[i] && table->slots[i] != SLOT_DELETED;
+	 i = (i + 1) & mask)
+	;
+    if (table->slots[i] == SLOT_DELETED)
+	table->deleted--;
+    table->slots[i] = res;
+    table->used++;
+}
+
+static void
+TableClear(ResourceTablePtr table, ResourcePtr *slot)
+{
+    unsigned int mask = TableSize(table) - 1;
+
+    /* the end of a probe sequence can go back to empty */
+    if (table->slots[(slot - table->slots + 1) & mask])
+    {
+	*slot = SLOT_DELETED;
+	table->deleted++;
+    }
+    else
+	*slot = SLOT_EMPTY;
+    table->used--;
+}
+
+static ResourcePtr *
+FindSlot(ClientResourceRec *rrec, XID id, ResourceTablePtr *ptable)
+{
+    ResourcePtr *slot;
+
+    *ptable = &rrec->table;
+    slot = TableFind(&rrec->table, id);
+    if (!slot && rrec->old.slots)
+    {
+	*ptable = &rrec->old;
+	slot = TableFind(&rrec->old, id);
+    }
+    return slot;
+}
+
+static void
+RehashStep(ClientResourceRec *rrec, int count)
+{
+    ResourceTablePtr old = &rrec->old;
+    ResourcePtr res;
+
+    while (count-- > 0 && rrec->rehash < TableSize(old))
+    {
+	res = old->slots[rrec->rehash];
+	if (res && res != SLOT_DELETED)
+	{
+	    /* keep the probe sequences of the remaining slots intact */
+	    old->slots[rrec->rehash] = SLOT_DELETED;
+	    TableInsert(&rrec->table, res);
+	}
+	rrec->rehash++;
+    }
+    if (rrec->rehash == TableSize(old))
+    {
+	free(old->slots);
+	old->slots = NULL;
+    }
+}
+
+/*
+ * Make room for one more id.  Tables are kept at most three quarters
+ * full, counting deleted slots, so that probing always ends; when that
+ * is reached, a new table is started, twice as big unless the old one is
+ * mostly deleted slots.
+ */
+static Bool
+TableReserve(ClientResourceRec *rrec)
+{
+    ResourceTablePtr table = &rrec->table;
+    ResourceTableRec grown;
+    int size = TableSize(table);
+
+    if (rrec->old.slots)
+	RehashStep(rrec, REHASH_STEP);
+    if ((table->used + table->deleted + 1) * 4 <= size * 3)
+	return TRUE;
+
+    if (rrec->old.slots)
+	RehashStep(rrec, TableSize(&rrec->old));
+    if (!InitResourceTable(&grown, table->hashsize +
+			   ((table->used + 1) * 2 > size ? 1 : 0)))
+	/* carry on in the full table while there is any room at all */
+	return table->used + table->deleted + 1 < size;
+    rrec->old = *table;
+    rrec->rehash = 0;
+    *table = grown;
+    RehashStep(rrec, REHASH_STEP);
+    return TRUE;
+}
+
+/* A list head for every type, allocated as types show up. */
+static struct list *
+TypeList(ClientResourceRec *rrec, RESTYPE type)
+{
+    int index = type & TypeMask;
+    int i, n;
+    struct list *lists;
+
+    if (index < rrec->numTypes)
+	return &rrec->byType[index];
+
+    n = max(index, lastResourceType) + 1;
+    lists = malloc(n * sizeof(struct list));
+    if (!lists)
+	return NULL;
+    /* the members point back at their heads, which are moving */
+    for (i = 0; i < rrec->numTypes; i++)
+    {
+	if (list_is_empty(&rrec->byType[i]))
+	    list_init(&lists[i]);
+	else
+	{
+	    lists[i] = rrec->byType[i];
+	    lists[i].next->prev = &lists[i];
+	    lists[i].prev->next = &lists[i];
+	}
+    }
+    for (; i < n; i++)
+	list_init(&lists[i]);
+    free(rrec->byType);
+    rrec->byType = lists;
+    rrec->numTypes = n;
+    return &lists[index];
+}
+
+/* Take a resource out of its client's table and lists. */
+static void
+UnlinkResource(ClientResourceRec *rrec, ResourcePtr res)
+{
+    ResourceTablePtr table;
+    ResourcePtr *slot, *prev;
+
+    slot = FindSlot(rrec, res->id, &table);
+    for (prev = slot; *prev != res; prev = &(*prev)->next)
+	;
+    *prev = res->next;
+    if (!*slot)
+	TableClear(table, slot);
+    list_del(&res->all);
+    list_del(&res->byType);
+    rrec->elements--;
+}
+
+/*
+ * Walking a client's resources, either all of them or those of one
+ * type.  A marker resource is kept in the list right behind the one
+ * last returned, so the caller may free or add any resources between
+ * calls; resources added are not returned.
+ */
+typedef struct _ResourceWalk {
+    struct list	*head;
+    Bool	byType;
+    ResourceRec	marker;		/* id None */
+} ResourceWalkRec;
+
+static _X_INLINE struct list *
+WalkEntry(ResourceWalkRec *walk, ResourcePtr res)
+{
+    return walk->byType ? &res->byType : &res->all;
+}
+
+static void
+WalkStart(ResourceWalkRec *walk, ClientResourceRec *rrec, RESTYPE type)
+{
+    walk->byType = type != 0;
+    walk->marker.id = None;
+    if (!type)
+	walk->head = &rrec->all;
+    else if ((type & TypeMask) < rrec->numTypes)
+	walk->head = &rrec->byType[type & TypeMask];
+    else
+	walk->head = NULL;
+    if (walk->head)
+	list_add(WalkEntry(walk, &walk->marker), walk->head);
+    else
+	list_init(WalkEntry(walk, &walk->marker));
+}
+
+static ResourcePtr
+WalkNext(ResourceWalkRec *walk)
+{
+    struct list *marker = WalkEntry(walk, &walk->marker);
+    struct list *entry;
+    ResourcePtr res;
+
+    if (!walk->head)
+	return NULL;
+    for (entry = marker->next; entry != walk->head; entry = entry->next)
+    {
+	if (walk->byType)
+	    res = list_entry(entry, ResourceRec, byType);
+	else
+	    res = list_entry(entry, ResourceRec, all);
+	if (res->id == None)
+	    continue;		/* someone else's marker */
+	list_del(marker);
+	list_add(marker, entry);
+	return res;
+    }
+    return NULL;
+}
+
+static void
+WalkEnd(ResourceWalkRec *walk)
+{
+    list_del(WalkEntry(walk, &walk->marker));
+}
+
 /*****************
  * InitClientResources
  *    When a new client is created, call this to allocate space
@@ -293,7 +569,7 @@ static ClientResourceRec clientTable[MAXCLIENTS];
 Bool
 InitClientResources(ClientPtr client)
 {
-    int i, j;
+    ClientResourceRec *rrec;
  
     if (client == serverClient)
     {
@@ -306,51 +582,26 @@ InitClientResources(ClientPtr client)
 	    return FALSE;
 	memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
     }
-    clientTable[i = client->index].resources =
-	malloc(INITBUCKETS*sizeof(ResourcePtr));
-    if (!clientTable[i].resources)
+    rrec = &clientTable[client->index];
+    if (!InitResourceTable(&rrec->table, INITHASHSIZE))
 	return FALSE;
-    clientTable[i].buckets = INITBUCKETS;
-    clientTable[i].elements = 0;
-    clientTable[i].hashsize = INITHASHSIZE;
+    rrec->old.slots = NULL;
+    rrec->rehash = 0;
+    rrec->elements = 0;
+    list_init(&rrec->all);
+    rrec->byType = NULL;
+    rrec->numTypes = 0;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
      * clients, we can start from zero, with SERVER_BIT set.
      */
-    clientTable[i].fakeID = client->clientAsMask |
-			    (client->index ? SERVER_BIT : SERVER_MINID);
-    clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (j=0; j<INITBUCKETS; j++) 
-    {
-        clientTable[i].resources[j] = NULL;
-    }
+    rrec->fakeID = client->clientAsMask |
+		   (client->index ? SERVER_BIT : SERVER_MINID);
+    rrec->endFakeID = (rrec->fakeID | RESOURCE_ID_MASK) + 1;
     return TRUE;
 }
 
-
-static int
-Hash(int client, XID id)
-{
-    id &= RESOURCE_ID_MASK;
-    switch (clientTable[client].hashsize)
-    {
-	case 6:
-	    return ((int)(0x03F & (id ^ (id>>6) ^ (id>>12))));
-	case 7:
-	    return ((int)(0x07F & (id ^ (id>>7) ^ (id>>13))));
-	case 8:
-	    return ((int)(0x0FF & (id ^ (id>>8) ^ (id>>16))));
-	case 9:
-	    return ((int)(0x1FF & (id ^ (id>>9))));
-	case 10:
-	    return ((int)(0x3FF & (id ^ (id>>10))));
-	case 11:
-	    return ((int)(0x7FF & (id ^ (id>>11))));
-    }
-    return -1;
-}
-
 static XID
 AvailableID(
     int client,
@@ -358,16 +609,13 @@ AvailableID(
     XID maxid,
     XID goodid)
 {
-    ResourcePtr res;
+    ResourceTablePtr table;
 
     if ((goodid >= id) && (goodid <= maxid))
 	return goodid;
     for (; id <= maxid; id++)
     {
-	res = clientTable[client].resources[Hash(client, id)];
-	while (res && (res->id != id))
-	    res = res->next;
-	if (!res)
+	if (!FindSlot(&clientTable[client], id, &table))
 	    return id;
     }
     return 0;
@@ -377,9 +625,7 @@ void
 GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 {
     XID id, maxid;
-    ResourcePtr *resp;
     ResourcePtr res;
-    int i;
     XID goodid;
 
     id = (Mask)client << CLIENTOFFSET;
@@ -387,20 +633,16 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 	id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
-    for (resp = clientTable[client].resources, i = clientTable[client].buckets;
-	 --i >= 0;)
+    list_for_each_entry(res, &clientTable[client].all, all)
     {
-	for (res = *resp++; res; res = res->next)
-	{
-	    if ((res->id < id) || (res->id > maxid))
-		continue;
-	    if (((res->id - id) >= (maxid - res->id)) ?
-		(goodid = AvailableID(client, id, res->id - 1, goodid)) :
-		!(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
-		maxid = res->id - 1;
-	    else
-		id = res->id + 1;
-	}
+	if ((res->id < id) || (res->id > maxid))
+	    continue;
+	if (((res->id - id) >= (maxid - res->id)) ?
+	    (goodid = AvailableID(client, id, res->id - 1, goodid)) :
+	    !(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
+	    maxid = res->id - 1;
+	else
+	    id = res->id + 1;
     }
     if (id > maxid)
 	id = maxid = 0;
@@ -480,126 +722,82 @@ AddResource(XID id, RESTYPE type, pointer value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr res, *head;
+    ResourceTablePtr table;
+    ResourcePtr res, *slot;
+    struct list *typeList;
     	
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
 #endif
     client = CLIENT_ID(id);
     rrec = &clientTable[client];
-    if (!rrec->buckets)
+    if (!rrec->table.slots)
     {
 	ErrorF("[dix] AddResource(%lx, %lx, %lx), client=%d \n",
 		(unsigned long)id, type, (unsigned long)value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4*rrec->buckets) &&
-	(rrec->hashsize < MAXHASHSIZE))
-	RebuildTable(client);
-    head = &rrec->resources[Hash(client, id)];
     res = malloc(sizeof(ResourceRec));
-    if (!res)
+    typeList = TypeList(rrec, type);
+    slot = FindSlot(rrec, id, &table);
+    if (!res || !typeList || (!slot && !TableReserve(rrec)))
     {
+	free(res);
 	(*resourceTypes[type & TypeMask].deleteFunc)(value, id);
 	return FALSE;
     }
-    res->next = *head;
     res->id = id;
     res->type = type;
     res->value = value;
-    *head = res;
-    rrec->elements++;
-    CallResourceStateCallback(ResourceStateAdding, res);
-    return TRUE;
-}
-
-static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr res, next;
-    ResourcePtr **tails, *resources;
-    ResourcePtr **tptr, *rptr;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails = malloc(j * sizeof(ResourcePtr *));
-    if (!tails)
-	return;
-    resources = malloc(j * sizeof(ResourcePtr));
-    if (!resources)
+    if (slot)
     {
-	free(tails);
-	return;
+	res->next = *slot;
+	*slot = res;
     }
-    for (rptr = resources, tptr = tails; --j >= 0; rptr++, tptr++)
+    else
     {
-	*rptr = NULL;
-	*tptr = rptr;
-    }
-    clientTable[client].hashsize++;
-    for (j = clientTable[client].buckets,
-	 rptr = clientTable[client].resources;
-	 --j >= 0;
-	 rptr++)
-    {
-	for (res = *rptr; res; res = next)
-	{
-	    next = res->next;
-	    res->next = NULL;
-	    tptr = &tails[Hash(client, res->id)];
-	    **tptr = res;
-	    *tptr = &res->next;
-	}
+	res->next = NULL;
+	TableInsert(&rrec->table, res);
     }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
+    list_add(&res->all, &rrec->all);
+    list_add(&res->byType, typeList);
+    rrec->elements++;
+    CallResourceStateCallback(ResourceStateAdding, res);
+    return TRUE;
 }
 
 void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int		cid;
-    ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int		elements;
+    ClientResourceRec *rrec;
+    ResourceTablePtr table;
+    ResourcePtr res, *slot;
+    RESTYPE	rtype;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].table.slots)
     {
-	head = &clientTable[cid].resources[Hash(cid, id)];
-	eltptr = &clientTable[cid].elements;
+	rrec = &clientTable[cid];
+	if (rrec->old.slots)
+	    RehashStep(rrec, REHASH_STEP);
 
-	prev = head;
-	while ( (res = *prev) )
+	/* newest first; the delete functions may free others as well */
+	while ((slot = FindSlot(rrec, id, &table)))
 	{
-	    if (res->id == id)
-	    {
-		RESTYPE rtype = res->type;
+	    res = *slot;
+	    rtype = res->type;
 
 #ifdef XSERVER_DTRACE
-		XSERVER_RESOURCE_FREE(res->id, res->type,
-			      res->value, TypeNameString(res->type));
+	    XSERVER_RESOURCE_FREE(res->id, res->type,
+			  res->value, TypeNameString(res->type));
 #endif		    
-		*prev = res->next;
-		elements = --*eltptr;
+	    UnlinkResource(rrec, res);
 
-		CallResourceStateCallback(ResourceStateFreeing, res);
+	    CallResourceStateCallback(ResourceStateFreeing, res);
 
-		if (rtype != skipDeleteFuncType)
-		    (*resourceTypes[rtype & TypeMask].deleteFunc)(res->value, res->id);
-		free(res);
-		if (*eltptr != elements)
-		    prev = head; /* prev may no longer be valid */
-	    }
-	    else
-		prev = &res->next;
+	    if (rtype != skipDeleteFuncType)
+		(*resourceTypes[rtype & TypeMask].deleteFunc)(res->value, res->id);
+	    free(res);
         }
     }
 }
@@ -609,23 +807,26 @@ void
 FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
     int		cid;
-    ResourcePtr res;
-    ResourcePtr *prev, *head;
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    ClientResourceRec *rrec;
+    ResourceTablePtr table;
+    ResourcePtr res, *slot;
+
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].table.slots)
     {
-	head = &clientTable[cid].resources[Hash(cid, id)];
+	rrec = &clientTable[cid];
+	if (rrec->old.slots)
+	    RehashStep(rrec, REHASH_STEP);
 
-	prev = head;
-	while ( (res = *prev) )
+	slot = FindSlot(rrec, id, &table);
+	for (res = slot ? *slot : NULL; res; res = res->next)
 	{
-	    if (res->id == id && res->type == type)
+	    if (res->type == type)
 	    {
 #ifdef XSERVER_DTRACE
 		XSERVER_RESOURCE_FREE(res->id, res->type,
 			      res->value, TypeNameString(res->type));
 #endif		    		    
-		*prev = res->next;
-		clientTable[cid].elements--;
+		UnlinkResource(rrec, res);
 
 		CallResourceStateCallback(ResourceStateFreeing, res);
 
@@ -634,8 +835,6 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 		free(res);
 		break;
 	    }
-	    else
-		prev = &res->next;
         }
     }
 }
@@ -650,14 +849,15 @@ Bool
 ChangeResourceValue (XID id, RESTYPE rtype, pointer value)
 {
     int    cid;
-    ResourcePtr res;
+    ResourceTablePtr table;
+    ResourcePtr res, *slot;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].table.slots)
     {
-	res = clientTable[cid].resources[Hash(cid, id)];
+	slot = FindSlot(&clientTable[cid], id, &table);
 
-	for (; res; res = res->next)
-	    if ((res->id == id) && (res->type == rtype))
+	for (res = slot ? *slot : NULL; res; res = res->next)
+	    if (res->type == rtype)
 	    {
 		res->value = value;
 		return TRUE;
@@ -666,10 +866,10 @@ ChangeResourceValue (XID id, RESTYPE rtype, pointer value)
     return FALSE;
 }
 
-/* Note: if func adds or deletes resources, then func can get called
- * more than once for some resources.  If func adds new resources,
- * func might or might not get called for them.  func cannot both
- * add and delete an equal number of resources!
+/* Note: func may add or delete resources.  It is called once for each
+ * resource there was when the search started and that is still there
+ * when its turn comes; new resources might or might not be found.
+ * Searches for one type only visit the resources of that type.
  */
 
 void
@@ -679,29 +879,19 @@ FindClientResourcesByType(
     FindResType func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ResourceWalkRec walk;
+    ResourcePtr this;
 
     if (!client)
 	client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) 
+    WalkStart(&walk, &clientTable[client->index], type);
+    while ((this = WalkNext(&walk)))
     {
-        for (this = resources[i]; this; this = next)
-	{
-	    next = this->next;
-	    if (!type || this->type == type) {
-		elements = *eltptr;
-		(*func)(this->value, this->id, cdata);
-		if (*eltptr != elements)
-		    next = resources[i]; /* start over */
-	    }
-	}
+	if (!type || this->type == type)
+	    (*func)(this->value, this->id, cdata);
     }
+    WalkEnd(&walk);
 }
 
 void
@@ -710,27 +900,16 @@ FindAllClientResources(
     FindAllRes func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ResourceWalkRec walk;
+    ResourcePtr this;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++)
-    {
-        for (this = resources[i]; this; this = next)
-        {
-            next = this->next;
-            elements = *eltptr;
-            (*func)(this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i]; /* start over */
-        }
-    }
+    WalkStart(&walk, &clientTable[client->index], 0);
+    while ((this = WalkNext(&walk)))
+        (*func)(this->value, this->id, this->type, cdata);
+    WalkEnd(&walk);
 }
 
 
@@ -741,26 +920,25 @@ LookupClientResourceComplex(
     FindComplexResType func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
+    ResourceWalkRec walk;
+    ResourcePtr this;
     pointer value;
-    int i;
 
     if (!client)
 	client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-	    next = this->next;
-	    if (!type || this->type == type) {
-		/* workaround func freeing the type as DRI1 does */
-		value = this->value;
-		if((*func)(value, this->id, cdata))
-		    return value;
+    WalkStart(&walk, &clientTable[client->index], type);
+    while ((this = WalkNext(&walk))) {
+	if (!type || this->type == type) {
+	    /* workaround func freeing the type as DRI1 does */
+	    value = this->value;
+	    if((*func)(value, this->id, cdata)) {
+		WalkEnd(&walk);
+		return value;
 	    }
 	}
     }
+    WalkEnd(&walk);
     return NULL;
 }
 
@@ -768,52 +946,42 @@ LookupClientResourceComplex(
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
+    ResourceWalkRec walk;
     ResourcePtr this;
-    ResourcePtr *prev;
-    int j, elements;
-    int *eltptr;
 
     if (!client)
 	return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (j=0; j < clientTable[client->index].buckets; j++) 
+    rrec = &clientTable[client->index];
+    WalkStart(&walk, rrec, 0);
+    while ((this = WalkNext(&walk)))
     {
-	prev = &resources[j];
-        while ( (this = *prev) )
+	RESTYPE rtype = this->type;
+	if (rtype & RC_NEVERRETAIN)
 	{
-	    RESTYPE rtype = this->type;
-	    if (rtype & RC_NEVERRETAIN)
-	    {
 #ifdef XSERVER_DTRACE
-		XSERVER_RESOURCE_FREE(this->id, this->type,
-			      this->value, TypeNameString(this->type));
+	    XSERVER_RESOURCE_FREE(this->id, this->type,
+			  this->value, TypeNameString(this->type));
 #endif		    
-		*prev = this->next;
-		clientTable[client->index].elements--;
+	    UnlinkResource(rrec, this);
 
-		CallResourceStateCallback(ResourceStateFreeing, this);
+	    CallResourceStateCallback(ResourceStateFreeing, this);
 
-		elements = *eltptr;
-		(*resourceTypes[rtype & TypeMask].deleteFunc)(this->value, this->id);
-		free(this);
-		if (*eltptr != elements)
-		    prev = &resources[j]; /* prev may no longer be valid */
-	    }
-	    else
-		prev = &this->next;
+	    (*resourceTypes[rtype & TypeMask].deleteFunc)(this->value, this->id);
+	    free(this);
 	}
     }
+    WalkEnd(&walk);
 }
 
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
+    ResourceWalkRec walk;
     ResourcePtr this;
-    int j;
+    RESTYPE rtype;
 
     /* This routine shouldn't be called with a null client, but just in
 	case ... */
@@ -823,41 +991,46 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (j=0; j < clientTable[client->index].buckets; j++) 
-    {
-        /* It may seem silly to update the head of this resource list as
-	we delete the members, since the entire list will be deleted any way, 
-	but there are some resource deletion functions "FreeClientPixels" for 
-	one which do a LookupID on another resource id (a Colormap id in this
-	case), so the resource list must be kept valid up to the point that
-	it is deleted, so every time we delete a resource, we must update the
-	head, just like in FreeResource. I hope that this doesn't slow down
-	mass deletion appreciably. PRH */
+    rrec = &clientTable[client->index];
 
-	ResourcePtr *head;
+    /* Resources are freed newest first, since some ddx layers depend on
+	resources being freed in the opposite order they are added.
 
-	head = &resources[j];
+	It may seem silly to keep the table up to date as we delete the
+	members, since the entire table will be deleted any way, but there
+	are some resource deletion functions "FreeClientPixels" for one
+	which do a LookupID on another resource id (a Colormap id in this
+	case), so the table must be kept valid up to the point that it is
+	deleted, so every time we delete a resource, we must unlink it,
+	just like in FreeResource.  The delete functions might even add
+	resources, hence the outer loop. */
 
-        for (this = *head; this; this = *head)
+    while (rrec->elements)
+    {
+	WalkStart(&walk, rrec, 0);
+	while ((this = WalkNext(&walk)))
 	{
-	    RESTYPE rtype = this->type;
+	    rtype = this->type;
 #ifdef XSERVER_DTRACE
 	    XSERVER_RESOURCE_FREE(this->id, this->type,
 			  this->value, TypeNameString(this->type));
 #endif		    
-	    *head = this->next;
-	    clientTable[client->index].elements--;
+	    UnlinkResource(rrec, this);
 
 	    CallResourceStateCallback(ResourceStateFreeing, this);
 
 	    (*resourceTypes[rtype & TypeMask].deleteFunc)(this->value, this->id);
 	    free(this);
 	}
+	WalkEnd(&walk);
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    free(rrec->table.slots);
+    rrec->table.slots = NULL;
+    free(rrec->old.slots);
+    rrec->old.slots = NULL;
+    free(rrec->byType);
+    rrec->byType = NULL;
+    rrec->numTypes = 0;
 }
 
 void
@@ -867,7 +1040,7 @@ FreeAllResources(void)
 
     for (i = currentMaxClients; --i >= 0; ) 
     {
-        if (clientTable[i].buckets) 
+        if (clientTable[i].table.slots) 
 	    FreeClientResources(clients[i]);
     }
 }
@@ -903,17 +1076,17 @@ dixLookupResourceByType(pointer *result, XID id, RESTYPE rtype,
 			ClientPtr client, Mask mode)
 {
     int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    ResourceTablePtr table;
+    ResourcePtr res = NULL, *slot;
 
     *result = NULL;
     if ((rtype & TypeMask) > lastResourceType)
 	return BadImplementation;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-	res = clientTable[cid].resources[Hash(cid, id)];
-
-	for (; res; res = res->next)
-	    if (res->id == id && res->type == rtype)
+    if ((cid < MAXCLIENTS) && clientTable[cid].table.slots &&
+	(slot = FindSlot(&clientTable[cid], id, &table))) {
+	for (res = *slot; res; res = res->next)
+	    if (res->type == rtype)
 		break;
     }
     if (!res)
@@ -938,15 +1111,15 @@ dixLookupResourceByClass(pointer *result, XID id, RESTYPE rclass,
 			 ClientPtr client, Mask mode)
 {
     int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    ResourceTablePtr table;
+    ResourcePtr res = NULL, *slot;
 
     *result = NULL;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-	res = clientTable[cid].resources[Hash(cid, id)];
-
-	for (; res; res = res->next)
-	    if (res->id == id && (res->type & rclass))
+    if ((cid < MAXCLIENTS) && clientTable[cid].table.slots &&
+	(slot = FindSlot(&clientTable[cid], id, &table))) {
+	for (res = *slot; res; res = res->next)
+	    if (res->type & rclass)
 		break;
     }
     if (!res)
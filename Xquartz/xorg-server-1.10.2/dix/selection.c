@@ -206,7 +206,7 @@ ProcSetSelectionOwner(ClientPtr client)
 	rc = XaceHookSelectionAccess(client, &pSel,
 				     DixCreateAccess|DixSetAttrAccess);
 	if (rc != Success) {
-	    free(pSel);
+	    dixFreeObjectWithPrivates(pSel, PRIVATE_SELECTION);
 	    return rc;
 	}
 
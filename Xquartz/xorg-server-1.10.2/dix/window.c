@@ -216,6 +216,265 @@ PrintWindowTree(void)
 }
 #endif
 
+/******
+ * Hit index
+ *
+ *    Pointer hit-testing walks down the tree looking for the topmost
+ *    mapped child containing the point.  Windows with many children get
+ *    a grid over their interior; each cell lists the mapped children whose
+ *    border box touches it, so only those need testing.  Boxes reaching
+ *    past the interior are clamped to the edge cells, as the point can
+ *    be in the parent's border.  Children are ranked in stacking order to
+ *    pick the topmost of the candidates; ranks are recomputed lazily
+ *    after the stacking order changes.
+ *
+ *    The grid is built the first time a walk has to look at HIT_INDEX_MIN
+ *    children, and kept up to date from then on by the functions that map,
+ *    unmap, move, resize and restack windows.  It is laid out again when
+ *    the parent itself changes size.
+ ******/
+
+#define HIT_INDEX_MIN	32	/* children walked before indexing */
+#define HIT_GRID	16	/* cells along each side */
+
+typedef struct _HitCell {
+    WindowPtr	*wins;
+    int		num;
+    int		size;
+} HitCellRec, *HitCellPtr;
+
+typedef struct _HitIndex {
+    int		width, height;	/* parent size the grid was laid out for */
+    Bool	ranksValid;
+    HitCellRec	cells[HIT_GRID * HIT_GRID];
+} HitIndexRec, *HitIndexPtr;
+
+typedef struct _HitWindow {
+    HitIndexPtr	index;		/* of the children, if any */
+    Bool	inParent;	/* listed in the parent's index */
+    int		rank;		/* stacking position among the siblings */
+    short	cx1, cy1, cx2, cy2; /* cells of the parent listing it */
+} HitWindowRec, *HitWindowPtr;
+
+static DevPrivateKeyRec hitWindowKeyRec;
+#define hitWindowKey (&hitWindowKeyRec)
+
+#define HitWindow(pWin) \
+    ((HitWindowPtr)dixLookupPrivate(&(pWin)->devPrivates, hitWindowKey))
+
+static int
+HitCellCoord(int v, int size)
+{
+    if (v < 0)
+	return 0;
+    if (v >= size)
+	return HIT_GRID - 1;
+    return v * HIT_GRID / size;
+}
+
+static Bool
+HitCellAdd(HitCellPtr cell, WindowPtr pWin)
+{
+    if (cell->num == cell->size)
+    {
+	int size = cell->size ? cell->size * 2 : 4;
+	WindowPtr *wins = realloc(cell->wins, size * sizeof(WindowPtr));
+
+	if (!wins)
+	    return FALSE;
+	cell->wins = wins;
+	cell->size = size;
+    }
+    cell->wins[cell->num++] = pWin;
+    return TRUE;
+}
+
+static void
+HitCellRemove(HitCellPtr cell, WindowPtr pWin)
+{
+    int i;
+
+    for (i = 0; i < cell->num; i++)
+	if (cell->wins[i] == pWin)
+	{
+	    cell->wins[i] = cell->wins[--cell->num];
+	    return;
+	}
+}
+
+static void
+HitIndexRemove(HitIndexPtr index, WindowPtr pWin)
+{
+    HitWindowPtr hit = HitWindow(pWin);
+    int x, y;
+
+    if (!hit->inParent)
+	return;
+    for (y = hit->cy1; y <= hit->cy2; y++)
+	for (x = hit->cx1; x <= hit->cx2; x++)
+	    HitCellRemove(&index->cells[y * HIT_GRID + x], pWin);
+    hit->inParent = FALSE;
+}
+
+static Bool
+HitIndexAdd(HitIndexPtr index, WindowPtr pWin)
+{
+    HitWindowPtr hit = HitWindow(pWin);
+    int bw = wBorderWidth(pWin);
+    int x, y;
+
+    hit->cx1 = HitCellCoord(pWin->origin.x - bw, index->width);
+    hit->cy1 = HitCellCoord(pWin->origin.y - bw, index->height);
+    hit->cx2 = HitCellCoord(pWin->origin.x + (int)pWin->drawable.width + bw - 1,
+			    index->width);
+    hit->cy2 = HitCellCoord(pWin->origin.y + (int)pWin->drawable.height + bw - 1,
+			    index->height);
+    for (y = hit->cy1; y <= hit->cy2; y++)
+	for (x = hit->cx1; x <= hit->cx2; x++)
+	    if (!HitCellAdd(&index->cells[y * HIT_GRID + x], pWin))
+	    {
+		hit->inParent = TRUE;
+		HitIndexRemove(index, pWin);
+		return FALSE;
+	    }
+    hit->inParent = TRUE;
+    return TRUE;
+}
+
+static void
+FreeHitIndex(WindowPtr pParent)
+{
+    HitWindowPtr hit = HitWindow(pParent);
+    WindowPtr pChild;
+    int i;
+
+    if (!hit->index)
+	return;
+    for (i = 0; i < HIT_GRID * HIT_GRID; i++)
+	free(hit->index->cells[i].wins);
+    free(hit->index);
+    hit->index = NULL;
+    for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+	HitWindow(pChild)->inParent = FALSE;
+}
+
+/*
+ * Lay out the grid of pParent for its current size and list all its
+ * mapped children.  If memory runs out the window is left unindexed.
+ */
+static void
+BuildHitIndex(WindowPtr pParent)
+{
+    HitWindowPtr hit = HitWindow(pParent);
+    HitIndexPtr index;
+    WindowPtr pChild;
+
+    FreeHitIndex(pParent);
+    index = calloc(1, sizeof(HitIndexRec));
+    if (!index)
+	return;
+    index->width = max(pParent->drawable.width, 1);
+    index->height = max(pParent->drawable.height, 1);
+    hit->index = index;
+    for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+	if (pChild->mapped && !HitIndexAdd(index, pChild))
+	{
+	    FreeHitIndex(pParent);
+	    return;
+	}
+}
+
+/*
+ * Bring the entry of pWin in its parent's grid up to date with its
+ * mapped state and geometry.
+ */
+static void
+HitIndexUpdate(WindowPtr pWin)
+{
+    HitIndexPtr index;
+
+    if (!pWin->parent || !(index = HitWindow(pWin->parent)->index))
+	return;
+    if (HitWindow(pWin)->inParent)
+	HitIndexRemove(index, pWin);
+    else
+	index->ranksValid = FALSE;
+    if (pWin->mapped && !HitIndexAdd(index, pWin))
+	FreeHitIndex(pWin->parent);
+}
+
+static void
+HitIndexRestack(WindowPtr pParent)
+{
+    HitIndexPtr index = HitWindow(pParent)->index;
+
+    if (index)
+	index->ranksValid = FALSE;
+}
+
+/*****
+ * ChildAtPoint
+ *    Returns the topmost mapped child of pParent for which hit(pChild, x, y)
+ *    is TRUE, or NULL.  x and y are in screen coordinates, hit only has
+ *    to be called for children whose border box contains the point.
+ *****/
+
+WindowPtr
+ChildAtPoint(WindowPtr pParent, int x, int y, ChildHitProcPtr hit)
+{
+    HitIndexPtr index = HitWindow(pParent)->index;
+    HitCellPtr cell;
+    WindowPtr pChild, pBest;
+    int i, rank, walked;
+
+    if (index && (index->width != max(pParent->drawable.width, 1) ||
+		  index->height != max(pParent->drawable.height, 1)))
+    {
+	BuildHitIndex(pParent);
+	index = HitWindow(pParent)->index;
+    }
+
+    if (!index)
+    {
+	walked = 0;
+	for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+	{
+	    if (pChild->mapped && (*hit)(pChild, x, y))
+		break;
+	    walked++;
+	}
+	if (walked >= HIT_INDEX_MIN)
+	    BuildHitIndex(pParent);
+	return pChild;
+    }
+
+    if (!index->ranksValid)
+    {
+	rank = 0;
+	for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+	    HitWindow(pChild)->rank = rank++;
+	index->ranksValid = TRUE;
+    }
+
+    cell = &index->cells[HitCellCoord(y - pParent->drawable.y, index->height) *
+			 HIT_GRID +
+			 HitCellCoord(x - pParent->drawable.x, index->width)];
+    pBest = NULL;
+    rank = 0;
+    for (i = 0; i < cell->num; i++)
+    {
+	pChild = cell->wins[i];
+	if (pBest && HitWindow(pChild)->rank > rank)
+	    continue;
+	if ((*hit)(pChild, x, y))
+	{
+	    pBest = pChild;
+	    rank = HitWindow(pChild)->rank;
+	}
+    }
+    return pBest;
+}
+
 int
 TraverseTree(WindowPtr pWin, VisitWindowProcPtr func, pointer data)
 {
@@ -359,6 +618,10 @@ CreateRootWindow(ScreenPtr pScreen)
     BoxRec	box;
     PixmapFormatRec *format;
 
+    if (!dixRegisterPrivateKey(hitWindowKey, PRIVATE_WINDOW,
+			       sizeof(HitWindowRec)))
+	return FALSE;
+
     pWin = dixAllocateObjectWithPrivates(WindowRec, PRIVATE_WINDOW);
     if (!pWin)
 	return FALSE;
@@ -392,8 +655,10 @@ CreateRootWindow(ScreenPtr pScreen)
     pWin->optional->dontPropagateMask = 0;
     pWin->optional->otherEventMasks = 0;
     pWin->optional->otherClients = NULL;
+    pWin->optional->eventIndex = NULL;
     pWin->optional->passiveGrabs = NULL;
     pWin->optional->userProps = NULL;
+    pWin->optional->propIndex = NULL;
     pWin->optional->backingBitPlanes = ~0L;
     pWin->optional->backingPixel = 0;
     pWin->optional->boundingShape = NULL;
@@ -825,6 +1090,7 @@ FreeWindowResources(WindowPtr pWin)
     DeleteWindowFromAnySaveSet(pWin);
     DeleteWindowFromAnySelections(pWin);
     DeleteWindowFromAnyEvents(pWin, TRUE);
+    FreeHitIndex(pWin);
     RegionUninit(&pWin->clipList);
     RegionUninit(&pWin->winSize);
     RegionUninit(&pWin->borderClip);
@@ -1568,6 +1834,7 @@ MoveWindowInStack(WindowPtr pWin, WindowPtr pNextSib)
 		     pFirstChange = pFirstChange->nextSib;
 	    }
 	}
+	HitIndexRestack(pParent);
 	if(pWin->drawable.pScreen->RestackWindow)
 	    (*pWin->drawable.pScreen->RestackWindow)(pWin, pOldNextSib);
     }
@@ -1761,6 +2028,8 @@ ResizeChildrenWinSize(WindowPtr pWin, int dx, int dy, int dw, int dh)
 	SetWinSize (pSib);
 	SetBorderSize (pSib);
 	(*pScreen->PositionWindow)(pSib, pSib->drawable.x, pSib->drawable.y);
+	if (resized)
+	    HitIndexUpdate(pSib);
 
 	if ( (pChild = pSib->firstChild) )
 	{
@@ -2364,7 +2633,10 @@ ActuallyDoSomething:
 	ReflectStackChange(pWin, pSib, VTOther);
 
     if (action != RESTACK_WIN)
+    {
+	HitIndexUpdate(pWin);
 	CheckCursorConfinement(pWin);
+    }
     return Success;
 #undef RESTACK_WIN
 #undef MOVE_WIN
@@ -2646,6 +2918,7 @@ MapWindow(WindowPtr pWin, ClientPtr client)
 	}
 
 	pWin->mapped = TRUE;
+	HitIndexUpdate(pWin);
 	if (SubStrSend(pWin, pParent) && MapUnmapEventsEnabled(pWin))
 	{
 	    memset(&event, 0, sizeof(xEvent));
@@ -2734,6 +3007,7 @@ MapSubwindows(WindowPtr pParent, ClientPtr client)
 	    }
     
 	    pWin->mapped = TRUE;
+	    HitIndexUpdate(pWin);
 	    if (parentNotify || StrSend(pWin))
 	    {
 		memset(&event, 0, sizeof(xEvent));
@@ -2863,6 +3137,7 @@ UnmapWindow(WindowPtr pWin, Bool fromConfigure)
 	(*pScreen->MarkWindow)(pLayerWin->parent);
     }
     pWin->mapped = FALSE;
+    HitIndexUpdate(pWin);
     if (wasRealized)
 	UnrealizeTree(pWin, fromConfigure);
     if (wasViewable)
@@ -2923,6 +3198,7 @@ UnmapSubwindows(WindowPtr pWin)
 		anyMarked = TRUE;
 	    }
 	    pChild->mapped = FALSE;
+	    HitIndexUpdate(pChild);
 	    if (pChild->realized)
 		UnrealizeTree(pChild, FALSE);
 	    if (wasViewable)
@@ -2997,7 +3273,10 @@ HandleSaveSet(ClientPtr client)
 			       pWin->drawable.y - wBorderWidth (pWin) - pParent->drawable.y,
 			       client);
 		if(!pWin->realized && pWin->mapped)
+		{
 		    pWin->mapped = FALSE;
+		    HitIndexUpdate(pWin);
+		}
 	    }
 #ifdef XFIXES
 	    if (SaveSetShouldMap (client->saveSet[j]))
@@ -3184,6 +3463,7 @@ dixSaveScreens(ClientPtr client, int on, int mode)
 			   (short)(-(rand() % RANDOM_WIDTH)),
 			   (short)(-(rand() % RANDOM_WIDTH)),
 			   pWin->nextSib, VTMove);
+		HitIndexUpdate(pWin);
 		screenIsSaved = SCREEN_SAVER_ON;
 	    }
 	    /*
@@ -3444,8 +3724,10 @@ MakeWindowOptional (WindowPtr pWin)
     optional->dontPropagateMask = DontPropagateMasks[pWin->dontPropagate];
     optional->otherEventMasks = 0;
     optional->otherClients = NULL;
+    optional->eventIndex = NULL;
     optional->passiveGrabs = NULL;
     optional->userProps = NULL;
+    optional->propIndex = NULL;
     optional->backingBitPlanes = ~0L;
     optional->backingPixel = 0;
     optional->boundingShape = NULL;
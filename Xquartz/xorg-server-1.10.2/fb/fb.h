@@ -1634,6 +1634,9 @@ fbCreatePixmap (ScreenPtr pScreen, int width, int height, int depth,
 extern _X_EXPORT Bool
 fbDestroyPixmap (PixmapPtr pPixmap);
 
+extern _X_EXPORT void
+fbFlushPixmapCache (ScreenPtr pScreen);
+
 extern _X_EXPORT RegionPtr
 fbPixmapToRegion(PixmapPtr pPix);
 
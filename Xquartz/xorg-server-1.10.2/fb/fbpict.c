@@ -139,20 +139,30 @@ create_conical_gradient_image (PictGradient *gradient)
 	gradient->nstops);
 }
 
-static pixman_image_t *
-create_bits_picture (PicturePtr pict,
-		     Bool       has_clip)
+static FbBits *
+get_picture_bits (PicturePtr pict, FbStride *pStride)
 {
     FbBits *bits;
     FbStride stride;
     int bpp, xoff, yoff;
-    pixman_image_t *image;
-    
+
     fbGetDrawable (pict->pDrawable, bits, stride, bpp, xoff, yoff);
 
-    bits = (FbBits*)((CARD8*)bits +
+    *pStride = stride;
+    return (FbBits*)((CARD8*)bits +
 		     (pict->pDrawable->y + yoff) * stride * sizeof(FbBits) +
 		     (pict->pDrawable->x + xoff) * (bpp / 8));
+}
+
+static pixman_image_t *
+create_bits_picture (PicturePtr pict,
+		     Bool       has_clip)
+{
+    FbBits *bits;
+    FbStride stride;
+    pixman_image_t *image;
+    
+    bits = get_picture_bits (pict, &stride);
 
     image = pixman_image_create_bits (
 	pict->format,
@@ -310,9 +320,48 @@ image_from_pict_internal (PicturePtr pict,
     return image;
 }
 
+#ifndef FB_ACCESS_WRAPPER
+/*
+ * Composite operands keep their image in pict->pImage, which the render
+ * code drops when the picture changes.  Drawable pictures are only cached
+ * once validated, and the image is checked against where the bits of the
+ * drawable are now, in case the storage was swapped underneath it.
+ * Pictures with an alpha map aren't cached, as the alpha map can change
+ * on its own.
+ */
+static pixman_image_t *
+image_from_pict_cached (PicturePtr pict)
+{
+    FbBits *bits;
+    FbStride stride;
+
+    if (pict->pDrawable)
+    {
+	if (pict->serialNumber != pict->pDrawable->serialNumber)
+	    return image_from_pict_internal (pict, TRUE, FALSE);
+
+	bits = get_picture_bits (pict, &stride);
+	if (pict->pImage &&
+	    ((FbBits *) pixman_image_get_data (pict->pImage) != bits ||
+	     pixman_image_get_stride (pict->pImage) != stride * sizeof (FbBits)))
+	    PictureDropImage (pict);
+    }
+
+    if (!pict->pImage)
+	pict->pImage = image_from_pict_internal (pict, TRUE, FALSE);
+    if (pict->pImage)
+	pixman_image_ref (pict->pImage);
+    return pict->pImage;
+}
+#endif
+
 pixman_image_t *
 image_from_pict (PicturePtr pict, Bool has_clip)
 {
+#ifndef FB_ACCESS_WRAPPER
+    if (pict && has_clip && !pict->alphaMap)
+	return image_from_pict_cached (pict);
+#endif
     return image_from_pict_internal (pict, has_clip, FALSE);
 }
 
@@ -323,6 +372,242 @@ free_pixman_pict (PicturePtr pict, pixman_image_t *image)
 	fbFinishAccess (pict->pDrawable);
 }
 
+/*
+ * Glyph atlas.  Glyphs up to FB_GLYPH_CELL pixels square are copied into
+ * the cells of one image per format, found again by their sha1, so
+ * fbGlyphs composites a whole request from a few images without setting up
+ * a picture per glyph.  Glyphs in different glyph sets but with the same
+ * bits share a cell.  Once an atlas is full, its cells are reused in
+ * turn.
+ */
+#define FB_GLYPH_CELL		32
+#define FB_GLYPH_ATLAS_COLUMNS	32
+#define FB_GLYPH_ATLAS_CELLS	(FB_GLYPH_ATLAS_COLUMNS * 32)
+#define FB_GLYPH_ATLAS_HASH	(FB_GLYPH_ATLAS_CELLS * 2)
+
+#define NeedsComponent(f) (PICT_FORMAT_A(f) != 0 && PICT_FORMAT_RGB(f) != 0)
+
+typedef struct _FbGlyphAtlas {
+    struct _FbGlyphAtlas	*next;
+    pixman_format_code_t	format;
+    pixman_image_t		*image;
+    int				used;	/* cells filled so far */
+    int				evict;	/* cell to reuse next when full */
+    int				hash[FB_GLYPH_ATLAS_HASH];	/* first cell + 1 */
+    int				chain[FB_GLYPH_ATLAS_CELLS];	/* next cell + 1 */
+    unsigned char		sha1[FB_GLYPH_ATLAS_CELLS][20];
+} FbGlyphAtlasRec, *FbGlyphAtlasPtr;
+
+static FbGlyphAtlasPtr fbGlyphAtlases;
+
+#define FbGlyphHash(sha1) \
+    (((sha1)[0] | ((sha1)[1] << 8) | ((sha1)[2] << 16)) & (FB_GLYPH_ATLAS_HASH - 1))
+
+static FbGlyphAtlasPtr
+fbGetGlyphAtlas (pixman_format_code_t format)
+{
+    FbGlyphAtlasPtr atlas;
+
+    for (atlas = fbGlyphAtlases; atlas; atlas = atlas->next)
+	if (atlas->format == format)
+	    return atlas;
+
+    atlas = calloc (1, sizeof (FbGlyphAtlasRec));
+    if (!atlas)
+	return NULL;
+    atlas->image = pixman_image_create_bits (
+	format, FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL,
+	FB_GLYPH_ATLAS_CELLS / FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL,
+	NULL, 0);
+    if (!atlas->image)
+    {
+	free (atlas);
+	return NULL;
+    }
+    pixman_image_set_component_alpha (atlas->image, NeedsComponent (format));
+    atlas->format = format;
+    atlas->next = fbGlyphAtlases;
+    fbGlyphAtlases = atlas;
+    return atlas;
+}
+
+/*
+ * Find the atlas cell holding glyph, copying it in from its picture if it
+ * isn't there yet.  Returns the atlas image and the position of the glyph
+ * in it, or NULL if the glyph doesn't go in an atlas.
+ */
+static pixman_image_t *
+fbGlyphAtlasLookup (GlyphPtr glyph, PicturePtr pPicture, int *x, int *y)
+{
+    FbGlyphAtlasPtr atlas;
+    pixman_image_t *image;
+    int *prev;
+    int cell;
+
+    if (glyph->info.width > FB_GLYPH_CELL || glyph->info.height > FB_GLYPH_CELL)
+	return NULL;
+    atlas = fbGetGlyphAtlas (pPicture->format);
+    if (!atlas)
+	return NULL;
+
+    for (cell = atlas->hash[FbGlyphHash (glyph->sha1)]; cell;
+	 cell = atlas->chain[cell - 1])
+    {
+	if (!memcmp (atlas->sha1[cell - 1], glyph->sha1, 20))
+	    break;
+    }
+
+    if (!cell)
+    {
+	image = image_from_pict (pPicture, FALSE);
+	if (!image)
+	    return NULL;
+
+	if (atlas->used < FB_GLYPH_ATLAS_CELLS)
+	    cell = ++atlas->used;
+	else
+	{
+	    cell = atlas->evict + 1;
+	    atlas->evict = cell % FB_GLYPH_ATLAS_CELLS;
+	    for (prev = &atlas->hash[FbGlyphHash (atlas->sha1[cell - 1])];
+		 *prev != cell;
+		 prev = &atlas->chain[*prev - 1])
+		;
+	    *prev = atlas->chain[cell - 1];
+	}
+	memcpy (atlas->sha1[cell - 1], glyph->sha1, 20);
+	atlas->chain[cell - 1] = atlas->hash[FbGlyphHash (glyph->sha1)];
+	atlas->hash[FbGlyphHash (glyph->sha1)] = cell;
+
+	pixman_image_composite (PIXMAN_OP_SRC, image, NULL, atlas->image,
+				0, 0, 0, 0,
+				(cell - 1) % FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL,
+				(cell - 1) / FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL,
+				glyph->info.width, glyph->info.height);
+	free_pixman_pict (pPicture, image);
+    }
+
+    *x = (cell - 1) % FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL;
+    *y = (cell - 1) / FB_GLYPH_ATLAS_COLUMNS * FB_GLYPH_CELL;
+    return atlas->image;
+}
+
+/*
+ * Render a whole CompositeGlyphs request with pixman directly: the source,
+ * destination and any mask are set up once, and each glyph is a single
+ * composite from its atlas cell, in place of the CompositePicture per
+ * glyph of miGlyphs.
+ */
+void
+fbGlyphs (CARD8		op,
+	  PicturePtr	pSrc,
+	  PicturePtr	pDst,
+	  PictFormatPtr	maskFormat,
+	  INT16		xSrc,
+	  INT16		ySrc,
+	  int		nlist,
+	  GlyphListPtr	list,
+	  GlyphPtr	*glyphs)
+{
+    ScreenPtr	    pScreen = pDst->pDrawable->pScreen;
+    pixman_image_t  *src, *dest, *mask = NULL, *image, *unatlased;
+    PicturePtr	    pPicture;
+    GlyphPtr	    glyph;
+    BoxRec	    extents;
+    int		    xDst = list->xOff, yDst = list->yOff;
+    int		    x, y, xGlyph, yGlyph, xCell, yCell, n;
+
+    miGlyphExtents (nlist, list, glyphs, &extents);
+    if (extents.x2 <= extents.x1 || extents.y2 <= extents.y1)
+	return;
+    miCompositeSourceValidate (pSrc, xSrc + extents.x1 - xDst,
+			       ySrc + extents.y1 - yDst,
+			       extents.x2 - extents.x1,
+			       extents.y2 - extents.y1);
+
+    src = image_from_pict (pSrc, TRUE);
+    dest = image_from_pict (pDst, TRUE);
+    if (!src || !dest)
+	goto out;
+
+    x = 0;
+    y = 0;
+    if (maskFormat)
+    {
+	mask = pixman_image_create_bits (maskFormat->format,
+					 extents.x2 - extents.x1,
+					 extents.y2 - extents.y1, NULL, 0);
+	if (!mask)
+	    goto out;
+	pixman_image_set_component_alpha (mask,
+					  NeedsComponent (maskFormat->format));
+	x = -extents.x1;
+	y = -extents.y1;
+    }
+
+    while (nlist--)
+    {
+	x += list->xOff;
+	y += list->yOff;
+	n = list->len;
+	while (n--)
+	{
+	    glyph = *glyphs++;
+	    pPicture = GlyphPicture (glyph)[pScreen->myNum];
+
+	    if (pPicture && glyph->info.width && glyph->info.height)
+	    {
+		xGlyph = x - glyph->info.x;
+		yGlyph = y - glyph->info.y;
+		unatlased = NULL;
+		image = fbGlyphAtlasLookup (glyph, pPicture, &xCell, &yCell);
+		if (!image)
+		{
+		    image = unatlased = image_from_pict (pPicture, FALSE);
+		    xCell = yCell = 0;
+		}
+
+		if (!image)
+		    ;
+		else if (mask)
+		    pixman_image_composite (PIXMAN_OP_ADD, image, NULL, mask,
+					    xCell, yCell, 0, 0,
+					    xGlyph, yGlyph,
+					    glyph->info.width,
+					    glyph->info.height);
+		else
+		    pixman_image_composite (op, src, image, dest,
+					    xSrc + xGlyph - xDst,
+					    ySrc + yGlyph - yDst,
+					    xCell, yCell,
+					    xGlyph, yGlyph,
+					    glyph->info.width,
+					    glyph->info.height);
+		free_pixman_pict (pPicture, unatlased);
+	    }
+
+	    x += glyph->info.xOff;
+	    y += glyph->info.yOff;
+	}
+	list++;
+    }
+
+    if (mask)
+	pixman_image_composite (op, src, mask, dest,
+				xSrc + extents.x1 - xDst,
+				ySrc + extents.y1 - yDst,
+				0, 0,
+				extents.x1, extents.y1,
+				extents.x2 - extents.x1,
+				extents.y2 - extents.y1);
+
+out:
+    if (mask)
+	pixman_image_unref (mask);
+    free_pixman_pict (pSrc, src);
+    free_pixman_pict (pDst, dest);
+}
+
 Bool
 fbPictureInit (ScreenPtr pScreen, PictFormatPtr formats, int nformats)
 {
@@ -333,7 +618,7 @@ fbPictureInit (ScreenPtr pScreen, PictFormatPtr formats, int nformats)
 	return FALSE;
     ps = GetPictureScreen(pScreen);
     ps->Composite = fbComposite;
-    ps->Glyphs = miGlyphs;
+    ps->Glyphs = fbGlyphs;
     ps->CompositeRects = miCompositeRects;
     ps->RasterizeTrapezoid = fbRasterizeTrapezoid;
     ps->AddTraps = fbAddTraps;
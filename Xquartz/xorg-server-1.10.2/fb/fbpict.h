@@ -43,6 +43,17 @@ fbComposite (CARD8      op,
 	     CARD16     width,
 	     CARD16     height);
 
+extern _X_EXPORT void
+fbGlyphs (CARD8		op,
+	  PicturePtr	pSrc,
+	  PicturePtr	pDst,
+	  PictFormatPtr	maskFormat,
+	  INT16		xSrc,
+	  INT16		ySrc,
+	  int		nlist,
+	  GlyphListPtr	list,
+	  GlyphPtr	*glyphs);
+
 /* fbtrap.c */
 
 extern _X_EXPORT void
@@ -27,6 +27,162 @@
 #include <stdlib.h>
 
 #include "fb.h"
+#include "list.h"
+
+/*
+ * The storage of destroyed pixmaps is kept for new pixmaps of the same
+ * size, depth and bpp.  The cache holds at most FB_PIXMAP_CACHE_BYTES, the
+ * least recently freed storage going first, and doesn't keep pixmaps
+ * larger than FB_PIXMAP_CACHE_LARGEST.  While the storage is unused, the
+ * pixmap record at its start holds the cache entry, which is no larger.
+ */
+#define FB_PIXMAP_CACHE_BYTES	(16 << 20)
+#define FB_PIXMAP_CACHE_LARGEST	(FB_PIXMAP_CACHE_BYTES / 16)
+#define FB_PIXMAP_CACHE_HASH	64
+
+typedef struct _FbCachedPixmap {
+    struct list	lru;
+    struct list	bucket;
+    ScreenPtr	pScreen;
+    int		base;
+    int		width, height;
+    CARD8	depth, bpp;
+    unsigned	size;
+} FbCachedPixmapRec, *FbCachedPixmapPtr;
+
+static struct list fbPixmapLRU;
+static struct list fbPixmapBuckets[FB_PIXMAP_CACHE_HASH];
+static Bool fbPixmapCacheReady;
+
+#define FbPixmapHash(w, h, bpp) \
+    ((((w) * 31 + (h)) * 7 + (bpp)) & (FB_PIXMAP_CACHE_HASH - 1))
+
+static void
+fbInitPixmapCache (void)
+{
+    int	i;
+
+    list_init(&fbPixmapLRU);
+    for (i = 0; i < FB_PIXMAP_CACHE_HASH; i++)
+	list_init(&fbPixmapBuckets[i]);
+    fbPixmapCacheReady = TRUE;
+}
+
+static void
+fbUncachePixmap (FbCachedPixmapPtr pCached)
+{
+    list_del(&pCached->lru);
+    list_del(&pCached->bucket);
+    PixmapCacheStats.bytes -= pCached->size;
+}
+
+static PixmapPtr
+fbTakeCachedPixmap (ScreenPtr pScreen, int width, int height,
+		    int depth, int bpp)
+{
+    FbCachedPixmapPtr	pCached;
+    PixmapPtr		pPixmap;
+
+    if (!fbPixmapCacheReady)
+	return NullPixmap;
+    list_for_each_entry(pCached,
+			&fbPixmapBuckets[FbPixmapHash(width, height, bpp)],
+			bucket)
+    {
+	if (pCached->width == width && pCached->height == height &&
+	    pCached->bpp == bpp && pCached->depth == depth &&
+	    pCached->pScreen == pScreen &&
+	    pCached->base == pScreen->totalPixmapSize)
+	{
+	    fbUncachePixmap(pCached);
+	    PixmapCacheStats.hits++;
+	    pPixmap = (PixmapPtr) pCached;
+	    dixInitPrivates(pPixmap, pPixmap + 1, PRIVATE_PIXMAP);
+	    return pPixmap;
+	}
+    }
+    return NullPixmap;
+}
+
+/*
+ * Keep the storage of a pixmap whose last reference is gone, if it still
+ * has the layout fbCreatePixmapBpp gave it.
+ */
+static Bool
+fbCachePixmap (PixmapPtr pPixmap)
+{
+    ScreenPtr		pScreen = pPixmap->drawable.pScreen;
+    int			width = pPixmap->drawable.width;
+    int			height = pPixmap->drawable.height;
+    int			bpp = pPixmap->drawable.bitsPerPixel;
+    FbCachedPixmapPtr	pCached;
+    size_t		paddedWidth;
+    size_t		size;
+    char		*bits;
+    int			base, adjust;
+
+    if (!width || !height)
+	return FALSE;
+    paddedWidth = ((width * bpp + FB_MASK) >> FB_SHIFT) * sizeof (FbBits);
+    base = pScreen->totalPixmapSize;
+    adjust = 0;
+    if (base & 7)
+	adjust = 8 - (base & 7);
+    bits = (char *) pPixmap + base + adjust;
+    size = base + adjust + height * paddedWidth;
+#ifdef FB_DEBUG
+    bits += paddedWidth;
+    size += 2 * paddedWidth;
+#endif
+    if (pPixmap->devKind != (int) paddedWidth ||
+	pPixmap->devPrivate.ptr != bits ||
+	size > FB_PIXMAP_CACHE_LARGEST)
+	return FALSE;
+
+    if (!fbPixmapCacheReady)
+	fbInitPixmapCache();
+    dixFiniPrivates(pPixmap, PRIVATE_PIXMAP);
+    pCached = (FbCachedPixmapPtr) pPixmap;
+    pCached->pScreen = pScreen;
+    pCached->base = base;
+    pCached->width = width;
+    pCached->height = height;
+    pCached->depth = pPixmap->drawable.depth;
+    pCached->bpp = bpp;
+    pCached->size = size;
+    list_add(&pCached->lru, &fbPixmapLRU);
+    list_add(&pCached->bucket, &fbPixmapBuckets[FbPixmapHash(width, height, bpp)]);
+    PixmapCacheStats.bytes += size;
+
+    while (PixmapCacheStats.bytes > FB_PIXMAP_CACHE_BYTES)
+    {
+	pCached = list_entry(fbPixmapLRU.prev, FbCachedPixmapRec, lru);
+	fbUncachePixmap(pCached);
+	dixSlabFree(pCached);
+	PixmapCacheStats.evictions++;
+    }
+    return TRUE;
+}
+
+/*
+ * Drop the cached storage of pixmaps of pScreen, or of all screens when
+ * pScreen is NULL.
+ */
+void
+fbFlushPixmapCache (ScreenPtr pScreen)
+{
+    FbCachedPixmapPtr	pCached, pNext;
+
+    if (!fbPixmapCacheReady)
+	return;
+    list_for_each_entry_safe(pCached, pNext, &fbPixmapLRU, lru)
+    {
+	if (pScreen && pCached->pScreen != pScreen)
+	    continue;
+	fbUncachePixmap(pCached);
+	dixSlabFree(pCached);
+    }
+}
 
 PixmapPtr
 fbCreatePixmapBpp (ScreenPtr pScreen, int width, int height, int depth, int bpp,
@@ -50,9 +206,14 @@ fbCreatePixmapBpp (ScreenPtr pScreen, int width, int height, int depth, int bpp,
 #ifdef FB_DEBUG
     datasize += 2 * paddedWidth;
 #endif
-    pPixmap = AllocatePixmap(pScreen, datasize);
+    pPixmap = fbTakeCachedPixmap(pScreen, width, height, depth, bpp);
     if (!pPixmap)
-	return NullPixmap;
+    {
+	PixmapCacheStats.misses++;
+	pPixmap = AllocatePixmap(pScreen, datasize);
+	if (!pPixmap)
+	    return NullPixmap;
+    }
     pPixmap->drawable.type = DRAWABLE_PIXMAP;
     pPixmap->drawable.class = 0;
     pPixmap->drawable.pScreen = pScreen;
@@ -101,7 +262,8 @@ fbDestroyPixmap (PixmapPtr pPixmap)
 {
     if(--pPixmap->refcnt)
 	return TRUE;
-    FreePixmap(pPixmap);
+    if (!fbCachePixmap(pPixmap))
+	FreePixmap(pPixmap);
     return TRUE;
 }
 
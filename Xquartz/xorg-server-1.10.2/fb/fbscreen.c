@@ -32,6 +32,7 @@ fbCloseScreen (int index, ScreenPtr pScreen)
     int	    d;
     DepthPtr	depths = pScreen->allowedDepths;
 
+    fbFlushPixmapCache(pScreen);
     for (d = 0; d < pScreen->numDepths; d++)
 	free(depths[d].vids);
     free(depths);
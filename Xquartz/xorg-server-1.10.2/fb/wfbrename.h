@@ -67,6 +67,7 @@
 #define fbFillRegionSolid wfbFillRegionSolid
 #define fbFillSpans wfbFillSpans
 #define fbFixCoordModePrevious wfbFixCoordModePrevious
+#define fbFlushPixmapCache wfbFlushPixmapCache
 #define fbGCFuncs wfbGCFuncs
 #define fbGCOps wfbGCOps
 #define fbGCPrivateKeyRec wfbGCPrivateKeyRec
@@ -83,6 +84,7 @@
 #define fbGlyph32 wfbGlyph32
 #define fbGlyph8 wfbGlyph8
 #define fbGlyphIn wfbGlyphIn
+#define fbGlyphs wfbGlyphs
 #define fbHasVisualTypes wfbHasVisualTypes
 #define fbImageGlyphBlt wfbImageGlyphBlt
 #define fbIn wfbIn
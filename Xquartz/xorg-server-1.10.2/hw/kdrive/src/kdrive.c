@@ -73,6 +73,9 @@ Bool		    kdEmulateMiddleButton;
 Bool		    kdRawPointerCoordinates;
 Bool		    kdDisableZaphod;
 Bool                kdAllowZap;
+#ifdef INPUT_THREAD
+Bool		    kdInputThread;
+#endif
 Bool		    kdEnabled;
 int		    kdSubpixelOrder;
 int		    kdVirtualTerminal = -1;
@@ -542,6 +545,9 @@ KdUseMsg (void)
     ErrorF("-origin X,Y      Locates the next screen in the the virtual screen (Xinerama)\n");
     ErrorF("-switchCmd       Command to execute on vt switch\n");
     ErrorF("-zap             Terminate server on Ctrl+Alt+Backspace\n");
+#ifdef INPUT_THREAD
+    ErrorF("-inputthread     Read input devices from a dedicated thread instead of SIGIO\n");
+#endif
     ErrorF("vtxx             Use virtual terminal xx instead of the next available\n");
 }
 
@@ -581,6 +587,13 @@ KdProcessArgument (int argc, char **argv, int i)
 	kdAllowZap = TRUE;
 	return 1;
     }
+#ifdef INPUT_THREAD
+    if (!strcmp (argv[i], "-inputthread"))
+    {
+	kdInputThread = TRUE;
+	return 1;
+    }
+#endif
     if (!strcmp (argv[i], "-3button"))
     {
 	kdEmulateMiddleButton = FALSE;
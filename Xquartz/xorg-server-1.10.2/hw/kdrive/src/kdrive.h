@@ -351,6 +351,9 @@ extern Bool		kdSwitchPending;
 extern Bool		kdEmulateMiddleButton;
 extern Bool		kdDisableZaphod;
 extern Bool		kdAllowZap;
+#ifdef INPUT_THREAD
+extern Bool		kdInputThread;
+#endif
 extern int		kdVirtualTerminal;
 extern char		*kdSwitchCmd;
 extern KdOsFuncs	*kdOsFuncs;
@@ -519,6 +522,9 @@ KdUnregisterFds (void *closure, Bool do_close);
 void
 KdUnregisterFd (void *closure, int fd, Bool do_close);
 
+void
+KdRemoveGoneDevice (DeviceIntPtr pDev, int fd);
+
 void
 KdEnqueueKeyboardEvent(KdKeyboardInfo *ki, unsigned char scan_code,
                     unsigned char is_up);
@@ -38,6 +38,13 @@
 #include <sys/file.h> /* needed for FNONBLOCK & FASYNC */
 #endif
 
+#ifdef INPUT_THREAD
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#endif
+
 #include "xkbsrv.h"
 
 #include <X11/extensions/XI.h>
@@ -86,6 +93,7 @@ typedef struct _kdInputFd {
     int	        (*enable) (int fd, void *closure);
     void        (*disable) (int fd, void *closure);
     void        *closure;
+    Bool	gone;	/* device removal is pending, stop reading */
 } KdInputFd;
 
 static KdInputFd kdInputFds[KD_MAX_INPUT_FDS];
@@ -102,11 +110,145 @@ KdSigio (int sig)
 	(*kdInputFds[i].read) (kdInputFds[i].fd, kdInputFds[i].closure);
 }
 
+#ifdef INPUT_THREAD
+/*
+ * With -inputthread the device fds are read by a thread of their own
+ * rather than from the SIGIO handler.  kdInputMutex stands in for the
+ * signal mask: the thread holds it while calling the drivers, and the
+ * main thread holds it wherever SIGIO would have been blocked.  Events
+ * reach dix through the mieq input ring, which needs no locking.
+ */
+static Bool		kdInputThreadRunning;
+static pthread_mutex_t	kdInputMutex = PTHREAD_MUTEX_INITIALIZER;
+static Bool		kdInputLocked;	/* by the main thread */
+static int		kdInputControlFd = -1;
+static pthread_t	kdInputThreadId;
+
+/* devices whose fds went away, removed by the main thread */
+static DeviceIntPtr	kdGoneDevices[KD_MAX_INPUT_FDS];
+static int		kdNumGoneDevices;
+
+static void
+KdKickInputThread (void)
+{
+    uint64_t	one = 1;
+
+    /* make the thread pick up the new set of fds */
+    if (write (kdInputControlFd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+	ErrorF ("[kdrive] Failed to wake the input thread: %s\n",
+		strerror (errno));
+}
+
+static void *
+KdInputThread (void *arg)
+{
+    struct pollfd   fds[KD_MAX_INPUT_FDS + 1];
+    int		    nfds, i, j;
+    uint64_t	    count;
+
+    for (;;)
+    {
+	pthread_mutex_lock (&kdInputMutex);
+	if (!kdInputThreadRunning)
+	{
+	    pthread_mutex_unlock (&kdInputMutex);
+	    return NULL;
+	}
+	fds[0].fd = kdInputControlFd;
+	fds[0].events = POLLIN;
+	nfds = 1;
+	if (kdInputEnabled)
+	{
+	    for (i = 0; i < kdNumInputFds; i++)
+	    {
+		if (kdInputFds[i].gone)
+		    continue;
+		fds[nfds].fd = kdInputFds[i].fd;
+		fds[nfds].events = POLLIN;
+		nfds++;
+	    }
+	}
+	pthread_mutex_unlock (&kdInputMutex);
+
+	if (poll (fds, nfds, -1) < 0)
+	{
+	    if (errno != EINTR)
+		ErrorF ("[kdrive] Input thread poll failed: %s\n",
+			strerror (errno));
+	    continue;
+	}
+	if (fds[0].revents & POLLIN)
+	    while (read (kdInputControlFd, &count, sizeof (count)) > 0)
+		;
+
+	pthread_mutex_lock (&kdInputMutex);
+	for (i = 1; i < nfds; i++)
+	{
+	    if (!(fds[i].revents & (POLLIN|POLLERR|POLLHUP)))
+		continue;
+	    /* the fd may have been unregistered while we were polling */
+	    for (j = 0; j < kdNumInputFds; j++)
+	    {
+		if (kdInputFds[j].fd == fds[i].fd && !kdInputFds[j].gone)
+		{
+		    (*kdInputFds[j].read) (kdInputFds[j].fd,
+					   kdInputFds[j].closure);
+		    break;
+		}
+	    }
+	}
+	pthread_mutex_unlock (&kdInputMutex);
+    }
+}
+
+static void
+KdStartInputThread (void)
+{
+    pthread_t	thread;
+
+    kdInputControlFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (kdInputControlFd < 0)
+    {
+	ErrorF ("[kdrive] Cannot create input thread eventfd: %s\n",
+		strerror (errno));
+	return;
+    }
+
+    /* the thread waits for this before it looks at kdInputThreadRunning */
+    pthread_mutex_lock (&kdInputMutex);
+    if (OsCreateThread (&thread, KdInputThread, NULL) == 0)
+    {
+	kdInputThreadId = thread;
+	kdInputThreadRunning = mieqInitInputThread (thread);
+    }
+    pthread_mutex_unlock (&kdInputMutex);
+
+    if (!kdInputThreadRunning)
+    {
+	ErrorF ("[kdrive] Cannot start the input thread, using SIGIO\n");
+	close (kdInputControlFd);
+	kdInputControlFd = -1;
+    }
+}
+#endif
+
 static void
 KdBlockSigio (void)
 {
     sigset_t	set;
 
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning)
+    {
+	/* like the signal mask, blocking twice needs one unblock */
+	if (!kdInputLocked)
+	{
+	    pthread_mutex_lock (&kdInputMutex);
+	    kdInputLocked = TRUE;
+	}
+	return;
+    }
+#endif
     sigemptyset (&set);
     sigaddset (&set, SIGIO);
     sigprocmask (SIG_BLOCK, &set, 0);
@@ -117,6 +259,17 @@ KdUnblockSigio (void)
 {
     sigset_t	set;
 
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning)
+    {
+	if (kdInputLocked)
+	{
+	    kdInputLocked = FALSE;
+	    pthread_mutex_unlock (&kdInputMutex);
+	}
+	return;
+    }
+#endif
     sigemptyset (&set);
     sigaddset (&set, SIGIO);
     sigprocmask (SIG_UNBLOCK, &set, 0);
@@ -178,6 +331,14 @@ KdAddFd (int fd)
     sigset_t		set;
 
     kdnFds++;
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning)
+    {
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | NOBLOCK);
+	KdKickInputThread ();
+	return;
+    }
+#endif
     fcntl (fd, F_SETOWN, getpid());
     KdNonBlockFd (fd);
     AddEnabledDevice (fd);
@@ -199,6 +360,14 @@ KdRemoveFd (int fd)
     int			flags;
 
     kdnFds--;
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning)
+    {
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~NOBLOCK);
+	KdKickInputThread ();
+	return;
+    }
+#endif
     RemoveEnabledDevice (fd);
     flags = fcntl (fd, F_GETFL);
     flags &= ~(FASYNC|NOBLOCK);
@@ -212,19 +381,48 @@ KdRemoveFd (int fd)
     }
 }
 
+/*
+ * The input thread walks kdInputFds, so changes to it have to be made
+ * with the input lock held; callers may already hold it.
+ */
+static Bool
+KdLockInputFds (void)
+{
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning && !kdInputLocked)
+    {
+	KdBlockSigio ();
+	return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+static void
+KdUnlockInputFds (Bool locked)
+{
+    if (locked)
+	KdUnblockSigio ();
+}
+
 Bool
 KdRegisterFd (int fd, void (*read) (int fd, void *closure), void *closure)
 {
+    Bool    locked;
+
     if (kdNumInputFds == KD_MAX_INPUT_FDS)
 	return FALSE;
+    locked = KdLockInputFds ();
     kdInputFds[kdNumInputFds].fd = fd;
     kdInputFds[kdNumInputFds].read = read;
     kdInputFds[kdNumInputFds].enable = 0;
     kdInputFds[kdNumInputFds].disable = 0;
     kdInputFds[kdNumInputFds].closure = closure;
+    kdInputFds[kdNumInputFds].gone = FALSE;
     kdNumInputFds++;
     if (kdInputEnabled)
 	KdAddFd (fd);
+    KdUnlockInputFds (locked);
     return TRUE;
 }
 
@@ -232,6 +430,7 @@ void
 KdUnregisterFd (void *closure, int fd, Bool do_close)
 {
     int	i, j;
+    Bool locked = KdLockInputFds ();
 
     for (i = 0; i < kdNumInputFds; i++) {
 	if (kdInputFds[i].closure == closure &&
@@ -246,6 +445,7 @@ KdUnregisterFd (void *closure, int fd, Bool do_close)
             break;
 	}
     }
+    KdUnlockInputFds (locked);
 }
 
 void
@@ -254,6 +454,78 @@ KdUnregisterFds (void *closure, Bool do_close)
     KdUnregisterFd(closure, -1, do_close);
 }
 
+/*
+ * Called by a driver whose device fd has gone away.  The input thread
+ * holds kdInputMutex and must not touch the device list, so from there
+ * the fd is only dropped from the poll set and the device is left for
+ * the main thread to remove in ProcessInputEvents.
+ */
+void
+KdRemoveGoneDevice (DeviceIntPtr pDev, int fd)
+{
+#ifdef INPUT_THREAD
+    int	i;
+
+    if (kdInputThreadRunning &&
+	pthread_equal (pthread_self (), kdInputThreadId))
+    {
+	for (i = 0; i < kdNumInputFds; i++)
+	    if (kdInputFds[i].fd == fd)
+		kdInputFds[i].gone = TRUE;
+	for (i = 0; i < kdNumGoneDevices; i++)
+	    if (kdGoneDevices[i] == pDev)
+		return;
+	if (kdNumGoneDevices < KD_MAX_INPUT_FDS)
+	    kdGoneDevices[kdNumGoneDevices++] = pDev;
+	mieqInputThreadNotify ();
+	return;
+    }
+#endif
+    DeleteInputDeviceRequest (pDev);
+}
+
+#ifdef INPUT_THREAD
+static void
+KdProcessGoneDevices (void)
+{
+    DeviceIntPtr    pDev;
+    Bool	    locked;
+
+    if (!kdInputThreadRunning)
+	return;
+    for (;;)
+    {
+	locked = KdLockInputFds ();
+	pDev = NULL;
+	if (kdNumGoneDevices)
+	    pDev = kdGoneDevices[--kdNumGoneDevices];
+	KdUnlockInputFds (locked);
+	if (!pDev)
+	    break;
+	DeleteInputDeviceRequest (pDev);
+    }
+}
+
+/* the device may have been removed some other way in the meantime */
+static void
+KdForgetGoneDevice (DeviceIntPtr pDev)
+{
+    int	    i;
+    Bool    locked;
+
+    if (!kdInputThreadRunning)
+	return;
+    locked = KdLockInputFds ();
+    for (i = 0; i < kdNumGoneDevices; i++)
+	if (kdGoneDevices[i] == pDev)
+	{
+	    kdGoneDevices[i] = kdGoneDevices[--kdNumGoneDevices];
+	    break;
+	}
+    KdUnlockInputFds (locked);
+}
+#endif
+
 void
 KdDisableInput (void)
 {
@@ -1290,6 +1562,18 @@ KdInitInput (void)
 
     kdInputEnabled = TRUE;
 
+#ifdef INPUT_THREAD
+    if (kdInputThread && !kdInputThreadRunning)
+	KdStartInputThread ();
+    if (kdInputThreadRunning)
+    {
+	/* the devices of the previous generation are gone */
+	KdBlockSigio ();
+	kdNumGoneDevices = 0;
+	KdUnblockSigio ();
+    }
+#endif
+
     for (dev = kdConfigPointers; dev; dev = dev->next) {
         pi = KdParsePointer(dev->line);
         if (!pi)
@@ -2025,6 +2309,14 @@ KdWakeupHandler (int		screen,
     int		i;
     KdPointerInfo	*pi;
 
+#ifdef INPUT_THREAD
+    if (kdInputThreadRunning)
+    {
+	if (result > 0)
+	    mieqInputThreadWakeup (readmask);
+    }
+    else
+#endif
     if (kdInputEnabled && result > 0)
     {
 	for (i = 0; i < kdNumInputFds; i++)
@@ -2173,6 +2465,9 @@ void
 ProcessInputEvents (void)
 {
     mieqProcessInputEvents();
+#ifdef INPUT_THREAD
+    KdProcessGoneDevices ();
+#endif
     miPointerUpdateSprite(inputInfo.pointer);
     if (kdSwitchPending)
 	KdProcessSwitch ();
@@ -2327,5 +2622,8 @@ NewInputDeviceRequest(InputOption *options, InputAttributes *attrs,
 void
 DeleteInputDeviceRequest(DeviceIntPtr pDev)
 {
+#ifdef INPUT_THREAD
+    KdForgetGoneDevice (pDev);
+#endif
     RemoveDevice(pDev, TRUE);
 }
@@ -167,7 +167,7 @@ winDestroyPixmapNativeGDI (PixmapPtr pPixmap)
   pPixmapPriv->pbmih = NULL;
 
   /* Free the pixmap memory */
-  free (pPixmap);
+  FreePixmap (pPixmap);
   pPixmap = NULL;
 
   return TRUE;
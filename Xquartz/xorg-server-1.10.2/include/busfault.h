@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2011 The X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BUSFAULT_H_
+#define _BUSFAULT_H_
+
+#include <sys/types.h>
+
+/*
+ * Files mapped from clients can be truncated under the server, and
+ * touching the lost pages raises SIGBUS.  A registered range that
+ * faults is replaced with anonymous zero pages so the access completes,
+ * and its notify proc is called from the next block handler to tear
+ * the mapping down.
+ */
+
+typedef void (*BusFaultNotify)(void *data);
+
+typedef struct _BusFault *BusFaultPtr;
+
+extern BusFaultPtr
+BusFaultRegister(void *addr, size_t size, BusFaultNotify notify, void *data);
+
+extern void
+BusFaultUnregister(BusFaultPtr busfault);
+
+extern Bool
+BusFaultCatch(void *addr);
+
+#endif /* _BUSFAULT_H_ */
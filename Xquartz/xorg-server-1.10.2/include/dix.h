@@ -294,6 +294,12 @@ extern _X_EXPORT Atom MakeAtom(
     unsigned /*len*/,
     Bool /*makeit*/);
 
+extern _X_EXPORT int InternAtoms(
+    const char * const * /*names*/,
+    int /*count*/,
+    Bool /*makeit*/,
+    Atom * /*atoms*/);
+
 extern _X_EXPORT Bool ValidAtom(
     Atom /*atom*/);
 
@@ -489,6 +495,8 @@ extern _X_EXPORT void WriteEventsToClient(
     int	     /*count*/,
     xEventPtr /*events*/);
 
+extern _X_EXPORT Bool CoalesceBlockedEvents;
+
 extern _X_EXPORT int TryClientEvents(
     ClientPtr /*client*/,
     DeviceIntPtr /* device */,
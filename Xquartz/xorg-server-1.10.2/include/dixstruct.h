@@ -105,6 +105,7 @@ typedef struct _Client {
 		ClientPtr /* pClient */);
     CARD32	req_len;		/* length of current request */
     Bool	big_requests;		/* supports large requests */
+    int		req_fds;		/* fds the current request carries */
     int		priority;
     ClientState clientState;
     PrivateRec	*devPrivates;
@@ -119,10 +120,30 @@ typedef struct _Client {
     long    smart_start_tick;
     long    smart_stop_tick;
     long    smart_check_tick;
+    long    smart_slice;	/* slice earned as a bulk client, in ms */
+    int	    smart_heap_index;	/* position in the run queue, or -1 */
+    unsigned long smart_round;	/* last scheduling round it was ready in */
+    CARD64  smart_vruntime;	/* weighted run time, in us */
+    CARD64  smart_ready_time;	/* when it started waiting, in us */
+    CARD64  smart_cpu;		/* time spent running requests, in us */
+    CARD64  smart_wait;		/* time spent ready but not running, in us */
+    unsigned long smart_runs;	/* times it was picked */
+    unsigned long smart_preempts; /* times its slice ran out */
+    unsigned long coalesced_motion;	/* events merged while write-blocked */
+    unsigned long coalesced_expose;
+    unsigned long coalesced_configure;
+    unsigned long coalesced_other;	/* extension events */
     
     DeviceIntPtr clientPtr;
 }           ClientRec;
 
+/*
+ * Requests that pass file descriptors say how many before reading them
+ * with ReadFdFromClient; the ones left unread are closed with the
+ * request.
+ */
+#define SetReqFds(client, n) ((client)->req_fds = (n))
+
 /*
  * Scheduling interface
  */
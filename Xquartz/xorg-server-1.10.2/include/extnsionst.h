@@ -82,6 +82,16 @@ typedef void (*EventSwapPtr) (xEvent *, xEvent *);
 
 extern _X_EXPORT EventSwapPtr EventSwapVector[128];
 
+/*
+ * Merges event into queued, an unsent event of the same type for the same
+ * client, and returns TRUE; or returns FALSE if the client has to get both.
+ * Extensions set the entries for their events in EventCoalesceVector[];
+ * NULL entries are never merged.
+ */
+typedef Bool (*EventCoalescePtr) (xEvent * /*queued*/, xEvent * /*event*/);
+
+extern _X_EXPORT EventCoalescePtr EventCoalesceVector[128];
+
 extern _X_EXPORT void NotImplemented (	/* FIXME: this may move to another file... */
 	xEvent *,
 	xEvent *) _X_NORETURN;
@@ -122,6 +122,14 @@ extern _X_EXPORT int FreeGC(
     pointer /*pGC*/,
     XID /*gid*/);
 
+typedef struct _GCPoolStats {
+    unsigned long	hits;		/* GCs taken from the pool */
+    unsigned long	misses;		/* GCs allocated afresh */
+    int			pooled;		/* GCs waiting in the pool */
+} GCPoolStatsRec;
+
+extern _X_EXPORT GCPoolStatsRec GCPoolStats;
+
 extern _X_EXPORT void FreeGCperDepth(
     int /*screenNum*/);
 
@@ -40,6 +40,7 @@ extern _X_EXPORT Bool PanoramiXExtensionDisabledHack;
 
 #ifdef COMPOSITE
 extern _X_EXPORT Bool noCompositeExtension;
+extern _X_EXPORT int compositeThreads;
 #endif
 
 #ifdef DAMAGE
@@ -66,6 +67,10 @@ extern _X_EXPORT Bool noScreenSaverExtension;
 extern _X_EXPORT Bool noMITShmExtension;
 #endif
 
+#ifdef SHM_ASYNC
+extern _X_EXPORT int shmAsyncThreshold;
+#endif
+
 #ifdef RANDR
 extern _X_EXPORT Bool noRRExtension;
 #endif
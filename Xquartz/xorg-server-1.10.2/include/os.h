@@ -98,6 +98,12 @@ extern _X_EXPORT int WaitForSomething(
 
 extern _X_EXPORT int ReadRequestFromClient(ClientPtr /*client*/);
 
+extern _X_EXPORT int ReadFdFromClient(ClientPtr /*client*/);
+
+extern _X_EXPORT int WriteFdToClient(ClientPtr /*client*/, int /*fd*/, Bool /*do_close*/);
+
+extern _X_EXPORT Bool ClientHasQueuedRequest(ClientPtr /*client*/);
+
 extern _X_EXPORT Bool InsertFakeRequest(
     ClientPtr /*client*/, 
     char* /*data*/, 
@@ -113,8 +119,26 @@ extern _X_EXPORT void SetCriticalOutputPending(void);
 
 extern _X_EXPORT int WriteToClient(ClientPtr /*who*/, int /*count*/, const void* /*buf*/);
 
+typedef void (*ClientDataDoneProcPtr)(pointer /*data*/, pointer /*closure*/);
+
+extern _X_EXPORT int WriteToClientNoCopy(ClientPtr /*who*/, int /*count*/, const void* /*buf*/, ClientDataDoneProcPtr /*done*/, pointer /*closure*/);
+
+extern _X_EXPORT void MarkQueuedEvent(ClientPtr /*who*/);
+
+extern _X_EXPORT pointer LastQueuedEvent(ClientPtr /*who*/);
+
 extern _X_EXPORT void ResetOsBuffers(void);
 
+/* Client I/O buffer pool, one entry per size class */
+typedef struct _BufferPoolStats {
+    int size;			/* buffer size, 0 for the big request class */
+    unsigned long hits;		/* buffers handed out from the pool */
+    unsigned long misses;	/* buffers that had to be allocated */
+    unsigned long retained;	/* bytes currently held by the pool */
+} BufferPoolStatsRec, *BufferPoolStatsPtr;
+
+extern _X_EXPORT int GetBufferPoolStats(BufferPoolStatsPtr /*stats*/, int /*nstats*/);
+
 extern _X_EXPORT void InitConnectionLimits(void);
 
 extern _X_EXPORT void NotifyParentProcess(void);
@@ -167,6 +191,7 @@ extern void ListenOnOpenFD(int /* fd */, int /* noxauth */);
 #endif
 
 extern _X_EXPORT CARD32 GetTimeInMillis(void);
+extern _X_EXPORT CARD64 GetTimeInMicros(void);
 
 extern _X_EXPORT void AdjustWaitForDelay(
     pointer /*waitTime*/,
@@ -304,6 +329,14 @@ extern _X_EXPORT void OsBlockSignals (void);
 
 extern _X_EXPORT void OsReleaseSignals (void);
 
+#ifdef SERVER_THREADS
+#include <pthread.h>
+
+extern _X_EXPORT int OsCreateThread (pthread_t * /*thread*/,
+				     void *(* /*func*/)(void *),
+				     void * /*arg*/);
+#endif
+
 extern _X_EXPORT void OsAbort (void) _X_NORETURN;
 
 #if !defined(WIN32)
@@ -109,6 +109,16 @@ extern _X_EXPORT Bool CreateScratchPixmapsForScreen(
 extern _X_EXPORT void FreeScratchPixmapsForScreen(
     int /*scrnum*/);
 
+/* Kept by the ddx when it recycles the storage of freed pixmaps */
+typedef struct _PixmapCacheStats {
+    unsigned long	hits;		/* pixmaps created from cached storage */
+    unsigned long	misses;		/* pixmaps allocated afresh */
+    unsigned long	evictions;	/* storage dropped to stay under the cap */
+    unsigned long	bytes;		/* storage held by the cache */
+} PixmapCacheStatsRec;
+
+extern _X_EXPORT PixmapCacheStatsRec PixmapCacheStats;
+
 extern _X_EXPORT PixmapPtr AllocatePixmap(
     ScreenPtr /*pScreen*/,
     int /*pixDataSize*/);
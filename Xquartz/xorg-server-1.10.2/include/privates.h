@@ -257,6 +257,17 @@ _dixAllocateObjectWithPrivates(unsigned size, unsigned clear, unsigned offset, D
 extern _X_EXPORT void
 _dixFreeObjectWithPrivates(void *object, PrivatePtr privates, DevPrivateType type);
 
+/*
+ * The allocator behind the above, for objects like pixmaps that lay out
+ * their privates themselves.  Memory from dixSlabAlloc is not cleared and
+ * must be released with dixSlabFree.
+ */
+extern _X_EXPORT void *
+dixSlabAlloc(DevPrivateType type, unsigned size);
+
+extern _X_EXPORT void
+dixSlabFree(void *object);
+
 #define dixFreeObjectWithPrivates(o,t) _dixFreeObjectWithPrivates(o, (o)->devPrivates, t)
 
 /*
@@ -56,6 +56,7 @@ SOFTWARE.
 
 typedef struct _Property {
         struct _Property       *next;
+        struct _Property       *prev;
 	ATOM 		propertyName;
 	ATOM		type;       /* ignored by server */
 	short		format;     /* format of data for swapping - 8,16,32 */
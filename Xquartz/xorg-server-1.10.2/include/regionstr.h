@@ -183,6 +183,18 @@ extern _X_EXPORT RegionPtr RegionCreate(
 extern _X_EXPORT void RegionDestroy(
     RegionPtr /*pReg*/);
 
+/*
+ * Temporary regions live until the next FlushAllOutput, which empties
+ * them for reuse while keeping their rectangle storage.  They must not
+ * be passed to RegionDestroy or kept across anything that may flush,
+ * and only the main thread may create them.
+ */
+extern _X_EXPORT RegionPtr RegionCreateTemporary(
+    BoxPtr /*rect*/,
+    int /*size*/);
+
+extern _X_EXPORT void RegionResetTemporaries(void);
+
 static inline Bool
 RegionCopy(RegionPtr dst, RegionPtr src)
 {
@@ -77,6 +77,11 @@ typedef int (*VisitWindowProcPtr)(
     WindowPtr /*pWin*/,
     pointer /*data*/);
 
+typedef Bool (*ChildHitProcPtr)(
+    WindowPtr /*pWin*/,
+    int /*x*/,
+    int /*y*/);
+
 extern _X_EXPORT int TraverseTree(
     WindowPtr /*pWin*/,
     VisitWindowProcPtr /*func*/,
@@ -208,6 +213,12 @@ extern _X_EXPORT Bool PointInWindowIsVisible(
     int /*x*/,
     int /*y*/);
 
+extern _X_EXPORT WindowPtr ChildAtPoint(
+    WindowPtr /*pParent*/,
+    int /*x*/,
+    int /*y*/,
+    ChildHitProcPtr /*hit*/);
+
 extern _X_EXPORT RegionPtr NotClippedByChildren(
     WindowPtr /*pWin*/);
 
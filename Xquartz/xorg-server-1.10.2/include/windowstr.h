@@ -85,8 +85,10 @@ typedef struct _WindowOpt {
     Mask		dontPropagateMask; /* default: window.dontPropagate */
     Mask		otherEventMasks;   /* default: 0 */
     struct _OtherClients *otherClients;	   /* default: NULL */
+    struct _EventIndex	*eventIndex;	   /* default: NULL */
     struct _GrabRec	*passiveGrabs;	   /* default: NULL */
     PropertyPtr		userProps;	   /* default: NULL */
+    struct _PropertyIndex *propIndex;	   /* default: NULL */
     unsigned long	backingBitPlanes;  /* default: ~0L */
     unsigned long	backingPixel;	   /* default: 0 */
     RegionPtr		boundingShape;	   /* default: NULL */
@@ -219,6 +219,22 @@ extern _X_EXPORT void mieqProcessInputEvents(
     void
 );
 
+#ifdef INPUT_THREAD
+#include <pthread.h>
+
+extern _X_EXPORT Bool mieqInitInputThread(
+    pthread_t /* thread */
+);
+
+extern _X_EXPORT void mieqInputThreadNotify(
+    void
+);
+
+extern _X_EXPORT void mieqInputThreadWakeup(
+    pointer /* readmask */
+);
+#endif
+
 extern DeviceIntPtr CopyGetMasterEvent(
     DeviceIntPtr /* sdev */,
     InternalEvent* /* original */,
@@ -466,7 +482,11 @@ extern _X_EXPORT int miShapedWindowIn(
     int /*y*/
 );
 
-typedef void 
+/*
+ * Returns FALSE when the window has no storage to draw to, so that it and
+ * its inferiors are clipped as if fully obscured
+ */
+typedef Bool
 (*SetRedirectBorderClipProcPtr) (WindowPtr pWindow, RegionPtr pRegion);
 
 typedef RegionPtr
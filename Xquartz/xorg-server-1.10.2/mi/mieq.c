@@ -79,6 +79,215 @@ typedef struct _EventQueue {
 
 static EventQueueRec miEventQueue;
 
+#ifdef INPUT_THREAD
+#include  <errno.h>
+#include  <unistd.h>
+#include  <pthread.h>
+#include  <sys/eventfd.h>
+
+/*
+ * Events enqueued by the DDX input thread bypass miEventQueue and go
+ * through a single-producer/single-consumer ring of fixed size slots
+ * instead, so neither side ever takes a lock.  The producer only writes
+ * slots and the tail, the consumer only the head.  A full ring is never
+ * overwritten: the producer chains a segment twice the size behind it and
+ * carries on there, and the consumer frees the old segment once it has
+ * drained it and seen the link.
+ */
+#define RING_INITIAL_SIZE   QUEUE_SIZE
+#define RING_MAX_EVENTS	    (16 * 1024)	/* slots ever allocated */
+
+/* Full barrier; the ring indices are only published after the slot. */
+#define RingBarrier()	    __sync_synchronize()
+
+typedef struct _RingSlot {
+    InternalEvent	    event;
+    ScreenPtr		    pScreen;
+    DeviceIntPtr	    pDev;
+} RingSlotRec, *RingSlotPtr;
+
+typedef struct _EventRing {
+    struct _EventRing * volatile next;	/* set by the producer when full */
+    unsigned int	    size;	/* power of two */
+    volatile unsigned int   head;	/* written by the consumer only */
+    volatile unsigned int   tail;	/* written by the producer only */
+    RingSlotRec		    slots[1];	/* size entries */
+} EventRingRec, *EventRingPtr;
+
+static EventRingPtr	ringHead;	/* segment the consumer reads */
+static EventRingPtr	ringTail;	/* segment the producer fills */
+static unsigned int	ringEvents;	/* slots allocated, bounds growth */
+static CARD32		ringLastEventTime;
+static pthread_t	miInputThread;
+static Bool		miInputThreadActive;
+static int		miInputWakeupFd = -1;
+
+/* The input check is a flag once the input thread is running: the two
+ * queues have no single head/tail pair to compare. */
+static volatile HWEventQueueType miInputPending;
+static HWEventQueueType miInputIdle;
+
+static EventRingPtr
+RingAlloc(unsigned int size)
+{
+    EventRingPtr ring;
+
+    ring = malloc(sizeof(EventRingRec) + (size - 1) * sizeof(RingSlotRec));
+    if (!ring)
+	return NULL;
+    ring->next = NULL;
+    ring->size = size;
+    ring->head = ring->tail = 0;
+    return ring;
+}
+
+static void
+RingEnqueue(DeviceIntPtr pDev, InternalEvent *e)
+{
+    EventRingPtr ring = ringTail;
+    RingSlotPtr slot;
+    int evlen = e->any.length;
+    static int stuck = 0;
+
+    if (ring->tail - ring->head == ring->size)
+    {
+	EventRingPtr grown = NULL;
+
+	if (ringEvents + ring->size * 2 <= RING_MAX_EVENTS)
+	    grown = RingAlloc(ring->size * 2);
+	if (!grown)
+	{
+	    if (!stuck) {
+		ErrorF("[mi] Input ring overflowing. The server is probably "
+		       "stuck in an infinite loop.\n");
+		stuck = 1;
+	    }
+	    return;
+	}
+	ringEvents += grown->size;
+	ring->next = grown;
+	ringTail = ring = grown;
+    }
+    stuck = 0;
+
+    if (evlen > sizeof(InternalEvent))
+    {
+	ErrorF("[mi] Oversized input event (%d bytes). Tossing event.\n",
+	       evlen);
+	return;
+    }
+
+    slot = &ring->slots[ring->tail & (ring->size - 1)];
+    memcpy(&slot->event, e, evlen);
+    if (slot->event.any.time < ringLastEventTime &&
+	ringLastEventTime - slot->event.any.time < 10000)
+	slot->event.any.time = ringLastEventTime;
+    ringLastEventTime = slot->event.any.time;
+    slot->pScreen = pDev ? EnqueueScreen(pDev) : NULL;
+    slot->pDev = pDev;
+
+    RingBarrier();
+    ring->tail++;
+    RingBarrier();
+    mieqInputThreadNotify();
+}
+
+/*
+ * Take the next event off the ring, copying it to the consumer's buffer
+ * before the slot is handed back to the producer.
+ */
+static Bool
+RingDequeue(InternalEvent *event, DeviceIntPtr *pDev, ScreenPtr *pScreen)
+{
+    EventRingPtr ring;
+    RingSlotPtr slot;
+
+    for (;;)
+    {
+	ring = ringHead;
+	if (ring->head != ring->tail)
+	    break;
+	/* the producer is done with a segment once it links the next one,
+	 * but it may have filled the last slots just before */
+	if (!ring->next)
+	    return FALSE;
+	RingBarrier();
+	if (ring->head != ring->tail)
+	    break;
+	ringHead = ring->next;
+	free(ring);
+    }
+
+    RingBarrier();
+    slot = &ring->slots[ring->head & (ring->size - 1)];
+    memcpy(event, &slot->event, slot->event.any.length);
+    *pDev = slot->pDev;
+    *pScreen = slot->pScreen;
+    RingBarrier();
+    ring->head++;
+    return TRUE;
+}
+
+/**
+ * Route events enqueued by @thread through the input ring from now on,
+ * waking the main thread through an eventfd it selects on.  Call this
+ * from the main thread, before @thread enqueues anything.
+ */
+Bool
+mieqInitInputThread(pthread_t thread)
+{
+    if (miInputThreadActive)
+	return TRUE;
+
+    miInputWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (miInputWakeupFd < 0)
+	return FALSE;
+    ringHead = ringTail = RingAlloc(RING_INITIAL_SIZE);
+    if (!ringHead)
+    {
+	close(miInputWakeupFd);
+	miInputWakeupFd = -1;
+	return FALSE;
+    }
+    ringEvents = RING_INITIAL_SIZE;
+    ringLastEventTime = GetTimeInMillis();
+    miInputThread = thread;
+    miInputThreadActive = TRUE;
+
+    AddEnabledDevice(miInputWakeupFd);
+    SetInputCheck((HWEventQueuePtr)&miInputPending, &miInputIdle);
+    return TRUE;
+}
+
+/**
+ * Make the main thread run ProcessInputEvents soon.  Call this from the
+ * input thread, after handing it work through some other channel.
+ */
+void
+mieqInputThreadNotify(void)
+{
+    uint64_t one = 1;
+
+    miInputPending = 1;
+    if (write(miInputWakeupFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	ErrorF("[mi] Failed to wake the main thread: %s\n", strerror(errno));
+}
+
+/**
+ * Clear the input thread's wakeup.  Call this from a wakeup handler, the
+ * pending events are picked up by the next ProcessInputEvents.
+ */
+void
+mieqInputThreadWakeup(pointer readmask)
+{
+    uint64_t count;
+
+    if (miInputThreadActive && FD_ISSET(miInputWakeupFd, (fd_set *)readmask))
+	while (read(miInputWakeupFd, &count, sizeof(count)) > 0)
+	    ;
+}
+#endif /* INPUT_THREAD */
+
 #ifdef XQUARTZ
 #include  <pthread.h>
 static pthread_mutex_t miEventQueueMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -118,6 +327,22 @@ mieqInit(void)
 	}
     }
 
+#ifdef INPUT_THREAD
+    if (miInputThreadActive)
+    {
+	/* the devices of the previous generation are gone */
+	InternalEvent event;
+	DeviceIntPtr dev;
+	ScreenPtr screen;
+
+	while (RingDequeue(&event, &dev, &screen))
+	    ;
+	miInputPending = 0;
+	AddEnabledDevice(miInputWakeupFd);
+	SetInputCheck((HWEventQueuePtr)&miInputPending, &miInputIdle);
+	return TRUE;
+    }
+#endif
     SetInputCheck(&miEventQueue.head, &miEventQueue.tail);
     return TRUE;
 }
@@ -151,6 +376,19 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
     int                    evlen;
     Time                   time;
 
+#ifdef INPUT_THREAD
+    if (miInputThreadActive)
+    {
+	if (pthread_equal(pthread_self(), miInputThread))
+	{
+	    CHECKEVENT(e);
+	    RingEnqueue(pDev, e);
+	    return;
+	}
+	miInputPending = 1;
+    }
+#endif
+
 #ifdef XQUARTZ
     wait_for_server_init();
     pthread_mutex_lock(&miEventQueueMutex);
@@ -424,6 +662,30 @@ mieqProcessDeviceEvent(DeviceIntPtr dev,
     }
 }
 
+static void
+mieqDispatchEvent(DeviceIntPtr dev, InternalEvent *event, ScreenPtr screen)
+{
+    DeviceIntPtr master;
+
+    master  = (dev && !IsMaster(dev) && dev->u.master) ? dev->u.master : NULL;
+
+    if (screenIsSaved == SCREEN_SAVER_ON)
+        dixSaveScreens (serverClient, SCREEN_SAVER_OFF, ScreenSaverReset);
+#ifdef DPMSExtension
+    else if (DPMSPowerLevel != DPMSModeOn)
+        SetScreenSaverTimer();
+
+    if (DPMSPowerLevel != DPMSModeOn)
+        DPMSSet(serverClient, DPMSModeOn);
+#endif
+
+    mieqProcessDeviceEvent(dev, event, screen);
+
+    /* Update the sprite now. Next event may be from different device. */
+    if (event->any.type == ET_Motion && master)
+        miPointerUpdateSprite(dev);
+}
+
 /* Call this from ProcessInputEvents(). */
 void
 mieqProcessInputEvents(void)
@@ -433,8 +695,21 @@ mieqProcessInputEvents(void)
     ScreenPtr screen;
     static InternalEvent *event = NULL;
     static size_t event_size = 0;
-    DeviceIntPtr dev = NULL,
-                 master = NULL;
+    DeviceIntPtr dev = NULL;
+
+#ifdef INPUT_THREAD
+    if (miInputThreadActive)
+    {
+        static InternalEvent ringEvent;
+
+        /* clear before draining, anything enqueued from here on sets it
+         * again and is seen by the next check */
+        miInputPending = 0;
+        RingBarrier();
+        while (RingDequeue(&ringEvent, &dev, &screen))
+            mieqDispatchEvent(dev, &ringEvent, screen);
+    }
+#endif
 
 #ifdef XQUARTZ
     pthread_mutex_lock(&miEventQueueMutex);
@@ -466,23 +741,7 @@ mieqProcessInputEvents(void)
         pthread_mutex_unlock(&miEventQueueMutex);
 #endif
 
-        master  = (dev && !IsMaster(dev) && dev->u.master) ? dev->u.master : NULL;
-
-        if (screenIsSaved == SCREEN_SAVER_ON)
-            dixSaveScreens (serverClient, SCREEN_SAVER_OFF, ScreenSaverReset);
-#ifdef DPMSExtension
-        else if (DPMSPowerLevel != DPMSModeOn)
-            SetScreenSaverTimer();
-
-        if (DPMSPowerLevel != DPMSModeOn)
-            DPMSSet(serverClient, DPMSModeOn);
-#endif
-
-        mieqProcessDeviceEvent(dev, event, screen);
-
-        /* Update the sprite now. Next event may be from different device. */
-        if (event->any.type == ET_Motion && master)
-            miPointerUpdateSprite(dev);
+        mieqDispatchEvent(dev, event, screen);
 
 #ifdef XQUARTZ
         pthread_mutex_lock(&miEventQueueMutex);
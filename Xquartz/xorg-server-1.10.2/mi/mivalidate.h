@@ -41,6 +41,8 @@ typedef union _Validate {
 	RegionPtr	borderVisible;	/* visible region of border, */
 					/* non-null when size changes */
 	Bool		resized;	/* unclipped winSize has changed */
+	Bool		overlapped;	/* only marked for overlapping */
+					/* a window that changed */
     } before;
     struct AfterValidate {
 	RegionRec	exposed;	/* exposed regions, absolute pos */
@@ -189,6 +189,91 @@ miRegisterRedirectBorderClipProc (SetRedirectBorderClipProcPtr setBorderClip,
 				    HasBorder(w) && \
 				    (w)->backgroundState == ParentRelative)
 
+/*
+ * A window marked only because it overlaps a window that changed keeps
+ * its clips if its new universe is its old borderClip: the change was
+ * hidden from it by windows above, or happened below it.  Then the
+ * clips of everything in it hold as well, unless something in it was
+ * marked for a change of its own.  Skipping such subtrees limits the
+ * work to windows the exposed or obscured area actually reaches.
+ */
+static Bool
+miClipsUnchanged (
+    WindowPtr	pParent,
+    RegionPtr	universe,
+    VTKind	kind)
+{
+    WindowPtr	pChild;
+    RegionPtr	pBorderClip = &pParent->borderClip;
+
+    if (kind == VTBroken || pParent->visibility == VisibilityNotViewable)
+	return FALSE;
+#ifdef COMPOSITE
+    if (pParent->redirectDraw != RedirectDrawNone)
+    {
+	if (TreatAsTransparent (pParent) || !miGetRedirectBorderClipProc)
+	    return FALSE;
+	pBorderClip = (*miGetRedirectBorderClipProc) (pParent);
+    }
+#endif
+    pChild = pParent;
+    while (1)
+    {
+	if (pChild->valdata == UnmapValData)
+	    return FALSE;
+	if (pChild->valdata)
+	{
+	    if (!pChild->valdata->before.overlapped ||
+		pChild->valdata->before.borderVisible ||
+		pChild->valdata->before.resized ||
+		pChild->drawable.x != pChild->valdata->before.oldAbsCorner.x ||
+		pChild->drawable.y != pChild->valdata->before.oldAbsCorner.y)
+		return FALSE;
+	}
+	if (pChild->viewable && pChild->firstChild)
+	{
+	    pChild = pChild->firstChild;
+	    continue;
+	}
+	while (!pChild->nextSib && (pChild != pParent))
+	    pChild = pChild->parent;
+	if (pChild == pParent)
+	    break;
+	pChild = pChild->nextSib;
+    }
+    return RegionEqual(universe, pBorderClip);
+}
+
+/*
+ * Leave the subtree of pParent as it is, with nothing exposed.
+ */
+static void
+miSkipClips (
+    WindowPtr	pParent)
+{
+    WindowPtr	pChild;
+
+    pChild = pParent;
+    while (1)
+    {
+	if (pChild->valdata && pChild->valdata != UnmapValData)
+	{
+	    RegionNull(&pChild->valdata->after.borderExposed);
+	    RegionNull(&pChild->valdata->after.exposed);
+	}
+	if (pChild->viewable && pChild->firstChild)
+	{
+	    pChild = pChild->firstChild;
+	    continue;
+	}
+	while (!pChild->nextSib && (pChild != pParent))
+	    pChild = pChild->parent;
+	if (pChild == pParent)
+	    break;
+	pChild = pChild->nextSib;
+    }
+}
+
 
 /*
  *-----------------------------------------------------------------------
@@ -224,6 +309,14 @@ miComputeClips (
     Bool		overlap;
     RegionPtr		borderVisible;
     Bool		resized;
+
+    if (pParent->valdata->before.overlapped &&
+	miClipsUnchanged (pParent, universe, kind))
+    {
+	miSkipClips (pParent);
+	return;
+    }
+
     /*
      * Figure out the new visibility of this window.
      * The extent of the universe should be the same as the extent of
@@ -245,17 +338,23 @@ miComputeClips (
 
 #ifdef COMPOSITE
     /*
-     * In redirected drawing case, reset universe to borderSize
+     * In redirected drawing case, reset universe to borderSize, or to
+     * nothing when the window has no pixmap to draw to
      */
     if (pParent->redirectDraw != RedirectDrawNone)
     {
+	Bool	drawable = TRUE;
+
 	if (miSetRedirectBorderClipProc)
 	{
 	    if (TreatAsTransparent (pParent))
 		RegionEmpty(universe);
-	    (*miSetRedirectBorderClipProc) (pParent, universe);
+	    drawable = (*miSetRedirectBorderClipProc) (pParent, universe);
 	}
-	RegionCopy(universe, &pParent->borderSize);
+	if (drawable)
+	    RegionCopy(universe, &pParent->borderSize);
+	else
+	    RegionEmpty(universe);
     }
 #endif
 
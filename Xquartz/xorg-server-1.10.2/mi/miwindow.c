@@ -125,12 +125,18 @@ miMarkWindow(WindowPtr pWin)
     ValidatePtr val;
 
     if (pWin->valdata)
+    {
+	/* marked again, perhaps because it changed itself */
+	if (pWin->valdata != UnmapValData)
+	    pWin->valdata->before.overlapped = FALSE;
 	return;
+    }
     val = (ValidatePtr)xnfalloc(sizeof(ValidateRec));
     val->before.oldAbsCorner.x = pWin->drawable.x;
     val->before.oldAbsCorner.y = pWin->drawable.y;
     val->before.borderVisible = NullRegion;
     val->before.resized = FALSE;
+    val->before.overlapped = FALSE;
     pWin->valdata = val;
 }
 
@@ -190,7 +196,15 @@ miMarkOverlappedWindows(WindowPtr pWin, WindowPtr pFirst, WindowPtr *ppLayerWin)
 		    SetBorderSize (pChild);
 		if (RegionContainsRect(&pChild->borderSize, box))
 		{
+		    ValidatePtr val = pChild->valdata;
+		    Bool overlapped = !val || (val != UnmapValData &&
+					       val->before.overlapped);
+
 		    (* MarkWindow)(pChild);
+		    /* windows only marked here keep their geometry, so
+		     * miValidateTree can skip them if their clip holds */
+		    if (pChild->valdata && pChild->valdata != UnmapValData)
+			pChild->valdata->before.overlapped = overlapped;
 		    anyMarked = TRUE;
 		    if (pChild->firstChild)
 		    {
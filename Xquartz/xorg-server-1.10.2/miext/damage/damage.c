@@ -120,11 +120,151 @@ getDrawableDamageRef (DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+/*
+ * Tiled damage (DamageSetTiled) doesn't union every drawing operation
+ * into the damage region.  It marks the DAMAGE_TILE_SIZE square tiles
+ * the operation touches in a bitmap, and turns the bitmap into region
+ * only when the damage is looked at.  It never reports less than was
+ * drawn, but may report up to a tile more around it.
+ */
+#define DAMAGE_TILE_SHIFT	6
+#define DAMAGE_TILE_SIZE	(1 << DAMAGE_TILE_SHIFT)
+
+static void
+damageFlushTiles (DamagePtr pDamage)
+{
+    BoxPtr	pTileBox = &pDamage->tileBox;
+    int		cols, rows, stride = pDamage->tileStride;
+    int		x, y, x1, n;
+    CARD32	*row;
+    xRectangle	*rects;
+    RegionPtr	pTiles;
+    RegionRec	all;
+
+    if (!pDamage->tilesDirty)
+	return;
+    pDamage->tilesDirty = FALSE;
+
+    cols = (pTileBox->x2 - pTileBox->x1 + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+    rows = (pTileBox->y2 - pTileBox->y1 + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+    rects = malloc(rows * ((cols + 1) / 2) * sizeof (xRectangle));
+    n = 0;
+    for (y = 0; y < rows; y++)
+    {
+	row = pDamage->tiles + y * stride;
+	for (x = 0; x < cols; x++)
+	{
+	    if (!(row[x >> 5] & ((CARD32) 1 << (x & 31))))
+		continue;
+	    /* one rectangle for each run of marked tiles */
+	    for (x1 = x; x < cols; x++)
+		if (!(row[x >> 5] & ((CARD32) 1 << (x & 31))))
+		    break;
+	    if (rects)
+	    {
+		rects[n].x = pTileBox->x1 + (x1 << DAMAGE_TILE_SHIFT);
+		rects[n].y = pTileBox->y1 + (y << DAMAGE_TILE_SHIFT);
+		rects[n].width = min(x << DAMAGE_TILE_SHIFT,
+				     pTileBox->x2 - pTileBox->x1) -
+				 (x1 << DAMAGE_TILE_SHIFT);
+		rects[n].height = min((y + 1) << DAMAGE_TILE_SHIFT,
+				      pTileBox->y2 - pTileBox->y1) -
+				  (y << DAMAGE_TILE_SHIFT);
+		n++;
+	    }
+	}
+	memset (row, 0, stride * sizeof (CARD32));
+    }
+    if (!rects)
+    {
+	/* without memory for the runs, damage all of it */
+	RegionInit(&all, pTileBox, 1);
+	RegionUnion(&pDamage->damage, &pDamage->damage, &all);
+	RegionUninit(&all);
+	return;
+    }
+    pTiles = RegionFromRects(n, rects, CT_YXBANDED);
+    RegionUnion(&pDamage->damage, &pDamage->damage, pTiles);
+    RegionDestroy(pTiles);
+    free(rects);
+}
+
+/*
+ * Make the bitmap cover the drawable as it is now, including the border
+ * of windows.  When the drawable changed size, what the old bitmap had
+ * goes to the region first.
+ */
+static Bool
+damageValidateTiles (DamagePtr pDamage)
+{
+    DrawablePtr	pDrawable = pDamage->pDrawable;
+    BoxRec	box;
+    int		bw = 0, cols, rows;
+
+    if (pDrawable->type == DRAWABLE_WINDOW)
+	bw = wBorderWidth ((WindowPtr) pDrawable);
+    box.x1 = -bw;
+    box.y1 = -bw;
+    box.x2 = pDrawable->width + bw;
+    box.y2 = pDrawable->height + bw;
+    if (pDamage->tiles && BOX_SAME (&box, &pDamage->tileBox))
+	return TRUE;
+
+    damageFlushTiles (pDamage);
+    free(pDamage->tiles);
+    cols = (box.x2 - box.x1 + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+    rows = (box.y2 - box.y1 + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+    pDamage->tileStride = (cols + 31) >> 5;
+    pDamage->tileBox = box;
+    pDamage->tiles = NULL;
+    if (rows && cols)
+	pDamage->tiles = calloc(rows * pDamage->tileStride, sizeof (CARD32));
+    return pDamage->tiles != NULL;
+}
+
+static void
+damageMarkTiles (DamagePtr pDamage, RegionPtr pRegion, int draw_x, int draw_y)
+{
+    BoxPtr	pTileBox = &pDamage->tileBox;
+    BoxPtr	pBox = RegionRects(pRegion);
+    int		nBox = RegionNumRects(pRegion);
+    int		x1, y1, x2, y2, x, y;
+    CARD32	*row;
+    Bool	was_empty;
+
+    was_empty = !pDamage->tilesDirty && !RegionNotEmpty(&pDamage->damage);
+    for (; nBox--; pBox++)
+    {
+	x1 = max(pBox->x1 - draw_x, pTileBox->x1) - pTileBox->x1;
+	y1 = max(pBox->y1 - draw_y, pTileBox->y1) - pTileBox->y1;
+	x2 = min(pBox->x2 - draw_x, pTileBox->x2) - pTileBox->x1;
+	y2 = min(pBox->y2 - draw_y, pTileBox->y2) - pTileBox->y1;
+	if (x1 >= x2 || y1 >= y2)
+	    continue;
+	x2 = (x2 - 1) >> DAMAGE_TILE_SHIFT;
+	y2 = (y2 - 1) >> DAMAGE_TILE_SHIFT;
+	for (y = y1 >> DAMAGE_TILE_SHIFT; y <= y2; y++)
+	{
+	    row = pDamage->tiles + y * pDamage->tileStride;
+	    for (x = x1 >> DAMAGE_TILE_SHIFT; x <= x2; x++)
+		row[x >> 5] |= (CARD32) 1 << (x & 31);
+	}
+	pDamage->tilesDirty = TRUE;
+    }
+    if (was_empty && pDamage->tilesDirty &&
+	pDamage->damageLevel == DamageReportNonEmpty && pDamage->damageReport)
+    {
+	damageFlushTiles (pDamage);
+	(*pDamage->damageReport) (pDamage, &pDamage->damage,
+				  pDamage->closure);
+    }
+}
+
 static void
 damageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 {
     BoxRec tmpBox;
-    RegionRec tmpRegion;
+    RegionPtr pTmpRegion;
     Bool was_empty;
 
     switch (pDamage->damageLevel) {
@@ -134,14 +274,13 @@ damageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 	(*pDamage->damageReport) (pDamage, pDamageRegion, pDamage->closure);
 	break;
     case DamageReportDeltaRegion:
-	RegionNull(&tmpRegion);
-	RegionSubtract(&tmpRegion, pDamageRegion, &pDamage->damage);
-	if (RegionNotEmpty(&tmpRegion)) {
+	pTmpRegion = RegionCreateTemporary(NullBox, 0);
+	RegionSubtract(pTmpRegion, pDamageRegion, &pDamage->damage);
+	if (RegionNotEmpty(pTmpRegion)) {
 	    RegionUnion(&pDamage->damage, &pDamage->damage,
 			 pDamageRegion);
-	    (*pDamage->damageReport) (pDamage, &tmpRegion, pDamage->closure);
+	    (*pDamage->damageReport) (pDamage, pTmpRegion, pDamage->closure);
 	}
-	RegionUninit(&tmpRegion);
 	break;
     case DamageReportBoundingBox:
 	tmpBox = *RegionExtents(&pDamage->damage);
@@ -153,7 +292,7 @@ damageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 	}
 	break;
     case DamageReportNonEmpty:
-	was_empty = !RegionNotEmpty(&pDamage->damage);
+	was_empty = !RegionNotEmpty(&pDamage->damage) && !pDamage->tilesDirty;
 	RegionUnion(&pDamage->damage, &pDamage->damage,
 		     pDamageRegion);
 	if (was_empty && RegionNotEmpty(&pDamage->damage)) {
@@ -224,7 +363,7 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
     damageScrPriv(pScreen);
     drawableDamage(pDrawable);
     DamagePtr	    pNext;
-    RegionRec	    clippedRec;
+    RegionPtr	    pClipped = NullRegion;
     RegionPtr	    pDamageRegion;
     RegionRec	    pixClip;
     int		    draw_x, draw_y;
@@ -271,7 +410,6 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
     }
         
 
-    RegionNull(&clippedRec);
     for (; pDamage; pDamage = pNext)
     {
 	pNext = pDamage->pNext;
@@ -306,6 +444,16 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 	    draw_y += ((PixmapPtr) pDamage->pDrawable)->screen_y;
 	}
 #endif
+
+	/*
+	 * Tiled damage just marks what the region touches
+	 */
+	if (pDamage->tiled && !pDamage->reportAfter &&
+	    !pDamage->damageMarker && damageValidateTiles (pDamage))
+	{
+	    damageMarkTiles (pDamage, pRegion, draw_x, draw_y);
+	    continue;
+	}
 	
 	/*
 	 * Clip against border or pixmap bounds
@@ -314,7 +462,9 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 	pDamageRegion = pRegion;
 	if (clip || pDamage->pDrawable != pDrawable)
 	{
-	    pDamageRegion = &clippedRec;
+	    if (!pClipped)
+		pClipped = RegionCreateTemporary(NullBox, 0);
+	    pDamageRegion = pClipped;
 	    if (pDamage->pDrawable->type == DRAWABLE_WINDOW) {
 		RegionIntersect(pDamageRegion, pRegion,
 		    &((WindowPtr)(pDamage->pDrawable))->borderClip);
@@ -376,8 +526,6 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
     if (screen_x || screen_y)
 	RegionTranslate(pRegion, -screen_x, -screen_y);
 #endif
-    
-    RegionUninit(&clippedRec);
 }
 
 static void
@@ -1904,6 +2052,9 @@ DamageCreate (DamageReportFunc  damageReport,
     pDamage->isWindow = FALSE;
     pDamage->pDrawable = 0;
     pDamage->reportAfter = FALSE;
+    pDamage->tiled = FALSE;
+    pDamage->tiles = NULL;
+    pDamage->tilesDirty = FALSE;
 
     pDamage->damageReport = damageReport;
     pDamage->damageReportPostRendering = NULL;
@@ -2015,6 +2166,7 @@ DamageDestroy (DamagePtr    pDamage)
     (*pScrPriv->funcs.Destroy) (pDamage);
     RegionUninit(&pDamage->damage);
     RegionUninit(&pDamage->pendingDamage);
+    free(pDamage->tiles);
     dixFreeObjectWithPrivates(pDamage, PRIVATE_DAMAGE);
 }
 
@@ -2026,6 +2178,7 @@ DamageSubtract (DamagePtr	    pDamage,
     RegionRec	pixmapClip;
     DrawablePtr	pDrawable = pDamage->pDrawable;
     
+    damageFlushTiles (pDamage);
     RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
     if (pDrawable)
     {
@@ -2054,12 +2207,20 @@ DamageSubtract (DamagePtr	    pDamage,
 void
 DamageEmpty (DamagePtr	    pDamage)
 {
+    if (pDamage->tilesDirty)
+    {
+	memset (pDamage->tiles, 0, pDamage->tileStride * sizeof (CARD32) *
+		((pDamage->tileBox.y2 - pDamage->tileBox.y1 +
+		  DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT));
+	pDamage->tilesDirty = FALSE;
+    }
     RegionEmpty(&pDamage->damage);
 }
 
 RegionPtr
 DamageRegion (DamagePtr		    pDamage)
 {
+    damageFlushTiles (pDamage);
     return &pDamage->damage;
 }
 
@@ -2111,6 +2272,22 @@ DamageSetReportAfterOp (DamagePtr pDamage, Bool reportAfter)
     pDamage->reportAfter = reportAfter;
 }
 
+Bool
+DamageSetTiled (DamagePtr pDamage, Bool tiled)
+{
+    if (tiled && pDamage->damageLevel != DamageReportNone &&
+	pDamage->damageLevel != DamageReportNonEmpty)
+	return FALSE;
+    if (!tiled)
+    {
+	damageFlushTiles (pDamage);
+	free(pDamage->tiles);
+	pDamage->tiles = NULL;
+    }
+    pDamage->tiled = tiled;
+    return TRUE;
+}
+
 void
 DamageSetPostRenderingFunctions(DamagePtr pDamage, DamageReportFunc damageReportPostRendering,
 				DamageMarkerFunc damageMarker)
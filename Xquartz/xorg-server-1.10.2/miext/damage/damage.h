@@ -118,6 +118,11 @@ DamageDamageRegion (DrawablePtr	    pDrawable,
 extern _X_EXPORT void
 DamageSetReportAfterOp (DamagePtr pDamage, Bool reportAfter);
 
+/* Only track damage to the nearest tile, for DamageReportNone and
+ * DamageReportNonEmpty; returns FALSE for other report levels. */
+extern _X_EXPORT Bool
+DamageSetTiled (DamagePtr pDamage, Bool tiled);
+
 extern _X_EXPORT void
 DamageSetPostRenderingFunctions(DamagePtr pDamage, DamageReportFunc damageReportPostRendering,
 				DamageMarkerFunc damageMarker);
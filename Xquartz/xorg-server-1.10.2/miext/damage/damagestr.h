@@ -51,6 +51,11 @@ typedef struct _damage {
     Bool		reportAfter;
     RegionRec		pendingDamage; /* will be flushed post submission at the latest */
     RegionRec		backupDamage; /* for use with damageMarker */
+    Bool		tiled; /* accumulate in tiles, see DamageSetTiled */
+    CARD32		*tiles; /* bitmap of tiles drawn to */
+    BoxRec		tileBox; /* drawable area the bitmap covers */
+    int			tileStride; /* CARD32 per row of tiles */
+    Bool		tilesDirty; /* some tiles are marked */
     ScreenPtr		pScreen;
     PrivateRec		*devPrivates;
 } DamageRec;
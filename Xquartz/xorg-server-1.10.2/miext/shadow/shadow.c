@@ -160,6 +160,10 @@ shadowSetup(ScreenPtr pScreen)
 	free(pBuf);
 	return FALSE;
     }
+#ifndef BACKWARDS_COMPATIBILITY
+    /* updates copy whole rectangles anyway */
+    DamageSetTiled(pBuf->pDamage, TRUE);
+#endif
 
     wrap(pBuf, pScreen, CloseScreen);
     wrap(pBuf, pScreen, GetImage);
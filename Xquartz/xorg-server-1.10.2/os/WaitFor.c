@@ -115,16 +115,18 @@ mffs(fd_mask mask)
 #endif
 
 struct _OsTimerRec {
-    OsTimerPtr		next;
+    int			index;		/* in timerHeap, -1 if not pending */
     CARD32		expires;
     CARD32              delta;
     OsTimerCallback	callback;
     pointer		arg;
 };
 
-static void DoTimer(OsTimerPtr timer, CARD32 now, OsTimerPtr *prev);
+static void DoTimer(OsTimerPtr timer, CARD32 now);
 static void CheckAllTimers(void);
-static OsTimerPtr timers = NULL;
+static OsTimerPtr *timerHeap = NULL;
+static int numTimers = 0;
+static int sizeTimers = 0;
 
 /*****************
  * WaitForSomething:
@@ -143,6 +145,263 @@ static OsTimerPtr timers = NULL;
  *     pClientsReady is an array to store ready client->index values into.
  *****************/
 
+#ifdef HAVE_EPOLL
+
+/* Indices of the clients reported readable by the last OsPollWait.
+ * Indices rather than connections, since a wakeup handler may close
+ * any of them before they are collected. */
+static int ReadableClients[MAXCLIENTS];
+static int nReadableClients;
+
+static OsCommPtr
+ReadableClient(int i)
+{
+    ClientPtr client = clients[ReadableClients[i]];
+
+    if (!client || client->clientGone || !client->osPrivate)
+	return NULL;
+    return (OsCommPtr)client->osPrivate;
+}
+
+/* Forget the readable clients, so the next wakeup can report them again */
+static void
+ClearReadableClients(void)
+{
+    OsCommPtr oc;
+    int i;
+
+    for (i = 0; i < nReadableClients; i++)
+	if ((oc = ReadableClient(i)))
+	    oc->flags &= ~OS_COMM_READABLE;
+    nReadableClients = 0;
+}
+
+void
+ClientPollNotify(int fd, int xevents, pointer data)
+{
+    OsCommPtr oc = (OsCommPtr)data;
+
+    if (xevents & X_NOTIFY_WRITE)
+    {
+	ClearClientWriteBlocked(oc);
+	MarkOutputPending(oc);
+	NewOutputPending = TRUE;
+    }
+    if ((xevents & X_NOTIFY_READ) &&
+	!(oc->flags & OS_COMM_READABLE) && oc->client)
+    {
+	oc->flags |= OS_COMM_READABLE;
+	ReadableClients[nReadableClients++] = oc->client->index;
+    }
+}
+
+/*
+ * Apply the strict priority rule of the select() version: only the
+ * highest priority ready clients are returned to dix.
+ */
+static void
+AddReadyClient(int *pClientsReady, int *nready, int *highest_priority,
+	       ClientPtr client)
+{
+    if (*nready == 0 || client->priority > *highest_priority)
+    {
+	pClientsReady[0] = client->index;
+	*highest_priority = client->priority;
+	*nready = 1;
+    }
+    else if (client->priority == *highest_priority)
+	pClientsReady[(*nready)++] = client->index;
+}
+
+/*****************
+ * WaitForSomething, ospoll version.
+ *    Same contract as the select() version below; the client masks are
+ *    replaced by ReadyClients, OutputPendingClients and the readable
+ *    clients collected by ClientPollNotify, so the cost of a wakeup
+ *    depends on how many clients are ready rather than on the highest
+ *    descriptor in use.  LastSelectMask is still handed to the block
+ *    and wakeup handlers; everything in it is waited for as well.
+ *****************/
+
+int
+WaitForSomething(int *pClientsReady)
+{
+    int i;
+    struct timeval waittime, *wt;
+    INT32 timeout = 0;
+    int pollerr;
+    static int nready;
+    fd_set devicesReadable;
+    fd_set tmp_set;
+    CARD32 now = 0;
+    Bool someReady = FALSE;
+    int highest_priority = 0;
+    OsCommPtr oc;
+
+    if (nready)
+	SmartScheduleStopTimer();
+    nready = 0;
+    /* the clients returned last time have been read from since */
+    ClearReadableClients();
+
+    while (1)
+    {
+	/* deal with any blocked jobs */
+	if (workQueue)
+	    ProcessWorkQueue();
+	if (!list_is_empty(&ReadyClients))
+	{
+	    if (!SmartScheduleDisable)
+	    {
+		someReady = TRUE;
+		waittime.tv_sec = 0;
+		waittime.tv_usec = 0;
+		wt = &waittime;
+	    }
+	    else
+		break;
+	}
+	if (!someReady)
+	{
+	    wt = NULL;
+	    if (numTimers)
+	    {
+		now = GetTimeInMillis();
+		timeout = timerHeap[0]->expires - now;
+		if (timeout > 0 && timeout > timerHeap[0]->delta + 250) {
+		    /* time has rewound.  reset the timers. */
+		    CheckAllTimers();
+		}
+
+		if (numTimers) {
+		    timeout = timerHeap[0]->expires - now;
+		    if (timeout < 0)
+			timeout = 0;
+		    waittime.tv_sec = timeout / MILLI_PER_SECOND;
+		    waittime.tv_usec = (timeout % MILLI_PER_SECOND) *
+				       (1000000 / MILLI_PER_SECOND);
+		    wt = &waittime;
+		}
+	    }
+	}
+	XFD_COPYSET(&AllSockets, &LastSelectMask);
+
+	BlockHandler((pointer)&wt, (pointer)&LastSelectMask);
+	if (NewOutputPending)
+	    FlushAllOutput();
+	PollSelectMask(&LastSelectMask);
+	FD_ZERO(&LastSelectMask);
+	ClearReadableClients();
+	/* keep this check close to the wait to minimize race */
+	if (dispatchException)
+	    i = -1;
+	else
+	{
+	    if (wt)
+		timeout = wt->tv_sec * MILLI_PER_SECOND +
+			  (wt->tv_usec + 999) / (1000000 / MILLI_PER_SECOND);
+	    else
+		timeout = -1;
+	    i = OsPollWait(ServerPoll, timeout);
+	}
+	pollerr = GetErrno();
+	WakeupHandler(i, (pointer)&LastSelectMask);
+	if (i <= 0) /* An error or timeout occurred */
+	{
+	    if (dispatchException)
+		return 0;
+	    if (i < 0)
+	    {
+		if (pollerr == EINVAL || pollerr == EBADF)
+		{
+		    FatalError("WaitForSomething(): %s: %s\n",
+			       OsPollBackendName(ServerPoll), strerror(pollerr));
+		}
+		else if (pollerr != EINTR && pollerr != EAGAIN)
+		{
+		    ErrorF("WaitForSomething(): %s: %s\n",
+			   OsPollBackendName(ServerPoll), strerror(pollerr));
+		}
+	    }
+	    else if (someReady)
+	    {
+		/*
+		 * If no-one else is home, bail quickly
+		 */
+		break;
+	    }
+	    if (*checkForInput[0] != *checkForInput[1])
+		return 0;
+
+	    if (numTimers)
+	    {
+		int expired = 0;
+		now = GetTimeInMillis();
+		if ((int) (timerHeap[0]->expires - now) <= 0)
+		    expired = 1;
+
+		while (numTimers && (int) (timerHeap[0]->expires - now) <= 0)
+		    DoTimer(timerHeap[0], now);
+
+		if (expired)
+		    return 0;
+	    }
+	}
+	else
+	{
+	    if (*checkForInput[0] == *checkForInput[1]) {
+		if (numTimers)
+		{
+		    int expired = 0;
+		    now = GetTimeInMillis();
+		    if ((int) (timerHeap[0]->expires - now) <= 0)
+			expired = 1;
+
+		    while (numTimers && (int) (timerHeap[0]->expires - now) <= 0)
+			DoTimer(timerHeap[0], now);
+
+		    if (expired)
+			return 0;
+		}
+	    }
+
+	    XFD_ANDSET(&devicesReadable, &LastSelectMask, &EnabledDevices);
+	    XFD_ANDSET(&tmp_set, &LastSelectMask, &WellKnownConnections);
+	    if (XFD_ANYSET(&tmp_set))
+		QueueWorkProc(EstablishNewConnections, NULL,
+			      (pointer)&LastSelectMask);
+
+	    if (someReady || nReadableClients || XFD_ANYSET (&devicesReadable))
+		break;
+	    /* check here for DDXes that queue events during Block/Wakeup */
+	    if (*checkForInput[0] != *checkForInput[1])
+		return 0;
+	}
+    }
+
+    nready = 0;
+    for (i = 0; i < nReadableClients; i++)
+    {
+	if ((oc = ReadableClient(i)) && (oc->flags & OS_COMM_READABLE) &&
+	    ClientIsListenedTo(oc))
+	    AddReadyClient(pClientsReady, &nready, &highest_priority,
+			   oc->client);
+    }
+    list_for_each_entry(oc, &ReadyClients, ready)
+    {
+	if (!(oc->flags & OS_COMM_READABLE))
+	    AddReadyClient(pClientsReady, &nready, &highest_priority,
+			   oc->client);
+    }
+
+    if (nready)
+        SmartScheduleStartTimer();
+
+    return nready;
+}
+
+#else /* HAVE_EPOLL */
+
 int
 WaitForSomething(int *pClientsReady)
 {
@@ -194,17 +453,17 @@ WaitForSomething(int *pClientsReady)
 	else
 	{
         wt = NULL;
-	if (timers)
+	if (numTimers)
         {
             now = GetTimeInMillis();
-	    timeout = timers->expires - now;
-            if (timeout > 0 && timeout > timers->delta + 250) {
+	    timeout = timerHeap[0]->expires - now;
+            if (timeout > 0 && timeout > timerHeap[0]->delta + 250) {
                 /* time has rewound.  reset the timers. */
                 CheckAllTimers();
             }
 
-	    if (timers) {
-		timeout = timers->expires - now;
+	    if (numTimers) {
+		timeout = timerHeap[0]->expires - now;
 		if (timeout < 0)
 		    timeout = 0;
 		waittime.tv_sec = timeout / MILLI_PER_SECOND;
@@ -268,15 +527,15 @@ WaitForSomething(int *pClientsReady)
 	    if (*checkForInput[0] != *checkForInput[1])
 		return 0;
 
-	    if (timers)
+	    if (numTimers)
 	    {
                 int expired = 0;
 		now = GetTimeInMillis();
-		if ((int) (timers->expires - now) <= 0)
+		if ((int) (timerHeap[0]->expires - now) <= 0)
 		    expired = 1;
 
-		while (timers && (int) (timers->expires - now) <= 0)
-		    DoTimer(timers, now, &timers);
+		while (numTimers && (int) (timerHeap[0]->expires - now) <= 0)
+		    DoTimer(timerHeap[0], now);
 
                 if (expired)
                     return 0;
@@ -287,15 +546,15 @@ WaitForSomething(int *pClientsReady)
 	    fd_set tmp_set;
 
 	    if (*checkForInput[0] == *checkForInput[1]) {
-	        if (timers)
+	        if (numTimers)
 	        {
                     int expired = 0;
 		    now = GetTimeInMillis();
-		    if ((int) (timers->expires - now) <= 0)
+		    if ((int) (timerHeap[0]->expires - now) <= 0)
 		        expired = 1;
 
-		    while (timers && (int) (timers->expires - now) <= 0)
-		        DoTimer(timers, now, &timers);
+		    while (numTimers && (int) (timerHeap[0]->expires - now) <= 0)
+		        DoTimer(timerHeap[0], now);
 
                     if (expired)
                         return 0;
@@ -397,18 +656,22 @@ WaitForSomething(int *pClientsReady)
     return nready;
 }
 
+#endif /* HAVE_EPOLL */
+
 /* If time has rewound, re-run every affected timer.
- * Timers might drop out of the list, so we have to restart every time. */
+ * Timers might drop out of the heap, so we have to restart every time. */
 static void
 CheckAllTimers(void)
 {
     OsTimerPtr timer;
     CARD32 now;
+    int i;
 
 start:
     now = GetTimeInMillis();
 
-    for (timer = timers; timer; timer = timer->next) {
+    for (i = 0; i < numTimers; i++) {
+        timer = timerHeap[i];
         if (timer->expires - now > timer->delta + 250) {
             TimerForce(timer);
             goto start;
@@ -416,13 +679,96 @@ start:
     }
 }
 
+/*
+ * Pending timers are kept in a binary heap ordered on expiry time, so
+ * arming and cancelling a timer are O(log n) and the next one to expire
+ * is always timerHeap[0].  Each timer knows its position in the heap,
+ * or -1 when it isn't pending.
+ */
+#define TimerBefore(a, b) ((int) ((a)->expires - (b)->expires) < 0)
+
 static void
-DoTimer(OsTimerPtr timer, CARD32 now, OsTimerPtr *prev)
+TimerHeapPut(OsTimerPtr timer, int i)
+{
+    timerHeap[i] = timer;
+    timer->index = i;
+}
+
+static void
+TimerHeapUp(int i)
+{
+    OsTimerPtr timer = timerHeap[i];
+    int parent;
+
+    while (i > 0)
+    {
+	parent = (i - 1) / 2;
+	if (!TimerBefore(timer, timerHeap[parent]))
+	    break;
+	TimerHeapPut(timerHeap[parent], i);
+	i = parent;
+    }
+    TimerHeapPut(timer, i);
+}
+
+static void
+TimerHeapDown(int i)
+{
+    OsTimerPtr timer = timerHeap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < numTimers)
+    {
+	if (child + 1 < numTimers &&
+	    TimerBefore(timerHeap[child + 1], timerHeap[child]))
+	    child++;
+	if (!TimerBefore(timerHeap[child], timer))
+	    break;
+	TimerHeapPut(timerHeap[child], i);
+	i = child;
+    }
+    TimerHeapPut(timer, i);
+}
+
+static Bool
+TimerHeapInsert(OsTimerPtr timer)
+{
+    if (numTimers == sizeTimers)
+    {
+	int size = sizeTimers ? sizeTimers * 2 : 16;
+	OsTimerPtr *heap = realloc(timerHeap, size * sizeof(OsTimerPtr));
+
+	if (!heap)
+	    return FALSE;
+	timerHeap = heap;
+	sizeTimers = size;
+    }
+    timerHeap[numTimers] = timer;
+    TimerHeapUp(numTimers++);
+    return TRUE;
+}
+
+static void
+TimerHeapRemove(OsTimerPtr timer)
+{
+    int i = timer->index;
+    OsTimerPtr last;
+
+    timer->index = -1;
+    last = timerHeap[--numTimers];
+    if (last == timer)
+	return;
+    TimerHeapPut(last, i);
+    TimerHeapUp(i);
+    TimerHeapDown(last->index);
+}
+
+static void
+DoTimer(OsTimerPtr timer, CARD32 now)
 {
     CARD32 newTime;
 
-    *prev = timer->next;
-    timer->next = NULL;
+    TimerHeapRemove(timer);
     newTime = (*timer->callback)(timer, now, timer->arg);
     if (newTime)
 	TimerSet(timer, 0, newTime, timer->callback, timer->arg);
@@ -432,7 +778,6 @@ OsTimerPtr
 TimerSet(OsTimerPtr timer, int flags, CARD32 millis, 
     OsTimerCallback func, pointer arg)
 {
-    register OsTimerPtr *prev;
     CARD32 now = GetTimeInMillis();
 
     if (!timer)
@@ -440,19 +785,13 @@ TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
 	timer = malloc(sizeof(struct _OsTimerRec));
 	if (!timer)
 	    return NULL;
+	timer->index = -1;
     }
-    else
+    else if (timer->index >= 0)
     {
-	for (prev = &timers; *prev; prev = &(*prev)->next)
-	{
-	    if (*prev == timer)
-	    {
-		*prev = timer->next;
-		if (flags & TimerForceOld)
-		    (void)(*timer->callback)(timer, now, timer->arg);
-		break;
-	    }
-	}
+	TimerHeapRemove(timer);
+	if (flags & TimerForceOld)
+	    (void)(*timer->callback)(timer, now, timer->arg);
     }
     if (!millis)
 	return timer;
@@ -468,52 +807,33 @@ TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
     timer->arg = arg;
     if ((int) (millis - now) <= 0)
     {
-	timer->next = NULL;
 	millis = (*timer->callback)(timer, now, timer->arg);
 	if (!millis)
 	    return timer;
+	return TimerSet(timer, 0, millis, func, arg);
     }
-    for (prev = &timers;
-	 *prev && (int) ((*prev)->expires - millis) <= 0;
-	 prev = &(*prev)->next)
-        ;
-    timer->next = *prev;
-    *prev = timer;
+    if (!TimerHeapInsert(timer))
+	ErrorF("TimerSet: out of memory, timer not armed\n");
     return timer;
 }
 
 Bool
 TimerForce(OsTimerPtr timer)
 {
-    OsTimerPtr *prev;
-
-    for (prev = &timers; *prev; prev = &(*prev)->next)
-    {
-	if (*prev == timer)
-	{
-	    DoTimer(timer, GetTimeInMillis(), prev);
-	    return TRUE;
-	}
-    }
-    return FALSE;
+    if (timer->index < 0)
+	return FALSE;
+    DoTimer(timer, GetTimeInMillis());
+    return TRUE;
 }
 
 
 void
 TimerCancel(OsTimerPtr timer)
 {
-    OsTimerPtr *prev;
-
     if (!timer)
 	return;
-    for (prev = &timers; *prev; prev = &(*prev)->next)
-    {
-	if (*prev == timer)
-	{
-	    *prev = timer->next;
-	    break;
-	}
-    }
+    if (timer->index >= 0)
+	TimerHeapRemove(timer);
 }
 
 void
@@ -530,20 +850,15 @@ TimerCheck(void)
 {
     CARD32 now = GetTimeInMillis();
 
-    while (timers && (int) (timers->expires - now) <= 0)
-	DoTimer(timers, now, &timers);
+    while (numTimers && (int) (timerHeap[0]->expires - now) <= 0)
+	DoTimer(timerHeap[0], now);
 }
 
 void
 TimerInit(void)
 {
-    OsTimerPtr timer;
-
-    while ((timer = timers))
-    {
-	timers = timer->next;
-	free(timer);
-    }
+    while (numTimers)
+	free(timerHeap[--numTimers]);
 }
 
 #ifdef DPMSExtension
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2011 The X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "dix.h"
+#include "busfault.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+typedef struct _BusFault {
+    struct _BusFault	*next;
+    char		*addr;
+    size_t		size;
+    Bool		valid;
+    BusFaultNotify	notify;
+    void		*data;
+} BusFaultRec;
+
+static BusFaultPtr busfaults;
+static volatile Bool busfaulted;
+static Bool busfaultHandlers;
+
+static void
+BusFaultBlockHandler(pointer data, OSTimePtr timeout, pointer readmask)
+{
+    BusFaultPtr busfault, next;
+
+    if (!busfaulted)
+	return;
+    busfaulted = FALSE;
+    for (busfault = busfaults; busfault; busfault = next)
+    {
+	next = busfault->next;
+	if (!busfault->valid)
+	    (*busfault->notify)(busfault->data);
+    }
+}
+
+static void
+BusFaultWakeupHandler(pointer data, int result, pointer readmask)
+{
+}
+
+/*
+ * Watch [addr, addr + size) for faults until BusFaultUnregister.
+ */
+BusFaultPtr
+BusFaultRegister(void *addr, size_t size, BusFaultNotify notify, void *data)
+{
+    BusFaultPtr busfault;
+
+    busfault = malloc(sizeof(BusFaultRec));
+    if (!busfault)
+	return NULL;
+    busfault->addr = addr;
+    busfault->size = size;
+    busfault->valid = TRUE;
+    busfault->notify = notify;
+    busfault->data = data;
+
+    if (!busfaultHandlers)
+    {
+	if (!RegisterBlockAndWakeupHandlers(BusFaultBlockHandler,
+					    BusFaultWakeupHandler, NULL))
+	{
+	    free(busfault);
+	    return NULL;
+	}
+	busfaultHandlers = TRUE;
+    }
+    busfault->next = busfaults;
+    busfaults = busfault;
+    return busfault;
+}
+
+void
+BusFaultUnregister(BusFaultPtr busfault)
+{
+    BusFaultPtr *prev;
+
+    for (prev = &busfaults; *prev; prev = &(*prev)->next)
+	if (*prev == busfault)
+	{
+	    *prev = busfault->next;
+	    break;
+	}
+    free(busfault);
+
+    if (!busfaults && busfaultHandlers)
+    {
+	RemoveBlockAndWakeupHandlers(BusFaultBlockHandler,
+				     BusFaultWakeupHandler, NULL);
+	busfaultHandlers = FALSE;
+    }
+}
+
+/*
+ * Called from the SIGBUS handler.  If addr is in a registered range,
+ * map zero pages over the whole range and return TRUE so the faulting
+ * access is retried; the owner hears about it from the block handler.
+ */
+Bool
+BusFaultCatch(void *addr)
+{
+    BusFaultPtr busfault;
+    char *fault = addr;
+
+    for (busfault = busfaults; busfault; busfault = busfault->next)
+    {
+	if (fault < busfault->addr ||
+	    fault >= busfault->addr + busfault->size)
+	    continue;
+	if (mmap(busfault->addr, busfault->size, PROT_READ|PROT_WRITE,
+		 MAP_ANONYMOUS|MAP_PRIVATE|MAP_FIXED, -1, 0) == MAP_FAILED)
+	    return FALSE;
+	busfault->valid = FALSE;
+	busfaulted = TRUE;
+	return TRUE;
+    }
+    return FALSE;
+}
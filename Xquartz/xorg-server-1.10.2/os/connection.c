@@ -103,6 +103,10 @@ SOFTWARE.
 
 #include <sys/uio.h>
 
+#ifdef HAVE_EPOLL
+#include <fcntl.h>
+#endif
+
 #endif /* WIN32 */
 #include "misc.h"		/* for typedef of pointer */
 #include "osdep.h"
@@ -142,6 +146,15 @@ int MaxClients = 0;
 Bool NewOutputPending;		/* not yet attempted to write some new output */
 Bool AnyClientsWriteBlocked;	/* true if some client blocked on write */
 
+#ifdef HAVE_EPOLL
+OsPollPtr ServerPoll;		/* every descriptor we wait on */
+struct list ReadyClients;	/* listened-to clients with FULL requests */
+struct list OutputPendingClients; /* clients with reply/event data ready */
+static fd_set PolledSockets;	/* non-client descriptors added to ServerPoll */
+static int NumClientsWriteBlocked;
+static int NumClientConnections;
+#endif
+
 static Bool RunFromSmartParent;	/* send SIGUSR1 to parent process */
 Bool RunFromSigStopParent;	/* send SIGSTOP to our own process; Upstart (or
 				   equivalent) will send SIGCONT back. */
@@ -254,6 +267,11 @@ static int	       	*ListenTransFds = NULL;
 static int		ListenTransCount;
 
 static void ErrorConnMax(XtransConnInfo /* trans_conn */);
+#ifdef HAVE_EPOLL
+static void UpdateClientListening(OsCommPtr /* oc */);
+static void UpdateAllClientsListening(void);
+static void ForgetPolledSocket(int /* fd */);
+#endif
 
 static XtransConnInfo
 lookup_trans_conn (int fd)
@@ -298,6 +316,17 @@ InitConnectionLimits(void)
     if (lastfdesc < 0)
 	lastfdesc = MAXSOCKS;
 
+#ifdef HAVE_EPOLL
+    /* Client descriptors are not limited by select(), only the number
+     * of clients is limited by the resource id space. */
+    MaxClients = lastfdesc;
+    if (MaxClients > MAXCLIENTS)
+    {
+	MaxClients = MAXCLIENTS;
+	if (debug_conns)
+	    ErrorF( "REACHED MAXIMUM CLIENTS LIMIT %d\n", MAXCLIENTS);
+    }
+#else
     if (lastfdesc > MAXSELECT)
 	lastfdesc = MAXSELECT;
 
@@ -308,6 +337,7 @@ InitConnectionLimits(void)
 	    ErrorF( "REACHED MAXIMUM CLIENTS LIMIT %d\n", MAXCLIENTS);
     }
     MaxClients = lastfdesc;
+#endif
 
 #ifdef DEBUG
     ErrorF("InitConnectionLimits: MaxClients = %d\n", MaxClients);
@@ -315,10 +345,23 @@ InitConnectionLimits(void)
 
 #if !defined(WIN32)
     if (!ConnectionTranslation)
-        ConnectionTranslation = (int *)xnfalloc(sizeof(int)*(lastfdesc + 1));
+        ConnectionTranslation = (int *)xnfcalloc(sizeof(int), lastfdesc + 1);
 #else
     InitConnectionTranslation();
 #endif
+
+#ifdef HAVE_EPOLL
+    if (!ServerPoll)
+    {
+	ServerPoll = OsPollCreate();
+	if (!ServerPoll)
+	    FatalError("InitConnectionLimits: cannot create %s poll set: %s\n",
+		       "epoll", strerror(errno));
+	list_init(&ReadyClients);
+	list_init(&OutputPendingClients);
+	FD_ZERO(&PolledSockets);
+    }
+#endif
 }
 
 /*
@@ -379,7 +422,7 @@ CreateWellKnownSockets(void)
     FD_ZERO(&ClientsWithInput);
 
 #if !defined(WIN32)
-    for (i=0; i<MaxClients; i++) ConnectionTranslation[i] = 0;
+    for (i=0; i<=lastfdesc; i++) ConnectionTranslation[i] = 0;
 #else
     ClearConnectionTranslation();
 #endif
@@ -741,8 +784,23 @@ AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
     oc->output = (ConnectionOutputPtr)NULL;
     oc->auth_id = None;
     oc->conn_time = conn_time;
+#ifdef HAVE_EPOLL
+    oc->client = NullClient;
+    oc->flags = 0;
+    list_init(&oc->ready);
+    list_init(&oc->pending);
+    ForgetPolledSocket(fd);
+    if (!OsPollAdd(ServerPoll, fd, ClientPollNotify, (pointer)oc))
+    {
+	free(oc);
+	return NullClient;
+    }
+#endif
     if (!(client = NextAvailableClient((pointer)oc)))
     {
+#ifdef HAVE_EPOLL
+	OsPollRemove(ServerPoll, fd);
+#endif
 	free(oc);
 	return NullClient;
     }
@@ -752,6 +810,11 @@ AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
 #else
     SetConnectionTranslation(fd, client->index);
 #endif
+#ifdef HAVE_EPOLL
+    oc->client = client;
+    NumClientConnections++;
+    UpdateClientListening(oc);
+#else
     if (GrabInProgress)
     {
         FD_SET(fd, &SavedAllClients);
@@ -762,6 +825,7 @@ AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
         FD_SET(fd, &AllClients);
         FD_SET(fd, &AllSockets);
     }
+#endif
 
 #ifdef DEBUG
     ErrorF("AllocNewConnection: client index = %d, socket fd = %d\n",
@@ -930,6 +994,9 @@ CloseDownFileDescriptor(OsCommPtr oc)
 {
     int connection = oc->fd;
 
+#ifdef HAVE_EPOLL
+    OsPollRemove(ServerPoll, connection);
+#endif
     if (oc->trans_conn) {
 	_XSERVTransDisconnect(oc->trans_conn);
 	_XSERVTransClose(oc->trans_conn);
@@ -939,6 +1006,12 @@ CloseDownFileDescriptor(OsCommPtr oc)
 #else
     SetConnectionTranslation(connection, 0);
 #endif    
+#ifdef HAVE_EPOLL
+    ClearClientWithInput(oc);
+    ClearOutputPending(oc);
+    ClearClientWriteBlocked(oc);
+    NumClientConnections--;
+#else
     FD_CLR(connection, &AllSockets);
     FD_CLR(connection, &AllClients);
     FD_CLR(connection, &ClientsWithInput);
@@ -953,6 +1026,7 @@ CloseDownFileDescriptor(OsCommPtr oc)
     if (!XFD_ANYSET(&ClientsWriteBlocked))
     	AnyClientsWriteBlocked = FALSE;
     FD_CLR(connection, &OutputPending);
+#endif
 }
 
 /*****************
@@ -964,6 +1038,29 @@ CloseDownFileDescriptor(OsCommPtr oc)
  *    to check each and every socket individually.
  *****************/
 
+#ifdef HAVE_EPOLL
+/*
+ * epoll silently forgets closed descriptors rather than failing with
+ * EBADF, so this is only reached from the dispatcher; ask each client
+ * descriptor directly.
+ */
+void
+CheckConnections(void)
+{
+    int i;
+
+    for (i = 1; i < currentMaxClients; i++)
+    {
+	ClientPtr client = clients[i];
+	OsCommPtr oc;
+
+	if (!client || client->clientGone || !(oc = client->osPrivate))
+	    continue;
+	if (fcntl(oc->fd, F_GETFL) == -1 && errno == EBADF)
+	    CloseDownClient(client);
+    }
+}
+#else
 void
 CheckConnections(void)
 {
@@ -1017,6 +1114,7 @@ CheckConnections(void)
     }	
 #endif
 }
+#endif /* HAVE_EPOLL */
 
 
 /*****************
@@ -1032,7 +1130,7 @@ CloseDownConnection(ClientPtr client)
     if (FlushCallback)
 	CallCallbacks(&FlushCallback, NULL);
 
-    if (oc->output && oc->output->count)
+    if (oc->output && (oc->output->count || oc->output->chunks))
 	FlushClient(client, oc, (char *)NULL, 0);
 #ifdef XDMCP
     XdmcpCloseDisplay(oc->fd);
@@ -1045,6 +1143,268 @@ CloseDownConnection(ClientPtr client)
 	AuditF("client %d disconnected\n", client->index);
 }
 
+/*****************
+ * Client state
+ *    ClientsWithInput, OutputPending and ClientsWriteBlocked membership.
+ *    With select() these are bits in the masks; with the ospoll backend
+ *    they are flags in the connection plus the ReadyClients and
+ *    OutputPendingClients lists.
+ *****************/
+
+#ifdef HAVE_EPOLL
+
+/* Would select() have been told about this client? */
+Bool
+ClientIsListenedTo(OsCommPtr oc)
+{
+    ClientPtr client = oc->client;
+
+    if (!client || client->ignoreCount)
+	return FALSE;
+    return !GrabInProgress || GrabInProgress == client->index ||
+	   (oc->flags & OS_COMM_IMPERVIOUS);
+}
+
+static void
+UpdateClientListening(OsCommPtr oc)
+{
+    Bool listening = ClientIsListenedTo(oc);
+
+    if (listening)
+	OsPollListen(ServerPoll, oc->fd, X_NOTIFY_READ);
+    else
+	OsPollMute(ServerPoll, oc->fd, X_NOTIFY_READ);
+
+    /* Buffered requests of ignored or grabbed-out clients stay flagged
+     * and come back when the client is listened to again. */
+    if (listening && (oc->flags & OS_COMM_INPUT))
+    {
+	if (list_is_empty(&oc->ready))
+	    __list_add(&oc->ready, ReadyClients.prev, &ReadyClients);
+    }
+    else
+	list_del(&oc->ready);
+}
+
+static void
+UpdateAllClientsListening(void)
+{
+    int i;
+
+    for (i = 1; i < currentMaxClients; i++)
+	if (clients[i] && clients[i]->osPrivate)
+	    UpdateClientListening((OsCommPtr)clients[i]->osPrivate);
+}
+
+void
+MarkClientWithInput(OsCommPtr oc)
+{
+    oc->flags |= OS_COMM_INPUT;
+    if (list_is_empty(&oc->ready) && ClientIsListenedTo(oc))
+	__list_add(&oc->ready, ReadyClients.prev, &ReadyClients);
+}
+
+void
+ClearClientWithInput(OsCommPtr oc)
+{
+    oc->flags &= ~OS_COMM_INPUT;
+    list_del(&oc->ready);
+}
+
+Bool
+ClientHasInput(OsCommPtr oc)
+{
+    return (oc->flags & OS_COMM_INPUT) != 0;
+}
+
+Bool
+ClientIsWriteBlocked(OsCommPtr oc)
+{
+    return (oc->flags & OS_COMM_WRITE_BLOCKED) != 0;
+}
+
+void
+MarkOutputPending(OsCommPtr oc)
+{
+    if (oc->flags & OS_COMM_OUTPUT_PENDING)
+	return;
+    oc->flags |= OS_COMM_OUTPUT_PENDING;
+    __list_add(&oc->pending, OutputPendingClients.prev, &OutputPendingClients);
+}
+
+void
+ClearOutputPending(OsCommPtr oc)
+{
+    oc->flags &= ~OS_COMM_OUTPUT_PENDING;
+    list_del(&oc->pending);
+}
+
+Bool
+AnyOutputPending(void)
+{
+    return !list_is_empty(&OutputPendingClients);
+}
+
+void
+MarkClientWriteBlocked(OsCommPtr oc)
+{
+    if (!(oc->flags & OS_COMM_WRITE_BLOCKED))
+    {
+	oc->flags |= OS_COMM_WRITE_BLOCKED;
+	NumClientsWriteBlocked++;
+	OsPollListen(ServerPoll, oc->fd, X_NOTIFY_WRITE);
+    }
+    AnyClientsWriteBlocked = TRUE;
+}
+
+void
+ClearClientWriteBlocked(OsCommPtr oc)
+{
+    if (oc->flags & OS_COMM_WRITE_BLOCKED)
+    {
+	oc->flags &= ~OS_COMM_WRITE_BLOCKED;
+	NumClientsWriteBlocked--;
+	OsPollMute(ServerPoll, oc->fd, X_NOTIFY_WRITE);
+    }
+    AnyClientsWriteBlocked = NumClientsWriteBlocked > 0;
+}
+
+Bool
+AnyClientsConnected(void)
+{
+    return NumClientConnections > 0;
+}
+
+static void
+ForgetPolledSocket(int fd)
+{
+    if (fd < XFD_SETSIZE && FD_ISSET(fd, &PolledSockets))
+    {
+	FD_CLR(fd, &PolledSockets);
+	OsPollRemove(ServerPoll, fd);
+    }
+}
+
+static void
+SocketPollNotify(int fd, int xevents, pointer data)
+{
+    FD_SET(fd, &LastSelectMask);
+}
+
+/*****************
+ * PollSelectMask
+ *    Compatibility with code that still thinks in terms of select():
+ *    listeners, input devices, AddGeneralSocket users and whatever a
+ *    BlockHandler added to the mask it was handed are registered with
+ *    ServerPoll, and dropped once they no longer appear.  Readiness is
+ *    reported back by setting the descriptor in LastSelectMask, which
+ *    the caller clears before waiting.  This only ever scans a single
+ *    fd_set, never the client descriptors.
+ *****************/
+
+void
+PollSelectMask(fd_set *mask)
+{
+    int i, fd;
+
+    for (i = 0; i < howmany(XFD_SETSIZE, NFDBITS); i++)
+    {
+	fd_mask changed = mask->fds_bits[i] ^ PolledSockets.fds_bits[i];
+
+	while (changed)
+	{
+	    int bit = mffs(changed) - 1;
+
+	    changed &= ~((fd_mask)1 << bit);
+	    fd = bit + i * (sizeof(fd_mask) * 8);
+	    if (FD_ISSET(fd, mask))
+	    {
+		/* Never steal a descriptor from a client */
+		if (OsPollIsTracked(ServerPoll, fd) ||
+		    !OsPollAdd(ServerPoll, fd, SocketPollNotify, NULL))
+		{
+		    FD_CLR(fd, mask);
+		    continue;
+		}
+		OsPollListen(ServerPoll, fd, X_NOTIFY_READ);
+		FD_SET(fd, &PolledSockets);
+	    }
+	    else
+	    {
+		OsPollRemove(ServerPoll, fd);
+		FD_CLR(fd, &PolledSockets);
+	    }
+	}
+    }
+}
+
+#else /* HAVE_EPOLL */
+
+void
+MarkClientWithInput(OsCommPtr oc)
+{
+    FD_SET(oc->fd, &ClientsWithInput);
+}
+
+void
+ClearClientWithInput(OsCommPtr oc)
+{
+    FD_CLR(oc->fd, &ClientsWithInput);
+}
+
+Bool
+ClientHasInput(OsCommPtr oc)
+{
+    return FD_ISSET(oc->fd, &ClientsWithInput);
+}
+
+Bool
+ClientIsWriteBlocked(OsCommPtr oc)
+{
+    return FD_ISSET(oc->fd, &ClientsWriteBlocked);
+}
+
+void
+MarkOutputPending(OsCommPtr oc)
+{
+    FD_SET(oc->fd, &OutputPending);
+}
+
+void
+ClearOutputPending(OsCommPtr oc)
+{
+    FD_CLR(oc->fd, &OutputPending);
+}
+
+Bool
+AnyOutputPending(void)
+{
+    return XFD_ANYSET(&OutputPending);
+}
+
+void
+MarkClientWriteBlocked(OsCommPtr oc)
+{
+    FD_SET(oc->fd, &ClientsWriteBlocked);
+    AnyClientsWriteBlocked = TRUE;
+}
+
+void
+ClearClientWriteBlocked(OsCommPtr oc)
+{
+    FD_CLR(oc->fd, &ClientsWriteBlocked);
+    if (! XFD_ANYSET(&ClientsWriteBlocked))
+	AnyClientsWriteBlocked = FALSE;
+}
+
+Bool
+AnyClientsConnected(void)
+{
+    return XFD_ANYSET(&AllClients);
+}
+
+#endif /* HAVE_EPOLL */
+
 void
 AddGeneralSocket(int fd)
 {
@@ -1066,6 +1426,11 @@ RemoveGeneralSocket(int fd)
     FD_CLR(fd, &AllSockets);
     if (GrabInProgress)
 	FD_CLR(fd, &SavedAllSockets);
+#ifdef HAVE_EPOLL
+    /* Forget it now, the descriptor may be reused by a client before
+     * the next PollSelectMask. */
+    ForgetPolledSocket(fd);
+#endif
 }
 
 void
@@ -1095,6 +1460,14 @@ OnlyListenToOneClient(ClientPtr client)
     if (rc != Success)
 	return rc;
 
+#ifdef HAVE_EPOLL
+    (void) connection;
+    if (! GrabInProgress)
+    {
+	GrabInProgress = client->index;
+	UpdateAllClientsListening();
+    }
+#else
     if (! GrabInProgress)
     {
 	XFD_COPYSET(&ClientsWithInput, &SavedClientsWithInput);
@@ -1114,6 +1487,7 @@ OnlyListenToOneClient(ClientPtr client)
 	XFD_ORSET(&AllSockets, &AllSockets, &AllClients);
 	GrabInProgress = client->index;
     }
+#endif
     return rc;
 }
 
@@ -1127,10 +1501,15 @@ ListenToAllClients(void)
 {
     if (GrabInProgress)
     {
+#ifdef HAVE_EPOLL
+	GrabInProgress = 0;
+	UpdateAllClientsListening();
+#else
 	XFD_ORSET(&AllSockets, &AllSockets, &SavedAllSockets);
 	XFD_ORSET(&AllClients, &AllClients, &SavedAllClients);
 	XFD_ORSET(&ClientsWithInput, &ClientsWithInput, &SavedClientsWithInput);
 	GrabInProgress = 0;
+#endif
     }	
 }
 
@@ -1151,6 +1530,10 @@ IgnoreClient (ClientPtr client)
 	return;
 
     isItTimeToYield = TRUE;
+#ifdef HAVE_EPOLL
+    (void) connection;
+    UpdateClientListening(oc);
+#else
     if (!GrabInProgress || FD_ISSET(connection, &AllClients))
     {
     	if (FD_ISSET (connection, &ClientsWithInput))
@@ -1172,6 +1555,7 @@ IgnoreClient (ClientPtr client)
 	FD_CLR(connection, &SavedAllSockets);
 	FD_CLR(connection, &SavedAllClients);
     }
+#endif
 }
 
 /****************
@@ -1189,6 +1573,10 @@ AttendClient (ClientPtr client)
     if (client->ignoreCount)
 	return;
 
+#ifdef HAVE_EPOLL
+    (void) connection;
+    UpdateClientListening(oc);
+#else
     if (!GrabInProgress || GrabInProgress == client->index ||
 	FD_ISSET(connection, &GrabImperviousClients))
     {
@@ -1205,6 +1593,7 @@ AttendClient (ClientPtr client)
 	if (FD_ISSET(connection, &IgnoredClientsWithInput))
 	    FD_SET(connection, &SavedClientsWithInput);
     }
+#endif
 }
 
 /* make client impervious to grabs; assume only executing client calls this */
@@ -1215,7 +1604,13 @@ MakeClientGrabImpervious(ClientPtr client)
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     int connection = oc->fd;
 
+#ifdef HAVE_EPOLL
+    (void) connection;
+    oc->flags |= OS_COMM_IMPERVIOUS;
+    UpdateClientListening(oc);
+#else
     FD_SET(connection, &GrabImperviousClients);
+#endif
 
     if (ServerGrabCallback)
     {
@@ -1234,6 +1629,13 @@ MakeClientGrabPervious(ClientPtr client)
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     int connection = oc->fd;
 
+#ifdef HAVE_EPOLL
+    (void) connection;
+    oc->flags &= ~OS_COMM_IMPERVIOUS;
+    UpdateClientListening(oc);
+    if (GrabInProgress && (GrabInProgress != client->index))
+	isItTimeToYield = TRUE;
+#else
     FD_CLR(connection, &GrabImperviousClients);
     if (GrabInProgress && (GrabInProgress != client->index))
     {
@@ -1246,6 +1648,7 @@ MakeClientGrabPervious(ClientPtr client)
 	FD_CLR(connection, &AllClients);
 	isItTimeToYield = TRUE;
     }
+#endif
 
     if (ServerGrabCallback)
     {
@@ -48,7 +48,8 @@ SOFTWARE.
 /*****************************************************************
  * i/o functions
  *
- *   WriteToClient, ReadRequestFromClient
+ *   WriteToClient, WriteToClientNoCopy, ReadRequestFromClient
+ *   ClientHasQueuedRequest
  *   InsertFakeRequest, ResetCurrentRequest
  *
  *****************************************************************/
@@ -71,6 +72,7 @@ SOFTWARE.
 #include <errno.h>
 #if !defined(WIN32)
 #include <sys/uio.h>
+#include <unistd.h>
 #endif
 #include <X11/X.h>
 #include <X11/Xproto.h>
@@ -80,6 +82,7 @@ SOFTWARE.
 #include "opaque.h"
 #include "dixstruct.h"
 #include "misc.h"
+#include "regionstr.h"
 
 CallbackListPtr       ReplyCallback;
 CallbackListPtr       FlushCallback;
@@ -98,8 +101,6 @@ static ConnectionOutputPtr AllocateOutputBuffer(void);
 
 static Bool CriticalOutputPending;
 static int timesThisConnection = 0;
-static ConnectionInputPtr FreeInputs = (ConnectionInputPtr)NULL;
-static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr)NULL;
 static OsCommPtr AvailableInput = (OsCommPtr)NULL;
 
 #define get_req_len(req,cli) ((cli)->swapped ? \
@@ -113,6 +114,188 @@ static OsCommPtr AvailableInput = (OsCommPtr)NULL;
 
 #define MAX_TIMES_PER         10
 
+/*
+ * Input and output buffers come from a pool of size classes shared by
+ * all clients, so a client that alternates big and small requests trades
+ * buffers with the pool instead of reallocating.  Requests bigger than
+ * the largest class get a buffer of their own size; one of those is kept.
+ * Free buffers hold their list link.  Every POOL_TRIM_INTERVAL the pool
+ * frees the buffers of each class that stayed unused for the whole
+ * interval, and it never keeps more than max of a class.
+ */
+typedef struct _poolBuffer {
+    struct _poolBuffer *next;
+    int size;
+} PoolBufferRec, *PoolBufferPtr;
+
+typedef struct _bufferClass {
+    int size;			/* 0 for the big request class */
+    int max;			/* most free buffers kept */
+    int nfree;
+    int minFree;		/* fewest free buffers since the last trim */
+    PoolBufferPtr free;
+    unsigned long hits;
+    unsigned long misses;
+} BufferClassRec, *BufferClassPtr;
+
+static BufferClassRec BufferClasses[] = {
+    { BUFSIZE,		64 },
+    { 64 * 1024,	16 },
+    { 1024 * 1024,	4 },
+    { 0,		1 },
+};
+
+#define NUM_BUFFER_CLASSES (sizeof(BufferClasses) / sizeof(BufferClasses[0]))
+#define BIG_BUFFER_CLASS (&BufferClasses[NUM_BUFFER_CLASSES - 1])
+
+static OsTimerPtr PoolTrimTimer;
+static Bool PoolTrimPending;
+
+static BufferClassPtr
+PoolClass(int size)
+{
+    BufferClassPtr bc;
+
+    for (bc = BufferClasses; bc != BIG_BUFFER_CLASS; bc++)
+	if (size <= bc->size)
+	    return bc;
+    return bc;
+}
+
+/*
+ * Get a buffer of at least needed bytes; *size is set to its real size.
+ */
+static char *
+PoolGetBuffer(int needed, int *size)
+{
+    BufferClassPtr bc = PoolClass(needed);
+    PoolBufferPtr pb = bc->free;
+    int bufsize = bc->size ? bc->size : needed;
+
+    if (pb && pb->size >= bufsize)
+    {
+	bc->free = pb->next;
+	if (--bc->nfree < bc->minFree)
+	    bc->minFree = bc->nfree;
+	bc->hits++;
+	*size = pb->size;
+	return (char *)pb;
+    }
+    bc->misses++;
+    *size = bufsize;
+    return malloc(bufsize);
+}
+
+static CARD32
+PoolTrim(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    BufferClassPtr bc;
+    PoolBufferPtr pb;
+    Bool retained = FALSE;
+
+    for (bc = BufferClasses; bc < BufferClasses + NUM_BUFFER_CLASSES; bc++)
+    {
+	for (; bc->minFree > 0; bc->minFree--, bc->nfree--)
+	{
+	    pb = bc->free;
+	    bc->free = pb->next;
+	    free(pb);
+	}
+	bc->minFree = bc->nfree;
+	if (bc->nfree)
+	    retained = TRUE;
+    }
+    if (!retained)
+	PoolTrimPending = FALSE;
+    return retained ? POOL_TRIM_INTERVAL : 0;
+}
+
+static void
+PoolPutBuffer(char *buf, int size)
+{
+    BufferClassPtr bc = PoolClass(size);
+    PoolBufferPtr pb = (PoolBufferPtr)buf;
+
+    if ((bc->size && bc->size != size) || bc->nfree >= bc->max)
+    {
+	/* the big class keeps the bigger buffer */
+	if (bc->size || bc->free->size >= size)
+	{
+	    free(buf);
+	    return;
+	}
+	pb = bc->free;
+	bc->free = pb->next;
+	bc->nfree--;
+	free(pb);
+	pb = (PoolBufferPtr)buf;
+    }
+    pb->size = size;
+    pb->next = bc->free;
+    bc->free = pb;
+    bc->nfree++;
+    if (!PoolTrimPending)
+    {
+	bc->minFree = bc->nfree;
+	PoolTrimTimer = TimerSet(PoolTrimTimer, 0, POOL_TRIM_INTERVAL,
+				 PoolTrim, NULL);
+	PoolTrimPending = PoolTrimTimer != NULL;
+    }
+}
+
+int
+GetBufferPoolStats(BufferPoolStatsPtr stats, int nstats)
+{
+    BufferClassPtr bc;
+    PoolBufferPtr pb;
+    int n;
+
+    for (n = 0; n < nstats && n < NUM_BUFFER_CLASSES; n++)
+    {
+	bc = &BufferClasses[n];
+	stats[n].size = bc->size;
+	stats[n].hits = bc->hits;
+	stats[n].misses = bc->misses;
+	stats[n].retained = 0;
+	for (pb = bc->free; pb; pb = pb->next)
+	    stats[n].retained += pb->size;
+    }
+    return n;
+}
+
+/*
+ * Move the first count bytes of *buf into a pool buffer of at least
+ * needed bytes, and give the old one back.
+ */
+static Bool
+PoolResizeBuffer(char **buf, int *size, int count, int needed)
+{
+    char *nbuf;
+    int nsize;
+
+    if (!(nbuf = PoolGetBuffer(needed, &nsize)))
+	return FALSE;
+    memcpy(nbuf, *buf, count);
+    PoolPutBuffer(*buf, *size);
+    *buf = nbuf;
+    *size = nsize;
+    return TRUE;
+}
+
+static void
+FreeInputBuffer(ConnectionInputPtr oci)
+{
+    PoolPutBuffer(oci->buffer, oci->size);
+    free(oci);
+}
+
+static void
+FreeOutputBuffer(ConnectionOutputPtr oco)
+{
+    PoolPutBuffer((char *)oco->buf, oco->size);
+    free(oco);
+}
+
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
  *
@@ -178,10 +361,10 @@ YieldControl(void)
 }
 
 static void
-YieldControlNoInput(int fd)
+YieldControlNoInput(OsCommPtr oc)
 {
     YieldControl();
-    FD_CLR(fd, &ClientsWithInput);
+    ClearClientWithInput(oc);
 }
 
 static void
@@ -195,34 +378,22 @@ ReadRequestFromClient(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     unsigned int gotnow, needed;
     int result;
     register xReq *request;
     Bool need_header;
     Bool move_header;
 
-    /* If an input buffer was empty, either free it if it is too big
-     * or link it into our list of free input buffers.  This means that
-     * different clients can share the same input buffer (at different
-     * times).  This was done to save memory.
+    /* If an input buffer was empty, give it back to the pool.  This
+     * means that different clients can share the same input buffer (at
+     * different times).  This was done to save memory.
      */
 
     if (AvailableInput)
     {
 	if (AvailableInput != oc)
 	{
-	    register ConnectionInputPtr aci = AvailableInput->input;
-	    if (aci->size > BUFWATERMARK)
-	    {
-		free(aci->buffer);
-		free(aci);
-	    }
-	    else
-	    {
-		aci->next = FreeInputs;
-		FreeInputs = aci;
-	    }
+	    FreeInputBuffer(AvailableInput->input);
 	    AvailableInput->input = (ConnectionInputPtr)NULL;
 	}
 	AvailableInput = (OsCommPtr)NULL;
@@ -232,11 +403,7 @@ ReadRequestFromClient(ClientPtr client)
 
     if (!oci)
     {
-	if ((oci = FreeInputs))
-	{
-	    FreeInputs = oci->next;
-	}
-	else if (!(oci = AllocateInputBuffer()))
+	if (!(oci = AllocateInputBuffer()))
 	{
 	    YieldControlDeath();
 	    return -1;
@@ -244,6 +411,19 @@ ReadRequestFromClient(ClientPtr client)
 	oc->input = oci;
     }
 
+    /* close the fds the last request did not read */
+
+#if XTRANS_SEND_FDS
+    while (client->req_fds > 0)
+    {
+	int fd = ReadFdFromClient(client);
+
+	if (fd >= 0)
+	    close(fd);
+    }
+#endif
+    client->req_fds = 0;
+
     /* advance to start of next request */
 
     oci->bufptr += oci->lenLastReq;
@@ -320,16 +500,11 @@ ReadRequestFromClient(ClientPtr client)
 	    if (needed > oci->size)
 	    {
 		/* make buffer bigger to accomodate request */
-		char *ibuf;
-
-		ibuf = (char *)realloc(oci->buffer, needed);
-		if (!ibuf)
+		if (!PoolResizeBuffer(&oci->buffer, &oci->size, gotnow, needed))
 		{
 		    YieldControlDeath();
 		    return -1;
 		}
-		oci->size = needed;
-		oci->buffer = ibuf;
 	    }
 	    oci->bufptr = oci->buffer;
 	    oci->bufcnt = gotnow;
@@ -357,7 +532,7 @@ ReadRequestFromClient(ClientPtr client)
 		if (0)
 #endif
 		{
-		    YieldControlNoInput(fd);
+		    YieldControlNoInput(oc);
 		    return 0;
 		}
 	    }
@@ -370,15 +545,11 @@ ReadRequestFromClient(ClientPtr client)
 	if ((oci->size > BUFWATERMARK) &&
 	    (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE))
 	{
-	    char *ibuf;
+	    int offset = oci->bufptr - oci->buffer;
 
-	    ibuf = (char *)realloc(oci->buffer, BUFSIZE);
-	    if (ibuf)
-	    {
-		oci->size = BUFSIZE;
-		oci->buffer = ibuf;
-		oci->bufptr = ibuf + oci->bufcnt - gotnow;
-	    }
+	    if (PoolResizeBuffer(&oci->buffer, &oci->size,
+				 oci->bufcnt, BUFSIZE))
+		oci->bufptr = oci->buffer + offset;
 	}
 	if (need_header && gotnow >= needed)
 	{
@@ -399,7 +570,7 @@ ReadRequestFromClient(ClientPtr client)
 	if (gotnow < needed)
 	{
 	    /* Still don't have enough; punt. */
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
 	    return 0;
 	}
     }
@@ -451,13 +622,13 @@ ReadRequestFromClient(ClientPtr client)
 		 (gotnow >= sizeof(xBigReq) &&
 		  gotnow >= (get_big_req_len(request, client) << 2))))
 	    )
-	    FD_SET(fd, &ClientsWithInput);
+	    MarkClientWithInput(oc);
 	else
 	{
 	    if (!SmartScheduleDisable)
-		FD_CLR(fd, &ClientsWithInput);
+		ClearClientWithInput(oc);
 	    else
-		YieldControlNoInput(fd);
+		YieldControlNoInput(oc);
 	}
     }
     else
@@ -465,9 +636,9 @@ ReadRequestFromClient(ClientPtr client)
 	if (!gotnow)
 	    AvailableInput = oc;
 	if (!SmartScheduleDisable)
-	    FD_CLR(fd, &ClientsWithInput);
+	    ClearClientWithInput(oc);
 	else
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
     }
     if (SmartScheduleDisable)
     if (++timesThisConnection >= MAX_TIMES_PER)
@@ -491,6 +662,67 @@ ReadRequestFromClient(ClientPtr client)
     return needed;
 }
 
+/*****************************************************************
+ * ClientHasQueuedRequest
+ *    TRUE if another complete request is already in the client's
+ *    input buffer, so the next ReadRequestFromClient won't have to
+ *    read from the connection.
+ *****************************************************************/
+
+Bool
+ClientHasQueuedRequest(ClientPtr client)
+{
+    OsCommPtr oc = (OsCommPtr)client->osPrivate;
+
+    return oc && oc->input && ClientHasInput(oc);
+}
+
+/*****************************************************************
+ * ReadFdFromClient
+ *    Returns the next file descriptor passed with the current request,
+ *    or -1 if the request did not declare one with SetReqFds or the
+ *    connection cannot pass them.
+ *
+ *****************************************************************/
+
+int
+ReadFdFromClient(ClientPtr client)
+{
+    int fd = -1;
+
+#if XTRANS_SEND_FDS
+    if (client->req_fds > 0) {
+	OsCommPtr oc = (OsCommPtr) client->osPrivate;
+
+	--client->req_fds;
+	fd = _XSERVTransRecvFd(oc->trans_conn);
+    }
+    else
+	LogMessage(X_ERROR, "Request asks for FD without setting req_fds\n");
+#endif
+    return fd;
+}
+
+/*****************************************************************
+ * WriteFdToClient
+ *    Queues fd to go out with the next bytes written to the client,
+ *    closing it once sent if do_close.  Returns -1 if the connection
+ *    cannot pass file descriptors.
+ *
+ *****************************************************************/
+
+int
+WriteFdToClient(ClientPtr client, int fd, Bool do_close)
+{
+#if XTRANS_SEND_FDS
+    OsCommPtr oc = (OsCommPtr) client->osPrivate;
+
+    return _XSERVTransSendFd(oc->trans_conn, fd, do_close);
+#else
+    return -1;
+#endif
+}
+
 /*****************************************************************
  * InsertFakeRequest
  *    Splice a consed up (possibly partial) request in as the next request.
@@ -502,33 +734,20 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     int gotnow, moveup;
 
     if (AvailableInput)
     {
 	if (AvailableInput != oc)
 	{
-	    ConnectionInputPtr aci = AvailableInput->input;
-	    if (aci->size > BUFWATERMARK)
-	    {
-		free(aci->buffer);
-		free(aci);
-	    }
-	    else
-	    {
-		aci->next = FreeInputs;
-		FreeInputs = aci;
-	    }
+	    FreeInputBuffer(AvailableInput->input);
 	    AvailableInput->input = (ConnectionInputPtr)NULL;
 	}
 	AvailableInput = (OsCommPtr)NULL;
     }
     if (!oci)
     {
-	if ((oci = FreeInputs))
-	    FreeInputs = oci->next;
-	else if (!(oci = AllocateInputBuffer()))
+	if (!(oci = AllocateInputBuffer()))
 	    return FALSE;
 	oc->input = oci;
     }
@@ -537,14 +756,10 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if ((gotnow + count) > oci->size)
     {
-	char *ibuf;
-
-	ibuf = (char *)realloc(oci->buffer, gotnow + count);
-	if (!ibuf)
+	if (!PoolResizeBuffer(&oci->buffer, &oci->size, oci->bufcnt,
+			      oci->bufcnt + count))
 	    return FALSE;
-	oci->size = gotnow + count;
-	oci->buffer = ibuf;
-	oci->bufptr = ibuf + oci->bufcnt - gotnow;
+	oci->bufptr = oci->buffer + oci->bufcnt - gotnow;
     }
     moveup = count - (oci->bufptr - oci->buffer);
     if (moveup > 0)
@@ -559,9 +774,9 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     gotnow += count;
     if ((gotnow >= sizeof(xReq)) &&
 	(gotnow >= (int)(get_req_len((xReq *)oci->bufptr, client) << 2)))
-	FD_SET(fd, &ClientsWithInput);
+	MarkClientWithInput(oc);
     else
-	YieldControlNoInput(fd);
+	YieldControlNoInput(oc);
     return TRUE;
 }
 
@@ -576,7 +791,6 @@ ResetCurrentRequest(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     register ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     register xReq *request;
     int gotnow, needed;
     if (AvailableInput == oc)
@@ -585,7 +799,7 @@ ResetCurrentRequest(ClientPtr client)
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if (gotnow < sizeof(xReq))
     {
-	YieldControlNoInput(fd);
+	YieldControlNoInput(oc);
     }
     else
     {
@@ -604,18 +818,23 @@ ResetCurrentRequest(ClientPtr client)
 	}
 	if (gotnow >= (needed << 2))
 	{
-	    if (FD_ISSET(fd, &AllClients))
+#ifdef HAVE_EPOLL
+	    /* kept on the side while the client is ignored or grabbed out */
+	    MarkClientWithInput(oc);
+#else
+	    if (FD_ISSET(oc->fd, &AllClients))
 	    {
-		FD_SET(fd, &ClientsWithInput);
+		FD_SET(oc->fd, &ClientsWithInput);
 	    }
 	    else
 	    {
-		FD_SET(fd, &IgnoredClientsWithInput);
+		FD_SET(oc->fd, &IgnoredClientsWithInput);
 	    }
+#endif
 	    YieldControl();
 	}
 	else
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
     }
 }
 
@@ -634,9 +853,14 @@ static const int padlength[4] = {0, 3, 2, 1};
 void
 FlushAllOutput(void)
 {
+#ifdef HAVE_EPOLL
+    OsCommPtr oc, tmp;
+    struct list newOutputPending;
+#else
     register int index, base;
     register fd_mask mask; /* raphael */
     OsCommPtr oc;
+#endif
     register ClientPtr client;
     Bool newoutput = NewOutputPending;
 #if defined(WIN32)
@@ -646,6 +870,9 @@ FlushAllOutput(void)
     if (FlushCallback)
 	CallCallbacks(&FlushCallback, NULL);
 
+    /* the dispatch cycle is over, take back its temporary regions */
+    RegionResetTemporaries();
+
     if (!newoutput)
 	return;
 
@@ -657,7 +884,34 @@ FlushAllOutput(void)
     CriticalOutputPending = FALSE;
     NewOutputPending = FALSE;
 
-#ifndef WIN32
+#if defined(HAVE_EPOLL)
+    /* Only the clients that actually have output queued are visited */
+    list_init(&newOutputPending);
+    list_for_each_entry_safe(oc, tmp, &OutputPendingClients, pending)
+    {
+	ClearOutputPending(oc);
+	client = oc->client;
+	if (client->clientGone)
+	    continue;
+	if (ClientHasInput(oc))
+	{
+	    /* set the bit again */
+	    oc->flags |= OS_COMM_OUTPUT_PENDING;
+	    __list_add(&oc->pending, newOutputPending.prev, &newOutputPending);
+	    NewOutputPending = TRUE;
+	}
+	else
+	    (void)FlushClient(client, oc, (char *)NULL, 0);
+    }
+    if (!list_is_empty(&newOutputPending))
+    {
+	/* splice the deferred clients back */
+	newOutputPending.next->prev = OutputPendingClients.prev;
+	OutputPendingClients.prev->next = newOutputPending.next;
+	newOutputPending.prev->next = &OutputPendingClients;
+	OutputPendingClients.prev = newOutputPending.prev;
+    }
+#elif !defined(WIN32)
     for (base = 0; base < howmany(XFD_SETSIZE, NFDBITS); base++)
     {
 	mask = OutputPending.fds_bits[ base ];
@@ -717,6 +971,61 @@ SetCriticalOutputPending(void)
     CriticalOutputPending = TRUE;
 }
 
+/*
+ * Get an output buffer for the client.  If that fails the connection
+ * is shut down.
+ */
+static ConnectionOutputPtr
+GetOutputBuffer(ClientPtr who, OsCommPtr oc)
+{
+    ConnectionOutputPtr oco;
+
+    if (!(oco = AllocateOutputBuffer()))
+    {
+	if (oc->trans_conn) {
+	    _XSERVTransDisconnect(oc->trans_conn);
+	    _XSERVTransClose(oc->trans_conn);
+	    oc->trans_conn = NULL;
+	}
+	MarkClientException(who);
+	return NULL;
+    }
+    oc->output = oco;
+    return oco;
+}
+
+static void
+NotifyReplyCallbacks(ClientPtr who, const char *buf, int count, int padBytes)
+{
+    ReplyInfoRec replyinfo;
+
+    replyinfo.client = who;
+    replyinfo.replyData = buf;
+    replyinfo.dataLenBytes = count + padBytes;
+    if (who->replyBytesRemaining)
+    { /* still sending data of an earlier reply */
+	who->replyBytesRemaining -= count + padBytes;
+	replyinfo.startOfReply = FALSE;
+	replyinfo.bytesRemaining = who->replyBytesRemaining;
+	CallCallbacks((&ReplyCallback), (pointer)&replyinfo);
+    }
+    else if (who->clientState == ClientStateRunning
+	     && buf[0] == X_Reply)
+    { /* start of new reply */
+	CARD32 replylen;
+	unsigned long bytesleft;
+	char n;
+
+	replylen = ((xGenericReply *)buf)->length;
+	if (who->swapped)
+	    swapl(&replylen, n);
+	bytesleft = (replylen * 4) + SIZEOF(xReply) - count - padBytes;
+	replyinfo.startOfReply = TRUE;
+	replyinfo.bytesRemaining = who->replyBytesRemaining = bytesleft;
+	CallCallbacks((&ReplyCallback), (pointer)&replyinfo);
+    }
+}
+
 /*****************
  * WriteToClient
  *    Copies buf into ClientPtr.buf if it fits (with padding), else
@@ -782,57 +1091,13 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
     }
 #endif
 
-    if (!oco)
-    {
-	if ((oco = FreeOutputs))
-	{
-	    FreeOutputs = oco->next;
-	}
-	else if (!(oco = AllocateOutputBuffer()))
-	{
-	    if (oc->trans_conn) {
-		_XSERVTransDisconnect(oc->trans_conn);
-		_XSERVTransClose(oc->trans_conn);
-		oc->trans_conn = NULL;
-	    }
-	    MarkClientException(who);
-	    return -1;
-	}
-	oc->output = oco;
-    }
+    if (!oco && !(oco = GetOutputBuffer(who, oc)))
+	return -1;
 
     padBytes = padlength[count & 3];
 
     if(ReplyCallback)
-    {
-        ReplyInfoRec replyinfo;
-
-	replyinfo.client = who;
-	replyinfo.replyData = buf;
-	replyinfo.dataLenBytes = count + padBytes;
-	if (who->replyBytesRemaining)
-	{ /* still sending data of an earlier reply */
-	    who->replyBytesRemaining -= count + padBytes;
-	    replyinfo.startOfReply = FALSE;
-	    replyinfo.bytesRemaining = who->replyBytesRemaining;
-	    CallCallbacks((&ReplyCallback), (pointer)&replyinfo);
-	}
-	else if (who->clientState == ClientStateRunning
-		 && buf[0] == X_Reply)
-        { /* start of new reply */
-	    CARD32 replylen;
-	    unsigned long bytesleft;
-	    char n;
-
-	    replylen = ((xGenericReply *)buf)->length;
-	    if (who->swapped)
-		swapl(&replylen, n);
-	    bytesleft = (replylen * 4) + SIZEOF(xReply) - count - padBytes;
-	    replyinfo.startOfReply = TRUE;
-	    replyinfo.bytesRemaining = who->replyBytesRemaining = bytesleft;
-	    CallCallbacks((&ReplyCallback), (pointer)&replyinfo);
-	} 	                      
-    }
+	NotifyReplyCallbacks(who, buf, count, padBytes);
 #ifdef DEBUG_COMMUNICATION
     else if (multicount) {
 	if (who->replyBytesRemaining) {
@@ -847,8 +1112,8 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
 #endif
     if (oco->count + count + padBytes > oco->size)
     {
-	FD_CLR(oc->fd, &OutputPending);
-	if(!XFD_ANYSET(&OutputPending)) {
+	ClearOutputPending(oc);
+	if(!AnyOutputPending()) {
 	  CriticalOutputPending = FALSE;
 	  NewOutputPending = FALSE;
 	}
@@ -860,12 +1125,203 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
     }
 
     NewOutputPending = TRUE;
-    FD_SET(oc->fd, &OutputPending);
+    MarkOutputPending(oc);
     memmove((char *)oco->buf + oco->count, buf, count);
+    /* pool buffers come from malloc, don't send stale bytes as padding */
+    if (padBytes)
+	memset((char *)oco->buf + oco->count + count, 0, padBytes);
     oco->count += count + padBytes;
     return count;
 }
 
+/*****************
+ * WriteToClientNoCopy
+ *    Like WriteToClient, but large payloads are queued by reference
+ *    instead of being copied into the output buffer, and are written
+ *    out with writev when the client is flushed.  The caller hands buf
+ *    over and must not touch it until done(buf, closure) is called,
+ *    which happens once the data has been written or the client is
+ *    gone; done may be called before this returns.  done may be NULL
+ *    if buf simply has to outlive the write.
+ *****************/
+
+int
+WriteToClientNoCopy(ClientPtr who, int count, const void *buf,
+		    ClientDataDoneProcPtr done, pointer closure)
+{
+    OsCommPtr oc;
+    ConnectionOutputPtr oco;
+    OutputChunkPtr chunk;
+    int padBytes;
+    int result;
+
+    if (!count || !who || who == serverClient || who->clientGone ||
+	count < NOCOPY_MINSIZE)
+    {
+	result = WriteToClient(who, count, buf);
+	if (done)
+	    (*done) ((pointer)buf, closure);
+	return result;
+    }
+    oc = who->osPrivate;
+    oco = oc->output;
+    if (!oco && !(oco = GetOutputBuffer(who, oc)))
+    {
+	if (done)
+	    (*done) ((pointer)buf, closure);
+	return -1;
+    }
+
+    padBytes = padlength[count & 3];
+
+    if(ReplyCallback)
+	NotifyReplyCallbacks(who, buf, count, padBytes);
+
+    chunk = malloc(sizeof(OutputChunk));
+    if (!chunk)
+    {
+	/* fall back to copying */
+	result = WriteToClient(who, count, buf);
+	if (done)
+	    (*done) ((pointer)buf, closure);
+	return result;
+    }
+    chunk->next = NULL;
+    chunk->data = buf;
+    chunk->count = count;
+    chunk->pad = padBytes;
+    chunk->offset = 0;
+    chunk->bufpos = oco->count;
+    chunk->done = done;
+    chunk->closure = closure;
+    if (oco->lastChunk)
+	oco->lastChunk->next = chunk;
+    else
+	oco->chunks = chunk;
+    oco->lastChunk = chunk;
+    oco->chunkBytes += count + padBytes;
+
+    if (oco->count + oco->chunkBytes >= NOCOPY_FLUSHSIZE)
+    {
+	ClearOutputPending(oc);
+	if(!AnyOutputPending()) {
+	  CriticalOutputPending = FALSE;
+	  NewOutputPending = FALSE;
+	}
+
+	if (FlushCallback)
+	    CallCallbacks(&FlushCallback, NULL);
+
+	if (FlushClient(who, oc, (char *)NULL, 0) < 0)
+	    return -1;
+	return count;
+    }
+
+    NewOutputPending = TRUE;
+    MarkOutputPending(oc);
+    return count;
+}
+
+/*
+ * Events for a write-blocked client wait in its output buffer until the
+ * client catches up, and newer events may be merged into the last one
+ * meanwhile.  WriteEventsToClient marks each event it has written, and
+ * LastQueuedEvent returns the marked event as long as it is the last thing
+ * queued and none of it has been sent.
+ */
+void
+MarkQueuedEvent(ClientPtr who)
+{
+    OsCommPtr oc = who->osPrivate;
+    ConnectionOutputPtr oco = oc->output;
+
+    if (oco)
+	oco->eventPos = oco->count - sizeof(xEvent);
+}
+
+pointer
+LastQueuedEvent(ClientPtr who)
+{
+    OsCommPtr oc = who->osPrivate;
+    ConnectionOutputPtr oco = oc->output;
+
+    if (!oco || oco->eventPos < 0 ||
+	oco->eventPos != oco->count - (int)sizeof(xEvent) ||
+	(oco->lastChunk && oco->lastChunk->bufpos > oco->eventPos) ||
+	!ClientIsWriteBlocked(oc))
+	return NULL;
+    return (pointer)(oco->buf + oco->eventPos);
+}
+
+/*
+ * Drop the first written bytes of queued output, which is the output
+ * buffer interleaved with the referenced chunks.  Chunks that have been
+ * written completely are released.  Returns the part of written that
+ * went beyond the queued output.
+ */
+static long
+ConsumeOutput(ConnectionOutputPtr oco, long written)
+{
+    OutputChunkPtr chunk;
+    long skip = 0;	/* bytes of buf consumed */
+    long len;
+
+    while (written > 0)
+    {
+	chunk = oco->chunks;
+	len = (chunk ? chunk->bufpos : oco->count) - skip;
+	if (len > 0)
+	{
+	    if (len > written)
+		len = written;
+	    skip += len;
+	    written -= len;
+	    continue;
+	}
+	if (!chunk)
+	    break;
+	len = chunk->count + chunk->pad - chunk->offset;
+	if (len > written)
+	    len = written;
+	chunk->offset += len;
+	oco->chunkBytes -= len;
+	written -= len;
+	if (chunk->offset == chunk->count + chunk->pad)
+	{
+	    if (!(oco->chunks = chunk->next))
+		oco->lastChunk = NULL;
+	    if (chunk->done)
+		(*chunk->done) ((pointer)chunk->data, chunk->closure);
+	    free(chunk);
+	}
+    }
+    if (skip)
+    {
+	oco->count -= skip;
+	oco->eventPos -= skip;
+	memmove((char *)oco->buf, (char *)oco->buf + skip, oco->count);
+	for (chunk = oco->chunks; chunk; chunk = chunk->next)
+	    chunk->bufpos -= skip;
+    }
+    return written;
+}
+
+static void
+FreeOutputChunks(ConnectionOutputPtr oco)
+{
+    OutputChunkPtr chunk;
+
+    while ((chunk = oco->chunks))
+    {
+	oco->chunks = chunk->next;
+	if (chunk->done)
+	    (*chunk->done) ((pointer)chunk->data, chunk->closure);
+	free(chunk);
+    }
+    oco->lastChunk = NULL;
+    oco->chunkBytes = 0;
+}
+
  /********************
  * FlushClient()
  *    If the client isn't keeping up with us, then we try to continue
@@ -880,12 +1336,12 @@ int
 FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 {
     ConnectionOutputPtr oco = oc->output;
-    int connection = oc->fd;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
+    struct iovec iov[OUTPUT_IOV];
     static char padBuffer[3];
     const char *extraBuf = __extraBuf;
-    long written;
+    OutputChunkPtr chunk;
+    long written;	/* amount of extraBuf and its pad written */
     long padsize;
     long notWritten;
     long todo;
@@ -894,49 +1350,61 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 	return 0;
     written = 0;
     padsize = padlength[extraCount & 3];
-    notWritten = oco->count + extraCount + padsize;
+    notWritten = oco->count + oco->chunkBytes + extraCount + padsize;
     todo = notWritten;
     while (notWritten) {
-	long before = written;	/* amount of whole thing written */
 	long remain = todo;	/* amount to try this time, <= notWritten */
+	long pos = 0;		/* start of the unlisted part of buf */
 	int i = 0;
 	long len;
-	
-	/* You could be very general here and have "in" and "out" iovecs
-	 * and write a loop without using a macro, but what the heck.  This
-	 * translates to:
-	 *
-	 *     how much of this piece is new?
-	 *     if more new then we are trying this time, clamp
-	 *     if nothing new
-	 *         then bump down amount already written, for next piece
-	 *         else put new stuff in iovec, will need all of next piece
+
+	/* The queued output is buf with the chunks spliced in at their
+	 * bufpos, followed by extraBuf and its pad.  Whatever has been
+	 * written of the queue is already consumed, so this just lists
+	 * the pieces in order until todo is covered or the iovec is full;
+	 * once it is full nothing further may be listed.
 	 *
 	 * Note that todo had better be at least 1 or else we'll end up
 	 * writing 0 iovecs.
 	 */
 #define InsertIOV(pointer, length) \
-	len = (length) - before; \
+	len = (length); \
 	if (len > remain) \
 	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
+	if (len > 0) { \
 	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
+	    iov[i].iov_base = (pointer); \
 	    i++; \
 	    remain -= len; \
-	    before = 0; \
+	    if (i == OUTPUT_IOV) \
+		remain = 0; \
 	}
 
-	InsertIOV ((char *)oco->buf, oco->count)
-	InsertIOV ((char *)extraBuf, extraCount)
-	InsertIOV (padBuffer, padsize)
+	for (chunk = oco->chunks; chunk && remain; chunk = chunk->next)
+	{
+	    InsertIOV ((char *)oco->buf + pos, chunk->bufpos - pos)
+	    pos = chunk->bufpos;
+	    if (chunk->offset < chunk->count) {
+		InsertIOV ((char *)chunk->data + chunk->offset,
+			   chunk->count - chunk->offset)
+		InsertIOV (padBuffer, chunk->pad)
+	    } else {
+		InsertIOV (padBuffer, chunk->count + chunk->pad - chunk->offset)
+	    }
+	}
+	InsertIOV ((char *)oco->buf + pos, oco->count - pos)
+	if (written < extraCount) {
+	    InsertIOV ((char *)extraBuf + written, extraCount - written)
+	    InsertIOV (padBuffer, padsize)
+	} else {
+	    InsertIOV (padBuffer, extraCount + padsize - written)
+	}
+#undef InsertIOV
 
 	errno = 0;
 	if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0)
 	{
-	    written += len;
+	    written += ConsumeOutput(oco, len);
 	    notWritten -= len;
 	    todo = notWritten;
 	}
@@ -949,46 +1417,27 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 #endif
 		)
 	{
+	    long needed;
+
 	    /* If we've arrived here, then the client is stuffed to the gills
 	       and not ready to accept more.  Make a note of it and buffer
-	       the rest. */
-	    FD_SET(connection, &ClientsWriteBlocked);
-	    AnyClientsWriteBlocked = TRUE;
-
-	    if (written < oco->count)
-	    {
-		if (written > 0)
-		{
-		    oco->count -= written;
-		    memmove((char *)oco->buf,
-			    (char *)oco->buf + written,
-			  oco->count);
-		    written = 0;
-		}
-	    }
-	    else
-	    {
-		written -= oco->count;
-		oco->count = 0;
-	    }
+	       the rest; the chunks stay queued as they are. */
+	    MarkClientWriteBlocked(oc);
 
-	    if (notWritten > oco->size)
+	    needed = oco->count + extraCount + padsize - written;
+	    if (needed > oco->size)
 	    {
-		unsigned char *obuf;
-
-		obuf = (unsigned char *)realloc(oco->buf,
-						 notWritten + BUFSIZE);
-		if (!obuf)
+		if (!PoolResizeBuffer((char **)&oco->buf, &oco->size,
+				      oco->count, needed))
 		{
 		    _XSERVTransDisconnect(oc->trans_conn);
 		    _XSERVTransClose(oc->trans_conn);
 		    oc->trans_conn = NULL;
 		    MarkClientException(who);
+		    FreeOutputChunks(oco);
 		    oco->count = 0;
 		    return -1;
 		}
-		oco->size = notWritten + BUFSIZE;
-		oco->buf = obuf;
 	    }
 
 	    /* If the amount written extended into the padBuffer, then the
@@ -998,7 +1447,7 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 			 extraBuf + written,
 		       len);
 
-	    oco->count = notWritten; /* this will include the pad */
+	    oco->count = needed; /* this will include the pad */
 	    /* return only the amount explicitly requested */
 	    return extraCount;
 	}
@@ -1017,6 +1466,7 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 		oc->trans_conn = NULL;
 	    }
 	    MarkClientException(who);
+	    FreeOutputChunks(oco);
 	    oco->count = 0;
 	    return -1;
 	}
@@ -1026,21 +1476,8 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
     oco->count = 0;
     /* check to see if this client was write blocked */
     if (AnyClientsWriteBlocked)
-    {
-	FD_CLR(oc->fd, &ClientsWriteBlocked);
- 	if (! XFD_ANYSET(&ClientsWriteBlocked))
-	    AnyClientsWriteBlocked = FALSE;
-    }
-    if (oco->size > BUFWATERMARK)
-    {
-	free(oco->buf);
-	free(oco);
-    }
-    else
-    {
-	oco->next = FreeOutputs;
-	FreeOutputs = oco;
-    }
+	ClearClientWriteBlocked(oc);
+    FreeOutputBuffer(oco);
     oc->output = (ConnectionOutputPtr)NULL;
     return extraCount; /* return only the amount explicitly requested */
 }
@@ -1053,13 +1490,12 @@ AllocateInputBuffer(void)
     oci = malloc(sizeof(ConnectionInput));
     if (!oci)
 	return NULL;
-    oci->buffer = malloc(BUFSIZE);
+    oci->buffer = PoolGetBuffer(BUFSIZE, &oci->size);
     if (!oci->buffer)
     {
 	free(oci);
 	return NULL;
     }
-    oci->size = BUFSIZE;
     oci->bufptr = oci->buffer;
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
@@ -1075,14 +1511,17 @@ AllocateOutputBuffer(void)
     oco = malloc(sizeof(ConnectionOutput));
     if (!oco)
 	return NULL;
-    oco->buf = calloc(1, BUFSIZE);
+    oco->buf = (unsigned char *)PoolGetBuffer(BUFSIZE, &oco->size);
     if (!oco->buf)
     {
 	free(oco);
 	return NULL;
     }
-    oco->size = BUFSIZE;
     oco->count = 0;
+    oco->chunks = NULL;
+    oco->lastChunk = NULL;
+    oco->chunkBytes = 0;
+    oco->eventPos = -1;
     return oco;
 }
 
@@ -1095,53 +1534,30 @@ FreeOsBuffers(OsCommPtr oc)
     if (AvailableInput == oc)
 	AvailableInput = (OsCommPtr)NULL;
     if ((oci = oc->input))
-    {
-	if (FreeInputs)
-	{
-	    free(oci->buffer);
-	    free(oci);
-	}
-	else
-	{
-	    FreeInputs = oci;
-	    oci->next = (ConnectionInputPtr)NULL;
-	    oci->bufptr = oci->buffer;
-	    oci->bufcnt = 0;
-	    oci->lenLastReq = 0;
-	}
-    }
+	FreeInputBuffer(oci);
     if ((oco = oc->output))
     {
-	if (FreeOutputs)
-	{
-	    free(oco->buf);
-	    free(oco);
-	}
-	else
-	{
-	    FreeOutputs = oco;
-	    oco->next = (ConnectionOutputPtr)NULL;
-	    oco->count = 0;
-	}
+	FreeOutputChunks(oco);
+	FreeOutputBuffer(oco);
     }
 }
 
 void
 ResetOsBuffers(void)
 {
-    ConnectionInputPtr oci;
-    ConnectionOutputPtr oco;
+    BufferClassPtr bc;
+    PoolBufferPtr pb;
 
-    while ((oci = FreeInputs))
-    {
-	FreeInputs = oci->next;
-	free(oci->buffer);
-	free(oci);
-    }
-    while ((oco = FreeOutputs))
+    for (bc = BufferClasses; bc < BufferClasses + NUM_BUFFER_CLASSES; bc++)
     {
-	FreeOutputs = oco->next;
-	free(oco->buf);
-	free(oco);
+	while ((pb = bc->free))
+	{
+	    bc->free = pb->next;
+	    free(pb);
+	}
+	bc->nfree = bc->minFree = 0;
     }
+    TimerFree(PoolTrimTimer);
+    PoolTrimTimer = NULL;
+    PoolTrimPending = FALSE;
 }
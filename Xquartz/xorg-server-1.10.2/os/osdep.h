@@ -55,6 +55,10 @@ SOFTWARE.
 #define BOTIMEOUT 200 /* in milliseconds */
 #define BUFSIZE 4096
 #define BUFWATERMARK 8192
+#define NOCOPY_MINSIZE 4096 /* smaller WriteToClientNoCopy data is copied */
+#define NOCOPY_FLUSHSIZE (256*1024) /* queued output which forces a flush */
+#define OUTPUT_IOV 64 /* iovecs per writev in FlushClient */
+#define POOL_TRIM_INTERVAL 10000 /* ms between trims of idle pooled buffers */
 
 #if defined(XDMCP) || defined(HASXDMAUTH)
 #include <X11/Xdmcp.h>
@@ -103,6 +107,11 @@ SOFTWARE.
 /* MAXSELECT is the number of fds that select() can handle */
 #define MAXSELECT (sizeof(fd_set) * NBBY)
 
+#ifdef HAVE_EPOLL
+#include "ospoll.h"
+#include "list.h"
+#endif
+
 #ifndef HAS_GETDTABLESIZE
 #if !defined(SVR4) && !defined(SYSV)
 #define HAS_GETDTABLESIZE
@@ -119,7 +128,6 @@ typedef Bool (*AddAuthorFunc)(unsigned name_length, const char *name,
 #endif
 
 typedef struct _connectionInput {
-    struct _connectionInput *next;
     char *buffer;               /* contains current client input */
     char *bufptr;               /* pointer to current start of data */
     int  bufcnt;                /* count of bytes in buffer */
@@ -128,11 +136,30 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput, *ConnectionInputPtr;
 
+/*
+ * A payload queued by WriteToClientNoCopy.  The data is referenced, not
+ * copied, and is written out after the first bufpos bytes of the output
+ * buffer, followed by pad bytes of zeros.
+ */
+typedef struct _outputChunk {
+    struct _outputChunk *next;
+    const char *data;
+    int count;			/* length of data */
+    int pad;			/* zero bytes written after data */
+    int offset;			/* bytes of data and pad already written */
+    int bufpos;			/* bytes of buf that precede this chunk */
+    ClientDataDoneProcPtr done;
+    pointer closure;
+} OutputChunk, *OutputChunkPtr;
+
 typedef struct _connectionOutput {
-    struct _connectionOutput *next;
     int size;
     unsigned char *buf;
     int count;
+    OutputChunkPtr chunks;	/* referenced payloads, in output order */
+    OutputChunkPtr lastChunk;
+    long chunkBytes;		/* unwritten bytes held in chunks */
+    int eventPos;		/* offset of the last event in buf, or -1 */
 } ConnectionOutput, *ConnectionOutputPtr;
 
 struct _osComm;
@@ -173,8 +200,27 @@ typedef struct _osComm {
     CARD32 conn_time;		/* timestamp if not established, else 0  */
     struct _XtransConnInfo *trans_conn; /* transport connection object */
     Bool local_client;
+#ifdef HAVE_EPOLL
+    ClientPtr client;
+    int flags;			/* OS_COMM_*, replacing the client fd_sets */
+    struct list ready;		/* on ReadyClients */
+    struct list pending;	/* on OutputPendingClients */
+#endif
 } OsCommRec, *OsCommPtr;
 
+#ifdef HAVE_EPOLL
+/*
+ * With the ospoll backend, clients are not kept in the fd_set masks at
+ * all; the bits live in the connection and the interesting sets are
+ * lists, so that each wakeup costs O(ready) rather than O(maxfd).
+ */
+#define OS_COMM_INPUT		(1 << 0) /* full request buffered */
+#define OS_COMM_OUTPUT_PENDING	(1 << 1) /* on OutputPendingClients */
+#define OS_COMM_WRITE_BLOCKED	(1 << 2) /* waiting for the socket to drain */
+#define OS_COMM_IMPERVIOUS	(1 << 3) /* not affected by server grabs */
+#define OS_COMM_READABLE	(1 << 4) /* reported by the current wakeup */
+#endif
+
 extern int FlushClient(
     ClientPtr /*who*/,
     OsCommPtr /*oc*/,
@@ -209,6 +255,28 @@ extern void ClearConnectionTranslation(void);
 extern Bool NewOutputPending;
 extern Bool AnyClientsWriteBlocked;
 
+/* in connection.c; client state normally kept in the fd_set masks */
+extern void MarkClientWithInput(OsCommPtr oc);
+extern void ClearClientWithInput(OsCommPtr oc);
+extern Bool ClientHasInput(OsCommPtr oc);
+extern void MarkOutputPending(OsCommPtr oc);
+extern void ClearOutputPending(OsCommPtr oc);
+extern Bool AnyOutputPending(void);
+extern void MarkClientWriteBlocked(OsCommPtr oc);
+extern void ClearClientWriteBlocked(OsCommPtr oc);
+extern Bool ClientIsWriteBlocked(OsCommPtr oc);
+extern Bool AnyClientsConnected(void);
+
+#ifdef HAVE_EPOLL
+extern OsPollPtr ServerPoll;
+extern struct list ReadyClients;
+extern struct list OutputPendingClients;
+extern void PollSelectMask(fd_set *mask);
+extern Bool ClientIsListenedTo(OsCommPtr oc);
+/* in WaitFor.c */
+extern void ClientPollNotify(int fd, int xevents, pointer data);
+#endif
+
 extern WorkQueuePtr workQueue;
 
 /* in WaitFor.c */
@@ -65,6 +65,7 @@ SOFTWARE.
 
 
 #include "dixstruct.h"
+#include "busfault.h"
 
 #ifndef PATH_MAX
 #ifdef MAXPATHLEN
@@ -125,6 +126,13 @@ OsSigHandler(int signo)
   }
 #endif /* RTLD_DI_SETSIGNAL */
 
+#ifdef SA_SIGINFO
+  /* a client truncated a segment the server has mapped */
+  if (signo == SIGBUS && sip->si_code != SI_USER &&
+      BusFaultCatch(sip->si_addr))
+      return;
+#endif
+
   if (OsSigWrapper != NULL) {
       if (OsSigWrapper(signo) == 0) {
 	  /* ddx handled signal and wants us to continue */
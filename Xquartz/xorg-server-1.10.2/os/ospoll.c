@@ -0,0 +1,361 @@
+/*
+ * Copyright © 2011 The X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "ospoll.h"
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+/*
+ * Descriptors are kept in a table indexed by fd, so lookups from the
+ * backend's ready list are O(1).  The table grows on demand and is never
+ * bounded by FD_SETSIZE.
+ */
+typedef struct _OsPollFd {
+    OsPollCallback	callback;	/* NULL if the slot is unused */
+    pointer		data;
+    int			xevents;	/* X_NOTIFY_* currently listened for */
+} OsPollFdRec, *OsPollFdPtr;
+
+typedef struct _OsPollBackend {
+    const char *name;
+    Bool	(*Init)(OsPollPtr ospoll);
+    void	(*Fini)(OsPollPtr ospoll);
+    Bool	(*Add)(OsPollPtr ospoll, int fd);
+    void	(*Remove)(OsPollPtr ospoll, int fd);
+    void	(*Change)(OsPollPtr ospoll, int fd, int xevents);
+    int		(*Wait)(OsPollPtr ospoll, int timeout);
+} OsPollBackendRec, *OsPollBackendPtr;
+
+typedef struct _OsPoll {
+    OsPollBackendPtr	backend;
+    OsPollFdPtr		fds;
+    int			size;		/* entries in fds */
+    int			count;		/* tracked descriptors */
+    /* backend private */
+    int			pollfd;
+    pointer		events;
+    int			maxevents;
+} OsPollRec;
+
+static OsPollFdPtr
+OsPollLookup(OsPollPtr ospoll, int fd)
+{
+    if (fd < 0 || fd >= ospoll->size || !ospoll->fds[fd].callback)
+	return NULL;
+    return &ospoll->fds[fd];
+}
+
+static Bool
+OsPollGrow(OsPollPtr ospoll, int fd)
+{
+    OsPollFdPtr fds;
+    int size = ospoll->size ? ospoll->size : 64;
+
+    while (size <= fd)
+	size <<= 1;
+    fds = realloc(ospoll->fds, size * sizeof(OsPollFdRec));
+    if (!fds)
+	return FALSE;
+    memset(fds + ospoll->size, 0, (size - ospoll->size) * sizeof(OsPollFdRec));
+    ospoll->fds = fds;
+    ospoll->size = size;
+    return TRUE;
+}
+
+/*
+ * Dispatch one ready descriptor.  The slot is looked up again, since an
+ * earlier callback in the same batch may have removed it.
+ */
+static void
+OsPollNotify(OsPollPtr ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd = OsPollLookup(ospoll, fd);
+
+    if (!pfd || !pfd->xevents)
+	return;
+    /* An error is reported as all the conditions listened for, so the
+     * owner finds it out in its read or write path; anything else is
+     * only reported while still being listened for */
+    if (xevents & X_NOTIFY_ERROR)
+	xevents |= pfd->xevents;
+    xevents &= pfd->xevents | X_NOTIFY_ERROR;
+    if (xevents)
+	(*pfd->callback)(fd, xevents, pfd->data);
+}
+
+#ifdef HAVE_EPOLL
+
+#define EPOLL_BATCH	64
+
+static uint32_t
+EpollEvents(int xevents)
+{
+    uint32_t events = 0;
+
+    if (xevents & X_NOTIFY_READ)
+	events |= EPOLLIN;
+    if (xevents & X_NOTIFY_WRITE)
+	events |= EPOLLOUT;
+    return events;
+}
+
+static Bool
+EpollInit(OsPollPtr ospoll)
+{
+    ospoll->pollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ospoll->pollfd < 0)
+	return FALSE;
+    ospoll->maxevents = EPOLL_BATCH;
+    ospoll->events = calloc(ospoll->maxevents, sizeof(struct epoll_event));
+    if (!ospoll->events)
+    {
+	close(ospoll->pollfd);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+EpollFini(OsPollPtr ospoll)
+{
+    close(ospoll->pollfd);
+    free(ospoll->events);
+}
+
+/*
+ * epoll reports hangups and errors even for an empty event mask, so a
+ * descriptor is only in the epoll set while it is listened for something.
+ */
+static Bool
+EpollAdd(OsPollPtr ospoll, int fd)
+{
+    struct epoll_event ev;
+
+    /* The previous owner of this descriptor number may have been closed
+     * without being removed and still be registered; drop it. */
+    memset(&ev, 0, sizeof(ev));
+    (void) epoll_ctl(ospoll->pollfd, EPOLL_CTL_DEL, fd, &ev);
+    return TRUE;
+}
+
+static void
+EpollRemove(OsPollPtr ospoll, int fd)
+{
+    struct epoll_event ev;
+
+    /* Fails harmlessly with EBADF/ENOENT if fd was already closed */
+    memset(&ev, 0, sizeof(ev));
+    (void) epoll_ctl(ospoll->pollfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+static void
+EpollChange(OsPollPtr ospoll, int fd, int xevents)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EpollEvents(xevents);
+    ev.data.fd = fd;
+    if (!xevents)
+    {
+	(void) epoll_ctl(ospoll->pollfd, EPOLL_CTL_DEL, fd, &ev);
+	return;
+    }
+    if (epoll_ctl(ospoll->pollfd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+	errno == ENOENT)
+	(void) epoll_ctl(ospoll->pollfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int
+EpollWait(OsPollPtr ospoll, int timeout)
+{
+    struct epoll_event *events = ospoll->events;
+    int nready, i;
+
+    nready = epoll_wait(ospoll->pollfd, events, ospoll->maxevents, timeout);
+    for (i = 0; i < nready; i++)
+    {
+	int xevents = 0;
+
+	if (events[i].events & EPOLLIN)
+	    xevents |= X_NOTIFY_READ;
+	if (events[i].events & EPOLLOUT)
+	    xevents |= X_NOTIFY_WRITE;
+	if (events[i].events & (EPOLLERR | EPOLLHUP))
+	    xevents |= X_NOTIFY_ERROR;
+	OsPollNotify(ospoll, events[i].data.fd, xevents);
+    }
+
+    /* A full batch means there are probably more; make room for next time */
+    if (nready == ospoll->maxevents && ospoll->maxevents < ospoll->count)
+    {
+	int maxevents = ospoll->maxevents * 2;
+
+	events = realloc(ospoll->events, maxevents * sizeof(struct epoll_event));
+	if (events)
+	{
+	    ospoll->events = events;
+	    ospoll->maxevents = maxevents;
+	}
+    }
+    return nready;
+}
+
+static OsPollBackendRec EpollBackend = {
+    "epoll",
+    EpollInit,
+    EpollFini,
+    EpollAdd,
+    EpollRemove,
+    EpollChange,
+    EpollWait,
+};
+
+#define DEFAULT_BACKEND	(&EpollBackend)
+
+#endif /* HAVE_EPOLL */
+
+#ifndef DEFAULT_BACKEND
+#error "ospoll needs at least one backend"
+#endif
+
+OsPollPtr
+OsPollCreate(void)
+{
+    OsPollPtr ospoll;
+
+    ospoll = calloc(1, sizeof(OsPollRec));
+    if (!ospoll)
+	return NULL;
+    ospoll->backend = DEFAULT_BACKEND;
+    ospoll->pollfd = -1;
+    if (!(*ospoll->backend->Init)(ospoll))
+    {
+	free(ospoll);
+	return NULL;
+    }
+    return ospoll;
+}
+
+void
+OsPollDestroy(OsPollPtr ospoll)
+{
+    if (!ospoll)
+	return;
+    (*ospoll->backend->Fini)(ospoll);
+    free(ospoll->fds);
+    free(ospoll);
+}
+
+Bool
+OsPollAdd(OsPollPtr ospoll, int fd, OsPollCallback callback, pointer data)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || !callback)
+	return FALSE;
+    if ((pfd = OsPollLookup(ospoll, fd)))
+    {
+	pfd->callback = callback;
+	pfd->data = data;
+	return TRUE;
+    }
+    if (fd >= ospoll->size && !OsPollGrow(ospoll, fd))
+	return FALSE;
+    if (!(*ospoll->backend->Add)(ospoll, fd))
+	return FALSE;
+    pfd = &ospoll->fds[fd];
+    pfd->callback = callback;
+    pfd->data = data;
+    pfd->xevents = X_NOTIFY_NONE;
+    ospoll->count++;
+    return TRUE;
+}
+
+void
+OsPollRemove(OsPollPtr ospoll, int fd)
+{
+    OsPollFdPtr pfd = OsPollLookup(ospoll, fd);
+
+    if (!pfd)
+	return;
+    (*ospoll->backend->Remove)(ospoll, fd);
+    pfd->callback = NULL;
+    pfd->data = NULL;
+    pfd->xevents = X_NOTIFY_NONE;
+    ospoll->count--;
+}
+
+Bool
+OsPollIsTracked(OsPollPtr ospoll, int fd)
+{
+    return OsPollLookup(ospoll, fd) != NULL;
+}
+
+void
+OsPollListen(OsPollPtr ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd = OsPollLookup(ospoll, fd);
+
+    xevents &= X_NOTIFY_READ | X_NOTIFY_WRITE;
+    if (!pfd || (pfd->xevents & xevents) == xevents)
+	return;
+    pfd->xevents |= xevents;
+    (*ospoll->backend->Change)(ospoll, fd, pfd->xevents);
+}
+
+void
+OsPollMute(OsPollPtr ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd = OsPollLookup(ospoll, fd);
+
+    if (!pfd || !(pfd->xevents & xevents))
+	return;
+    pfd->xevents &= ~xevents;
+    (*ospoll->backend->Change)(ospoll, fd, pfd->xevents);
+}
+
+int
+OsPollWait(OsPollPtr ospoll, int timeout)
+{
+    return (*ospoll->backend->Wait)(ospoll, timeout);
+}
+
+const char *
+OsPollBackendName(OsPollPtr ospoll)
+{
+    return ospoll->backend->name;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2011 The X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * ospoll: a small file descriptor multiplexing interface used by
+ * WaitForSomething when the server is built with --enable-epoll.
+ *
+ * Unlike select(), the cost of waiting is proportional to the number of
+ * descriptors that are actually ready, and descriptors are not limited
+ * to FD_SETSIZE.  The interface is backend neutral; each backend
+ * provides an OsPollBackendRec and ospoll.c picks one at build time.
+ */
+
+#ifndef _OSPOLL_H_
+#define _OSPOLL_H_
+
+#include "misc.h"
+
+/* Conditions a descriptor can be listened for, or reported with */
+#define X_NOTIFY_NONE	0x0
+#define X_NOTIFY_READ	0x1
+#define X_NOTIFY_WRITE	0x2
+#define X_NOTIFY_ERROR	0x4	/* reported only, never listened for */
+
+/* An error or hangup is reported as X_NOTIFY_ERROR together with every
+ * condition the descriptor is listened for, and not at all while it is
+ * listened for nothing. */
+
+typedef struct _OsPoll *OsPollPtr;
+
+typedef void (*OsPollCallback)(int fd, int xevents, pointer data);
+
+extern OsPollPtr OsPollCreate(void);
+
+extern void OsPollDestroy(OsPollPtr ospoll);
+
+/* Start tracking fd; it is not listened for anything until OsPollListen.
+ * Adding a descriptor which is already tracked replaces its callback. */
+extern Bool OsPollAdd(OsPollPtr ospoll, int fd,
+		      OsPollCallback callback, pointer data);
+
+extern void OsPollRemove(OsPollPtr ospoll, int fd);
+
+extern Bool OsPollIsTracked(OsPollPtr ospoll, int fd);
+
+/* Add (Listen) or drop (Mute) X_NOTIFY_READ and/or X_NOTIFY_WRITE */
+extern void OsPollListen(OsPollPtr ospoll, int fd, int xevents);
+
+extern void OsPollMute(OsPollPtr ospoll, int fd, int xevents);
+
+/* Wait up to timeout milliseconds (-1 forever) and invoke the callback
+ * of every ready descriptor.  Returns the number of ready descriptors,
+ * 0 on timeout or -1 with errno set. */
+extern int OsPollWait(OsPollPtr ospoll, int timeout);
+
+extern const char *OsPollBackendName(OsPollPtr ospoll);
+
+#endif /* _OSPOLL_H_ */
@@ -125,6 +125,7 @@ __stdcall unsigned long GetTickCount(void);
 Bool noTestExtensions;
 #ifdef COMPOSITE
 Bool noCompositeExtension = FALSE;
+int compositeThreads = 0;
 #endif
 
 #ifdef DAMAGE
@@ -146,6 +147,9 @@ Bool noScreenSaverExtension = FALSE;
 #ifdef MITSHM
 Bool noMITShmExtension = FALSE;
 #endif
+#ifdef SHM_ASYNC
+int shmAsyncThreshold = 0;
+#endif
 #ifdef RANDR
 Bool noRRExtension = FALSE;
 #endif
@@ -419,6 +423,12 @@ GetTimeInMillis (void)
 {
   return GetTickCount ();
 }
+
+CARD64
+GetTimeInMicros (void)
+{
+  return (CARD64) GetTickCount () * 1000;
+}
 #else
 CARD32
 GetTimeInMillis(void)
@@ -448,6 +458,21 @@ GetTimeInMillis(void)
     X_GETTIMEOFDAY(&tv);
     return(tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
+
+CARD64
+GetTimeInMicros(void)
+{
+    struct timeval tv;
+#ifdef MONOTONIC_CLOCK
+    struct timespec tp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0)
+        return (CARD64) tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+#endif
+
+    X_GETTIMEOFDAY(&tv);
+    return (CARD64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
 #endif
 
 void
@@ -485,8 +510,12 @@ void UseMsg(void)
     ErrorF("+bs                    enable any backing store support\n");
     ErrorF("-bs                    disable any backing store support\n");
     ErrorF("-c                     turns off key-click\n");
+    ErrorF("-coalesce              merge events queued for clients not reading\n");
     ErrorF("c #                    key-click volume (0-100)\n");
     ErrorF("-cc int                default color visual class\n");
+#ifdef COMPOSITE
+    ErrorF("-compthreads int       paint redirected windows on N threads\n");
+#endif
     ErrorF("-nocursor              disable the cursor\n");
     ErrorF("-core                  generate core dump on fatal error\n");
     ErrorF("-dpi int               screen resolution in dots per inch\n");
@@ -498,6 +527,7 @@ void UseMsg(void)
     ErrorF("-fc string             cursor font\n");
     ErrorF("-fn string             default font name\n");
     ErrorF("-fp string             default font path\n");
+    ErrorF("-glyphmem int          limit render glyphs to N Kb\n");
     ErrorF("-help                  prints message with these options\n");
     ErrorF("-I                     ignore all remaining arguments\n");
 #ifdef RLIMIT_DATA
@@ -522,6 +552,9 @@ void UseMsg(void)
     ErrorF("-render [default|mono|gray|color] set render color alloc policy\n");
     ErrorF("-retro                 start with classic stipple and cursor\n");
     ErrorF("-s #                   screen-saver timeout (minutes)\n");
+#ifdef SHM_ASYNC
+    ErrorF("-shmasync int          copy ShmPutImages of N bytes on a thread\n");
+#endif
     ErrorF("-t #                   default pointer threshold (pixels/t)\n");
     ErrorF("-terminate             terminate at server reset\n");
     ErrorF("-to #                  connection time out\n");
@@ -643,6 +676,10 @@ ProcessCommandLine(int argc, char *argv[])
 	{
 	    defaultKeyboardControl.click = 0;
 	}
+	else if ( strcmp( argv[i], "-coalesce") == 0)
+	{
+	    CoalesceBlockedEvents = TRUE;
+	}
 	else if ( strcmp( argv[i], "-cc") == 0)
 	{
 	    if(++i < argc)
@@ -650,6 +687,15 @@ ProcessCommandLine(int argc, char *argv[])
 	    else
 		UseMsg();
 	}
+#ifdef COMPOSITE
+	else if ( strcmp( argv[i], "-compthreads") == 0)
+	{
+	    if(++i < argc)
+	        compositeThreads = atoi(argv[i]);
+	    else
+		UseMsg();
+	}
+#endif
 	else if ( strcmp( argv[i], "-core") == 0)
 	{
 #if !defined(WIN32) || !defined(__MINGW32__)
@@ -712,6 +758,13 @@ ProcessCommandLine(int argc, char *argv[])
 	    else
 		UseMsg();
 	}
+	else if ( strcmp( argv[i], "-glyphmem") == 0)
+	{
+	    if(++i < argc)
+	        GlyphMemoryLimit = strtoul(argv[i], NULL, 10) * 1024;
+	    else
+		UseMsg();
+	}
 	else if ( strcmp( argv[i], "-help") == 0)
 	{
 	    UseMsg();
@@ -813,6 +866,15 @@ ProcessCommandLine(int argc, char *argv[])
 	    else
 		UseMsg();
 	}
+#ifdef SHM_ASYNC
+	else if ( strcmp( argv[i], "-shmasync") == 0)
+	{
+	    if(++i < argc)
+	        shmAsyncThreshold = atoi(argv[i]);
+	    else
+		UseMsg();
+	}
+#endif
 	else if ( strcmp( argv[i], "-t") == 0)
 	{
 	    if(++i < argc)
@@ -1227,6 +1289,28 @@ OsReleaseSignals (void)
 #endif
 }
 
+#ifdef SERVER_THREADS
+/*
+ * Start a detached thread with every signal blocked.  The handlers
+ * expect to interrupt the server thread, so signals must not be
+ * delivered to any other.  The caller's own mask is left unchanged.
+ */
+int
+OsCreateThread (pthread_t *thread, void *(*func)(void *), void *arg)
+{
+    sigset_t	set, old;
+    int		ret;
+
+    sigfillset (&set);
+    pthread_sigmask (SIG_BLOCK, &set, &old);
+    ret = pthread_create (thread, NULL, func, arg);
+    pthread_sigmask (SIG_SETMASK, &old, NULL);
+    if (ret == 0)
+	pthread_detach (*thread);
+    return ret;
+}
+#endif
+
 /*
  * Pending signals may interfere with core dumping. Provide a
  * mechanism to block signals when aborting.
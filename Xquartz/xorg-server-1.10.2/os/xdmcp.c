@@ -706,7 +706,7 @@ XdmcpWakeupHandler(
 	    else if (state == XDM_RUN_SESSION)
 		keepaliveDormancy = defaultKeepaliveDormancy;
 	}
-	if (XFD_ANYSET(&AllClients) && state == XDM_RUN_SESSION)
+	if (AnyClientsConnected() && state == XDM_RUN_SESSION)
 	    timeOutTime = GetTimeInMillis() +  keepaliveDormancy * 1000;
     }
     else if (timeOutTime && (int) (GetTimeInMillis() - timeOutTime) >= 0)
@@ -345,6 +345,7 @@ SetPicturePictFilter (PicturePtr pPicture, PictFilterPtr pFilter,
     for (i = 0; i < nparams; i++)
 	pPicture->filter_params[i] = params[i];
     pPicture->filter = pFilter->id;
+    PictureDropImage (pPicture);
 
     if (pPicture->pDrawable)
     {
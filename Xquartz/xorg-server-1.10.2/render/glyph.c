@@ -82,36 +82,42 @@ static GlyphHashSetRec glyphHashSets[] = {
 
 static const CARD8	glyphDepths[GlyphFormatNum] = { 1, 4, 8, 16, 32 };
 
-static GlyphHashRec	globalGlyphs[GlyphFormatNum];
+/*
+ * The glyphs of each format are indexed by sha1, so that the same glyph
+ * uploaded by many clients is stored once.  The index is split in
+ * GLYPH_SHARDS tables picked by a byte of the sha1 the signature doesn't
+ * use.  A shard that fills up gets a table twice the size and its entries
+ * move over GLYPH_MOVE_STEP slots at a time on each later change, so no
+ * request pays for rehashing them all; until they have, lookups look in
+ * both tables.
+ */
+#define GLYPH_SHARDS		16
+#define GLYPH_MOVE_STEP		64
 
-void
-GlyphUninit (ScreenPtr pScreen)
-{
-    PictureScreenPtr ps = GetPictureScreen (pScreen);
-    GlyphPtr	     glyph;
-    int		     fdepth, i;
-    int		     scrno = pScreen->myNum;
+typedef struct _GlyphShard {
+    GlyphHashRec    hash;	/* new glyphs go here */
+    GlyphHashRec    old;	/* table being moved into hash */
+    CARD32	    moved;	/* slots of old already moved */
+} GlyphShardRec, *GlyphShardPtr;
 
-    for (fdepth = 0; fdepth < GlyphFormatNum; fdepth++)
-    {
-	if (!globalGlyphs[fdepth].hashSet)
-	    continue;
-	
-	for (i = 0; i < globalGlyphs[fdepth].hashSet->size; i++)
-	{
-	    glyph = globalGlyphs[fdepth].table[i].glyph;
-	    if (glyph && glyph != DeletedGlyph)
-	    {
-		if (GlyphPicture(glyph)[scrno])
-		{
-		    FreePicture ((pointer) GlyphPicture (glyph)[scrno], 0);
-		    GlyphPicture(glyph)[scrno] = NULL;
-		}
-		(*ps->UnrealizeGlyph) (pScreen, glyph);
-	    }
-	}
-    }
-}
+static GlyphShardRec	globalGlyphs[GlyphFormatNum][GLYPH_SHARDS];
+
+#define GlyphShard(fdepth, sha1) \
+    (&globalGlyphs[fdepth][(sha1)[4] % GLYPH_SHARDS])
+
+/*
+ * A glyph whose last reference goes away stays indexed on the unused list,
+ * most recently used first, so that uploading it again (the same font
+ * opened by the next application) finds it.  Unused glyphs are dropped
+ * oldest first past GLYPH_UNUSED_BYTES, or to make room under the
+ * -glyphmem limit.
+ */
+#define GLYPH_UNUSED_BYTES	(2 * 1024 * 1024)
+
+static struct list	unusedGlyphs = { &unusedGlyphs, &unusedGlyphs };
+
+GlyphStatsRec		GlyphStats;
+unsigned long		GlyphMemoryLimit;
 
 GlyphHashSetPtr
 FindGlyphHashSet (CARD32 filled)
@@ -200,22 +206,165 @@ HashGlyph (xGlyphInfo    *gi,
     return Success;
 }
 
-GlyphPtr
-FindGlyphByHash (unsigned char sha1[20], int format)
+static GlyphRefPtr
+FindGlobalGlyphRef (GlyphShardPtr   shard,
+		    unsigned char   sha1[20],
+		    GlyphHashPtr    *pHash)
 {
-    GlyphRefPtr gr;
-    CARD32 signature = *(CARD32 *) sha1;
+    CARD32	signature = *(CARD32 *) sha1;
+    GlyphRefPtr	gr;
 
-    if (!globalGlyphs[format].hashSet)
-	return NULL;
+    if (shard->hash.table)
+    {
+	gr = FindGlyphRef (&shard->hash, signature, TRUE, sha1);
+	if (gr->glyph && gr->glyph != DeletedGlyph)
+	{
+	    *pHash = &shard->hash;
+	    return gr;
+	}
+    }
+    if (shard->old.table)
+    {
+	gr = FindGlyphRef (&shard->old, signature, TRUE, sha1);
+	if (gr->glyph && gr->glyph != DeletedGlyph)
+	{
+	    *pHash = &shard->old;
+	    return gr;
+	}
+    }
+    return NULL;
+}
 
-    gr = FindGlyphRef (&globalGlyphs[format],
-		       signature, TRUE, sha1);
+/*
+ * Move up to count slots of the old table of a shard into the new one,
+ * freeing the old table once it is all done.
+ */
+static void
+MoveGlobalGlyphs (GlyphShardPtr shard, CARD32 count)
+{
+    GlyphRefPtr	from, to;
+    CARD32	size;
 
-    if (gr->glyph && gr->glyph != DeletedGlyph)
-	return gr->glyph;
+    if (!shard->old.table)
+	return;
+    size = shard->old.hashSet->size;
+    while (count-- && shard->moved < size)
+    {
+	from = &shard->old.table[shard->moved++];
+	if (from->glyph && from->glyph != DeletedGlyph)
+	{
+	    to = FindGlyphRef (&shard->hash, from->signature,
+			       TRUE, from->glyph->sha1);
+	    to->signature = from->signature;
+	    to->glyph = from->glyph;
+	    shard->hash.tableEntries++;
+	    from->glyph = DeletedGlyph;
+	    from->signature = 0;
+	    shard->old.tableEntries--;
+	}
+    }
+    if (shard->moved == size)
+    {
+	free(shard->old.table);
+	shard->old.table = NULL;
+	shard->old.hashSet = NULL;
+	shard->old.tableEntries = 0;
+    }
+}
+
+/*
+ * Give a shard a new table sized for entries; what the current one holds
+ * moves over later.  A move still under way is finished first.
+ */
+static Bool
+ResizeGlobalGlyphs (GlyphShardPtr shard, CARD32 entries)
+{
+    GlyphHashSetPtr hashSet;
+    GlyphHashRec    hash;
+
+    hashSet = FindGlyphHashSet (entries);
+    if (!hashSet)
+	return FALSE;
+    if (hashSet == shard->hash.hashSet)
+	return TRUE;
+    if (!AllocateGlyphHash (&hash, hashSet))
+	return FALSE;
+    MoveGlobalGlyphs (shard, ~0);
+    if (shard->hash.tableEntries)
+    {
+	shard->old = shard->hash;
+	shard->moved = 0;
+    }
     else
-	return NULL;
+	free(shard->hash.table);
+    shard->hash = hash;
+    return TRUE;
+}
+
+static void
+InsertGlobalGlyph (GlyphShardPtr shard, GlyphPtr glyph)
+{
+    CARD32	signature = *(CARD32 *) glyph->sha1;
+    CARD32	entries = shard->hash.tableEntries + shard->old.tableEntries;
+    GlyphRefPtr	gr;
+
+    if (!shard->hash.table || entries >= shard->hash.hashSet->entries)
+    {
+	/*
+	 * Without memory for a bigger table, use up the slack of this one,
+	 * then leave glyphs out: they just aren't shared with later uploads
+	 * of the same bits.
+	 */
+	if (!ResizeGlobalGlyphs (shard, entries + 1) &&
+	    (!shard->hash.table || entries + 1 >= shard->hash.hashSet->size))
+	    return;
+    }
+    gr = FindGlyphRef (&shard->hash, signature, TRUE, glyph->sha1);
+    gr->signature = signature;
+    gr->glyph = glyph;
+    shard->hash.tableEntries++;
+    MoveGlobalGlyphs (shard, GLYPH_MOVE_STEP);
+}
+
+static void
+RemoveGlobalGlyph (GlyphPtr glyph)
+{
+    GlyphShardPtr   shard = GlyphShard (glyph->fdepth, glyph->sha1);
+    GlyphHashPtr    hash;
+    GlyphRefPtr	    gr;
+    CARD32	    entries;
+
+    gr = FindGlobalGlyphRef (shard, glyph->sha1, &hash);
+    if (!gr || gr->glyph != glyph)
+	return;
+    gr->glyph = DeletedGlyph;
+    gr->signature = 0;
+    hash->tableEntries--;
+    MoveGlobalGlyphs (shard, GLYPH_MOVE_STEP);
+
+    entries = shard->hash.tableEntries + shard->old.tableEntries;
+    if (!entries)
+    {
+	free(shard->old.table);
+	free(shard->hash.table);
+	memset (shard, 0, sizeof (GlyphShardRec));
+    }
+    else if (!shard->old.table && entries < shard->hash.hashSet->entries / 4)
+	ResizeGlobalGlyphs (shard, entries * 2);
+}
+
+/*
+ * An unused glyph found here must be referenced before any other glyph is
+ * allocated, as making room for that may drop it.
+ */
+GlyphPtr
+FindGlyphByHash (unsigned char sha1[20], int format)
+{
+    GlyphHashPtr    hash;
+    GlyphRefPtr	    gr;
+
+    gr = FindGlobalGlyphRef (GlyphShard (format, sha1), sha1, &hash);
+    return gr ? gr->glyph : NULL;
 }
 
 #ifdef CHECK_DUPLICATES
@@ -265,78 +414,147 @@ FreeGlyphPicture(GlyphPtr glyph)
     }
 }
 
-
+/*
+ * Free a glyph that isn't indexed and that no glyph set refers to.
+ */
 void
-FreeGlyph (GlyphPtr glyph, int format)
+DestroyGlyph (GlyphPtr glyph)
 {
-    CheckDuplicates (&globalGlyphs[format], "FreeGlyph");
-    if (--glyph->refcnt == 0)
+    GlyphStats.bytes -= glyph->size;
+    FreeGlyphPicture(glyph);
+    dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
+}
+
+static void
+DropUnusedGlyph (GlyphPtr glyph)
+{
+    list_del (&glyph->unused);
+    GlyphStats.unused -= glyph->size;
+    RemoveGlobalGlyph (glyph);
+    DestroyGlyph (glyph);
+}
+
+/*
+ * Drop unused glyphs until they fit in GLYPH_UNUSED_BYTES and room more
+ * bytes fit under the -glyphmem limit.
+ */
+static void
+TrimUnusedGlyphs (unsigned long room)
+{
+    while (!list_is_empty (&unusedGlyphs) &&
+	   (GlyphStats.unused > GLYPH_UNUSED_BYTES ||
+	    (GlyphMemoryLimit &&
+	     GlyphStats.bytes + room > GlyphMemoryLimit)))
+    {
+	DropUnusedGlyph (list_entry (unusedGlyphs.prev, GlyphRec, unused));
+	GlyphStats.evictions++;
+    }
+}
+
+static void
+UnrealizeGlobalGlyphs (ScreenPtr pScreen, GlyphHashPtr hash)
+{
+    PictureScreenPtr ps = GetPictureScreen (pScreen);
+    GlyphPtr	     glyph;
+    int		     i;
+    int		     scrno = pScreen->myNum;
+
+    if (!hash->hashSet)
+	return;
+
+    for (i = 0; i < hash->hashSet->size; i++)
     {
-	GlyphRefPtr      gr;
-	int	         i;
-	int	         first;
-	CARD32		 signature;
-
-	first = -1;
-	for (i = 0; i < globalGlyphs[format].hashSet->size; i++)
-	    if (globalGlyphs[format].table[i].glyph == glyph)
+	glyph = hash->table[i].glyph;
+	if (glyph && glyph != DeletedGlyph)
+	{
+	    if (GlyphPicture(glyph)[scrno])
 	    {
-		if (first != -1)
-		    DuplicateRef (glyph, "FreeGlyph check");
-		first = i;
+		FreePicture ((pointer) GlyphPicture (glyph)[scrno], 0);
+		GlyphPicture(glyph)[scrno] = NULL;
 	    }
+	    (*ps->UnrealizeGlyph) (pScreen, glyph);
+	}
+    }
+}
 
-	signature = *(CARD32 *) glyph->sha1;
-	gr = FindGlyphRef (&globalGlyphs[format], signature,
-			   TRUE, glyph->sha1);
-	if (gr - globalGlyphs[format].table != first)
-	    DuplicateRef (glyph, "Found wrong one");
-	if (gr->glyph && gr->glyph != DeletedGlyph)
+void
+GlyphUninit (ScreenPtr pScreen)
+{
+    int		     fdepth, i;
+
+    /* unused glyphs would come back without pictures after a reset */
+    while (!list_is_empty (&unusedGlyphs))
+	DropUnusedGlyph (list_entry (unusedGlyphs.next, GlyphRec, unused));
+
+    for (fdepth = 0; fdepth < GlyphFormatNum; fdepth++)
+	for (i = 0; i < GLYPH_SHARDS; i++)
 	{
-	    gr->glyph = DeletedGlyph;
-	    gr->signature = 0;
-	    globalGlyphs[format].tableEntries--;
+	    UnrealizeGlobalGlyphs (pScreen, &globalGlyphs[fdepth][i].hash);
+	    UnrealizeGlobalGlyphs (pScreen, &globalGlyphs[fdepth][i].old);
 	}
+}
+
+void
+ReferenceGlyph (GlyphPtr glyph)
+{
+    if (glyph->refcnt++ == 0 && !list_is_empty (&glyph->unused))
+    {
+	list_del (&glyph->unused);
+	GlyphStats.unused -= glyph->size;
+	GlyphStats.reused++;
+    }
+}
+
+void
+FreeGlyph (GlyphPtr glyph, int format)
+{
+    GlyphHashPtr    hash;
+    GlyphRefPtr	    gr;
 
-	FreeGlyphPicture(glyph);
-	dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
+    if (--glyph->refcnt == 0)
+    {
+	gr = FindGlobalGlyphRef (GlyphShard (format, glyph->sha1),
+				 glyph->sha1, &hash);
+	if (gr && gr->glyph == glyph && glyph->size <= GLYPH_UNUSED_BYTES)
+	{
+	    list_add (&glyph->unused, &unusedGlyphs);
+	    GlyphStats.unused += glyph->size;
+	    TrimUnusedGlyphs (0);
+	}
+	else
+	{
+	    RemoveGlobalGlyph (glyph);
+	    DestroyGlyph (glyph);
+	}
     }
 }
 
 void
 AddGlyph (GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
 {
+    GlyphShardPtr   shard = GlyphShard (glyphSet->fdepth, glyph->sha1);
+    GlyphHashPtr    hash;
     GlyphRefPtr	    gr;
-    CARD32	    signature;
 
-    CheckDuplicates (&globalGlyphs[glyphSet->fdepth], "AddGlyph top global");
     /* Locate existing matching glyph */
-    signature = *(CARD32 *) glyph->sha1;
-    gr = FindGlyphRef (&globalGlyphs[glyphSet->fdepth], signature,
-		       TRUE, glyph->sha1);
-    if (gr->glyph && gr->glyph != DeletedGlyph && gr->glyph != glyph)
+    gr = FindGlobalGlyphRef (shard, glyph->sha1, &hash);
+    if (gr && gr->glyph != glyph)
     {
-	FreeGlyphPicture(glyph);
-	dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
+	DestroyGlyph (glyph);
 	glyph = gr->glyph;
     }
-    else if (gr->glyph != glyph)
-    {
-	gr->glyph = glyph;
-	gr->signature = signature;
-	globalGlyphs[glyphSet->fdepth].tableEntries++;
-    }
+    else if (!gr)
+	InsertGlobalGlyph (shard, glyph);
     
     /* Insert/replace glyphset value */
     gr = FindGlyphRef (&glyphSet->hash, id, FALSE, 0);
-    ++glyph->refcnt;
+    ReferenceGlyph (glyph);
     if (gr->glyph && gr->glyph != DeletedGlyph)
 	FreeGlyph (gr->glyph, glyphSet->fdepth);
     else
 	glyphSet->hash.tableEntries++;
     gr->glyph = glyph;
     gr->signature = id;
-    CheckDuplicates (&globalGlyphs[glyphSet->fdepth], "AddGlyph bottom");
 }
 
 Bool
@@ -376,15 +594,26 @@ AllocateGlyph (xGlyphInfo *gi, int fdepth)
     GlyphPtr	     glyph;
     int		     i;
     int		     head_size;
+    unsigned long    bytes;
 
     head_size = sizeof (GlyphRec) + screenInfo.numScreens * sizeof (PicturePtr);
     size = (head_size + dixPrivatesSize(PRIVATE_GLYPH));
-    glyph = (GlyphPtr) malloc (size);
+    bytes = size + (unsigned long) screenInfo.numScreens * gi->height *
+	    PixmapBytePad (gi->width, glyphDepths[fdepth]);
+    if (GlyphMemoryLimit)
+    {
+	TrimUnusedGlyphs (bytes);
+	if (GlyphStats.bytes + bytes > GlyphMemoryLimit)
+	    return 0;
+    }
+    glyph = (GlyphPtr) dixSlabAlloc (PRIVATE_GLYPH, size);
     if (!glyph)
 	return 0;
     glyph->refcnt = 0;
-    glyph->size = size + sizeof (xGlyphInfo);
+    glyph->size = bytes;
     glyph->info = *gi;
+    glyph->fdepth = fdepth;
+    list_init (&glyph->unused);
     dixInitPrivates(glyph, (char *) glyph + head_size, PRIVATE_GLYPH);
 
     for (i = 0; i < screenInfo.numScreens; i++)
@@ -399,6 +628,7 @@ AllocateGlyph (xGlyphInfo *gi, int fdepth)
 	}
     }
     
+    GlyphStats.bytes += bytes;
     return glyph;
 
 bail:
@@ -470,8 +700,7 @@ ResizeGlyphHash (GlyphHashPtr hash, CARD32 change, Bool global)
 Bool
 ResizeGlyphSet (GlyphSetPtr glyphSet, CARD32 change)
 {
-    return (ResizeGlyphHash (&glyphSet->hash, change, FALSE) &&
-	    ResizeGlyphHash (&globalGlyphs[glyphSet->fdepth], change, TRUE));
+    return ResizeGlyphHash (&glyphSet->hash, change, FALSE);
 }
 			    
 GlyphSetPtr
@@ -479,19 +708,13 @@ AllocateGlyphSet (int fdepth, PictFormatPtr format)
 {
     GlyphSetPtr	glyphSet;
     
-    if (!globalGlyphs[fdepth].hashSet)
-    {
-	if (!AllocateGlyphHash (&globalGlyphs[fdepth], &glyphHashSets[0]))
-	    return FALSE;
-    }
-
     glyphSet = dixAllocateObjectWithPrivates(GlyphSetRec, PRIVATE_GLYPHSET);
     if (!glyphSet)
 	return FALSE;
 
     if (!AllocateGlyphHash (&glyphSet->hash, &glyphHashSets[0]))
     {
-	free(glyphSet);
+	dixFreeObjectWithPrivates(glyphSet, PRIVATE_GLYPHSET);
 	return FALSE;
     }
     glyphSet->refcnt = 1;
@@ -518,22 +741,14 @@ FreeGlyphSet (pointer	value,
 	    if (glyph && glyph != DeletedGlyph)
 		FreeGlyph (glyph, glyphSet->fdepth);
 	}
-	if (!globalGlyphs[glyphSet->fdepth].tableEntries)
-	{
-	    free(globalGlyphs[glyphSet->fdepth].table);
-	    globalGlyphs[glyphSet->fdepth].table = 0;
-	    globalGlyphs[glyphSet->fdepth].hashSet = 0;
-	}
-	else
-	    ResizeGlyphHash (&globalGlyphs[glyphSet->fdepth], 0, TRUE);
 	free(table);
 	dixFreeObjectWithPrivates(glyphSet, PRIVATE_GLYPHSET);
     }
     return Success;
 }
 
-static void
-GlyphExtents (int		nlist,
+void
+miGlyphExtents (int		nlist,
 		GlyphListPtr	list,
 		GlyphPtr	*glyphs,
 		BoxPtr		extents)
@@ -646,7 +861,7 @@ miGlyphs (CARD8		op,
 	GCPtr	    pGC;
 	xRectangle  rect;
 
-	GlyphExtents (nlist, list, glyphs, &extents);
+	miGlyphExtents (nlist, list, glyphs, &extents);
 
 	if (extents.x2 <= extents.x1 || extents.y2 <= extents.y1)
 	    return;
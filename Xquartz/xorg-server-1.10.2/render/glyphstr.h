@@ -31,6 +31,7 @@
 #include "regionstr.h"
 #include "miscstruct.h"
 #include "privates.h"
+#include "list.h"
 
 #define GlyphFormat1	0
 #define GlyphFormat4	1
@@ -43,8 +44,10 @@ typedef struct _Glyph {
     CARD32	    refcnt;
     PrivateRec	*devPrivates;
     unsigned char   sha1[20];
-    CARD32	    size; /* info + bitmap */
+    CARD32	    size; /* bytes, with the pixmaps on each screen */
     xGlyphInfo	    info;
+    CARD8	    fdepth;
+    struct list	    unused; /* on the unused list while refcnt is 0 */
     /* per-screen pixmaps follow */
 } GlyphRec, *GlyphPtr;
 
@@ -83,6 +86,20 @@ typedef struct _GlyphSet {
 #define GlyphSetSetPrivate(pGlyphSet,k,ptr)				\
     dixSetPrivate(&(pGlyphSet)->devPrivates, k, ptr)
 
+/*
+ * Glyph memory, reported by the X-Resource extension.  Glyphs no glyph set
+ * refers to stay around for reuse, within a fixed budget and the
+ * -glyphmem limit.
+ */
+typedef struct _GlyphStats {
+    unsigned long   bytes;	/* all glyphs, unused ones included */
+    unsigned long   unused;	/* bytes of unused glyphs */
+    unsigned long   reused;	/* unused glyphs uploaded again */
+    unsigned long   evictions;	/* unused glyphs dropped for room */
+} GlyphStatsRec;
+
+extern _X_EXPORT GlyphStatsRec GlyphStats;
+
 typedef struct _GlyphList {
     INT16	    xOff;
     INT16	    yOff;
@@ -114,9 +131,15 @@ HashGlyph (xGlyphInfo    *gi,
 	   unsigned long size,
 	   unsigned char sha1[20]);
 
+extern _X_EXPORT void
+ReferenceGlyph (GlyphPtr glyph);
+
 extern _X_EXPORT void
 FreeGlyph (GlyphPtr glyph, int format);
 
+extern _X_EXPORT void
+DestroyGlyph (GlyphPtr glyph);
+
 extern _X_EXPORT void
 AddGlyph (GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id);
 
@@ -111,6 +111,12 @@ extern _X_EXPORT void
 miUnrealizeGlyph (ScreenPtr pScreen,
 		  GlyphPtr  glyph);
 
+extern _X_EXPORT void
+miGlyphExtents (int		nlist,
+		GlyphListPtr	list,
+		GlyphPtr	*glyphs,
+		BoxPtr		extents);
+
 extern _X_EXPORT void
 miGlyphs (CARD8		op,
 	  PicturePtr	pSrc,
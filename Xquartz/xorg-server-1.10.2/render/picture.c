@@ -922,7 +922,7 @@ CreateSolidPicture (Picture pid, xRenderColor *color, int *error)
     pPicture->pSourcePict = (SourcePictPtr) malloc(sizeof(PictSolidFill));
     if (!pPicture->pSourcePict) {
         *error = BadAlloc;
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
     pPicture->pSourcePict->type = SourcePictTypeSolidFill;
@@ -951,7 +951,7 @@ CreateLinearGradientPicture (Picture pid, xPointFixed *p1, xPointFixed *p2,
     pPicture->pSourcePict = (SourcePictPtr) malloc(sizeof(PictLinearGradient));
     if (!pPicture->pSourcePict) {
         *error = BadAlloc;
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
 
@@ -961,7 +961,7 @@ CreateLinearGradientPicture (Picture pid, xPointFixed *p1, xPointFixed *p2,
 
     initGradient(pPicture->pSourcePict, nStops, stops, colors, error);
     if (*error) {
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
     return pPicture;
@@ -992,7 +992,7 @@ CreateRadialGradientPicture (Picture pid, xPointFixed *inner, xPointFixed *outer
     pPicture->pSourcePict = (SourcePictPtr) malloc(sizeof(PictRadialGradient));
     if (!pPicture->pSourcePict) {
         *error = BadAlloc;
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
     radial = &pPicture->pSourcePict->radial;
@@ -1013,7 +1013,7 @@ CreateRadialGradientPicture (Picture pid, xPointFixed *inner, xPointFixed *outer
     
     initGradient(pPicture->pSourcePict, nStops, stops, colors, error);
     if (*error) {
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
     return pPicture;
@@ -1040,7 +1040,7 @@ CreateConicalGradientPicture (Picture pid, xPointFixed *center, xFixed angle,
     pPicture->pSourcePict = (SourcePictPtr) malloc(sizeof(PictConicalGradient));
     if (!pPicture->pSourcePict) {
         *error = BadAlloc;
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
 
@@ -1050,7 +1050,7 @@ CreateConicalGradientPicture (Picture pid, xPointFixed *center, xFixed angle,
 
     initGradient(pPicture->pSourcePict, nStops, stops, colors, error);
     if (*error) {
-        free(pPicture);
+        dixFreeObjectWithPrivates(pPicture, PRIVATE_PICTURE);
         return 0;
     }
     return pPicture;
@@ -1074,6 +1074,7 @@ ChangePicture (PicturePtr	pPicture,
     BITS32		maskQ;
     
     pPicture->serialNumber |= GC_CHANGE_SERIAL_BIT;
+    PictureDropImage (pPicture);
     maskQ = vmask;
     while (vmask && !error)
     {
@@ -1394,6 +1395,7 @@ SetPictureTransform (PicturePtr	    pPicture,
 	pPicture->transform = NULL;
     }
     pPicture->serialNumber |= GC_CHANGE_SERIAL_BIT;
+    PictureDropImage (pPicture);
 
     if (pPicture->pDrawable != NULL) {
 	int result;
@@ -1417,6 +1419,7 @@ CopyPicture (PicturePtr	pSrc,
 
     pDst->serialNumber |= GC_CHANGE_SERIAL_BIT;
     pDst->stateChanges |= mask;
+    PictureDropImage (pDst);
 
     while (mask) {
 	Mask bit = lowbit(mask);
@@ -1490,6 +1493,22 @@ CopyPicture (PicturePtr	pSrc,
     (*ps->ChangePicture)(pDst, origMask);
 }
 
+/*
+ * The ddx may keep the pixman image it made of a picture for later
+ * operations, in pImage.  It is dropped here whenever the picture's
+ * attributes, clip or drawable change, which all go through either the
+ * functions setting them or ValidatePicture.
+ */
+void
+PictureDropImage (PicturePtr pPicture)
+{
+    if (pPicture->pImage)
+    {
+	pixman_image_unref (pPicture->pImage);
+	pPicture->pImage = NULL;
+    }
+}
+
 static void
 ValidateOnePicture (PicturePtr pPicture)
 {
@@ -1497,6 +1516,7 @@ ValidateOnePicture (PicturePtr pPicture)
     {
 	PictureScreenPtr    ps = GetPictureScreen(pPicture->pDrawable->pScreen);
 
+	PictureDropImage (pPicture);
 	(*ps->ValidatePicture) (pPicture, pPicture->stateChanges);
 	pPicture->stateChanges = 0;
 	pPicture->serialNumber = pPicture->pDrawable->serialNumber;
@@ -1519,6 +1539,7 @@ FreePicture (pointer	value,
 
     if (--pPicture->refcnt == 0)
     {
+	PictureDropImage (pPicture);
 	free(pPicture->transform);
 
 	if (pPicture->pSourcePict)
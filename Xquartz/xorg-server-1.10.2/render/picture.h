@@ -173,6 +173,9 @@ extern _X_EXPORT int PictureCmapPolicy;
 
 extern _X_EXPORT int PictureParseCmapPolicy (const char *name);
 
+/* bytes of glyphs and their pictures allowed, 0 for no limit (-glyphmem) */
+extern _X_EXPORT unsigned long GlyphMemoryLimit;
+
 extern _X_EXPORT int RenderErrBase;
 
 /* Fixed point updates from Carl Worth, USC, Information Sciences Institute */
@@ -183,6 +183,8 @@ typedef struct _Picture {
     SourcePictPtr   pSourcePict;
     xFixed	    *filter_params;
     int		    filter_nparams;
+
+    pixman_image_t  *pImage;	    /* kept by the ddx until the picture changes */
 } PictureRec;
 
 typedef Bool (*PictFilterValidateParamsProcPtr) (ScreenPtr pScreen, int id,
@@ -536,6 +538,9 @@ CopyPicture (PicturePtr	pSrc,
 extern _X_EXPORT void
 ValidatePicture(PicturePtr pPicture);
 
+extern _X_EXPORT void
+PictureDropImage (PicturePtr pPicture);
+
 extern _X_EXPORT int
 FreePicture (pointer	pPicture,
 	     XID	pid);
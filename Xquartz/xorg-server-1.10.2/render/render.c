@@ -1116,6 +1116,8 @@ ProcRenderAddGlyphs (ClientPtr client)
 
 	if (glyph_new->glyph && glyph_new->glyph != DeletedGlyph)
 	{
+	    /* hold it while the glyphs after it are allocated */
+	    ReferenceGlyph (glyph_new->glyph);
 	    glyph_new->found = TRUE;
 	}
 	else
@@ -1225,7 +1227,11 @@ ProcRenderAddGlyphs (ClientPtr client)
 	goto bail;
     }
     for (i = 0; i < nglyphs; i++)
+    {
 	AddGlyph (glyphSet, glyphs[i].glyph, glyphs[i].id);
+	if (glyphs[i].found)
+	    FreeGlyph (glyphs[i].glyph, glyphSet->fdepth);
+    }
 
     if (glyphsBase != glyphsLocal)
 	free(glyphsBase);
@@ -1236,8 +1242,14 @@ bail:
     if (pSrcPix)
 	FreeScratchPixmapHeader (pSrcPix);
     for (i = 0; i < nglyphs; i++)
-	if (glyphs[i].glyph && ! glyphs[i].found)
-	    free(glyphs[i].glyph);
+    {
+	if (!glyphs[i].glyph)
+	    continue;
+	if (glyphs[i].found)
+	    FreeGlyph (glyphs[i].glyph, glyphSet->fdepth);
+	else
+	    DestroyGlyph (glyphs[i].glyph);
+    }
     if (glyphsBase != glyphsLocal)
 	free(glyphsBase);
     return err;
@@ -0,0 +1,345 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdlib.h>
+#include <unistd.h>
+#include "misc.h"
+#include "pixmapstr.h"
+#include "regionstr.h"
+#include "globals.h"
+#include "compint.h"
+#include "tests-common.h"
+
+#include <glib.h>
+
+/**
+ * Composite repaint tests.  The windows are pixmaps of redirected
+ * top-level windows, stacked bottom to top over a screen pixmap, painted
+ * the way compPaintChildrenToWindow queues them.  The -m perf benchmark
+ * paints every visible window each frame on 1 to 2 * online cpus
+ * threads.
+ */
+
+#ifdef COMPOSITE_THREADS
+
+#define SCREEN_WIDTH	1920
+#define SCREEN_HEIGHT	1200
+#define NUM_FRAMES	20
+
+static PixmapRec screen_pixmap;
+static PixmapPtr *windows;
+static int num_windows;
+
+static void init_pixmap(PixmapPtr pPixmap, int x, int y, int w, int h,
+			CARD32 pixel)
+{
+    CARD32 *bits;
+    int i;
+
+    memset(pPixmap, 0, sizeof(PixmapRec));
+    pPixmap->drawable.type = DRAWABLE_PIXMAP;
+    pPixmap->drawable.depth = 24;
+    pPixmap->drawable.bitsPerPixel = 32;
+    pPixmap->drawable.width = w;
+    pPixmap->drawable.height = h;
+    pPixmap->devKind = w * 4;
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+    pPixmap->devPrivate.ptr = bits = malloc(w * h * 4);
+    g_assert(bits);
+    for (i = 0; i < w * h; i++)
+	bits[i] = pixel;
+}
+
+static void init_screen(void)
+{
+    InitRegions();
+    init_pixmap(&screen_pixmap, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+}
+
+/**
+ * Create count window pixmaps, the last one created on top.  Every
+ * window is filled with its own pixel value.
+ */
+static void create_windows(int count, int max_size)
+{
+    BoxRec box;
+    int i;
+
+    num_windows = count;
+    windows = calloc(count, sizeof(PixmapPtr));
+    g_assert(windows);
+    for (i = 0; i < count; i++)
+    {
+	windows[i] = malloc(sizeof(PixmapRec));
+	g_assert(windows[i]);
+	random_window_box(&box, 40, max_size, SCREEN_WIDTH, SCREEN_HEIGHT);
+	init_pixmap(windows[i], box.x1, box.y1,
+		    box.x2 - box.x1, box.y2 - box.y1, i + 1);
+    }
+}
+
+static void destroy_windows(void)
+{
+    int i;
+
+    for (i = 0; i < num_windows; i++)
+    {
+	free(windows[i]->devPrivate.ptr);
+	free(windows[i]);
+    }
+    free(windows);
+}
+
+static void window_box(PixmapPtr pWindow, BoxPtr pBox)
+{
+    pBox->x1 = pWindow->screen_x;
+    pBox->y1 = pWindow->screen_y;
+    pBox->x2 = pBox->x1 + pWindow->drawable.width;
+    pBox->y2 = pBox->y1 + pWindow->drawable.height;
+}
+
+/**
+ * The visible part of every window: its box minus the boxes above it.
+ */
+static RegionPtr visible_regions(void)
+{
+    RegionPtr regions;
+    RegionRec above, box;
+    BoxRec b;
+    int i;
+
+    regions = calloc(num_windows, sizeof(RegionRec));
+    g_assert(regions);
+    RegionNull(&above);
+    for (i = num_windows - 1; i >= 0; i--)
+    {
+	window_box(windows[i], &b);
+	RegionInit(&box, &b, 1);
+	RegionNull(&regions[i]);
+	RegionSubtract(&regions[i], &box, &above);
+	RegionUnion(&above, &above, &box);
+	RegionUninit(&box);
+    }
+    RegionUninit(&above);
+    return regions;
+}
+
+static void copy_box(PixmapPtr pWindow, BoxPtr pBox)
+{
+    CARD32 *dst, *src;
+    int y;
+
+    for (y = pBox->y1; y < pBox->y2; y++)
+    {
+	src = (CARD32 *) pWindow->devPrivate.ptr +
+	    (y - pWindow->screen_y) * pWindow->drawable.width +
+	    pBox->x1 - pWindow->screen_x;
+	dst = (CARD32 *) screen_pixmap.devPrivate.ptr +
+	    y * SCREEN_WIDTH + pBox->x1;
+	memcpy(dst, src, (pBox->x2 - pBox->x1) * 4);
+    }
+}
+
+/**
+ * Paint every window bottom to top on this thread.
+ */
+static void paint_serial(void)
+{
+    BoxRec b;
+    int i;
+
+    for (i = 0; i < num_windows; i++)
+    {
+	window_box(windows[i], &b);
+	copy_box(windows[i], &b);
+    }
+}
+
+/**
+ * Paint the visible part of every window on this thread.
+ */
+static void paint_regions_serial(RegionPtr regions)
+{
+    BoxPtr pBox;
+    int i, n;
+
+    for (i = 0; i < num_windows; i++)
+    {
+	pBox = RegionRects(&regions[i]);
+	for (n = RegionNumRects(&regions[i]); n--; pBox++)
+	    copy_box(windows[i], pBox);
+    }
+}
+
+static void paint_regions(RegionPtr regions)
+{
+    int i;
+
+    for (i = 0; i < num_windows; i++)
+	g_assert(compPaintQueue(windows[i], PICT_x8r8g8b8,
+				&screen_pixmap, PICT_x8r8g8b8,
+				&regions[i], NULL));
+    compPaintFlush();
+}
+
+static void clear_screen(void)
+{
+    memset(screen_pixmap.devPrivate.ptr, 0,
+	   SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+}
+
+/**
+ * Overlapping windows queued with their whole boxes end up painted in
+ * stacking order, and windows painted into a window painted afterwards
+ * show up in it.
+ */
+static void composite_order(void)
+{
+    CARD32 *expected;
+    RegionPtr regions;
+    PixmapRec parent;
+    BoxRec b;
+    int i;
+
+    init_screen();
+    create_windows(100, 400);
+    paint_serial();
+    expected = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+    g_assert(expected);
+    memcpy(expected, screen_pixmap.devPrivate.ptr,
+	   SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+
+    regions = calloc(num_windows, sizeof(RegionRec));
+    g_assert(regions);
+    for (i = 0; i < num_windows; i++)
+    {
+	window_box(windows[i], &b);
+	RegionInit(&regions[i], &b, 1);
+    }
+    compositeThreads = 4;
+    clear_screen();
+    paint_regions(regions);
+    g_assert(!memcmp(expected, screen_pixmap.devPrivate.ptr,
+		     SCREEN_WIDTH * SCREEN_HEIGHT * 4));
+
+    /* a child painted into its parent, the parent onto the screen */
+    init_pixmap(&parent, 100, 100, 300, 300, 0x1234);
+    clear_screen();
+    windows[0]->screen_x = 150;
+    windows[0]->screen_y = 150;
+    b.x1 = 150;
+    b.y1 = 150;
+    b.x2 = 190;
+    b.y2 = 190;
+    RegionReset(&regions[0], &b);
+    g_assert(compPaintQueue(windows[0], PICT_x8r8g8b8,
+			    &parent, PICT_x8r8g8b8, &regions[0], NULL));
+    window_box(&parent, &b);
+    RegionReset(&regions[1], &b);
+    g_assert(compPaintQueue(&parent, PICT_x8r8g8b8,
+			    &screen_pixmap, PICT_x8r8g8b8, &regions[1], NULL));
+    compPaintFlush();
+    g_assert(((CARD32 *) screen_pixmap.devPrivate.ptr)
+	     [160 * SCREEN_WIDTH + 160] == 1);
+    g_assert(((CARD32 *) screen_pixmap.devPrivate.ptr)
+	     [120 * SCREEN_WIDTH + 120] == 0x1234);
+    free(parent.devPrivate.ptr);
+
+    for (i = 0; i < num_windows; i++)
+	RegionUninit(&regions[i]);
+    free(regions);
+    free(expected);
+    destroy_windows();
+    free(screen_pixmap.devPrivate.ptr);
+    compositeThreads = 0;
+}
+
+/**
+ * Time NUM_FRAMES repaints of every visible window, for stacks of small
+ * and of large windows.
+ */
+static void composite_benchmark(void)
+{
+    static const struct { int count, size; } stacks[] = {
+	{ 50, 800 }, { 500, 300 }, { 2000, 100 }
+    };
+    RegionPtr regions;
+    double elapsed;
+    long cpus;
+    int i, j, threads;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+	cpus = 1;
+
+    for (i = 0; i < sizeof(stacks) / sizeof(stacks[0]); i++)
+    {
+	init_screen();
+	create_windows(stacks[i].count, stacks[i].size);
+	regions = visible_regions();
+
+	g_test_timer_start();
+	for (j = 0; j < NUM_FRAMES; j++)
+	    paint_regions_serial(regions);
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%d windows: 1 thread, %.2fms per frame",
+		       stacks[i].count, elapsed * 1000 / NUM_FRAMES);
+
+	for (threads = 2; threads <= cpus * 2; threads *= 2)
+	{
+	    compositeThreads = threads;
+	    g_test_timer_start();
+	    for (j = 0; j < NUM_FRAMES; j++)
+		paint_regions(regions);
+	    elapsed = g_test_timer_elapsed();
+	    g_test_message("%d windows: %d threads, %.2fms per frame",
+			   stacks[i].count, threads,
+			   elapsed * 1000 / NUM_FRAMES);
+	}
+	compositeThreads = 0;
+
+	for (j = 0; j < num_windows; j++)
+	    RegionUninit(&regions[j]);
+	free(regions);
+	destroy_windows();
+	free(screen_pixmap.devPrivate.ptr);
+    }
+}
+
+#endif /* COMPOSITE_THREADS */
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+#ifdef COMPOSITE_THREADS
+    g_test_add_func("/composite/paint/order", composite_order);
+    if (g_test_perf())
+	g_test_add_func("/composite/paint/benchmark", composite_benchmark);
+#endif
+
+    return g_test_run();
+}
@@ -0,0 +1,185 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "opaque.h"
+#include "osdep.h"
+#include "xace.h"
+
+#include <glib.h>
+
+/**
+ * Dispatch tests.  The client pipelines tiny requests the way x11perf
+ * -noop does: they are put in its input buffer with InsertFakeRequest,
+ * so Dispatch() runs them in batches without reading a connection.  The
+ * benchmark, registered only for -m perf, times a long run of them with
+ * and without a security hook registered.
+ */
+
+#define NUM_REQUESTS		(1 << 10)
+#define NUM_PERF_REQUESTS	(1 << 20)
+
+extern void Dispatch(void);
+
+#ifdef HAVE_EPOLL
+
+static ClientRec test_client;
+static OsCommRec test_oc;
+static HWEventQueueType input_head, input_tail;
+static int (*test_vector[256])(ClientPtr);
+static int handled, expected;
+
+/**
+ * Stands in for ProcNoOperation.  After the last request the client is
+ * taken out of clients[], so Dispatch() neither charges nor kills it, and
+ * the server is told to terminate.
+ */
+static int count_request(ClientPtr client)
+{
+    g_assert(client->sequence == ++handled);
+    if (handled == expected)
+    {
+	clients[client->index] = NULL;
+	isItTimeToYield = TRUE;
+	dispatchException |= DE_TERMINATE;
+    }
+    return Success;
+}
+
+static void run_requests(int count)
+{
+    xReq *requests;
+    int i;
+
+    requests = calloc(count, sizeof(xReq));
+    g_assert(requests);
+    for (i = 0; i < count; i++)
+    {
+	requests[i].reqType = X_NoOperation;
+	requests[i].length = 1;
+    }
+
+    test_client.sequence = 0;
+    test_client.smart_heap_index = -1;
+    clients[test_client.index] = &test_client;
+    g_assert(InsertFakeRequest(&test_client, (char *)requests,
+			       count * sizeof(xReq)));
+    free(requests);
+
+    handled = 0;
+    expected = count;
+    Dispatch();
+    SmartScheduleStopTimer();
+    dispatchException = 0;
+
+    g_assert(handled == count);
+    g_assert(!ClientHasQueuedRequest(&test_client));
+}
+
+static void dispatch_init(void)
+{
+    int i;
+
+    SetInputCheck(&input_head, &input_tail);
+    InitConnectionLimits();
+    g_assert(ServerPoll);
+    SmartScheduleInit();
+
+    for (i = 0; i < 256; i++)
+	test_vector[i] = ProcVector[i];
+    test_vector[X_NoOperation] = count_request;
+
+    memset(&test_oc, 0, sizeof(test_oc));
+    test_oc.fd = -1;
+    test_oc.client = &test_client;
+    list_init(&test_oc.ready);
+    list_init(&test_oc.pending);
+
+    memset(&test_client, 0, sizeof(test_client));
+    test_client.index = 1;
+    test_client.osPrivate = &test_oc;
+    test_client.requestVector = test_vector;
+}
+
+/**
+ * Every buffered request is run, in order, whether they fill several
+ * batches or end partway through one.
+ */
+static void dispatch_batch(void)
+{
+    run_requests(1);
+    run_requests(NUM_REQUESTS);
+    run_requests(NUM_REQUESTS + 1);
+}
+
+#ifdef XACE
+static void audit_end(CallbackListPtr *pcbl, pointer unused, pointer calldata)
+{
+}
+#endif
+
+static void dispatch_benchmark(void)
+{
+    double elapsed;
+
+    g_test_timer_start();
+    run_requests(NUM_PERF_REQUESTS);
+    elapsed = g_test_timer_elapsed();
+    g_test_message("%d NoOperation requests in %.3fs", NUM_PERF_REQUESTS,
+		   elapsed);
+
+#ifdef XACE
+    /* a hook brings back the checks between every request */
+    g_assert(XaceRegisterCallback(XACE_AUDIT_END, audit_end, NULL));
+    g_test_timer_start();
+    run_requests(NUM_PERF_REQUESTS);
+    elapsed = g_test_timer_elapsed();
+    g_test_message("%d NoOperation requests with a hook in %.3fs",
+		   NUM_PERF_REQUESTS, elapsed);
+    XaceDeleteCallback(XACE_AUDIT_END, audit_end, NULL);
+#endif
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+#ifdef HAVE_EPOLL
+    g_test_add_func("/dix/dispatch/init", dispatch_init);
+    g_test_add_func("/dix/dispatch/batch", dispatch_batch);
+    if (g_test_perf())
+	g_test_add_func("/dix/dispatch/benchmark", dispatch_benchmark);
+#endif
+
+    return g_test_run();
+}
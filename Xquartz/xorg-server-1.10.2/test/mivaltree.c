@@ -0,0 +1,351 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdlib.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "mi.h"
+#include "mivalidate.h"
+#include "tests-common.h"
+
+#include <glib.h>
+
+/**
+ * Clip computation tests.  The windows are top-level children of a fake
+ * root, validated the way miMoveWindow and the stacking code do.  With
+ * -m perf, a benchmark also times a storm of moves and raises over
+ * stacks of increasing size.
+ */
+
+#define SCREEN_WIDTH	1280
+#define SCREEN_HEIGHT	1024
+#define NUM_CONFIGURES	200
+
+static ScreenRec screen;
+static WindowRec root;
+static WindowPtr *windows;
+static int num_windows;
+
+static void init_root(void)
+{
+    BoxRec box = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    InitRegions();
+    memset(&screen, 0, sizeof(screen));
+    screen.width = SCREEN_WIDTH;
+    screen.height = SCREEN_HEIGHT;
+    screen.MarkWindow = miMarkWindow;
+    screen.MarkOverlappedWindows = miMarkOverlappedWindows;
+    screen.ValidateTree = miValidateTree;
+
+    memset(&root, 0, sizeof(root));
+    root.drawable.type = DRAWABLE_WINDOW;
+    root.drawable.pScreen = &screen;
+    root.drawable.width = SCREEN_WIDTH;
+    root.drawable.height = SCREEN_HEIGHT;
+    root.mapped = root.realized = root.viewable = TRUE;
+    root.visibility = VisibilityUnobscured;
+    RegionInit(&root.winSize, &box, 1);
+    RegionInit(&root.borderSize, &box, 1);
+    RegionInit(&root.clipList, &box, 1);
+    RegionInit(&root.borderClip, &box, 1);
+    screen.root = &root;
+}
+
+/**
+ * Free the validation data the way miHandleValidateExposures does.
+ */
+static void free_valdata(void)
+{
+    WindowPtr pWin;
+
+    for (pWin = root.firstChild; pWin; pWin = pWin->nextSib)
+    {
+	if (!pWin->valdata)
+	    continue;
+	RegionUninit(&pWin->valdata->after.borderExposed);
+	RegionUninit(&pWin->valdata->after.exposed);
+	free(pWin->valdata);
+	pWin->valdata = NULL;
+    }
+    RegionUninit(&root.valdata->after.borderExposed);
+    RegionUninit(&root.valdata->after.exposed);
+    free(root.valdata);
+    root.valdata = NULL;
+}
+
+static void place_window(WindowPtr pWin, int x, int y)
+{
+    pWin->origin.x = x + pWin->borderWidth;
+    pWin->origin.y = y + pWin->borderWidth;
+    pWin->drawable.x = pWin->origin.x;
+    pWin->drawable.y = pWin->origin.y;
+    SetWinSize(pWin);
+    SetBorderSize(pWin);
+}
+
+/**
+ * Create count mapped windows stacked on top of each other, with the
+ * last one created on top.  They have no clips until map_windows.
+ */
+static void create_windows(int count)
+{
+    WindowPtr pWin;
+    BoxRec box;
+    int i;
+
+    init_root();
+    num_windows = count;
+    windows = calloc(count, sizeof(WindowPtr));
+    g_assert(windows);
+    for (i = 0; i < count; i++)
+    {
+	pWin = windows[i] = calloc(1, sizeof(WindowRec));
+	g_assert(pWin);
+	pWin->drawable.type = DRAWABLE_WINDOW;
+	pWin->drawable.pScreen = &screen;
+	random_window_box(&box, 40, 300, SCREEN_WIDTH, SCREEN_HEIGHT);
+	pWin->drawable.width = box.x2 - box.x1;
+	pWin->drawable.height = box.y2 - box.y1;
+	pWin->borderWidth = g_test_rand_int_range(0, 2);
+	pWin->parent = &root;
+	pWin->mapped = pWin->realized = pWin->viewable = TRUE;
+	pWin->visibility = VisibilityNotViewable;
+	RegionNull(&pWin->winSize);
+	RegionNull(&pWin->borderSize);
+	RegionNull(&pWin->clipList);
+	RegionNull(&pWin->borderClip);
+	place_window(pWin, box.x1, box.y1);
+
+	pWin->nextSib = root.firstChild;
+	if (root.firstChild)
+	    root.firstChild->prevSib = pWin;
+	else
+	    root.lastChild = pWin;
+	root.firstChild = pWin;
+    }
+}
+
+/**
+ * Validate all windows at once, as mapping them would.
+ */
+static void map_windows(void)
+{
+    WindowPtr pWin;
+
+    for (pWin = root.firstChild; pWin; pWin = pWin->nextSib)
+	miMarkWindow(pWin);
+    miMarkWindow(&root);
+    miValidateTree(&root, NullWindow, VTMap);
+    free_valdata();
+}
+
+static void destroy_windows(void)
+{
+    int i;
+
+    for (i = 0; i < num_windows; i++)
+    {
+	RegionUninit(&windows[i]->winSize);
+	RegionUninit(&windows[i]->borderSize);
+	RegionUninit(&windows[i]->clipList);
+	RegionUninit(&windows[i]->borderClip);
+	free(windows[i]);
+    }
+    free(windows);
+    RegionUninit(&root.winSize);
+    RegionUninit(&root.borderSize);
+    RegionUninit(&root.clipList);
+    RegionUninit(&root.borderClip);
+}
+
+/**
+ * Move a window the way miMoveWindow does.
+ */
+static void move_window(WindowPtr pWin, int x, int y)
+{
+    miMarkOverlappedWindows(pWin, pWin, NULL);
+    place_window(pWin, x, y);
+    miMarkOverlappedWindows(pWin, pWin, NULL);
+    miValidateTree(&root, NullWindow, VTMove);
+    free_valdata();
+}
+
+/**
+ * Raise a window to the top the way the stacking code does.
+ */
+static void raise_window(WindowPtr pWin)
+{
+    if (!pWin->prevSib)
+	return;
+    pWin->prevSib->nextSib = pWin->nextSib;
+    if (pWin->nextSib)
+	pWin->nextSib->prevSib = pWin->prevSib;
+    else
+	root.lastChild = pWin->prevSib;
+    pWin->prevSib = NullWindow;
+    pWin->nextSib = root.firstChild;
+    root.firstChild->prevSib = pWin;
+    root.firstChild = pWin;
+
+    if (miMarkOverlappedWindows(pWin, pWin, NULL))
+    {
+	miValidateTree(&root, pWin, VTStack);
+	free_valdata();
+    }
+}
+
+static void configure_window(void)
+{
+    WindowPtr pWin = windows[g_test_rand_int_range(0, num_windows)];
+    int x, y;
+
+    if (g_test_rand_int_range(0, 4))
+    {
+	x = g_test_rand_int_range(0, SCREEN_WIDTH - pWin->drawable.width);
+	y = g_test_rand_int_range(0, SCREEN_HEIGHT - pWin->drawable.height);
+	move_window(pWin, x, y);
+    }
+    else
+	raise_window(pWin);
+}
+
+/**
+ * Compare the clips of every window with the ones computed from scratch,
+ * top to bottom.
+ */
+static void check_clips(void)
+{
+    RegionRec remaining, clip;
+    WindowPtr pWin;
+
+    RegionNull(&clip);
+    RegionNull(&remaining);
+    RegionCopy(&remaining, &root.winSize);
+    for (pWin = root.firstChild; pWin; pWin = pWin->nextSib)
+    {
+	RegionIntersect(&clip, &remaining, &pWin->borderSize);
+	g_assert(RegionEqual(&clip, &pWin->borderClip));
+	RegionIntersect(&clip, &clip, &pWin->winSize);
+	g_assert(RegionEqual(&clip, &pWin->clipList));
+	RegionSubtract(&remaining, &remaining, &pWin->borderSize);
+    }
+    g_assert(RegionEqual(&remaining, &root.clipList));
+    RegionUninit(&remaining);
+    RegionUninit(&clip);
+}
+
+/**
+ * A storm of moves and raises leaves every window with the clips it
+ * would get from a full recomputation.
+ */
+static void mivaltree_storm(void)
+{
+    int i;
+
+    create_windows(50);
+    map_windows();
+    check_clips();
+    for (i = 0; i < NUM_CONFIGURES; i++)
+    {
+	configure_window();
+	check_clips();
+    }
+    destroy_windows();
+}
+
+/**
+ * A window below a change that is hidden from it by a window in between
+ * is not clipped again, while one the change uncovers is.
+ */
+static void mivaltree_skip(void)
+{
+    WindowPtr top, middle, bottom;
+    unsigned long serial;
+
+    create_windows(3);
+    top = root.firstChild;
+    middle = top->nextSib;
+    bottom = middle->nextSib;
+
+    top->drawable.width = top->drawable.height = 50;
+    middle->drawable.width = middle->drawable.height = 600;
+    bottom->drawable.width = bottom->drawable.height = 300;
+    top->borderWidth = middle->borderWidth = bottom->borderWidth = 0;
+    place_window(top, 450, 450);
+    place_window(middle, 0, 0);
+    place_window(bottom, 400, 400);
+    map_windows();
+    check_clips();
+    g_assert(bottom->visibility == VisibilityPartiallyObscured);
+
+    serial = bottom->drawable.serialNumber;
+    move_window(top, 460, 460);
+    check_clips();
+    g_assert(bottom->drawable.serialNumber == serial);
+
+    move_window(middle, 600, 0);
+    check_clips();
+    g_assert(bottom->drawable.serialNumber != serial);
+    destroy_windows();
+}
+
+/**
+ * Time NUM_CONFIGURES moves and raises over stacks from 10 to 5000
+ * windows.
+ */
+static void mivaltree_benchmark(void)
+{
+    static const int sizes[] = { 10, 100, 1000, 5000 };
+    double elapsed;
+    int i, j;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+	create_windows(sizes[i]);
+	map_windows();
+	g_test_timer_start();
+	for (j = 0; j < NUM_CONFIGURES; j++)
+	    configure_window();
+	elapsed = g_test_timer_elapsed();
+	g_test_message("miValidateTree: %d configures of %d windows in %.3fs",
+		       NUM_CONFIGURES, sizes[i], elapsed);
+	check_clips();
+	destroy_windows();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+    g_test_add_func("/mi/validate/storm", mivaltree_storm);
+    g_test_add_func("/mi/validate/skip", mivaltree_skip);
+    if (g_test_perf())
+	g_test_add_func("/mi/validate/benchmark", mivaltree_benchmark);
+
+    return g_test_run();
+}
@@ -0,0 +1,282 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdlib.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "gcstruct.h"
+#include "dixfontstr.h"
+#include "fb.h"
+
+#include <glib.h>
+
+/**
+ * Pixmap cache and GC pool tests.  Under -m perf there is also a
+ * benchmark creating and freeing pixmaps and GCs the way toolkits do for
+ * double-buffering and glyph rendering.
+ */
+
+#define NUM_OBJECTS	200
+#define NUM_ROUNDS	1000
+
+static ScreenRec screen;
+static FontRec font;
+
+extern FontPtr defaultFont;
+
+static void test_change_gc(GCPtr pGC, unsigned long mask)
+{
+}
+
+static void test_destroy_gc(GCPtr pGC)
+{
+}
+
+static void test_destroy_clip(GCPtr pGC)
+{
+}
+
+static GCFuncs test_funcs;
+
+static Bool test_create_gc(GCPtr pGC)
+{
+    pGC->funcs = &test_funcs;
+    return TRUE;
+}
+
+static void pixmap_init(void)
+{
+    memset(&screen, 0, sizeof(screen));
+    screenInfo.screens[0] = &screen;
+    screenInfo.numScreens = 1;
+    g_assert(CreateScratchPixmapsForScreen(0));
+    screen.DestroyPixmap = fbDestroyPixmap;
+    screen.CreateGC = test_create_gc;
+    screen.PixmapPerDepth[0] = fbCreatePixmapBpp(&screen, 1, 1, 1, 1, 0);
+    g_assert(screen.PixmapPerDepth[0]);
+
+    test_funcs.ChangeGC = test_change_gc;
+    test_funcs.DestroyGC = test_destroy_gc;
+    test_funcs.DestroyClip = test_destroy_clip;
+    font.refcnt = 1;
+    defaultFont = &font;
+}
+
+/**
+ * A pixmap of the size, depth and bpp of one just destroyed gets its
+ * storage; other pixmaps don't.
+ */
+static void pixmap_cache_reuse(void)
+{
+    PixmapPtr pPixmap, pOther, pDeeper, pCopy;
+    unsigned long hits = PixmapCacheStats.hits;
+
+    pPixmap = fbCreatePixmapBpp(&screen, 64, 32, 24, 32, 0);
+    g_assert(pPixmap);
+    memset(pPixmap->devPrivate.ptr, 0xff, 32 * pPixmap->devKind);
+    fbDestroyPixmap(pPixmap);
+    g_assert(PixmapCacheStats.bytes > 0);
+
+    pOther = fbCreatePixmapBpp(&screen, 32, 64, 24, 32, 0);
+    g_assert(pOther != pPixmap);
+    pDeeper = fbCreatePixmapBpp(&screen, 64, 32, 32, 32, 0);
+    g_assert(pDeeper != pPixmap);
+    g_assert(PixmapCacheStats.hits == hits);
+
+    /* storage goes back only with the last reference */
+    pOther->refcnt++;
+    fbDestroyPixmap(pOther);
+    pCopy = fbCreatePixmapBpp(&screen, 32, 64, 24, 32, 0);
+    g_assert(pCopy != pOther);
+    fbDestroyPixmap(pCopy);
+
+    g_assert(fbCreatePixmapBpp(&screen, 64, 32, 24, 32, 0) == pPixmap);
+    g_assert(PixmapCacheStats.hits == hits + 1);
+    g_assert(pPixmap->refcnt == 1);
+    g_assert(pPixmap->devKind == 64 * 4);
+    g_assert(pPixmap->drawable.width == 64);
+    g_assert(pPixmap->drawable.height == 32);
+    g_assert(pPixmap->drawable.depth == 24);
+    g_assert(pPixmap->devPrivate.ptr > (pointer)pPixmap);
+
+    fbDestroyPixmap(pPixmap);
+    fbDestroyPixmap(pOther);
+    fbDestroyPixmap(pDeeper);
+    fbFlushPixmapCache(&screen);
+    g_assert(PixmapCacheStats.bytes == 0);
+}
+
+/**
+ * Freeing more pixmap storage than the cache holds evicts the oldest,
+ * and the storage the cache keeps stays under its cap.
+ */
+static void pixmap_cache_cap(void)
+{
+    PixmapPtr pixmaps[NUM_OBJECTS];
+    unsigned long evictions = PixmapCacheStats.evictions;
+    unsigned long freed = 0;
+    int i;
+
+    for (i = 0; i < NUM_OBJECTS; i++)
+    {
+	pixmaps[i] = fbCreatePixmapBpp(&screen, 256, 256, 24, 32, 0);
+	g_assert(pixmaps[i]);
+    }
+    for (i = 0; i < NUM_OBJECTS; i++)
+    {
+	fbDestroyPixmap(pixmaps[i]);
+	freed += 256 * 256 * 4;
+    }
+    g_assert(PixmapCacheStats.evictions > evictions);
+    g_assert(PixmapCacheStats.bytes < freed);
+
+    /* the most recently freed is still there */
+    g_assert(fbCreatePixmapBpp(&screen, 256, 256, 24, 32, 0) ==
+	     pixmaps[NUM_OBJECTS - 1]);
+    fbDestroyPixmap(pixmaps[NUM_OBJECTS - 1]);
+
+    /* too large to keep */
+    pixmaps[0] = fbCreatePixmapBpp(&screen, 2048, 2048, 24, 32, 0);
+    g_assert(pixmaps[0]);
+    evictions = PixmapCacheStats.evictions;
+    freed = PixmapCacheStats.bytes;
+    fbDestroyPixmap(pixmaps[0]);
+    g_assert(PixmapCacheStats.bytes == freed);
+    g_assert(PixmapCacheStats.evictions == evictions);
+
+    fbFlushPixmapCache(NULL);
+    g_assert(PixmapCacheStats.bytes == 0);
+}
+
+/**
+ * A GC created after one was freed reuses it, with every field back to
+ * its initial state.
+ */
+static void gc_pool_reuse(void)
+{
+    GCPtr pGC, pOther;
+    XID bg = 0x123456;
+    int status;
+    unsigned long hits = GCPoolStats.hits;
+
+    pGC = CreateGC(&screen.PixmapPerDepth[0]->drawable, GCBackground, &bg,
+		   &status, 0, serverClient);
+    g_assert(pGC && status == Success);
+    g_assert(pGC->bgPixel == 0x123456);
+    g_assert(font.refcnt == 2);
+    FreeGC(pGC, 0);
+    g_assert(font.refcnt == 1);
+    g_assert(GCPoolStats.pooled > 0);
+
+    pOther = CreateGC(&screen.PixmapPerDepth[0]->drawable, 0, NULL,
+		      &status, 0, serverClient);
+    g_assert(pOther == pGC);
+    g_assert(GCPoolStats.hits == hits + 1);
+    g_assert(pOther->fgPixel == 0);
+    g_assert(pOther->bgPixel == 1);
+    g_assert(pOther->alu == GXcopy);
+    g_assert(pOther->funcs == &test_funcs);
+    FreeGC(pOther, 0);
+}
+
+/**
+ * Time creating and freeing sets of pixmaps of the sizes backing pixmaps
+ * and glyph masks come in, and of GCs.
+ */
+static void pixmap_benchmark(void)
+{
+    PixmapPtr pixmaps[NUM_OBJECTS];
+    GCPtr gcs[NUM_OBJECTS];
+    int widths[NUM_OBJECTS], heights[NUM_OBJECTS];
+    unsigned long hits = PixmapCacheStats.hits;
+    unsigned long misses = PixmapCacheStats.misses;
+    double elapsed;
+    int i, j, status;
+
+    for (i = 0; i < NUM_OBJECTS; i++)
+    {
+	if (i % 4)
+	{
+	    /* glyph and icon masks */
+	    widths[i] = 8 + g_test_rand_int_range(0, 8);
+	    heights[i] = 12 + g_test_rand_int_range(0, 4);
+	}
+	else
+	{
+	    /* double-buffers of a few window sizes */
+	    widths[i] = 100 * (1 + g_test_rand_int_range(0, 4));
+	    heights[i] = 30 * (1 + g_test_rand_int_range(0, 4));
+	}
+    }
+
+    g_test_timer_start();
+    for (j = 0; j < NUM_ROUNDS; j++)
+    {
+	for (i = 0; i < NUM_OBJECTS; i++)
+	    pixmaps[i] = fbCreatePixmapBpp(&screen, widths[i], heights[i],
+					   i % 4 ? 8 : 24, i % 4 ? 8 : 32, 0);
+	for (i = 0; i < NUM_OBJECTS; i++)
+	    fbDestroyPixmap(pixmaps[i]);
+    }
+    elapsed = g_test_timer_elapsed();
+    g_test_message("fbCreatePixmap: %d pixmaps in %.3fs, %lu cache hits, "
+		   "%lu misses", NUM_ROUNDS * NUM_OBJECTS, elapsed,
+		   PixmapCacheStats.hits - hits,
+		   PixmapCacheStats.misses - misses);
+    g_assert(PixmapCacheStats.hits - hits > PixmapCacheStats.misses - misses);
+    fbFlushPixmapCache(NULL);
+
+    hits = GCPoolStats.hits;
+    misses = GCPoolStats.misses;
+    g_test_timer_start();
+    for (j = 0; j < NUM_ROUNDS; j++)
+    {
+	for (i = 0; i < NUM_OBJECTS / 4; i++)
+	    gcs[i] = CreateGC(&screen.PixmapPerDepth[0]->drawable, 0, NULL,
+			      &status, 0, serverClient);
+	for (i = 0; i < NUM_OBJECTS / 4; i++)
+	    FreeGC(gcs[i], 0);
+    }
+    elapsed = g_test_timer_elapsed();
+    g_test_message("CreateGC: %d GCs in %.3fs, %lu pool hits, %lu misses",
+		   NUM_ROUNDS * NUM_OBJECTS / 4, elapsed,
+		   GCPoolStats.hits - hits, GCPoolStats.misses - misses);
+    g_assert(GCPoolStats.hits - hits > GCPoolStats.misses - misses);
+}
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+    g_test_add_func("/fb/pixmap/init", pixmap_init);
+    g_test_add_func("/fb/pixmap/cache-reuse", pixmap_cache_reuse);
+    g_test_add_func("/fb/pixmap/cache-cap", pixmap_cache_cap);
+    g_test_add_func("/dix/gc/pool-reuse", gc_pool_reuse);
+    if (g_test_perf())
+	g_test_add_func("/fb/pixmap/benchmark", pixmap_benchmark);
+
+    return g_test_run();
+}
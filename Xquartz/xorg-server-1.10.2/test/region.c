@@ -0,0 +1,313 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdlib.h>
+#include "misc.h"
+#include "gc.h"
+#include "regionstr.h"
+
+#include <glib.h>
+
+/**
+ * Region tests.  Rectangles come in the shapes the server sees most:
+ * window borders of a desktop, glyph boxes in lines of text, and small
+ * scattered damage.  The benchmark, registered only for -m perf, times
+ * building regions from them, operating on the results and clipping
+ * spans.
+ */
+
+#define NUM_RECTS	500
+#define NUM_ROUNDS	200
+
+typedef enum {
+    RECTS_WINDOWS,
+    RECTS_TEXT,
+    RECTS_DAMAGE,
+    NUM_DISTRIBUTIONS
+} Distribution;
+
+static const char *distribution_names[NUM_DISTRIBUTIONS] = {
+    "windows", "text", "damage"
+};
+
+static void make_rects(Distribution dist, xRectangle *rects, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+	switch (dist) {
+	case RECTS_WINDOWS:
+	    rects[i].width = 100 + g_test_rand_int_range(0, 700);
+	    rects[i].height = 80 + g_test_rand_int_range(0, 600);
+	    rects[i].x = g_test_rand_int_range(0, 1920 - rects[i].width);
+	    rects[i].y = g_test_rand_int_range(0, 1200 - rects[i].height);
+	    break;
+	case RECTS_TEXT:
+	    /* lines of 80 cells, glyphs touching or overlapping a bit */
+	    rects[i].x = 10 + (i % 80) * 9 - g_test_rand_int_range(0, 2);
+	    rects[i].y = 20 + (i / 80) * 16 + g_test_rand_int_range(0, 3);
+	    rects[i].width = 6 + g_test_rand_int_range(0, 5);
+	    rects[i].height = 9 + g_test_rand_int_range(0, 4);
+	    break;
+	default:
+	    rects[i].x = g_test_rand_int_range(0, 1900);
+	    rects[i].y = g_test_rand_int_range(0, 1180);
+	    rects[i].width = 1 + g_test_rand_int_range(0, 20);
+	    rects[i].height = 1 + g_test_rand_int_range(0, 20);
+	    break;
+	}
+    }
+}
+
+/**
+ * Union the rectangles one at a time, the slow and obvious way.
+ */
+static void union_rects(RegionPtr pReg, xRectangle *rects, int count)
+{
+    int i;
+
+    RegionNull(pReg);
+    for (i = 0; i < count; i++)
+	g_assert(pixman_region_union_rect(pReg, pReg, rects[i].x, rects[i].y,
+					  rects[i].width, rects[i].height));
+}
+
+/**
+ * Regions built by RegionValidate, from rectangles appended in any
+ * order, are the unions of the rectangles.
+ */
+static void region_validate(void)
+{
+    xRectangle rects[NUM_RECTS];
+    RegionRec expected, single;
+    RegionPtr pReg;
+    BoxRec box;
+    Bool overlap;
+    int dist, i;
+
+    InitRegions();
+    for (dist = 0; dist < NUM_DISTRIBUTIONS; dist++)
+    {
+	make_rects(dist, rects, NUM_RECTS);
+	union_rects(&expected, rects, NUM_RECTS);
+
+	pReg = RegionCreate(NullBox, 0);
+	for (i = 0; i < NUM_RECTS; i++)
+	{
+	    box.x1 = rects[i].x;
+	    box.y1 = rects[i].y;
+	    box.x2 = rects[i].x + rects[i].width;
+	    box.y2 = rects[i].y + rects[i].height;
+	    RegionInit(&single, &box, 1);
+	    g_assert(RegionAppend(pReg, &single));
+	}
+	g_assert(RegionValidate(pReg, &overlap));
+	g_assert(RegionEqual(pReg, &expected));
+	RegionDestroy(pReg);
+
+	pReg = RegionFromRects(NUM_RECTS, rects, CT_UNSORTED);
+	g_assert(RegionEqual(pReg, &expected));
+	RegionDestroy(pReg);
+
+	/* and back from the banded rectangles of the result */
+	pReg = RegionFromRects(0, NULL, CT_UNSORTED);
+	for (i = 0; i < RegionNumRects(&expected); i++)
+	{
+	    RegionInit(&single, RegionRects(&expected) + i, 1);
+	    g_assert(RegionAppend(pReg, &single));
+	}
+	g_assert(RegionValidate(pReg, &overlap));
+	g_assert(!overlap);
+	g_assert(RegionEqual(pReg, &expected));
+	RegionDestroy(pReg);
+
+	RegionUninit(&expected);
+    }
+}
+
+/**
+ * Clipped spans are the parts of the spans inside the region.
+ */
+static void region_clip_spans(void)
+{
+    xRectangle rects[NUM_RECTS];
+    DDXPointRec spans[NUM_RECTS], clipped[NUM_RECTS * 8];
+    int widths[NUM_RECTS], clippedWidths[NUM_RECTS * 8];
+    RegionPtr pReg;
+    int i, n, x, inside, covered;
+
+    make_rects(RECTS_WINDOWS, rects, 20);
+    pReg = RegionFromRects(20, rects, CT_UNSORTED);
+    g_assert(RegionNumRects(pReg) > 1);
+
+    for (i = 0; i < NUM_RECTS; i++)
+    {
+	spans[i].x = g_test_rand_int_range(0, 1920) - 100;
+	spans[i].y = g_test_rand_int_range(0, 1200);
+	widths[i] = 1 + g_test_rand_int_range(0, 400);
+    }
+
+    inside = 0;
+    for (i = 0; i < NUM_RECTS; i++)
+	for (x = spans[i].x; x < spans[i].x + widths[i]; x++)
+	    if (RegionContainsPoint(pReg, x, spans[i].y, NULL))
+		inside++;
+
+    n = RegionClipSpans(pReg, spans, widths, NUM_RECTS,
+			clipped, clippedWidths, FALSE);
+    covered = 0;
+    for (i = 0; i < n; i++)
+    {
+	g_assert(clippedWidths[i] > 0);
+	for (x = clipped[i].x; x < clipped[i].x + clippedWidths[i]; x++)
+	    g_assert(RegionContainsPoint(pReg, x, clipped[i].y, NULL));
+	covered += clippedWidths[i];
+    }
+    g_assert(covered == inside);
+    RegionDestroy(pReg);
+}
+
+/**
+ * Temporary regions come back empty after a reset, keeping the storage
+ * they had for the next operation.
+ */
+static void region_temporary(void)
+{
+    xRectangle rects[2] = { { 0, 0, 5, 5 }, { 10, 10, 5, 5 } };
+    BoxRec box = { 0, 0, 20, 20 };
+    RegionPtr pReg, pFirst, pRects, pBox;
+    RegDataPtr data;
+    int i;
+
+    pRects = RegionFromRects(2, rects, CT_UNSORTED);
+    pBox = RegionCreate(&box, 1);
+
+    pFirst = RegionCreateTemporary(NullBox, 32);
+    g_assert(!RegionNotEmpty(pFirst));
+    g_assert(RegionSize(pFirst) == 32);
+    data = pFirst->data;
+    RegionIntersect(pFirst, pRects, pBox);
+    g_assert(RegionNumRects(pFirst) == 2);
+
+    for (i = 0; i < 1000; i++)
+    {
+	pReg = RegionCreateTemporary(&box, 1);
+	g_assert(RegionNumRects(pReg) == 1);
+	g_assert(pReg != pFirst);
+    }
+
+    RegionResetTemporaries();
+    pReg = RegionCreateTemporary(NullBox, 0);
+    g_assert(pReg == pFirst);
+    g_assert(!RegionNotEmpty(pReg));
+    g_assert(RegionNumRects(pReg) == 0);
+    RegionIntersect(pReg, pRects, pBox);
+    g_assert(RegionEqual(pReg, pRects));
+    g_assert(pReg->data == data);
+    RegionResetTemporaries();
+
+    RegionDestroy(pRects);
+    RegionDestroy(pBox);
+}
+
+/**
+ * Time building, combining and clipping against regions of each
+ * distribution.
+ */
+static void region_benchmark(void)
+{
+    xRectangle rects[NUM_RECTS];
+    DDXPointRec spans[NUM_RECTS], clipped[NUM_RECTS * 8];
+    int widths[NUM_RECTS], clippedWidths[NUM_RECTS * 8];
+    RegionPtr pReg, pOther, pTemp;
+    double elapsed;
+    int dist, i;
+
+    for (i = 0; i < NUM_RECTS; i++)
+    {
+	spans[i].x = g_test_rand_int_range(0, 1900);
+	spans[i].y = g_test_rand_int_range(0, 1200);
+	widths[i] = 1 + g_test_rand_int_range(0, 100);
+    }
+
+    for (dist = 0; dist < NUM_DISTRIBUTIONS; dist++)
+    {
+	make_rects(dist, rects, NUM_RECTS);
+
+	g_test_timer_start();
+	for (i = 0; i < NUM_ROUNDS; i++)
+	    RegionDestroy(RegionFromRects(NUM_RECTS, rects, CT_UNSORTED));
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%s: %d RegionFromRects of %d rects in %.3fs",
+		       distribution_names[dist], NUM_ROUNDS, NUM_RECTS,
+		       elapsed);
+
+	pReg = RegionFromRects(NUM_RECTS / 2, rects, CT_UNSORTED);
+	pOther = RegionFromRects(NUM_RECTS / 2, rects + NUM_RECTS / 2,
+				 CT_UNSORTED);
+	g_test_timer_start();
+	for (i = 0; i < NUM_ROUNDS; i++)
+	{
+	    pTemp = RegionCreateTemporary(NullBox, 0);
+	    RegionUnion(pTemp, pReg, pOther);
+	    pTemp = RegionCreateTemporary(NullBox, 0);
+	    RegionIntersect(pTemp, pReg, pOther);
+	    pTemp = RegionCreateTemporary(NullBox, 0);
+	    RegionSubtract(pTemp, pReg, pOther);
+	    RegionResetTemporaries();
+	}
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%s: %d union, intersect and subtract of %d and %d "
+		       "rects in %.3fs", distribution_names[dist], NUM_ROUNDS,
+		       RegionNumRects(pReg), RegionNumRects(pOther), elapsed);
+
+	RegionUnion(pReg, pReg, pOther);
+	g_test_timer_start();
+	for (i = 0; i < NUM_ROUNDS; i++)
+	    RegionClipSpans(pReg, spans, widths, NUM_RECTS,
+			    clipped, clippedWidths, FALSE);
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%s: %d RegionClipSpans of %d spans to %d rects "
+		       "in %.3fs", distribution_names[dist], NUM_ROUNDS,
+		       NUM_RECTS, RegionNumRects(pReg), elapsed);
+
+	RegionDestroy(pReg);
+	RegionDestroy(pOther);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+    g_test_add_func("/dix/region/validate", region_validate);
+    g_test_add_func("/dix/region/clip-spans", region_clip_spans);
+    g_test_add_func("/dix/region/temporary", region_temporary);
+    if (g_test_perf())
+	g_test_add_func("/dix/region/benchmark", region_benchmark);
+
+    return g_test_run();
+}
@@ -0,0 +1,205 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <stdint.h>
+#include "misc.h"
+#include "resource.h"
+#include "dixstruct.h"
+
+#include <glib.h>
+
+/**
+ * Resource database tests.  Adding, looking up and freeing resources
+ * works on enough XIDs to make the table grow a few times; with -m perf
+ * it uses NUM_PERF_XIDS and reports how long each step took.
+ */
+
+#define NUM_XIDS	(1 << 14)
+#define NUM_PERF_XIDS	(1 << 20)
+
+static ClientRec server_client;
+static ClientRec test_client;
+static RESTYPE test_type, other_type;
+static int deleted;
+static pointer last_deleted;
+
+static int test_delete(pointer value, XID id)
+{
+    deleted++;
+    last_deleted = value;
+    return Success;
+}
+
+static void resource_init(void)
+{
+    memset(&server_client, 0, sizeof(server_client));
+    serverClient = &server_client;
+    g_assert(InitClientResources(serverClient));
+
+    memset(&test_client, 0, sizeof(test_client));
+    test_client.index = 1;
+    test_client.clientAsMask = (Mask)1 << CLIENTOFFSET;
+    clients[1] = &test_client;
+    g_assert(InitClientResources(&test_client));
+
+    test_type = CreateNewResourceType(test_delete, "TestResource");
+    other_type = CreateNewResourceType(test_delete, "OtherResource");
+    g_assert(test_type && other_type);
+}
+
+static XID test_id(int i)
+{
+    return test_client.clientAsMask | (i + 1);
+}
+
+/**
+ * Create, look up and free a batch of resources.  Every id must be found
+ * with the value it was added with, and every free must call the delete
+ * function once.
+ */
+static void resource_add_lookup_free(void)
+{
+    pointer value;
+    int i, rc, nxids;
+    double elapsed;
+
+    nxids = g_test_perf() ? NUM_PERF_XIDS : NUM_XIDS;
+    deleted = 0;
+
+    g_test_timer_start();
+    for (i = 0; i < nxids; i++)
+        g_assert(AddResource(test_id(i), test_type, (pointer)(intptr_t)i));
+    elapsed = g_test_timer_elapsed();
+    g_test_message("AddResource: %d XIDs in %.3fs", nxids, elapsed);
+
+    g_test_timer_start();
+    for (i = 0; i < nxids; i++)
+    {
+        rc = dixLookupResourceByType(&value, test_id(i), test_type,
+                                     NULL, DixReadAccess);
+        g_assert(rc == Success);
+        g_assert(value == (pointer)(intptr_t)i);
+    }
+    elapsed = g_test_timer_elapsed();
+    g_test_message("dixLookupResourceByType: %d XIDs in %.3fs",
+                   nxids, elapsed);
+
+    rc = dixLookupResourceByType(&value, test_id(nxids), test_type,
+                                 NULL, DixReadAccess);
+    g_assert(rc != Success);
+
+    g_test_timer_start();
+    for (i = 0; i < nxids; i++)
+        FreeResource(test_id(i), RT_NONE);
+    elapsed = g_test_timer_elapsed();
+    g_test_message("FreeResource: %d XIDs in %.3fs", nxids, elapsed);
+
+    g_assert(deleted == nxids);
+    rc = dixLookupResourceByType(&value, test_id(0), test_type,
+                                 NULL, DixReadAccess);
+    g_assert(rc != Success);
+}
+
+static void count_resource(pointer value, XID id, pointer cdata)
+{
+    (*(int *)cdata)++;
+}
+
+static void free_pair(pointer value, XID id, pointer cdata)
+{
+    (*(int *)cdata)++;
+    /* free this one and the one added before it, which is the next the
+     * search would have returned */
+    FreeResource(id, RT_NONE);
+    FreeResource(id - 1, RT_NONE);
+}
+
+/**
+ * Searches by type only visit resources of that type, and a callback
+ * freeing resources under the search doesn't get anything called twice.
+ */
+static void resource_find_by_type(void)
+{
+    int i, count;
+
+    for (i = 0; i < 1000; i++)
+        g_assert(AddResource(test_id(i), i % 10 ? other_type : test_type,
+                             NULL));
+
+    count = 0;
+    FindClientResourcesByType(&test_client, test_type, count_resource, &count);
+    g_assert(count == 100);
+
+    count = 0;
+    FindClientResourcesByType(&test_client, 0, count_resource, &count);
+    g_assert(count == 1000);
+
+    /* ids 9, 7, 5, 3 and 1 of every ten are left to be called back */
+    count = 0;
+    FindClientResourcesByType(&test_client, other_type, free_pair, &count);
+    g_assert(count == 500);
+
+    count = 0;
+    FindClientResourcesByType(&test_client, 0, count_resource, &count);
+    g_assert(count == 0);
+}
+
+/**
+ * Resources sharing an id are freed newest first, and FreeClientResources
+ * frees everything in the opposite order it was added.
+ */
+static void resource_free_order(void)
+{
+    XID id = test_id(0);
+
+    deleted = 0;
+    g_assert(AddResource(id, test_type, (pointer)1));
+    g_assert(AddResource(id, other_type, (pointer)2));
+    g_assert(AddResource(id, test_type, (pointer)3));
+    FreeResourceByType(id, other_type, FALSE);
+    g_assert(deleted == 1);
+    g_assert(last_deleted == (pointer)2);
+    FreeResource(id, RT_NONE);
+    g_assert(deleted == 3);
+    g_assert(last_deleted == (pointer)1);
+
+    g_assert(AddResource(test_id(1), test_type, (pointer)4));
+    g_assert(AddResource(test_id(2), test_type, (pointer)5));
+    FreeClientResources(&test_client);
+    g_assert(deleted == 5);
+    g_assert(last_deleted == (pointer)4);
+}
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+    g_test_add_func("/dix/resource/init", resource_init);
+    g_test_add_func("/dix/resource/add-lookup-free", resource_add_lookup_free);
+    g_test_add_func("/dix/resource/find-by-type", resource_find_by_type);
+    g_test_add_func("/dix/resource/free-order", resource_free_order);
+
+    return g_test_run();
+}
@@ -0,0 +1,48 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TESTS_COMMON_H
+#define TESTS_COMMON_H
+
+#include "misc.h"
+#include "miscstruct.h"
+
+#include <glib.h>
+
+/**
+ * Pick the box of a random top-level window: min to min + range - 1
+ * pixels on each side, placed wholly on a width x height screen.  The
+ * numbers come from glib's test generator, so a run can be repeated
+ * with the --seed it reports.
+ */
+static inline void
+random_window_box(BoxPtr pBox, int min, int range, int width, int height)
+{
+    int w = min + g_test_rand_int_range(0, range);
+    int h = min + g_test_rand_int_range(0, range);
+
+    pBox->x1 = g_test_rand_int_range(0, width - w);
+    pBox->y1 = g_test_rand_int_range(0, height - h);
+    pBox->x2 = pBox->x1 + w;
+    pBox->y2 = pBox->y1 + h;
+}
+
+#endif /* TESTS_COMMON_H */
@@ -0,0 +1,131 @@
+/**
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "osdep.h"
+#include "ospoll.h"
+
+#include <glib.h>
+
+/**
+ * WaitForSomething tests.  The client is one end of a socketpair,
+ * tracked by ServerPoll the way AllocNewConnection does it; the test
+ * writes requests into the other end.
+ */
+
+#ifdef HAVE_EPOLL
+
+static ClientRec test_client;
+static OsCommRec test_oc;
+static int peer;
+static HWEventQueueType input_head, input_tail;
+
+static CARD32 wait_timeout(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    return 0;
+}
+
+/**
+ * Wait for the client, giving up after a second so a lost wakeup fails
+ * the test rather than hanging it.
+ */
+static int wait_for_client(int *ready)
+{
+    OsTimerPtr timer;
+    int nready;
+
+    timer = TimerSet(NULL, 0, 1000, wait_timeout, NULL);
+    nready = WaitForSomething(ready);
+    TimerFree(timer);
+    return nready;
+}
+
+static void waitfor_init(void)
+{
+    int fds[2];
+
+    SmartScheduleDisable = TRUE;
+    SetInputCheck(&input_head, &input_tail);
+    InitConnectionLimits();
+    g_assert(ServerPoll);
+
+    g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    peer = fds[1];
+
+    memset(&test_oc, 0, sizeof(test_oc));
+    test_oc.fd = fds[0];
+    test_oc.client = &test_client;
+    list_init(&test_oc.ready);
+    list_init(&test_oc.pending);
+
+    memset(&test_client, 0, sizeof(test_client));
+    test_client.index = 1;
+    test_client.osPrivate = &test_oc;
+    clients[1] = &test_client;
+
+    g_assert(OsPollAdd(ServerPoll, test_oc.fd, ClientPollNotify, &test_oc));
+    OsPollListen(ServerPoll, test_oc.fd, X_NOTIFY_READ);
+}
+
+/**
+ * A client is reported again when a second request arrives in a later
+ * wakeup, after the first one was read.
+ */
+static void waitfor_readable_twice(void)
+{
+    char request[4] = { 0 }, buf[sizeof(request)];
+    int ready[MAXCLIENTS];
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+	g_assert(write(peer, request, sizeof(request)) == sizeof(request));
+	g_assert(wait_for_client(ready) == 1);
+	g_assert(ready[0] == test_client.index);
+	g_assert(read(test_oc.fd, buf, sizeof(buf)) == sizeof(buf));
+    }
+
+    /* nothing left to read: the wait times out */
+    g_assert(wait_for_client(ready) == 0);
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv,NULL);
+    g_test_bug_base("https://bugzilla.freedesktop.org/show_bug.cgi?id=");
+
+#ifdef HAVE_EPOLL
+    g_test_add_func("/os/waitfor/init", waitfor_init);
+    g_test_add_func("/os/waitfor/readable-twice", waitfor_readable_twice);
+#endif
+
+    return g_test_run();
+}